@@ -52,7 +52,7 @@ int ms_acclog_init(const char *file)
  * @Param  : [in] fmt : 输出格式
  * @Param  : [in] ... : 可变参数列表
  * @Return : NONE
- * @Note   : 
+ * @Note   : 挂接了日志环的线程不调用 write()，见 ms_logring.h
  ***********************************************************/
 void ms_acclog(const char *fmt, ...)
 {
@@ -60,13 +60,15 @@ void ms_acclog(const char *fmt, ...)
     char *p;
     char *last;
     char accstr[MS_MAX_BUF_SIZE * 2];
+    pid_t pid;
+    pid_t tid;
     va_list args;
 
-    memset(&accstr, 0, sizeof(accstr));
     last = accstr + sizeof(accstr);
 
     p = ms_time_stamp(accstr, last);
-    p = ms_str_slprintf(p, last, " [%P#%P] ", getpid(), syscall(SYS_gettid));
+    ms_logring_ids(&pid, &tid);
+    p = ms_str_slprintf(p, last, " [%P#%P] ", pid, tid);
 
     // 可变参数
     va_start(args, fmt);
@@ -80,6 +82,12 @@ void ms_acclog(const char *fmt, ...)
 
     *p++ = '\n';
 
+    // 挂接了日志环的线程只追加到环中，由 flusher 写入文件
+    if (ms_logring_write(MS_LOGRING_ACCESS, accstr, p - accstr) == MS_OK)
+    {
+        return;
+    }
+
     do {
         nwrite = write(g_ms_acclog_t.fd, accstr, p - accstr);
     } while (nwrite == -1 && errno == EINTR);
@@ -122,9 +130,35 @@ int ms_acclog_reopen(void)
         ms_errlog_stderr(errno, "open() \"%s\" failed", g_ms_acclog_t.file);
         return MS_ERROR;
     }
-    ms_acclog_close();
+
+    // 以 dup2() 原子地替换旧的句柄，见 ms_errlog_reopen()
+    if (g_ms_acclog_t.fd > 0)
+    {
+        if (dup2(temp, g_ms_acclog_t.fd) == -1)
+        {
+            ms_errlog_stderr(errno, "dup2() \"%s\" failed", g_ms_acclog_t.file);
+            close(temp);
+            return MS_ERROR;
+        }
+        close(temp);
+        return MS_OK;
+    }
     g_ms_acclog_t.fd = temp;
 
     return MS_OK;
 }
 // @ms_acclog_reopen() ok
+
+/***********************************************************
+ * @Func   : ms_acclog_fd()
+ * @Author : lwp
+ * @Brief  : 返回访问日志的文件句柄。
+ * @Param  : [in] NONE
+ * @Return : 文件句柄
+ * @Note   : 供 flusher 写入日志环中的访问日志
+ ***********************************************************/
+int ms_acclog_fd(void)
+{
+    return g_ms_acclog_t.fd;
+}
+// @ms_acclog_fd() ok
@@ -10,11 +10,13 @@ extern "C"
 #include "ms_conf.h"
 
 #include "ms_errlog.h"
+#include "ms_logring.h"
 
 int ms_acclog_init(const char *file);
 void ms_acclog(const char *fmt, ...);
 void ms_acclog_close(void);
 int ms_acclog_reopen(void);
+int ms_acclog_fd(void);
 
 #ifdef __cpluscplus
 }
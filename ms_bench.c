@@ -0,0 +1,998 @@
+// ms_bench: 基于 ms_eventloop 与 ms_socket 的 HTTP 压测工具，不依赖 wrk 等外部工具。
+// 每个线程一个 eventloop，连接均分到各线程，结束后合并各线程的计数与延迟直方图，以一行 JSON 输出到标准输出。
+// 闭环模式下每个连接保持 pipeline 个请求在途，收到一个响应再发送一个，延迟从请求放入发送缓冲区时算起；
+// 开环模式(-r)下按固定速率安排请求，延迟从计划发送的时间算起，连接不足时积压的请求同样计入，
+// 避免 coordinated omission；churn 模式(-k)下每个连接只发送一个请求，延迟包括建立连接的时间。
+// 响应必须以 Content-Length 界定响应体，myserver 的响应均满足。
+#include "ms_eventloop.h"
+#include "ms_socket.h"
+#include "ms_rlimit.h"
+#include "ms_errlog.h"
+#include "ms_hist.h"
+
+#include <sys/timerfd.h>
+
+#define MS_BENCH_RBUF      65536 // 每个连接的接收缓冲区大小，响应头不能超过该大小
+#define MS_BENCH_TEMPLATES 16    // 请求模板的最大数目
+#define MS_BENCH_MAX_REQ   65536 // 请求模板的最大长度
+#define MS_BENCH_RETRY     10    // 连接出错后重连的间隔，毫秒
+#define MS_BENCH_TICK      100   // 开环模式下安排请求的间隔，微秒
+
+typedef struct ms_bench_conn_s   ms_bench_conn_t;
+typedef struct ms_bench_thread_s ms_bench_thread_t;
+
+// 压测的连接
+struct ms_bench_conn_s {
+    ms_bench_thread_t *thread;    // 所属线程
+    ms_bench_conn_t   *next;      // 开环模式下可发送请求的连接栈中的下一个
+    ms_event_timer_t  *timer;     // 出错后重连的定时器
+    ms_event_task_t    task;      // churn 模式下重新建立连接的任务
+    uint64_t          *start;     // 在途请求的开始时间，纳秒，容量为 pipeline 的环
+    char              *rbuf;      // 接收缓冲区，只保存未解析完的响应
+    char              *wbuf;      // 发送缓冲区，只保存未发送的请求
+    size_t             rlen;      // rbuf 中数据的长度
+    size_t             wlen;      // wbuf 中数据的长度
+    size_t             woff;      // wbuf 中已发送的长度
+    int64_t            body;      // 当前响应体剩余的长度，-1 代表等待响应头
+    int                status;    // 当前响应的状态码
+    int                head;      // start 中最早的在途请求
+    int                inflight;  // 在途的请求数
+    int                fd;        // 文件句柄，-1 代表未连接
+    int                connected; // 连接是否已建立
+    int                mask;      // 已注册的事件
+    int                ready;     // 是否在可发送请求的连接栈中
+    int                posted;    // 是否已投递重新建立连接的任务
+};
+
+// 压测线程
+struct ms_bench_thread_s {
+    pthread_t          tid;       // 线程 ID
+    ms_event_loop_t   *evlop;     // 该线程的 eventloop
+    ms_bench_conn_t   *conns;     // 该线程的连接
+    ms_bench_conn_t   *ready;     // 开环模式下可发送请求的连接栈
+    int                nconns;    // 连接数
+    int                tickfd;    // 开环模式下安排请求的 timerfd，时间轮的精度只有 1 毫秒
+    int                next;      // 下一个使用的请求模板
+    int                record;    // 是否已过预热阶段，开始统计
+    int                stop;      // 是否已结束
+    double             interval;  // 开环模式下相邻请求的计划间隔，纳秒
+    uint64_t           begin;     // 开始安排请求的时间，纳秒
+    uint64_t           issued;    // 开环模式下已发送的请求数
+    uint64_t           backlog;   // 结束时积压未发送的请求数
+    uint64_t           rbegin;    // 开始统计的时间，纳秒
+    uint64_t           rend;      // 结束统计的时间，纳秒
+    uint64_t           requests;  // 发送的请求数
+    uint64_t           responses; // 收到的响应数
+    uint64_t           errors;    // 连接出错的次数
+    uint64_t           status;    // 状态码不是 2xx/3xx 的响应数
+    uint64_t           connects;  // 建立的连接数
+    uint64_t           bytes;     // 接收的字节数
+    ms_hist_t          latency;   // 响应延迟，纳秒
+};
+
+// 压测参数
+static struct {
+    struct sockaddr_in addr;                       // 目标地址，网络字节序
+    const char        *target;                     // 目标地址，ip:port
+    int                threads;                    // 线程数
+    int                conns;                      // 总连接数
+    int                duration;                   // 统计的时长，秒
+    int                warmup;                     // 预热的时长，秒，不统计
+    int                depth;                      // 每个连接在途的请求数
+    int                churn;                      // 每个请求使用新的连接
+    double             rate;                       // 开环模式的总请求速率，0 为闭环模式
+    int                nreqs;                      // 请求模板的数目
+    char              *reqs[MS_BENCH_TEMPLATES];   // 请求模板
+    size_t             lens[MS_BENCH_TEMPLATES];   // 请求模板的长度
+    size_t             maxlen;                     // 请求模板的最大长度
+} bench;
+
+static int ms_bench_args(int argc, char **argv);
+static int ms_bench_template(const char *path);
+static void *ms_bench_thread(void *data);
+static void ms_bench_report(ms_bench_thread_t *threads, ms_hist_t *latency);
+static void ms_bench_warmup_handler(ms_event_loop_t *evlop, void *data);
+static void ms_bench_stop_handler(ms_event_loop_t *evlop, void *data);
+static int ms_bench_tick_start(ms_bench_thread_t *t);
+static void ms_bench_tick_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data);
+static void ms_bench_retry_handler(ms_event_loop_t *evlop, void *data);
+static void ms_bench_dispatch(ms_bench_thread_t *t);
+static void ms_bench_conn_idle(ms_event_loop_t *evlop, void *data);
+static int ms_bench_conn_open(ms_bench_conn_t *conn);
+static void ms_bench_conn_close(ms_bench_conn_t *conn);
+static void ms_bench_conn_error(ms_bench_conn_t *conn);
+static void ms_bench_conn_enqueue(ms_bench_conn_t *conn, uint64_t start);
+static int ms_bench_conn_flush(ms_bench_conn_t *conn);
+static int ms_bench_conn_parse(ms_bench_conn_t *conn);
+static void ms_bench_conn_done(ms_bench_conn_t *conn);
+static int64_t ms_bench_content_length(const char *p, const char *last);
+static void ms_bench_handler(ms_event_loop_t *evlop, int sockfd, uint32_t mask,
+        void *data);
+
+int main(int argc, char **argv)
+{
+    int nthreads = 0;
+    ms_bench_thread_t *threads = NULL;
+    ms_hist_t *latency = NULL;
+
+    if (ms_bench_args(argc, argv) == MS_ERROR)
+    {
+        printf("Usage: %s [-t threads] [-c connections] [-d seconds] "
+                "[-w warmup_seconds]\n"
+                "       [-p pipeline] [-r requests_per_second] [-k] "
+                "[-f request_file ...] ip:port\n", argv[0]);
+        return 1;
+    }
+
+    // 错误日志输出到标准错误，JSON 结果输出到标准输出
+    if (ms_errlog_init("/dev/stderr", MS_ERRLOG_ERR) == MS_ERROR)
+    {
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    ms_rlimit_set(bench.conns + MS_EVENTS_DEFAULT_SIZE);
+
+    threads = (ms_bench_thread_t *)calloc(bench.threads,
+            sizeof(ms_bench_thread_t));
+    latency = (ms_hist_t *)calloc(1, sizeof(ms_hist_t));
+    if (threads == NULL || latency == NULL)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "calloc() failed");
+        return 1;
+    }
+
+    // 连接与请求速率均分到各线程
+    for (int i = 0; i < bench.threads; i++)
+    {
+        threads[i].nconns = bench.conns / bench.threads
+            + (i < bench.conns % bench.threads);
+        threads[i].interval = bench.rate > 0 ?
+            1e9 * bench.threads / bench.rate : 0;
+    }
+
+    for (nthreads = 0; nthreads < bench.threads; nthreads++)
+    {
+        errno = pthread_create(&threads[nthreads].tid, NULL, ms_bench_thread,
+                &threads[nthreads]);
+        if (errno != 0)
+        {
+            ms_errlog(MS_ERRLOG_ERR, errno, "pthread_create() failed");
+            break;
+        }
+    }
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i].tid, NULL);
+        ms_hist_merge(latency, &threads[i].latency);
+    }
+
+    if (nthreads == bench.threads)
+    {
+        ms_bench_report(threads, latency);
+    }
+
+    free(latency);
+    free(threads);
+    ms_errlog_close();
+
+    return nthreads == bench.threads ? 0 : 1;
+}
+
+// 解析命令行参数
+static int ms_bench_args(int argc, char **argv)
+{
+    int opt = 0;
+    int port = 0;
+    char ip[INET_ADDRSTRLEN];
+    const char *colon = NULL;
+    static char def[256];
+
+    bench.threads = 1;
+    bench.conns = 100;
+    bench.duration = 10;
+    bench.warmup = 0;
+    bench.depth = 1;
+
+    while ((opt = getopt(argc, argv, "t:c:d:w:p:r:kf:")) != -1)
+    {
+        switch (opt)
+        {
+            case 't': bench.threads = atoi(optarg);  break;
+            case 'c': bench.conns = atoi(optarg);    break;
+            case 'd': bench.duration = atoi(optarg); break;
+            case 'w': bench.warmup = atoi(optarg);   break;
+            case 'p': bench.depth = atoi(optarg);    break;
+            case 'r': bench.rate = atof(optarg);     break;
+            case 'k': bench.churn = 1;               break;
+            case 'f':
+                if (ms_bench_template(optarg) == MS_ERROR)
+                {
+                    return MS_ERROR;
+                }
+                break;
+            default:
+                return MS_ERROR;
+        }
+    }
+
+    if (optind != argc - 1 || bench.threads < 1 || bench.duration < 1
+            || bench.conns < bench.threads || bench.depth < 1
+            || bench.warmup < 0 || bench.rate < 0)
+    {
+        return MS_ERROR;
+    }
+
+    // 目标地址
+    bench.target = argv[optind];
+    colon = strchr(bench.target, ':');
+    if (colon == NULL || colon - bench.target >= INET_ADDRSTRLEN)
+    {
+        return MS_ERROR;
+    }
+    memcpy(ip, bench.target, colon - bench.target);
+    ip[colon - bench.target] = '\0';
+    port = atoi(colon + 1);
+
+    bench.addr.sin_family = AF_INET;
+    bench.addr.sin_port = htons(port);
+    if (port <= 0 || port > 65535
+            || inet_pton(AF_INET, ip, &bench.addr.sin_addr) != 1)
+    {
+        return MS_ERROR;
+    }
+
+    // 每个连接只发送一个请求
+    if (bench.churn)
+    {
+        bench.depth = 1;
+    }
+
+    // 默认的请求
+    if (bench.nreqs == 0)
+    {
+        snprintf(def, sizeof(def), "GET / HTTP/1.1\r\nHost: %s\r\n\r\n",
+                bench.target);
+        bench.reqs[0] = def;
+        bench.lens[0] = strlen(def);
+        bench.maxlen = bench.lens[0];
+        bench.nreqs = 1;
+    }
+
+    return MS_OK;
+}
+
+// 读取请求模板，文件中单独的 LF 转换为 CRLF
+static int ms_bench_template(const char *path)
+{
+    int c = 0;
+    int prev = 0;
+    size_t len = 0;
+    char *req = NULL;
+    FILE *fp = NULL;
+
+    if (bench.nreqs == MS_BENCH_TEMPLATES)
+    {
+        fprintf(stderr, "too many request files, max %d\n",
+                MS_BENCH_TEMPLATES);
+        return MS_ERROR;
+    }
+
+    fp = fopen(path, "r");
+    req = (char *)malloc(MS_BENCH_MAX_REQ);
+    if (fp == NULL || req == NULL)
+    {
+        fprintf(stderr, "open \"%s\" failed: %s\n", path, strerror(errno));
+        goto end;
+    }
+
+    while ((c = fgetc(fp)) != EOF && len < MS_BENCH_MAX_REQ - 1)
+    {
+        if (c == '\n' && prev != '\r')
+        {
+            req[len++] = '\r';
+        }
+        req[len++] = c;
+        prev = c;
+    }
+
+    if (c != EOF || len == 0)
+    {
+        fprintf(stderr, "\"%s\" is empty or larger than %d bytes\n", path,
+                MS_BENCH_MAX_REQ);
+        goto end;
+    }
+
+    bench.reqs[bench.nreqs] = req;
+    bench.lens[bench.nreqs] = len;
+    bench.maxlen = ms_max(bench.maxlen, len);
+    bench.nreqs++;
+    fclose(fp);
+
+    return MS_OK;
+
+end:
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    free(req);
+
+    return MS_ERROR;
+}
+
+// 压测线程: 建立连接，运行 eventloop 直到结束
+static void *ms_bench_thread(void *data)
+{
+    ms_bench_thread_t *t = (ms_bench_thread_t *)data;
+    ms_bench_conn_t *conn = NULL;
+
+    t->tickfd = -1;
+    t->evlop = ms_eventloop_create(MS_EVENTS_DEFAULT_SIZE,
+            bench.conns + MS_EVENTS_DEFAULT_SIZE, 0, 0, MS_EVENTLOOP_EPOLL);
+    t->conns = (ms_bench_conn_t *)calloc(t->nconns, sizeof(ms_bench_conn_t));
+    if (t->evlop == NULL || t->conns == NULL)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "create bench thread failed");
+        goto end;
+    }
+
+    for (int i = 0; i < t->nconns; i++)
+    {
+        conn = &t->conns[i];
+        conn->thread = t;
+        conn->fd = -1;
+        conn->body = -1;
+        conn->start = (uint64_t *)calloc(bench.depth, sizeof(uint64_t));
+        conn->rbuf = (char *)malloc(MS_BENCH_RBUF);
+        conn->wbuf = (char *)malloc(bench.depth * bench.maxlen);
+        if (conn->start == NULL || conn->rbuf == NULL || conn->wbuf == NULL)
+        {
+            ms_errlog(MS_ERRLOG_ERR, errno, "malloc() failed");
+            goto end;
+        }
+        conn->task.proc = ms_bench_conn_idle;
+        conn->task.data = conn;
+    }
+
+    // 预热结束后开始统计，统计 duration 秒后结束
+    t->begin = ms_time_ns();
+    if (bench.warmup > 0)
+    {
+        ms_eventloop_timer_add(t->evlop, bench.warmup * 1000,
+                (const ms_event_timer_proc *)ms_bench_warmup_handler, t);
+    }
+    else
+    {
+        t->record = 1;
+        t->rbegin = t->begin;
+    }
+    ms_eventloop_timer_add(t->evlop, (bench.warmup + bench.duration) * 1000,
+            (const ms_event_timer_proc *)ms_bench_stop_handler, t);
+
+    if (bench.rate > 0 && ms_bench_tick_start(t) == MS_ERROR)
+    {
+        goto end;
+    }
+
+    for (int i = 0; i < t->nconns; i++)
+    {
+        ms_bench_conn_idle(t->evlop, &t->conns[i]);
+    }
+
+    ms_eventloop_main(t->evlop, -1);
+
+end:
+    for (int i = 0; t->conns != NULL && i < t->nconns; i++)
+    {
+        conn = &t->conns[i];
+        if (conn->fd != -1)
+        {
+            ms_socket_close(conn->fd);
+        }
+        free(conn->start);
+        free(conn->rbuf);
+        free(conn->wbuf);
+    }
+    free(t->conns);
+
+    if (t->tickfd != -1)
+    {
+        close(t->tickfd);
+    }
+
+    if (t->evlop != NULL)
+    {
+        ms_eventloop_destory(t->evlop);
+    }
+
+    return NULL;
+}
+
+// 合并各线程的计数，以一行 JSON 输出
+static void ms_bench_report(ms_bench_thread_t *threads, ms_hist_t *latency)
+{
+    ms_bench_thread_t total;
+    double sec = 0;
+
+    memset(&total, 0, offsetof(ms_bench_thread_t, latency));
+
+    for (int i = 0; i < bench.threads; i++)
+    {
+        total.requests  += threads[i].requests;
+        total.responses += threads[i].responses;
+        total.errors    += threads[i].errors;
+        total.status    += threads[i].status;
+        total.connects  += threads[i].connects;
+        total.bytes     += threads[i].bytes;
+        total.backlog   += threads[i].backlog;
+        if (threads[i].rend > threads[i].rbegin)
+        {
+            sec = ms_max(sec, (threads[i].rend - threads[i].rbegin) / 1e9);
+        }
+    }
+    sec = sec > 0 ? sec : 1;
+
+    printf("{\"target\": \"%s\", \"threads\": %d, \"connections\": %d, "
+            "\"pipeline\": %d, \"churn\": %d, \"rate\": %.0f, "
+            "\"duration\": %.3f, ", bench.target, bench.threads, bench.conns,
+            bench.depth, bench.churn, bench.rate, sec);
+    printf("\"requests\": %lu, \"responses\": %lu, \"errors\": %lu, "
+            "\"status_errors\": %lu, \"connects\": %lu, \"backlog\": %lu, ",
+            (unsigned long)total.requests, (unsigned long)total.responses,
+            (unsigned long)total.errors, (unsigned long)total.status,
+            (unsigned long)total.connects, (unsigned long)total.backlog);
+    printf("\"rps\": %.1f, \"kbps_in\": %.1f, ", total.responses / sec,
+            total.bytes / 1024.0 / sec);
+    printf("\"latency_us\": {\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+            "\"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}}\n",
+            latency->count ? latency->sum / 1e3 / latency->count : 0.0,
+            ms_hist_value(latency, 0.5) / 1e3,
+            ms_hist_value(latency, 0.9) / 1e3,
+            ms_hist_value(latency, 0.99) / 1e3,
+            ms_hist_value(latency, 0.999) / 1e3, latency->max / 1e3);
+    fflush(stdout);
+}
+
+// 预热结束，开始统计
+static void ms_bench_warmup_handler(ms_event_loop_t *evlop, void *data)
+{
+    ms_bench_thread_t *t = (ms_bench_thread_t *)data;
+
+    t->record = 1;
+    t->rbegin = ms_time_ns();
+}
+
+// 结束压测，记录积压未发送的请求数
+static void ms_bench_stop_handler(ms_event_loop_t *evlop, void *data)
+{
+    ms_bench_thread_t *t = (ms_bench_thread_t *)data;
+
+    t->rend = ms_time_ns();
+    if (bench.rate > 0)
+    {
+        t->backlog = (uint64_t)((t->rend - t->begin) / t->interval) + 1
+            - t->issued;
+    }
+    t->stop = 1;
+    ms_eventloop_stop(evlop);
+}
+
+// 开环模式: 创建周期为 MS_BENCH_TICK 微秒的 timerfd，定时安排到期的请求
+static int ms_bench_tick_start(ms_bench_thread_t *t)
+{
+    struct itimerspec its;
+
+    t->tickfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (t->tickfd == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "timerfd_create() failed");
+        return MS_ERROR;
+    }
+
+    its.it_value.tv_sec = 0;
+    its.it_value.tv_nsec = MS_BENCH_TICK * 1000;
+    its.it_interval = its.it_value;
+    if (timerfd_settime(t->tickfd, 0, &its, NULL) == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "timerfd_settime() failed");
+        return MS_ERROR;
+    }
+
+    return ms_eventloop_file_add(t->evlop, t->tickfd, EPOLLIN,
+            (const ms_event_file_proc *)ms_bench_tick_handler, t);
+}
+
+// 开环模式下定时安排到期的请求
+static void ms_bench_tick_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data)
+{
+    uint64_t n = 0;
+    ms_bench_thread_t *t = (ms_bench_thread_t *)data;
+
+    while (read(sockfd, &n, sizeof(n)) == -1 && errno == EINTR)
+    {
+        // 继续读取
+    }
+
+    ms_bench_dispatch(t);
+}
+
+// 出错后重连
+static void ms_bench_retry_handler(ms_event_loop_t *evlop, void *data)
+{
+    ms_bench_conn_t *conn = (ms_bench_conn_t *)data;
+
+    conn->timer = NULL;
+    ms_bench_conn_idle(evlop, conn);
+}
+
+// 开环模式: 将到期的请求依次交给可发送请求的连接，计划时间由请求的序号算出，
+// 连接不足时请求积压，在连接空闲后发送，延迟仍从计划时间算起
+static void ms_bench_dispatch(ms_bench_thread_t *t)
+{
+    uint64_t due = (uint64_t)((ms_time_ns() - t->begin) / t->interval) + 1;
+    ms_bench_conn_t *conn = NULL;
+
+    while (t->issued < due && t->ready != NULL && !t->stop)
+    {
+        conn = t->ready;
+        t->ready = conn->next;
+        conn->ready = 0;
+
+        // 出错后已关闭，重连成功后再次入栈
+        if (conn->fd == -1 && !bench.churn)
+        {
+            continue;
+        }
+
+        ms_bench_conn_enqueue(conn,
+                t->begin + (uint64_t)(t->issued * t->interval));
+        t->issued++;
+
+        if (conn->fd == -1)
+        {
+            if (ms_bench_conn_open(conn) == MS_ERROR)
+            {
+                ms_bench_conn_error(conn);
+            }
+            continue;
+        }
+
+        if (ms_bench_conn_flush(conn) == MS_ERROR)
+        {
+            ms_bench_conn_error(conn);
+            continue;
+        }
+
+        if (conn->inflight < bench.depth)
+        {
+            conn->next = t->ready;
+            t->ready = conn;
+            conn->ready = 1;
+        }
+    }
+}
+
+// 连接可以发送新的请求: 闭环模式下补满在途的请求，开环模式下放入可发送请求的连接栈；
+// 也作为出错后重连的定时器、churn 模式下重新建立连接的任务的回调
+static void ms_bench_conn_idle(ms_event_loop_t *evlop, void *data)
+{
+    ms_bench_conn_t *conn = (ms_bench_conn_t *)data;
+    ms_bench_thread_t *t = conn->thread;
+
+    conn->posted = 0;
+    if (t->stop)
+    {
+        return;
+    }
+
+    // 闭环模式
+    if (bench.rate == 0)
+    {
+        while (conn->inflight < bench.depth)
+        {
+            ms_bench_conn_enqueue(conn, ms_time_ns());
+        }
+
+        if (conn->fd == -1)
+        {
+            if (ms_bench_conn_open(conn) == MS_ERROR)
+            {
+                ms_bench_conn_error(conn);
+            }
+            return;
+        }
+
+        if (ms_bench_conn_flush(conn) == MS_ERROR)
+        {
+            ms_bench_conn_error(conn);
+        }
+        return;
+    }
+
+    // 开环模式: 连接建立后入栈，churn 模式下由 ms_bench_dispatch() 建立连接
+    if (conn->fd == -1 && !bench.churn)
+    {
+        if (ms_bench_conn_open(conn) == MS_ERROR)
+        {
+            ms_bench_conn_error(conn);
+        }
+        return;
+    }
+
+    if (!conn->ready)
+    {
+        conn->next = t->ready;
+        t->ready = conn;
+        conn->ready = 1;
+    }
+    ms_bench_dispatch(t);
+}
+
+// 发起非阻塞连接，可写时完成
+static int ms_bench_conn_open(ms_bench_conn_t *conn)
+{
+    int rev = MS_ERROR;
+
+    conn->fd = ms_socket_create(AF_INET, SOCK_STREAM, 0);
+    if (conn->fd == MS_ERROR)
+    {
+        conn->fd = -1;
+        return MS_ERROR;
+    }
+
+    if (ms_socket_blocking(conn->fd, 0) == MS_ERROR
+            || ms_socket_tcpnodelay(conn->fd, 1) == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+
+    rev = ms_socket_connect_nonblock(conn->fd, &bench.addr);
+    if (rev == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+
+    conn->mask = EPOLLOUT;
+    return ms_eventloop_file_add(conn->thread->evlop, conn->fd, EPOLLOUT,
+            (const ms_event_file_proc *)ms_bench_handler, conn);
+}
+
+// 关闭连接，丢弃未完成的请求与响应
+static void ms_bench_conn_close(ms_bench_conn_t *conn)
+{
+    if (conn->fd != -1)
+    {
+        ms_eventloop_file_del(conn->thread->evlop, conn->fd,
+                MS_EVENTLOOP_ALL);
+        ms_socket_close(conn->fd);
+    }
+
+    conn->fd = -1;
+    conn->connected = 0;
+    conn->mask = 0;
+    conn->inflight = 0;
+    conn->head = 0;
+    conn->rlen = 0;
+    conn->wlen = 0;
+    conn->woff = 0;
+    conn->body = -1;
+}
+
+// 连接出错: 计数，关闭连接，稍后重连；没有在途请求的空闲连接被对端关闭时不计数
+static void ms_bench_conn_error(ms_bench_conn_t *conn)
+{
+    ms_bench_thread_t *t = conn->thread;
+
+    if (t->record && (!conn->connected || conn->inflight > 0))
+    {
+        t->errors++;
+    }
+
+    ms_bench_conn_close(conn);
+
+    if (!t->stop && conn->timer == NULL)
+    {
+        conn->timer = ms_eventloop_timer_add(t->evlop, MS_BENCH_RETRY,
+                (const ms_event_timer_proc *)ms_bench_retry_handler, conn);
+    }
+}
+
+// 将下一个请求模板追加到发送缓冲区，start 为计算延迟的起点
+static void ms_bench_conn_enqueue(ms_bench_conn_t *conn, uint64_t start)
+{
+    ms_bench_thread_t *t = conn->thread;
+    int i = t->next;
+
+    t->next = (t->next + 1) % bench.nreqs;
+
+    // 未发送的请求不多于在途的请求，移到开头后总能放下
+    if (conn->woff > 0)
+    {
+        memmove(conn->wbuf, conn->wbuf + conn->woff, conn->wlen - conn->woff);
+        conn->wlen -= conn->woff;
+        conn->woff = 0;
+    }
+    memcpy(conn->wbuf + conn->wlen, bench.reqs[i], bench.lens[i]);
+    conn->wlen += bench.lens[i];
+
+    conn->start[(conn->head + conn->inflight) % bench.depth] = start;
+    conn->inflight++;
+
+    if (t->record)
+    {
+        t->requests++;
+    }
+}
+
+// 发送缓冲区中的请求，未发送完时注册写事件
+static int ms_bench_conn_flush(ms_bench_conn_t *conn)
+{
+    int mask = EPOLLIN;
+    ssize_t n = 0;
+
+    if (!conn->connected)
+    {
+        return MS_OK;
+    }
+
+    while (conn->woff < conn->wlen)
+    {
+        n = write(conn->fd, conn->wbuf + conn->woff, conn->wlen - conn->woff);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+
+            return MS_ERROR;
+        }
+        conn->woff += n;
+    }
+
+    if (conn->woff == conn->wlen)
+    {
+        conn->woff = 0;
+        conn->wlen = 0;
+    }
+    else
+    {
+        mask |= EPOLLOUT;
+    }
+
+    if (mask != conn->mask)
+    {
+        if (ms_eventloop_file_mod(conn->thread->evlop, conn->fd, mask,
+                    (const ms_event_file_proc *)ms_bench_handler, conn)
+                == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+        conn->mask = mask;
+    }
+
+    return MS_OK;
+}
+
+// 解析接收缓冲区中的响应，每个完整的响应调用一次 ms_bench_conn_done()
+static int ms_bench_conn_parse(ms_bench_conn_t *conn)
+{
+    char *p = conn->rbuf;
+    char *last = conn->rbuf + conn->rlen;
+    char *end = NULL;
+    size_t n = 0;
+
+    while (p < last)
+    {
+        // 响应头
+        if (conn->body < 0)
+        {
+            end = memmem(p, last - p, "\r\n\r\n", 4);
+            if (end == NULL)
+            {
+                if (p == conn->rbuf && conn->rlen == MS_BENCH_RBUF)
+                {
+                    ms_errlog(MS_ERRLOG_ERR, 0, "response header too large");
+                    return MS_ERROR;
+                }
+                break;
+            }
+
+            if (conn->inflight == 0 || end - p < 12
+                    || memcmp(p, "HTTP/1.", 7) != 0)
+            {
+                ms_errlog(MS_ERRLOG_ERR, 0, "unexpected response");
+                return MS_ERROR;
+            }
+
+            conn->status = atoi(p + 9);
+            conn->body = ms_bench_content_length(p, end);
+            if (conn->body < 0)
+            {
+                ms_errlog(MS_ERRLOG_ERR, 0, "invalid Content-Length");
+                return MS_ERROR;
+            }
+            p = end + 4;
+        }
+
+        // 响应体只计数，不保存
+        n = ms_min((size_t)conn->body, (size_t)(last - p));
+        p += n;
+        conn->body -= n;
+        if (conn->body > 0)
+        {
+            break;
+        }
+        conn->body = -1;
+
+        ms_bench_conn_done(conn);
+
+        // churn 模式下已关闭连接
+        if (conn->fd == -1)
+        {
+            return MS_OK;
+        }
+    }
+
+    memmove(conn->rbuf, p, last - p);
+    conn->rlen = last - p;
+
+    return MS_OK;
+}
+
+// 收到完整的响应: 记录延迟，继续发送请求
+static void ms_bench_conn_done(ms_bench_conn_t *conn)
+{
+    ms_bench_thread_t *t = conn->thread;
+    uint64_t start = conn->start[conn->head];
+
+    conn->head = (conn->head + 1) % bench.depth;
+    conn->inflight--;
+
+    if (t->record)
+    {
+        t->responses++;
+        ms_hist_add(&t->latency, ms_time_ns() - start);
+        if (conn->status < 200 || conn->status >= 400)
+        {
+            t->status++;
+        }
+    }
+
+    // churn 模式: 关闭连接，在本轮事件处理完后重新建立，以免复用的文件句柄收到旧的事件
+    if (bench.churn)
+    {
+        ms_bench_conn_close(conn);
+        if (!conn->posted)
+        {
+            conn->posted = 1;
+            ms_eventloop_task_post(t->evlop, &conn->task);
+        }
+        return;
+    }
+
+    // 闭环模式下由 ms_bench_handler() 一并发送
+    if (bench.rate == 0)
+    {
+        ms_bench_conn_enqueue(conn, ms_time_ns());
+        return;
+    }
+
+    ms_bench_conn_idle(t->evlop, conn);
+}
+
+// 在响应头 [p, last) 中查找 Content-Length，没有时为 0，非法时为 -1
+static int64_t ms_bench_content_length(const char *p, const char *last)
+{
+    static const char name[] = "\r\ncontent-length:";
+    size_t len = sizeof(name) - 1;
+    char *end = NULL;
+    int64_t value = 0;
+
+    for (; p + len <= last; p++)
+    {
+        if (*p != '\r' || strncasecmp(p, name, len) != 0)
+        {
+            continue;
+        }
+
+        value = strtoll(p + len, &end, 10);
+        if (end == p + len || value < 0)
+        {
+            return -1;
+        }
+        return value;
+    }
+
+    return 0;
+}
+
+// 连接的读写事件: 连接建立后发送请求，接收并解析响应
+static void ms_bench_handler(ms_event_loop_t *evlop, int sockfd, uint32_t mask,
+        void *data)
+{
+    ssize_t n = 0;
+    ms_bench_conn_t *conn = (ms_bench_conn_t *)data;
+    ms_bench_thread_t *t = conn->thread;
+
+    // 连接建立
+    if (!conn->connected)
+    {
+        if (ms_socket_error(sockfd) != 0)
+        {
+            ms_bench_conn_error(conn);
+            return;
+        }
+
+        conn->connected = 1;
+        if (t->record)
+        {
+            t->connects++;
+        }
+
+        if (ms_bench_conn_flush(conn) == MS_ERROR)
+        {
+            ms_bench_conn_error(conn);
+            return;
+        }
+
+        // 开环模式下放入可发送请求的连接栈
+        if (bench.rate > 0 && !bench.churn)
+        {
+            ms_bench_conn_idle(evlop, conn);
+        }
+        return;
+    }
+
+    // 边读边解析，直到 EAGAIN
+    while (mask & (EPOLLIN | EPOLLERR | EPOLLHUP))
+    {
+        n = read(sockfd, conn->rbuf + conn->rlen, MS_BENCH_RBUF - conn->rlen);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+
+        // 对端关闭或出错
+        if (n <= 0)
+        {
+            ms_bench_conn_error(conn);
+            return;
+        }
+
+        if (t->record)
+        {
+            t->bytes += n;
+        }
+        conn->rlen += n;
+
+        if (ms_bench_conn_parse(conn) == MS_ERROR)
+        {
+            ms_bench_conn_error(conn);
+            return;
+        }
+
+        if (conn->fd == -1)
+        {
+            return;
+        }
+    }
+
+    if (ms_bench_conn_flush(conn) == MS_ERROR)
+    {
+        ms_bench_conn_error(conn);
+    }
+}
@@ -0,0 +1,613 @@
+#include "ms_buf.h"
+
+static ms_buf_t *ms_buf_chain_tail(ms_buf_pool_t *pool, ms_buf_chain_t *chain);
+static void ms_buf_chain_link(ms_buf_chain_t *chain, ms_buf_t *buf);
+
+/***********************************************************
+ * @Func   : ms_buf_pool_init()
+ * @Author : lwp
+ * @Brief  : 初始化缓冲区池。
+ * @Param  : [in] pool
+ * @Param  : [in] size : 每个缓冲区块的容量，为 0 时使用 MS_BUF_DEFAULT_SIZE
+ * @Param  : [in] maxfree : 保留的空闲缓冲区块的最大数目
+ * @Return : NONE
+ * @Note   :
+ ***********************************************************/
+void ms_buf_pool_init(ms_buf_pool_t *pool, size_t size, uintptr_t maxfree)
+{
+    pool->free = NULL;
+    pool->size = size ? size : MS_BUF_DEFAULT_SIZE;
+    pool->nfree = 0;
+    pool->nalloc = 0;
+    pool->maxfree = maxfree;
+}
+// @ms_buf_pool_init() ok
+
+/***********************************************************
+ * @Func   : ms_buf_pool_destory()
+ * @Author : lwp
+ * @Brief  : 释放缓冲区池中空闲的缓冲区块。
+ * @Param  : [in] pool
+ * @Return : NONE
+ * @Note   : 仍挂在缓冲区链上的缓冲区块由 ms_buf_chain_free() 归还
+ ***********************************************************/
+void ms_buf_pool_destory(ms_buf_pool_t *pool)
+{
+    ms_buf_t *buf = NULL;
+
+    while (pool->free)
+    {
+        buf = pool->free;
+        pool->free = buf->next;
+        free(buf);
+        pool->nalloc--;
+    }
+    pool->nfree = 0;
+}
+// @ms_buf_pool_destory() ok
+
+/***********************************************************
+ * @Func   : ms_buf_alloc()
+ * @Author : lwp
+ * @Brief  : 从缓冲区池中分配一个空的缓冲区块。
+ * @Param  : [in] pool
+ * @Return : NULL : 分配失败
+ *           buf  : 缓冲区块
+ * @Note   : 优先复用空闲链表中的缓冲区块
+ ***********************************************************/
+ms_buf_t *ms_buf_alloc(ms_buf_pool_t *pool)
+{
+    ms_buf_t *buf = NULL;
+
+    if (pool->free)
+    {
+        buf = pool->free;
+        pool->free = buf->next;
+        pool->nfree--;
+    }
+    else
+    {
+        buf = (ms_buf_t *)malloc(sizeof(ms_buf_t) + pool->size);
+        if (buf == NULL)
+        {
+            ms_errlog(MS_ERRLOG_ERR, errno, "malloc() buf failed");
+            return NULL;
+        }
+        buf->end = (char *)(buf + 1) + pool->size;
+        pool->nalloc++;
+    }
+
+    buf->next = NULL;
+    buf->pos = (char *)(buf + 1);
+    buf->last = buf->pos;
+
+    return buf;
+}
+// @ms_buf_alloc() ok
+
+/***********************************************************
+ * @Func   : ms_buf_free()
+ * @Author : lwp
+ * @Brief  : 将缓冲区块归还缓冲区池。
+ * @Param  : [in] pool
+ * @Param  : [in] buf
+ * @Return : NONE
+ * @Note   : 空闲缓冲区块超过 maxfree 时直接释放，使内存随负载回落
+ ***********************************************************/
+void ms_buf_free(ms_buf_pool_t *pool, ms_buf_t *buf)
+{
+    if (pool->nfree >= pool->maxfree)
+    {
+        free(buf);
+        pool->nalloc--;
+        return;
+    }
+
+    buf->next = pool->free;
+    pool->free = buf;
+    pool->nfree++;
+}
+// @ms_buf_free() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_init()
+ * @Author : lwp
+ * @Brief  : 初始化空的缓冲区链。
+ * @Param  : [in] chain
+ * @Return : NONE
+ * @Note   :
+ ***********************************************************/
+void ms_buf_chain_init(ms_buf_chain_t *chain)
+{
+    chain->head = NULL;
+    chain->tail = NULL;
+    chain->size = 0;
+}
+// @ms_buf_chain_init() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_free()
+ * @Author : lwp
+ * @Brief  : 将缓冲区链上所有的缓冲区块归还缓冲区池。
+ * @Param  : [in] pool
+ * @Param  : [in] chain
+ * @Return : NONE
+ * @Note   :
+ ***********************************************************/
+void ms_buf_chain_free(ms_buf_pool_t *pool, ms_buf_chain_t *chain)
+{
+    ms_buf_t *buf = NULL;
+
+    while (chain->head)
+    {
+        buf = chain->head;
+        chain->head = buf->next;
+        ms_buf_free(pool, buf);
+    }
+
+    ms_buf_chain_init(chain);
+}
+// @ms_buf_chain_free() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_append()
+ * @Author : lwp
+ * @Brief  : 将 data 追加到缓冲区链的尾部。
+ * @Param  : [in] pool
+ * @Param  : [in] chain
+ * @Param  : [in] data
+ * @Param  : [in] len
+ * @Return : MS_OK / MS_ERROR
+ * @Note   : 空间不足时从缓冲区池中分配新的缓冲区块
+ ***********************************************************/
+int ms_buf_chain_append(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        const void *data, size_t len)
+{
+    size_t n;
+    ms_buf_t *buf = NULL;
+    const char *p = (const char *)data;
+
+    while (len > 0)
+    {
+        buf = ms_buf_chain_tail(pool, chain);
+        if (buf == NULL)
+        {
+            return MS_ERROR;
+        }
+
+        n = ms_min(len, (size_t)(buf->end - buf->last));
+        memcpy(buf->last, p, n);
+        buf->last += n;
+        chain->size += n;
+        p += n;
+        len -= n;
+    }
+
+    return MS_OK;
+}
+// @ms_buf_chain_append() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_printf()
+ * @Author : lwp
+ * @Brief  : 按 fmt 格式化后追加到缓冲区链的尾部。
+ * @Param  : [in] pool
+ * @Param  : [in] chain
+ * @Param  : [in] fmt : 格式同 ms_str_vslprintf()
+ * @Return : MS_OK / MS_ERROR
+ * @Note   : 单次格式化的结果不超过 MS_MAX_BUF_SIZE，超出部分被截断
+ ***********************************************************/
+int ms_buf_chain_printf(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        const char *fmt, ...)
+{
+    char *last = NULL;
+    char tmp[MS_MAX_BUF_SIZE];
+    va_list args;
+
+    va_start(args, fmt);
+    last = ms_str_vslprintf(tmp, tmp + sizeof(tmp), fmt, args);
+    va_end(args);
+
+    return ms_buf_chain_append(pool, chain, tmp, last - tmp);
+}
+// @ms_buf_chain_printf() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_move()
+ * @Author : lwp
+ * @Brief  : 将 src 头部 len 字节的数据移动到 dst 的尾部。
+ * @Param  : [in] pool
+ * @Param  : [in] dst
+ * @Param  : [in] src
+ * @Param  : [in] len
+ * @Return : 实际移动的字节数
+ * @Note   : 完整的缓冲区块直接转移，不拷贝数据
+ ***********************************************************/
+size_t ms_buf_chain_move(ms_buf_pool_t *pool, ms_buf_chain_t *dst,
+        ms_buf_chain_t *src, size_t len)
+{
+    size_t n;
+    size_t moved = 0;
+    ms_buf_t *buf = NULL;
+
+    while (len > 0 && src->head)
+    {
+        buf = src->head;
+        n = buf->last - buf->pos;
+
+        if (n <= len)
+        {
+            // 整块转移
+            src->head = buf->next;
+            if (src->head == NULL)
+            {
+                src->tail = NULL;
+            }
+            src->size -= n;
+
+            ms_buf_chain_link(dst, buf);
+            dst->size += n;
+        }
+        else
+        {
+            // 部分拷贝
+            n = len;
+            if (ms_buf_chain_append(pool, dst, buf->pos, n) != MS_OK)
+            {
+                break;
+            }
+            ms_buf_chain_consume(pool, src, n);
+        }
+
+        moved += n;
+        len -= n;
+    }
+
+    return moved;
+}
+// @ms_buf_chain_move() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_consume()
+ * @Author : lwp
+ * @Brief  : 丢弃缓冲区链头部 len 字节的数据。
+ * @Param  : [in] pool
+ * @Param  : [in] chain
+ * @Param  : [in] len
+ * @Return : NONE
+ * @Note   : 数据被取空的缓冲区块归还缓冲区池
+ ***********************************************************/
+void ms_buf_chain_consume(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        size_t len)
+{
+    size_t n;
+    ms_buf_t *buf = NULL;
+
+    while (len > 0 && chain->head)
+    {
+        buf = chain->head;
+        n = ms_min(len, (size_t)(buf->last - buf->pos));
+        buf->pos += n;
+        chain->size -= n;
+        len -= n;
+
+        if (buf->pos == buf->last)
+        {
+            chain->head = buf->next;
+            if (chain->head == NULL)
+            {
+                chain->tail = NULL;
+            }
+            ms_buf_free(pool, buf);
+        }
+    }
+}
+// @ms_buf_chain_consume() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_copy()
+ * @Author : lwp
+ * @Brief  : 从缓冲区链的 offset 处拷贝最多 len 字节到 dst。
+ * @Param  : [in] chain
+ * @Param  : [in] offset
+ * @Param  : [in] dst
+ * @Param  : [in] len
+ * @Return : 实际拷贝的字节数
+ * @Note   : 不修改缓冲区链
+ ***********************************************************/
+size_t ms_buf_chain_copy(ms_buf_chain_t *chain, size_t offset, void *dst,
+        size_t len)
+{
+    size_t n;
+    size_t copied = 0;
+    ms_buf_t *buf = chain->head;
+    char *p = (char *)dst;
+
+    for (; buf && len > 0; buf = buf->next)
+    {
+        n = buf->last - buf->pos;
+        if (offset >= n)
+        {
+            offset -= n;
+            continue;
+        }
+
+        n = ms_min(len, n - offset);
+        memcpy(p, buf->pos + offset, n);
+        offset = 0;
+        copied += n;
+        p += n;
+        len -= n;
+    }
+
+    return copied;
+}
+// @ms_buf_chain_copy() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_search()
+ * @Author : lwp
+ * @Brief  : 从缓冲区链的 offset 处开始查找 pattern。
+ * @Param  : [in] chain
+ * @Param  : [in] offset
+ * @Param  : [in] pattern
+ * @Param  : [in] len : pattern 的长度，不超过 MS_BUF_MAX_PATTERN
+ * @Return : -1 : 未找到
+ *           >= 0 : pattern 起始处距离链头的偏移
+ * @Note   : 跨越缓冲区块边界的匹配通过拼接块尾与下一块的块头完成
+ ***********************************************************/
+intptr_t ms_buf_chain_search(ms_buf_chain_t *chain, size_t offset,
+        const char *pattern, size_t len)
+{
+    size_t n;
+    size_t base = 0; // 当前缓冲区块距离链头的偏移
+    char *p = NULL;
+    char *found = NULL;
+    ms_buf_t *buf = NULL;
+    char tmp[MS_BUF_MAX_PATTERN * 2];
+
+    if (len == 0 || len > MS_BUF_MAX_PATTERN)
+    {
+        return -1;
+    }
+
+    for (buf = chain->head; buf; buf = buf->next)
+    {
+        n = buf->last - buf->pos;
+
+        // 块内查找
+        if (offset < base + n)
+        {
+            p = buf->pos + (offset > base ? offset - base : 0);
+            found = (char *)memmem(p, buf->last - p, pattern, len);
+            if (found)
+            {
+                return base + (found - buf->pos);
+            }
+        }
+
+        // 跨块查找: 块尾 len-1 字节与其后 len-1 字节拼接
+        if (buf->next && len > 1)
+        {
+            size_t start = (n >= len - 1) ? base + n - (len - 1) : base;
+            size_t got;
+
+            if (start < offset)
+            {
+                start = offset;
+            }
+            if (start < base + n)
+            {
+                got = ms_buf_chain_copy(chain, start, tmp,
+                        (base + n - start) + (len - 1));
+                found = (char *)memmem(tmp, got, pattern, len);
+                if (found)
+                {
+                    return start + (found - tmp);
+                }
+            }
+        }
+
+        base += n;
+    }
+
+    return -1;
+}
+// @ms_buf_chain_search() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_read()
+ * @Author : lwp
+ * @Brief  : 从 fd 中读取数据追加到缓冲区链，直到 EAGAIN/EOF 或达到 limit。
+ * @Param  : [in] pool
+ * @Param  : [in] chain
+ * @Param  : [in] fd
+ * @Param  : [in] limit : 缓冲区链的最大长度
+ * @Param  : [out] eof : 不为 NULL 时，读到 EOF 置为 1
+ * @Return : > 0 : 本次读取的字节数
+ *           0   : 对端关闭
+ *           MS_AGAIN : 暂无数据
+ *           MS_ERROR : 读取失败
+ * @Note   : 读到数据后遇到 EOF 或错误时返回已读的字节数，错误在下一次调用时报告；
+ *           边缘模式下 EOF 与数据同批到达时不会再有读事件，需由 eof 得知
+ ***********************************************************/
+ssize_t ms_buf_chain_read(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        int fd, size_t limit, int *eof)
+{
+    ssize_t n;
+    size_t total = 0;
+    ms_buf_t *buf = NULL;
+
+    while (chain->size < limit)
+    {
+        // 尾部缓冲区块已满时使用新的缓冲区块，读到数据后才挂到链尾
+        buf = chain->tail;
+        if (buf == NULL || buf->last == buf->end)
+        {
+            buf = ms_buf_alloc(pool);
+            if (buf == NULL)
+            {
+                return total ? (ssize_t)total : MS_ERROR;
+            }
+        }
+
+        n = read(fd, buf->last, ms_min((size_t)(buf->end - buf->last),
+                    limit - chain->size));
+        if (n > 0)
+        {
+            if (buf != chain->tail)
+            {
+                ms_buf_chain_link(chain, buf);
+            }
+            buf->last += n;
+            chain->size += n;
+            total += n;
+            continue;
+        }
+
+        if (buf != chain->tail)
+        {
+            ms_buf_free(pool, buf);
+        }
+
+        if (n == 0)
+        {
+            if (eof != NULL)
+            {
+                *eof = 1;
+            }
+            return total;
+        }
+
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return total ? (ssize_t)total : MS_AGAIN;
+        }
+
+        ms_errlog(MS_ERRLOG_ERR, errno, "read() fd \"%06d\" failed", fd);
+        return total ? (ssize_t)total : MS_ERROR;
+    }
+
+    return total;
+}
+// @ms_buf_chain_read() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_writev()
+ * @Author : lwp
+ * @Brief  : 以 writev() 将缓冲区链中的数据写入 fd，并丢弃已写入的数据。
+ * @Param  : [in] pool
+ * @Param  : [in] chain
+ * @Param  : [in] fd
+ * @Return : >= 0 : 本次写入的字节数
+ *           MS_AGAIN : 暂不可写
+ *           MS_ERROR : 写入失败
+ * @Note   : 每次 writev() 最多使用 MS_BUF_IOV_MAX 个缓冲区块
+ ***********************************************************/
+ssize_t ms_buf_chain_writev(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        int fd)
+{
+    int cnt;
+    ssize_t n;
+    size_t total = 0;
+    ms_buf_t *buf = NULL;
+    struct iovec iov[MS_BUF_IOV_MAX];
+
+    while (chain->size > 0)
+    {
+        cnt = 0;
+        for (buf = chain->head; buf && cnt < MS_BUF_IOV_MAX; buf = buf->next)
+        {
+            if (buf->last == buf->pos)
+            {
+                continue;
+            }
+            iov[cnt].iov_base = buf->pos;
+            iov[cnt].iov_len = buf->last - buf->pos;
+            cnt++;
+        }
+
+        n = writev(fd, iov, cnt);
+        if (n > 0)
+        {
+            ms_buf_chain_consume(pool, chain, n);
+            total += n;
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return total ? (ssize_t)total : MS_AGAIN;
+        }
+
+        ms_errlog(MS_ERRLOG_ERR, errno, "writev() fd \"%06d\" failed", fd);
+        return MS_ERROR;
+    }
+
+    return total;
+}
+// @ms_buf_chain_writev() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_tail()
+ * @Author : lwp
+ * @Brief  : 返回缓冲区链中尚有空闲空间的尾部缓冲区块。
+ * @Param  : [in] pool
+ * @Param  : [in] chain
+ * @Return : NULL : 分配失败
+ *           buf  : 缓冲区块
+ * @Note   : 尾部缓冲区块已满时分配新的缓冲区块并挂到链尾
+ ***********************************************************/
+static ms_buf_t *ms_buf_chain_tail(ms_buf_pool_t *pool, ms_buf_chain_t *chain)
+{
+    ms_buf_t *buf = chain->tail;
+
+    if (buf && buf->last < buf->end)
+    {
+        return buf;
+    }
+
+    buf = ms_buf_alloc(pool);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    ms_buf_chain_link(chain, buf);
+
+    return buf;
+}
+// @ms_buf_chain_tail() ok
+
+/***********************************************************
+ * @Func   : ms_buf_chain_link()
+ * @Author : lwp
+ * @Brief  : 将缓冲区块挂到缓冲区链的尾部。
+ * @Param  : [in] chain
+ * @Param  : [in] buf
+ * @Return : NONE
+ * @Note   : 不修改 chain->size
+ ***********************************************************/
+static void ms_buf_chain_link(ms_buf_chain_t *chain, ms_buf_t *buf)
+{
+    buf->next = NULL;
+    if (chain->tail)
+    {
+        chain->tail->next = buf;
+    }
+    else
+    {
+        chain->head = buf;
+    }
+    chain->tail = buf;
+}
+// @ms_buf_chain_link() ok
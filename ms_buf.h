@@ -0,0 +1,82 @@
+// 链式缓冲区: 数据存储在由缓冲区池分配的定长块中，块之间以链表相连，
+// 容量随数据增长，读写均可跨越块的边界。
+#ifndef _MS_BUF_H
+#define _MS_BUF_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_str.h"
+#include "ms_errlog.h"
+
+#define MS_BUF_DEFAULT_SIZE 4096 // 每个缓冲区块的容量
+#define MS_BUF_MAX_FREE     256  // 缓冲区池中保留的空闲缓冲区块的最大数目
+#define MS_BUF_IOV_MAX      64   // 单次 writev() 最多使用的缓冲区块数
+#define MS_BUF_MAX_PATTERN  64   // ms_buf_chain_search() 中 pattern 的最大长度
+
+typedef struct ms_buf_s       ms_buf_t;
+typedef struct ms_buf_chain_s ms_buf_chain_t;
+typedef struct ms_buf_pool_s  ms_buf_pool_t;
+
+// 缓冲区块，存储空间紧跟在结构体之后
+struct ms_buf_s {
+    ms_buf_t *next; // 下一个缓冲区块
+    char     *pos;  // 有效数据的起始地址
+    char     *last; // 有效数据的结束地址
+    char     *end;  // 存储空间的结束地址
+};
+
+// 缓冲区链
+struct ms_buf_chain_s {
+    ms_buf_t *head; // 第一个缓冲区块
+    ms_buf_t *tail; // 最后一个缓冲区块
+    size_t    size; // 有效数据的总长度
+};
+
+// 缓冲区池，空闲缓冲区块以链表存储
+struct ms_buf_pool_s {
+    ms_buf_t *free;   // 空闲缓冲区块链表
+    size_t    size;   // 每个缓冲区块的容量
+    uintptr_t nfree;  // 空闲缓冲区块的数目
+    uintptr_t nalloc; // 已分配缓冲区块的总数
+    uintptr_t maxfree; // 保留的空闲缓冲区块的最大数目，超出的部分直接释放
+};
+
+void ms_buf_pool_init(ms_buf_pool_t *pool, size_t size, uintptr_t maxfree);
+void ms_buf_pool_destory(ms_buf_pool_t *pool);
+
+ms_buf_t *ms_buf_alloc(ms_buf_pool_t *pool);
+void ms_buf_free(ms_buf_pool_t *pool, ms_buf_t *buf);
+
+void ms_buf_chain_init(ms_buf_chain_t *chain);
+void ms_buf_chain_free(ms_buf_pool_t *pool, ms_buf_chain_t *chain);
+
+int ms_buf_chain_append(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        const void *data, size_t len);
+int ms_buf_chain_printf(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        const char *fmt, ...);
+size_t ms_buf_chain_move(ms_buf_pool_t *pool, ms_buf_chain_t *dst,
+        ms_buf_chain_t *src, size_t len);
+void ms_buf_chain_consume(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        size_t len);
+
+size_t ms_buf_chain_copy(ms_buf_chain_t *chain, size_t offset, void *dst,
+        size_t len);
+intptr_t ms_buf_chain_search(ms_buf_chain_t *chain, size_t offset,
+        const char *pattern, size_t len);
+
+ssize_t ms_buf_chain_read(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        int fd, size_t limit, int *eof);
+ssize_t ms_buf_chain_writev(ms_buf_pool_t *pool, ms_buf_chain_t *chain,
+        int fd);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
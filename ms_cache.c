@@ -0,0 +1,416 @@
+#include "ms_cache.h"
+
+static uint32_t ms_cache_hash(const char *key, size_t klen);
+static ms_cache_node_t *ms_cache_find(ms_cache_t *cache, uint32_t hash,
+        const char *key, size_t klen);
+static void ms_cache_insert(ms_cache_t *cache, ms_cache_node_t *node);
+static void ms_cache_touch(ms_cache_t *cache, ms_cache_node_t *node);
+static void ms_cache_unlink(ms_cache_t *cache, ms_cache_node_t *node);
+static void ms_cache_put(ms_cache_t *cache, ms_cache_node_t *node);
+static void *ms_cache_alloc(ms_cache_t *cache, size_t size);
+
+/***********************************************************
+ * @Func   : ms_cache_create()
+ * @Author : lwp
+ * @Brief  : 创建共享内存 zone，并在其中创建响应缓存。
+ * @Param  : [in] size : 共享内存的大小
+ * @Param  : [in] ttl  : 缓存的有效时间，毫秒 0 代表不过期
+ * @Return : NULL  : 失败
+ *           cache : 成功，位于共享内存中
+ * @Note   : 必须在 master 中 fork() 之前调用
+ ***********************************************************/
+ms_cache_t *ms_cache_create(size_t size, int ttl)
+{
+    ms_shm_zone_t *zone = NULL;
+    ms_cache_t *cache = NULL;
+
+    zone = ms_shm_zone_add(MS_CACHE_ZONE, size + sizeof(ms_cache_t));
+    if (zone == NULL)
+    {
+        return NULL;
+    }
+
+    cache = (ms_cache_t *)ms_slab_calloc(zone->pool, sizeof(ms_cache_t));
+    if (cache == NULL)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "cache size \"%z\" too small", size);
+        return NULL;
+    }
+
+    cache->pool = zone->pool;
+    cache->ttl = ttl;
+    zone->pool->data = cache;
+
+    return cache;
+}
+// @ms_cache_create() ok
+
+/***********************************************************
+ * @Func   : ms_cache_stat()
+ * @Author : lwp
+ * @Brief  : 记录缓存的统计信息，各 worker 的计数是共享的。
+ * @Param  : [in] cache
+ * @Return : void
+ ***********************************************************/
+void ms_cache_stat(ms_cache_t *cache)
+{
+    ms_shm_mutex_lock(&cache->pool->mutex);
+
+    ms_errlog(MS_ERRLOG_INFO, 0,
+            "cache items \"%uL\" hit \"%uL\" miss \"%uL\" wait \"%uL\" "
+            "expire \"%uL\" evict \"%uL\"", (uint64_t)cache->nitems,
+            (uint64_t)cache->nhit, (uint64_t)cache->nmiss,
+            (uint64_t)cache->nwait, (uint64_t)cache->nexpire,
+            (uint64_t)cache->nevict);
+
+    ms_shm_mutex_unlock(&cache->pool->mutex);
+}
+// @ms_cache_stat() ok
+
+/***********************************************************
+ * @Func   : ms_cache_get()
+ * @Author : lwp
+ * @Brief  : 查找缓存，命中时将缓存的值追加到 chain。
+ * @Param  : [in] cache
+ * @Param  : [in] key
+ * @Param  : [in] klen
+ * @Param  : [in] bufs  : chain 所属的缓冲区池
+ * @Param  : [in] chain : 命中时追加值的缓冲区链
+ * @Return : MS_OK    : 命中，值已追加到 chain
+ *           MS_AGAIN : 未命中，调用者计算后须调用 ms_cache_set() 或 ms_cache_cancel()
+ *           MS_BUSY  : 其他请求正在计算，MS_CACHE_WAIT 毫秒后重试
+ *           MS_ERROR : 追加值失败
+ * @Note   : 值在锁外拷贝，期间结点被引用，不会被释放
+ ***********************************************************/
+int ms_cache_get(ms_cache_t *cache, const char *key, size_t klen,
+        ms_buf_pool_t *bufs, ms_buf_chain_t *chain)
+{
+    int rev = MS_OK;
+    uint64_t now = ms_time_ns() / 1000000; // 单调时钟，不受校时影响
+    uint32_t hash = ms_cache_hash(key, klen);
+    ms_cache_node_t *node = NULL;
+
+    ms_shm_mutex_lock(&cache->pool->mutex);
+
+    node = ms_cache_find(cache, hash, key, klen);
+
+    // 已过期: 移除后按未命中处理
+    if (node != NULL && node->state == MS_CACHE_READY && node->expire <= now)
+    {
+        ms_cache_unlink(cache, node);
+        cache->nexpire++;
+        node = NULL;
+    }
+
+    // 命中
+    if (node != NULL && node->state == MS_CACHE_READY)
+    {
+        node->refs++;
+        ms_cache_touch(cache, node);
+        cache->nhit++;
+        ms_shm_mutex_unlock(&cache->pool->mutex);
+
+        rev = ms_buf_chain_append(bufs, chain, node->data + node->klen,
+                node->vlen);
+
+        ms_shm_mutex_lock(&cache->pool->mutex);
+        ms_cache_put(cache, node);
+        ms_shm_mutex_unlock(&cache->pool->mutex);
+        return rev;
+    }
+
+    // 其他请求正在计算
+    if (node != NULL && node->expire > now)
+    {
+        cache->nwait++;
+        ms_shm_mutex_unlock(&cache->pool->mutex);
+        return MS_BUSY;
+    }
+
+    // 未命中，或计算者已超时: 由调用者计算，之后相同的请求等待
+    cache->nmiss++;
+    if (node == NULL)
+    {
+        node = ms_cache_alloc(cache, sizeof(ms_cache_node_t) + klen);
+        if (node != NULL)
+        {
+            node->hash = hash;
+            node->state = MS_CACHE_PENDING;
+            node->refs = 0;
+            node->stale = 0;
+            node->klen = klen;
+            node->vlen = 0;
+            memcpy(node->data, key, klen);
+            ms_cache_insert(cache, node);
+        }
+    }
+
+    // 接替计算时移到 LRU 链表头，截止时间前不会因过期被移除
+    if (node != NULL)
+    {
+        node->expire = now + MS_CACHE_LOCK;
+        ms_cache_touch(cache, node);
+    }
+
+    ms_shm_mutex_unlock(&cache->pool->mutex);
+
+    return MS_AGAIN;
+}
+// @ms_cache_get() ok
+
+/***********************************************************
+ * @Func   : ms_cache_set()
+ * @Author : lwp
+ * @Brief  : 缓存 chain 中 [offset, offset + len) 的数据，替换该键已有的结点。
+ * @Param  : [in] cache
+ * @Param  : [in] key
+ * @Param  : [in] klen
+ * @Param  : [in] chain  : 值所在的缓冲区链，如刚生成的响应所在的 conn->sbuf
+ * @Param  : [in] offset : 值在 chain 中的偏移
+ * @Param  : [in] len    : 值的长度
+ * @Return : MS_ERROR : 值过大或共享内存不足，只取消计算中的结点
+ *           MS_OK    : 成功
+ * @Note   : 内存不足时按 LRU 淘汰最多 MS_CACHE_EVICT 个结点
+ ***********************************************************/
+int ms_cache_set(ms_cache_t *cache, const char *key, size_t klen,
+        ms_buf_chain_t *chain, size_t offset, size_t len)
+{
+    size_t size = sizeof(ms_cache_node_t) + klen + len;
+    uint64_t now = ms_time_ns() / 1000000; // 单调时钟，不受校时影响
+    ms_cache_node_t *node = NULL;
+    ms_cache_node_t *old = NULL;
+
+    // 超过 zone 的 1/4 时不缓存，避免为之淘汰过多的结点
+    if (size > (cache->pool->npages << MS_SLAB_PAGE_SHIFT) / 4)
+    {
+        ms_cache_cancel(cache, key, klen);
+        return MS_ERROR;
+    }
+
+    ms_shm_mutex_lock(&cache->pool->mutex);
+
+    // 顺带移除 LRU 链表尾部已过期的结点
+    for (int i = 0; i < 2 && cache->oldest != NULL
+            && cache->oldest->expire <= now; i++)
+    {
+        ms_cache_unlink(cache, cache->oldest);
+        cache->nexpire++;
+    }
+
+    node = ms_cache_alloc(cache, size);
+
+    ms_shm_mutex_unlock(&cache->pool->mutex);
+
+    if (node == NULL)
+    {
+        ms_cache_cancel(cache, key, klen);
+        return MS_ERROR;
+    }
+
+    // 结点尚未链入，在锁外拷贝键与值
+    node->hash = ms_cache_hash(key, klen);
+    node->state = MS_CACHE_READY;
+    node->expire = cache->ttl > 0 ? now + cache->ttl : UINT64_MAX;
+    node->refs = 0;
+    node->stale = 0;
+    node->klen = klen;
+    node->vlen = len;
+    memcpy(node->data, key, klen);
+    ms_buf_chain_copy(chain, offset, node->data + klen, len);
+
+    ms_shm_mutex_lock(&cache->pool->mutex);
+
+    old = ms_cache_find(cache, node->hash, key, klen);
+    if (old != NULL)
+    {
+        ms_cache_unlink(cache, old);
+    }
+    ms_cache_insert(cache, node);
+
+    ms_shm_mutex_unlock(&cache->pool->mutex);
+
+    return MS_OK;
+}
+// @ms_cache_set() ok
+
+/***********************************************************
+ * @Func   : ms_cache_cancel()
+ * @Author : lwp
+ * @Brief  : 放弃计算未命中的键，等待的请求随后重新计算。
+ * @Param  : [in] cache
+ * @Param  : [in] key
+ * @Param  : [in] klen
+ * @Return : void
+ * @Note   : 响应不可缓存(如出错)时调用
+ ***********************************************************/
+void ms_cache_cancel(ms_cache_t *cache, const char *key, size_t klen)
+{
+    ms_cache_node_t *node = NULL;
+
+    ms_shm_mutex_lock(&cache->pool->mutex);
+
+    node = ms_cache_find(cache, ms_cache_hash(key, klen), key, klen);
+    if (node != NULL && node->state == MS_CACHE_PENDING)
+    {
+        ms_cache_unlink(cache, node);
+    }
+
+    ms_shm_mutex_unlock(&cache->pool->mutex);
+}
+// @ms_cache_cancel() ok
+
+static uint32_t ms_cache_hash(const char *key, size_t klen)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < klen; i++)
+    {
+        h ^= (uint8_t)key[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+// 以下函数均在持有 zone 的锁时调用
+static ms_cache_node_t *ms_cache_find(ms_cache_t *cache, uint32_t hash,
+        const char *key, size_t klen)
+{
+    ms_cache_node_t *node = cache->buckets[hash & (MS_CACHE_BUCKETS - 1)];
+
+    for (; node != NULL; node = node->next)
+    {
+        if (node->hash == hash && node->klen == klen
+                && memcmp(node->data, key, klen) == 0)
+        {
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+// 加入哈希表与 LRU 链表头；计算中的结点也在 LRU 链表中，
+// 计算者放弃(出错未取消、进程退出)后随过期或淘汰释放
+static void ms_cache_insert(ms_cache_t *cache, ms_cache_node_t *node)
+{
+    ms_cache_node_t **bucket =
+        &cache->buckets[node->hash & (MS_CACHE_BUCKETS - 1)];
+
+    node->next = *bucket;
+    *bucket = node;
+
+    node->newer = NULL;
+    node->older = cache->newest;
+    if (cache->newest != NULL)
+    {
+        cache->newest->newer = node;
+    }
+    cache->newest = node;
+    if (cache->oldest == NULL)
+    {
+        cache->oldest = node;
+    }
+
+    if (node->state == MS_CACHE_READY)
+    {
+        cache->nitems++;
+    }
+}
+
+// 移到 LRU 链表头
+static void ms_cache_touch(ms_cache_t *cache, ms_cache_node_t *node)
+{
+    if (cache->newest == node)
+    {
+        return;
+    }
+
+    // 从原位置摘下，node 不是链表头，newer 不为 NULL
+    node->newer->older = node->older;
+    if (node->older != NULL)
+    {
+        node->older->newer = node->newer;
+    }
+    else
+    {
+        cache->oldest = node->newer;
+    }
+
+    node->newer = NULL;
+    node->older = cache->newest;
+    cache->newest->newer = node;
+    cache->newest = node;
+}
+
+// 从哈希表与 LRU 链表中移除，之后不再被查找到；没有引用时立即释放
+static void ms_cache_unlink(ms_cache_t *cache, ms_cache_node_t *node)
+{
+    ms_cache_node_t **pp =
+        &cache->buckets[node->hash & (MS_CACHE_BUCKETS - 1)];
+
+    while (*pp != node)
+    {
+        pp = &(*pp)->next;
+    }
+    *pp = node->next;
+
+    if (node->newer != NULL)
+    {
+        node->newer->older = node->older;
+    }
+    else
+    {
+        cache->newest = node->older;
+    }
+
+    if (node->older != NULL)
+    {
+        node->older->newer = node->newer;
+    }
+    else
+    {
+        cache->oldest = node->newer;
+    }
+
+    if (node->state == MS_CACHE_READY)
+    {
+        cache->nitems--;
+    }
+
+    node->stale = 1;
+    if (node->refs == 0)
+    {
+        ms_slab_free_locked(cache->pool, node);
+    }
+}
+
+// 归还引用，已移除的结点在引用归零时释放
+static void ms_cache_put(ms_cache_t *cache, ms_cache_node_t *node)
+{
+    node->refs--;
+    if (node->refs == 0 && node->stale)
+    {
+        ms_slab_free_locked(cache->pool, node);
+    }
+}
+
+// 分配失败时按 LRU 淘汰结点后重试
+static void *ms_cache_alloc(ms_cache_t *cache, size_t size)
+{
+    void *p = NULL;
+
+    for (int i = 0; i <= MS_CACHE_EVICT; i++)
+    {
+        p = ms_slab_alloc_locked(cache->pool, size);
+        if (p != NULL || cache->oldest == NULL)
+        {
+            break;
+        }
+
+        ms_cache_unlink(cache, cache->oldest);
+        cache->nevict++;
+    }
+
+    return p;
+}
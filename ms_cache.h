@@ -0,0 +1,77 @@
+// 响应缓存: 以请求导出的键缓存完整的响应，位于共享内存 zone 中，各 worker 共用。
+// 以哈希表索引，按 LRU 淘汰，超过 TTL 后失效；命中时响应直接从共享内存拷贝到发送缓冲区链。
+// 同一个键的并发未命中只由第一个请求计算，其余请求等待计算完成后命中，计算者超时未完成时接替计算。
+#ifndef _MS_CACHE_H
+#define _MS_CACHE_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_buf.h"
+#include "ms_shm.h"
+#include "ms_slab.h"
+#include "ms_time.h"
+#include "ms_errlog.h"
+
+#define MS_CACHE_ZONE    "cache" // 共享内存 zone 的名称
+#define MS_CACHE_BUCKETS 4096    // 哈希表的桶数，必须为 2 的幂
+#define MS_CACHE_LOCK    1000    // 计算未命中的键的最长时间，毫秒，超过后由等待者接替
+#define MS_CACHE_WAIT    1       // 等待其他 worker 计算时重试的间隔，毫秒
+#define MS_CACHE_EVICT   16      // 分配失败时最多淘汰的结点数
+
+// 结点的状态
+#define MS_CACHE_PENDING 0 // 正在由某个 worker 计算，没有值
+#define MS_CACHE_READY   1 // 已缓存
+
+typedef struct ms_cache_node_s ms_cache_node_t;
+typedef struct ms_cache_s      ms_cache_t;
+
+// 缓存的结点，键与值依次存放在 data 中
+struct ms_cache_node_s {
+    ms_cache_node_t *next;   // 同一个桶中的下一个结点
+    ms_cache_node_t *newer;  // LRU 链表中较新的结点
+    ms_cache_node_t *older;  // LRU 链表中较旧的结点
+    uint64_t         expire; // READY: 失效的时间; PENDING: 计算的截止时间，单调时钟的毫秒
+    uint32_t         hash;   // 键的哈希值
+    int              state;  // 结点的状态，见 MS_CACHE_PENDING 等
+    int              refs;   // 正在拷贝值的请求数
+    int              stale;  // 已从哈希表中移除，引用归零时释放
+    size_t           klen;   // 键的长度
+    size_t           vlen;   // 值的长度
+    char             data[];
+};
+
+// 响应缓存，位于共享内存中，由 zone 的互斥锁保护
+struct ms_cache_s {
+    ms_slab_pool_t  *pool;     // 所在 zone 的 slab 池
+    ms_cache_node_t *buckets[MS_CACHE_BUCKETS]; // 以键为索引的哈希表
+    ms_cache_node_t *newest;   // LRU 链表头，最近使用的结点，包括计算中的结点
+    ms_cache_node_t *oldest;   // LRU 链表尾，最先淘汰的结点
+    int              ttl;      // 缓存的有效时间，毫秒 0 代表不过期
+    uintptr_t        nitems;   // 已缓存的结点数
+    uintptr_t        nhit;     // 命中的次数
+    uintptr_t        nmiss;    // 未命中的次数
+    uintptr_t        nwait;    // 等待其他 worker 计算的次数
+    uintptr_t        nexpire;  // 过期的次数
+    uintptr_t        nevict;   // 淘汰的次数
+};
+
+ms_cache_t *ms_cache_create(size_t size, int ttl);
+void ms_cache_stat(ms_cache_t *cache);
+
+int ms_cache_get(ms_cache_t *cache, const char *key, size_t klen,
+        ms_buf_pool_t *bufs, ms_buf_chain_t *chain);
+int ms_cache_set(ms_cache_t *cache, const char *key, size_t klen,
+        ms_buf_chain_t *chain, size_t offset, size_t len);
+void ms_cache_cancel(ms_cache_t *cache, const char *key, size_t klen);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
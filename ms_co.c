@@ -0,0 +1,233 @@
+#include "ms_co.h"
+
+// 当前线程正在运行的协程，每个线程拥有单独的 eventloop
+static __thread ms_co_t *ms_co_current = NULL;
+
+static void ms_co_entry(void);
+
+/***********************************************************
+ * @Func   : ms_co_pool_init()
+ * @Author : lwp
+ * @Brief  : 初始化协程池。
+ * @Param  : [in] pool
+ * @Param  : [in] stacksize : 协程栈的大小，为 0 时使用 MS_CO_DEFAULT_STACK
+ * @Param  : [in] maxfree : 保留的空闲协程的最大数目
+ * @Return : NONE
+ * @Note   : 栈的大小向上取整为页的整数倍，并额外分配一个保护页
+ ***********************************************************/
+void ms_co_pool_init(ms_co_pool_t *pool, size_t stacksize, uintptr_t maxfree)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+
+    pool->pagesize = pagesize > 0 ? (size_t)pagesize : 4096;
+
+    stacksize = stacksize ? stacksize : MS_CO_DEFAULT_STACK;
+    stacksize = ms_max(stacksize, MS_CO_MIN_STACK);
+    stacksize = (stacksize + pool->pagesize - 1) & ~(pool->pagesize - 1);
+
+    pool->free = NULL;
+    pool->size = pool->pagesize + stacksize;
+    pool->nfree = 0;
+    pool->nalloc = 0;
+    pool->maxfree = maxfree;
+}
+// @ms_co_pool_init() ok
+
+/***********************************************************
+ * @Func   : ms_co_pool_destory()
+ * @Author : lwp
+ * @Brief  : 释放协程池中空闲的协程。
+ * @Param  : [in] pool
+ * @Return : NONE
+ * @Note   : 仍在使用的协程由 ms_co_free() 归还
+ ***********************************************************/
+void ms_co_pool_destory(ms_co_pool_t *pool)
+{
+    ms_co_t *co = NULL;
+
+    while (pool->free)
+    {
+        co = pool->free;
+        pool->free = co->next;
+        munmap((char *)(co + 1) - pool->size, pool->size);
+        pool->nalloc--;
+    }
+    pool->nfree = 0;
+}
+// @ms_co_pool_destory() ok
+
+/***********************************************************
+ * @Func   : ms_co_create()
+ * @Author : lwp
+ * @Brief  : 从协程池中分配一个协程，首次 ms_co_resume() 时执行 proc(data)。
+ * @Param  : [in] pool
+ * @Param  : [in] proc : 协程的入口函数
+ * @Param  : [in] data : 入口函数的 data 参数
+ * @Return : NULL : 失败
+ *           co   : 协程
+ * @Note   : 优先复用空闲链表中的协程；新分配的栈只有被访问的页占用物理内存
+ ***********************************************************/
+ms_co_t *ms_co_create(ms_co_pool_t *pool, ms_co_proc *proc, void *data)
+{
+    char *base = NULL;
+    ms_co_t *co = NULL;
+
+    if (pool->free)
+    {
+        co = pool->free;
+        pool->free = co->next;
+        pool->nfree--;
+        base = (char *)(co + 1) - pool->size;
+    }
+    else
+    {
+        base = (char *)mmap(NULL, pool->size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                -1, 0);
+        if (base == MAP_FAILED)
+        {
+            ms_errlog(MS_ERRLOG_ERR, errno, "mmap() co stack failed");
+            return NULL;
+        }
+
+        // 栈向低地址增长，保护页位于最低地址
+        if (mprotect(base, pool->pagesize, PROT_NONE) == -1)
+        {
+            ms_errlog(MS_ERRLOG_ERR, errno, "mprotect() co guard page failed");
+            munmap(base, pool->size);
+            return NULL;
+        }
+
+        co = (ms_co_t *)(base + pool->size) - 1;
+        pool->nalloc++;
+    }
+
+    if (getcontext(&(co->ctx)) == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "getcontext() failed");
+        co->next = NULL;
+        ms_co_free(pool, co);
+        return NULL;
+    }
+
+    // 栈空间位于保护页与 ms_co_t 之间，栈顶按 16 字节对齐
+    co->ctx.uc_stack.ss_sp = base + pool->pagesize;
+    co->ctx.uc_stack.ss_size = ((uintptr_t)co & ~(uintptr_t)15)
+        - (uintptr_t)(base + pool->pagesize);
+    co->ctx.uc_link = &(co->caller);
+    makecontext(&(co->ctx), ms_co_entry, 0);
+
+    co->next = NULL;
+    co->proc = proc;
+    co->data = data;
+    co->status = MS_CO_READY;
+
+    return co;
+}
+// @ms_co_create() ok
+
+/***********************************************************
+ * @Func   : ms_co_free()
+ * @Author : lwp
+ * @Brief  : 将协程归还协程池。
+ * @Param  : [in] pool
+ * @Param  : [in] co
+ * @Return : NONE
+ * @Note   : 不可在 co 中调用；挂起的协程栈上的资源不会被释放
+ ***********************************************************/
+void ms_co_free(ms_co_pool_t *pool, ms_co_t *co)
+{
+    if (pool->nfree >= pool->maxfree)
+    {
+        munmap((char *)(co + 1) - pool->size, pool->size);
+        pool->nalloc--;
+        return;
+    }
+
+    co->status = MS_CO_DEAD;
+    co->next = pool->free;
+    pool->free = co;
+    pool->nfree++;
+}
+// @ms_co_free() ok
+
+/***********************************************************
+ * @Func   : ms_co_resume()
+ * @Author : lwp
+ * @Brief  : 切换到协程 co 运行，直到其挂起或结束。
+ * @Param  : [in] co
+ * @Return : MS_ERROR : 失败
+ *           MS_AGAIN : co 已挂起
+ *           MS_OK    : co 已结束，可调用 ms_co_free() 归还
+ * @Note   : 只能在协程之外调用，不支持协程嵌套
+ ***********************************************************/
+int ms_co_resume(ms_co_t *co)
+{
+    if (ms_co_current != NULL
+            || (co->status != MS_CO_READY && co->status != MS_CO_SUSPEND))
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "resume co \"%p\" status \"%d\" failed",
+                co, co->status);
+        return MS_ERROR;
+    }
+
+    co->status = MS_CO_RUNNING;
+    ms_co_current = co;
+    if (swapcontext(&(co->caller), &(co->ctx)) == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "swapcontext() failed");
+        ms_co_current = NULL;
+        co->status = MS_CO_DEAD;
+        return MS_ERROR;
+    }
+    ms_co_current = NULL;
+
+    return co->status == MS_CO_DEAD ? MS_OK : MS_AGAIN;
+}
+// @ms_co_resume() ok
+
+/***********************************************************
+ * @Func   : ms_co_yield()
+ * @Author : lwp
+ * @Brief  : 挂起当前协程，切换回 ms_co_resume() 的调用处。
+ * @Param  : NONE
+ * @Return : NONE
+ * @Note   : 在协程之外调用时直接返回
+ ***********************************************************/
+void ms_co_yield(void)
+{
+    ms_co_t *co = ms_co_current;
+
+    if (co == NULL)
+    {
+        return;
+    }
+
+    co->status = MS_CO_SUSPEND;
+    swapcontext(&(co->ctx), &(co->caller));
+}
+// @ms_co_yield() ok
+
+/***********************************************************
+ * @Func   : ms_co_self()
+ * @Author : lwp
+ * @Brief  : 获取当前线程正在运行的协程。
+ * @Param  : NONE
+ * @Return : NULL : 不在协程中
+ *           co   : 当前协程
+ * @Note   :
+ ***********************************************************/
+ms_co_t *ms_co_self(void)
+{
+    return ms_co_current;
+}
+// @ms_co_self() ok
+
+// 协程的入口，proc() 返回后由 uc_link 切换回 caller
+static void ms_co_entry(void)
+{
+    ms_co_t *co = ms_co_current;
+
+    co->proc(co->data);
+    co->status = MS_CO_DEAD;
+}
@@ -0,0 +1,66 @@
+// 有栈协程: 基于 ucontext 实现，协程栈由协程池分配，栈底设置保护页，
+// 栈溢出时触发 SIGSEGV 而不是覆盖其他内存。协程只能在创建它的线程中恢复。
+#ifndef _MS_CO_H
+#define _MS_CO_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include <ucontext.h>
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_errlog.h"
+
+#define MS_CO_DEFAULT_STACK (64 * 1024) // 协程栈的默认大小
+#define MS_CO_MIN_STACK     (16 * 1024) // 协程栈的最小值
+#define MS_CO_MAX_FREE      1024        // 协程池中保留的空闲协程的最大数目
+
+#define MS_CO_READY   0 // 已创建，尚未运行
+#define MS_CO_RUNNING 1 // 正在运行
+#define MS_CO_SUSPEND 2 // 已挂起，等待恢复
+#define MS_CO_DEAD    3 // 已运行结束
+
+typedef struct ms_co_s      ms_co_t;
+typedef struct ms_co_pool_s ms_co_pool_t;
+
+typedef void ms_co_proc(void *data);
+
+// 协程，位于其栈空间的顶端: [保护页][栈 ...][ms_co_t]
+struct ms_co_s {
+    ucontext_t  ctx;    // 协程的上下文
+    ucontext_t  caller; // 恢复协程的上下文，协程挂起或结束时切换回此处
+    ms_co_t    *next;   // 下一个协程，空闲协程以链表存储
+    ms_co_proc *proc;   // 协程的入口函数
+    void       *data;   // 入口函数的 data 参数
+    int         status; // 协程的状态
+};
+
+// 协程池，空闲协程保留其栈空间以便复用
+struct ms_co_pool_s {
+    ms_co_t   *free;     // 空闲协程链表
+    size_t     size;     // 每个协程 mmap() 的总长度，包括保护页
+    size_t     pagesize; // 保护页的大小
+    uintptr_t  nfree;    // 空闲协程的数目
+    uintptr_t  nalloc;   // 已分配协程的总数
+    uintptr_t  maxfree;  // 保留的空闲协程的最大数目，超出的部分直接释放
+};
+
+void ms_co_pool_init(ms_co_pool_t *pool, size_t stacksize, uintptr_t maxfree);
+void ms_co_pool_destory(ms_co_pool_t *pool);
+
+ms_co_t *ms_co_create(ms_co_pool_t *pool, ms_co_proc *proc, void *data);
+void ms_co_free(ms_co_pool_t *pool, ms_co_t *co);
+
+int ms_co_resume(ms_co_t *co);
+void ms_co_yield(void);
+ms_co_t *ms_co_self(void);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
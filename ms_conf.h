@@ -9,6 +9,8 @@ extern "C"
 #define MS_OK     0
 #define MS_ERROR -1
 #define MS_BUSY  -2
+#define MS_AGAIN -3
+#define MS_DEFER -4
 
 #define MS_NAME        "lwp"
 #define MS_VERSION     "0.1"
@@ -488,6 +488,36 @@ int check_file(ms_conf_item_t *t, const char *data)
 }
 // @check_file() ok
 
+/***********************************************************
+ * @Func   : check_file_off()
+ * @Author : lwp
+ * @Brief  : 检查可关闭的文件路径配置项是否正确。
+ * @Param  : [in] t : 指向当前配置项的结构体
+ * @Param  : [in] data : 文件路径配置项的值，off 代表不启用
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : 
+ ***********************************************************/
+int check_file_off(ms_conf_item_t *t, const char *data)
+{
+    if (strcmp(data, "off") != 0)
+    {
+        return check_file(t, data);
+    }
+
+    if (strlen(t->val))
+    {
+        ms_errlog_stderr(0, "config item \"%s\" is duplicated", t->key);
+        return MS_ERROR;
+    }
+
+    memset(t->val, 0, sizeof(t->val));
+    strcpy(t->val, data);
+
+    return MS_OK;
+}
+// @check_file_off() ok
+
 /***********************************************************
  * @Func   : check_num()
  * @Author : lwp
@@ -539,6 +569,140 @@ error:
 }
 // @check_num() ok
 
+/***********************************************************
+ * @Func   : check_addrs()
+ * @Author : lwp
+ * @Brief  : 检查以 ';' 分隔的 ip:port 列表是否正确。
+ * @Param  : [in] t : 指向当前配置项的结构体
+ * @Param  : [in] data : 地址列表配置项的值，如 127.0.0.1:8001;127.0.0.1:8002
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : 
+ ***********************************************************/
+int check_addrs(ms_conf_item_t *t, const char *data)
+{
+    int port = 0;
+    char *ptr = NULL;
+    char *colon = NULL;
+    char *saveptr = NULL;
+    char buff[MS_MAX_BUF_SIZE] = { 0 };
+    struct in_addr addr;
+
+    if (strlen(t->val))
+    {
+        ms_errlog_stderr(0, "config item \"%s\" is duplicated", t->key);
+        return MS_ERROR;
+    }
+
+    if (strlen(data) < 1 || strlen(data) >= sizeof(buff))
+    {
+        goto error;
+    }
+    strcpy(buff, data);
+
+    for (ptr = strtok_r(buff, ";", &saveptr); ptr != NULL;
+            ptr = strtok_r(NULL, ";", &saveptr))
+    {
+        colon = strchr(ptr, ':');
+        if (colon == NULL)
+        {
+            goto error;
+        }
+        *colon = EOS;
+
+        port = atoi(colon + 1);
+        if (inet_pton(AF_INET, ptr, &addr) != 1 || port < 1 || port > 65535
+                || strspn(colon + 1, "0123456789") != strlen(colon + 1))
+        {
+            goto error;
+        }
+    }
+
+    memset(t->val, 0, sizeof(t->val));
+    strcpy(t->val, data);
+    return MS_OK;
+
+error:
+    ms_errlog_stderr(0, "config item \"%s\" val \"%s\" is invalied", t->key,
+            data);
+    return MS_ERROR;
+}
+// @check_addrs() ok
+
+/***********************************************************
+ * @Func   : check_balance()
+ * @Author : lwp
+ * @Brief  : 检查负载均衡算法是否正确。
+ * @Param  : [in] t : 指向当前配置项的结构体
+ * @Param  : [in] data : 负载均衡配置项的值
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : rr/leastconn/hash 分别保存为 0/1/2
+ ***********************************************************/
+int check_balance(ms_conf_item_t *t, const char *data)
+{
+    char balance[3][10] = { "rr", "leastconn", "hash" };
+
+    if (strlen(t->val))
+    {
+        ms_errlog_stderr(0, "config item \"%s\" is duplicated", t->key);
+        return MS_ERROR;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (strcmp(data, balance[i]) == 0)
+        {
+            memset(t->val, 0, sizeof(t->val));
+            t->val[0] = '0' + i;
+
+            return MS_OK;
+        }
+    }
+
+    ms_errlog_stderr(0, "config item \"%s\" val \"%s\" is invalied", t->key,
+            data);
+    return MS_ERROR;
+}
+// @check_balance() ok
+
+/***********************************************************
+ * @Func   : check_policy()
+ * @Author : lwp
+ * @Brief  : 检查日志环满时的处理方式是否正确。
+ * @Param  : [in] t : 指向当前配置项的结构体
+ * @Param  : [in] data : 日志环满时处理方式配置项的值
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : drop/block 分别保存为 0/1
+ ***********************************************************/
+int check_policy(ms_conf_item_t *t, const char *data)
+{
+    char policy[2][10] = { "drop", "block" };
+
+    if (strlen(t->val))
+    {
+        ms_errlog_stderr(0, "config item \"%s\" is duplicated", t->key);
+        return MS_ERROR;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (strcmp(data, policy[i]) == 0)
+        {
+            memset(t->val, 0, sizeof(t->val));
+            t->val[0] = '0' + i;
+
+            return MS_OK;
+        }
+    }
+
+    ms_errlog_stderr(0, "config item \"%s\" val \"%s\" is invalied", t->key,
+            data);
+    return MS_ERROR;
+}
+// @check_policy() ok
+
 /***********************************************************
  * @Func   : check_str()
  * @Author : lwp
@@ -33,10 +33,14 @@ void ms_config_debug(void);
 int check_ipv4(ms_conf_item_t *t, const char *data);
 int check_port(ms_conf_item_t *t, const char *data);
 int check_file(ms_conf_item_t *t, const char *data);
+int check_file_off(ms_conf_item_t *t, const char *data);
 int check_dir(ms_conf_item_t *t, const char *data);
 int check_level(ms_conf_item_t *t, const char *data);
 int check_num(ms_conf_item_t *t, const char *data);
 int check_str(ms_conf_item_t *t, const char *data);
+int check_addrs(ms_conf_item_t *t, const char *data);
+int check_balance(ms_conf_item_t *t, const char *data);
+int check_policy(ms_conf_item_t *t, const char *data);
 
 #ifdef __cpluscplus
 }
@@ -178,7 +178,7 @@ int ms_errlog_init(const char *file, log_level_t level)
  * @Param  : [in] fmt : 输出格式
  * @Param  : [in] ... : 可变参数列表
  * @Return : NONE
- * @Note   :
+ * @Note   : 挂接了日志环的线程不调用 write()，见 ms_logring.h
  ***********************************************************/
 void ms_errlog_core(log_level_t level, int err, const char *file, int line,
         const char *func, const char *fmt, ...)
@@ -187,27 +187,31 @@ void ms_errlog_core(log_level_t level, int err, const char *file, int line,
     char *p;
     char *last;
     char errstr[MS_MAX_BUF_SIZE * 2];
+    pid_t pid;
+    pid_t tid;
     va_list args;
 
-    memset(&errstr, 0, sizeof(errstr));
     last = errstr + MS_MAX_BUF_SIZE * 2;
 
     // 获取时间戳
     p = ms_time_stamp(errstr, last);
 
+    // 挂接过日志环的线程使用缓存的进程与线程 ID
+    ms_logring_ids(&pid, &tid);
+
 #if (MS_ERRLOG_SHOW_FILE_LINE_FUNC)
     p = ms_str_slprintf(p, last, " [%s] [%P#%P] [%s-%05d-%s()] ",
             level_str[level],     // 日志级别
-            getpid(),             // 进程 ID
-            syscall(SYS_gettid),  // 线程 ID
+            pid,                  // 进程 ID
+            tid,                  // 线程 ID
             file,                 // 文件
             line,                 // 行号
             func);                // 函数
 #else
     p = ms_str_slprintf(p, last, " [%s] [%P#%P] ",
             level_str[level],     // 日志级别
-            getpid(),             // 进程 ID
-            syscall(SYS_gettid)); // 线程 ID
+            pid,                  // 进程 ID
+            tid);                 // 线程 ID
 #endif
 
     // 可变参数
@@ -228,6 +232,12 @@ void ms_errlog_core(log_level_t level, int err, const char *file, int line,
 
     *p++ = '\n';
 
+    // 挂接了日志环的线程只追加到环中，由 flusher 写入文件
+    if (ms_logring_write(MS_LOGRING_ERROR, errstr, p - errstr) == MS_OK)
+    {
+        return;
+    }
+
     do {
         nwrite = write(ms_errlog.fd, errstr, p - errstr);
     } while (nwrite == -1 && errno == EINTR);
@@ -284,13 +294,40 @@ int ms_errlog_reopen(void)
         ms_errlog_stderr(errno, "open() \"%s\" failed", ms_errlog.file);
         return MS_ERROR;
     }
-    ms_errlog_close();
+
+    // 线程模式下 worker 线程可能正在写入旧的句柄: 以 dup2() 原子地替换，
+    // 避免关闭后句柄号被其他线程的 accept4() 复用，日志写入客户端连接
+    if (ms_errlog.fd > 0)
+    {
+        if (dup2(temp, ms_errlog.fd) == -1)
+        {
+            ms_errlog_stderr(errno, "dup2() \"%s\" failed", ms_errlog.file);
+            close(temp);
+            return MS_ERROR;
+        }
+        close(temp);
+        return MS_OK;
+    }
     ms_errlog.fd = temp;
 
     return MS_OK;
 }
 // @ms_errlog_reopen() ok
 
+/***********************************************************
+ * @Func   : ms_errlog_fd()
+ * @Author : lwp
+ * @Brief  : 返回错误日志的文件句柄。
+ * @Param  : [in] NONE
+ * @Return : 文件句柄
+ * @Note   : 供 flusher 写入日志环中的错误日志
+ ***********************************************************/
+int ms_errlog_fd(void)
+{
+    return ms_errlog.fd;
+}
+// @ms_errlog_fd() ok
+
 /***********************************************************
  * @Func   : ms_errlog_errno()
  * @Author : lwp
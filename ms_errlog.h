@@ -11,6 +11,7 @@ extern "C"
 
 #include "ms_errno.h"
 #include "ms_time.h"
+#include "ms_logring.h"
 
 #define ms_errlog(level, err, ...)                                             \
     if (ms_errlog_level() >= level)                                            \
@@ -67,6 +68,7 @@ void ms_errlog_close(void);
 
 log_level_t ms_errlog_level(void);
 int ms_errlog_reopen(void);
+int ms_errlog_fd(void);
 
 #ifdef __cpluscplus
 }
@@ -1,24 +1,37 @@
 #include "ms_eventloop.h"
 
 static void ms_eventloop_timer_process(ms_event_loop_t *evlop);
+static void ms_eventloop_task_process(ms_event_loop_t *evlop);
+static void ms_eventloop_notify_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data);
+static ms_event_file_t *ms_eventloop_file_find(ms_event_loop_t *evlop,
+        int sockfd);
+static int ms_eventloop_uring_ctl(ms_event_loop_t *evlop, int sockfd,
+        ms_event_file_t *file, uint32_t mask);
+
+// io_uring 的 user_data: 高 32 位为 poll 请求的代数，低 32 位为文件句柄
+#define ms_eventloop_uring_data(gen, fd) \
+    (((uint64_t)(gen) << 32) | (uint32_t)(fd))
 
 /***********************************************************
  * @Func   : ms_eventloop_create()
  * @Author : lwp
  * @Brief  : 创建 eventloop。
- * @Param  : [in] event_size
+ * @Param  : [in] event_size : 单次等待返回的最大事件数
+ * @Param  : [in] max_files : 文件句柄的上限
  * @Param  : [in] pool_size : 内存池小块内存的大小
  * @Param  : [in] data_size : evlop->files[i]->data 的大小
+ * @Param  : [in] backend : MS_EVENTLOOP_EPOLL/MS_EVENTLOOP_URING
  * @Return : NULL : 失败
  *           evlop : 成功
- * @Note   : 
+ * @Note   : io_uring 创建失败时回退到 epoll；files 按页在首次使用时分配
  ***********************************************************/
-ms_event_loop_t *ms_eventloop_create(int event_size, int pool_size,
-        int data_size)
+ms_event_loop_t *ms_eventloop_create(int event_size, int max_files,
+        int pool_size, int data_size, int backend)
 {
     int poolsize = -1;
     int eventsize = -1;
-    void *pdata = NULL;
+    int maxfiles = -1;
     ms_mem_pool_t *pool = NULL;
     ms_event_loop_t *evlop = NULL;
 
@@ -27,6 +40,7 @@ ms_event_loop_t *ms_eventloop_create(int event_size, int pool_size,
         event_size : MS_EVENTS_DEFAULT_SIZE;
     poolsize = pool_size > MS_EVENTS_DEFAULT_SIZE ?
         pool_size : MS_EVENTS_DEFAULT_SIZE;
+    maxfiles = max_files > eventsize ? max_files : eventsize;
 
     // 创建内存池
     pool = ms_mem_pool_create(poolsize);
@@ -52,66 +66,74 @@ ms_event_loop_t *ms_eventloop_create(int event_size, int pool_size,
         goto end;
     }
 
-    // 创建 files 数组
-    evlop->files = (ms_event_file_t *)ms_mem_pool_pcalloc(evlop->pool,
-            eventsize * sizeof(ms_event_file_t));
-    if (NULL == evlop->files)
+    // 创建 files 页表，页在首次使用时分配
+    evlop->npages = (maxfiles + MS_EVENTS_PAGE_SIZE - 1) >> MS_EVENTS_PAGE_BITS;
+    evlop->pages = (ms_event_file_t **)ms_mem_pool_pcalloc(evlop->pool,
+            evlop->npages * sizeof(ms_event_file_t *));
+    if (NULL == evlop->pages)
     {
         goto end;
     }
+    evlop->maxfiles = maxfiles;
+    evlop->datasize = data_size > 0 ? data_size : 0;
 
-    // 创建 evlop->files[i]->data
-    if (data_size > 0)
+    // 创建定时器时间轮并初始化
+    evlop->timer = (ms_wheel_t *)ms_mem_pool_pcalloc(evlop->pool,
+            sizeof(ms_wheel_t));
+    if (NULL == evlop->timer)
     {
-        pdata = ms_mem_pool_pcalloc(evlop->pool, eventsize * data_size);
-        if (NULL == pdata)
-        {
-            goto end;
-        }
+        goto end;
+    }
+    ms_wheel_init(evlop->timer, ms_time_ms());
+
+    // 创建缓冲区池
+    evlop->bufs = (ms_buf_pool_t *)ms_mem_pool_pcalloc(evlop->pool,
+            sizeof(ms_buf_pool_t));
+    if (NULL == evlop->bufs)
+    {
+        goto end;
     }
+    ms_buf_pool_init(evlop->bufs, MS_BUF_DEFAULT_SIZE, MS_BUF_MAX_FREE);
 
-    // 初始化 files
-    for (int i = 0; i < eventsize; i++)
+    // 创建 io_uring
+    evlop->uring = NULL;
+    if (backend == MS_EVENTLOOP_URING)
     {
-        evlop->files[i].mask = MS_EVENTLOOP_NONE;
-        evlop->files[i].rproc = NULL;
-        evlop->files[i].wproc = NULL;
-        if (data_size > 0)
+        evlop->uring = (ms_uring_t *)ms_mem_pool_pcalloc(evlop->pool,
+                sizeof(ms_uring_t));
+        if (NULL == evlop->uring)
         {
-            evlop->files[i].data = pdata;
-            pdata = (char *)pdata + data_size;
+            goto end;
         }
-        else
+
+        if (ms_uring_create(evlop->uring, eventsize) == MS_ERROR)
         {
-            evlop->files[i].data = NULL;
+            ms_errlog(MS_ERRLOG_WARN, 0, ELP_TAG
+                    "io_uring unavailable, fallback to epoll");
+            evlop->uring = NULL;
         }
     }
 
-    // 创建定时器管理结构体并初始化
-    evlop->timer = (ms_event_rbtree_t *)ms_mem_pool_pcalloc(evlop->pool,
-            sizeof(ms_event_rbtree_t));
-    evlop->timer->tree = (ms_rbtree_t *)ms_mem_pool_pcalloc(evlop->pool,
-            sizeof(ms_rbtree_t));
-    evlop->timer->sentinel = (ms_rbtree_node_t *)ms_mem_pool_pcalloc(evlop->pool,
-            sizeof(ms_rbtree_node_t));
-    if (NULL == evlop->timer || NULL == evlop->timer->tree ||
-            NULL == evlop->timer->sentinel)
+    // 创建 epfd
+    if (evlop->uring != NULL)
     {
-        goto end;
+        evlop->epfd = evlop->uring->fd;
     }
-    ms_rbtree_init(evlop->timer->tree, evlop->timer->sentinel,
-            ms_rbtree_insert_timer_value);
-
-    // 创建 epfd
-    evlop->epfd = ms_epoll_create(eventsize);
-    if (MS_ERROR == evlop->epfd)
+    else
     {
-        goto end;
+        evlop->epfd = ms_epoll_create(eventsize);
+        if (MS_ERROR == evlop->epfd)
+        {
+            goto end;
+        }
     }
 
-    evlop->size = eventsize; // events 与 files 的最大容量
+    evlop->size = eventsize; // events 的容量
     evlop->stop = 0; // evlop 停止的标志
     evlop->free = NULL; // 初始空闲定时器回收链表
+    evlop->tasks = NULL; // 待处理任务的栈
+    evlop->notified = 0;
+    evlop->stats = NULL;
     evlop->data1 = NULL;
     evlop->data2 = NULL;
     evlop->data3 = NULL;
@@ -121,9 +143,26 @@ ms_event_loop_t *ms_eventloop_create(int event_size, int pool_size,
     evlop->data7 = NULL;
     evlop->data8 = NULL;
 
+    // 创建 eventfd 并注册读事件，用于其他线程唤醒 eventloop
+    evlop->notifyfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (evlop->notifyfd == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, ELP_TAG "eventfd() failed");
+        goto end;
+    }
+
+    if (ms_eventloop_file_add(evlop, evlop->notifyfd, EPOLLIN,
+                (const ms_event_file_proc *)ms_eventloop_notify_handler,
+                NULL) == MS_ERROR)
+    {
+        close(evlop->notifyfd);
+        goto end;
+    }
+
     ms_errlog(MS_ERRLOG_INFO, 0, ELP_TAG
-            "create eventloop \"%p\" size \"%d\" epfd \"%06d\"",
-            evlop, evlop->size, evlop->epfd);
+            "create eventloop \"%p\" size \"%d\" maxfiles \"%d\" epfd \"%06d\" backend \"%s\"",
+            evlop, evlop->size, evlop->maxfiles, evlop->epfd,
+            evlop->uring ? "io_uring" : "epoll");
     return evlop;
 
 end:
@@ -155,17 +194,38 @@ void ms_eventloop_destory(ms_event_loop_t *evlop)
             evlop, evlop->size, evlop->epfd);
 
     // 关闭文件句柄
-    for (int i = 0; i < evlop->size; i++)
+    for (int i = 0; i < evlop->npages; i++)
     {
-        file = &(evlop->files[i]);
-        if (file->mask != MS_EVENTLOOP_NONE)
+        if (evlop->pages[i] == NULL)
         {
-            close(i);
+            continue;
+        }
+
+        for (int j = 0; j < MS_EVENTS_PAGE_SIZE; j++)
+        {
+            file = &(evlop->pages[i][j]);
+            if (file->mask != MS_EVENTLOOP_NONE)
+            {
+                close((i << MS_EVENTS_PAGE_BITS) + j);
+            }
         }
     }
 
     // 关闭 epfd
-    close(evlop->epfd);
+    if (evlop->uring != NULL)
+    {
+        ms_uring_close(evlop->uring);
+    }
+    else
+    {
+        close(evlop->epfd);
+    }
+
+    // 释放缓冲区池
+    ms_errlog(MS_ERRLOG_INFO, 0, ELP_TAG
+            "buf pool alloc \"%uL\" free \"%uL\"",
+            (uint64_t)evlop->bufs->nalloc, (uint64_t)evlop->bufs->nfree);
+    ms_buf_pool_destory(evlop->bufs);
 
     // 销毁内存池
     pool = evlop->pool;
@@ -173,6 +233,63 @@ void ms_eventloop_destory(ms_event_loop_t *evlop)
 }
 // @ms_eventloop_destory() ok
 
+/***********************************************************
+ * @Func   : ms_eventloop_file_get()
+ * @Author : lwp
+ * @Brief  : 获取 sockfd 对应的文件属性，所在页不存在时分配并初始化。
+ * @Param  : [in] evlop
+ * @Param  : [in] sockfd
+ * @Return : NULL : sockfd 超过上限或分配失败
+ *           file : 成功
+ * @Note   : 页及其 data 分配后地址不再变化
+ ***********************************************************/
+ms_event_file_t *ms_eventloop_file_get(ms_event_loop_t *evlop, int sockfd)
+{
+    int index;
+    char *pdata = NULL;
+    ms_event_file_t *page = NULL;
+
+    if (sockfd < 0 || sockfd >= evlop->maxfiles)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, ELP_TAG
+                "fd \"%06d\" exceeds max files \"%d\"", sockfd, evlop->maxfiles);
+        return NULL;
+    }
+
+    index = sockfd >> MS_EVENTS_PAGE_BITS;
+    page = evlop->pages[index];
+    if (page != NULL)
+    {
+        return &(page[sockfd & MS_EVENTS_PAGE_MASK]);
+    }
+
+    // 分配新页，data 紧跟在 files 之后
+    page = (ms_event_file_t *)ms_mem_pool_pcalloc(evlop->pool,
+            MS_EVENTS_PAGE_SIZE * (sizeof(ms_event_file_t) + evlop->datasize));
+    if (NULL == page)
+    {
+        return NULL;
+    }
+
+    pdata = (char *)(page + MS_EVENTS_PAGE_SIZE);
+    for (int i = 0; i < MS_EVENTS_PAGE_SIZE; i++)
+    {
+        page[i].mask = MS_EVENTLOOP_NONE;
+        page[i].rproc = NULL;
+        page[i].wproc = NULL;
+        page[i].gen = 0;
+        page[i].armed = 0;
+        page[i].data = evlop->datasize > 0 ? pdata + i * evlop->datasize : NULL;
+    }
+    evlop->pages[index] = page;
+
+    ms_errlog(MS_ERRLOG_INFO, 0, ELP_TAG
+            "alloc files page \"%d\" on epfd \"%06d\"", index, evlop->epfd);
+
+    return &(page[sockfd & MS_EVENTS_PAGE_MASK]);
+}
+// @ms_eventloop_file_get() ok
+
 /***********************************************************
  * @Func   : ms_eventloop_file_add()
  * @Author : lwp
@@ -193,23 +310,31 @@ int ms_eventloop_file_add(ms_event_loop_t *evlop, int sockfd,
     ms_event_file_t *file = NULL;
     struct epoll_event ev = { 0 };
 
-    // 参数检测
-    if (sockfd >= evlop->size)
+    // 获取 sockfd 文件句柄对应的数据结构，所在页不存在时分配
+    file = ms_eventloop_file_get(evlop, sockfd);
+    if (NULL == file)
     {
-        ms_errlog(MS_ERRLOG_ERR, 0, ELP_TAG "eventloop event queue full");
         return MS_ERROR;
     }
 
-    // 获取 sockfd 文件句柄对应的数据结构
-    file = &(evlop->files[sockfd]);
-
     // 先注册 epoll
-    op = (file->mask == MS_EVENTLOOP_NONE) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
-    ev.data.fd = sockfd;
-    ev.events = file->mask | mask;
-    if (ms_epoll_ctl(evlop->epfd, op, sockfd, &ev) == MS_ERROR)
+    if (evlop->uring != NULL)
     {
-        return MS_ERROR;
+        if (ms_eventloop_uring_ctl(evlop, sockfd, file, file->mask | mask)
+                == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+    }
+    else
+    {
+        op = (file->mask == MS_EVENTLOOP_NONE) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        ev.data.fd = sockfd;
+        ev.events = file->mask | mask;
+        if (ms_epoll_ctl(evlop->epfd, op, sockfd, &ev) == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
     }
 
     // 后设置 files 列表属性
@@ -253,23 +378,30 @@ int ms_eventloop_file_mod(ms_event_loop_t *evlop, int sockfd,
     ms_event_file_t *file = NULL;
     struct epoll_event ev = { 0 };
 
-    // 参数检测
-    if (sockfd >= evlop->size)
+    // 获取 sockfd 文件句柄对应的数据结构，所在页不存在时分配
+    file = ms_eventloop_file_get(evlop, sockfd);
+    if (NULL == file)
     {
-        ms_errlog(MS_ERRLOG_ERR, 0, ELP_TAG "eventloop event queue full");
         return MS_ERROR;
     }
 
-    // 获取 sockfd 文件句柄对应的数据结构
-    file = &(evlop->files[sockfd]);
-
     // 先注册 epoll
-    op = (file->mask == MS_EVENTLOOP_NONE) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
-    ev.data.fd = sockfd;
-    ev.events = mask;
-    if (ms_epoll_ctl(evlop->epfd, op, sockfd, &ev) == MS_ERROR)
+    if (evlop->uring != NULL)
     {
-        return MS_ERROR;
+        if (ms_eventloop_uring_ctl(evlop, sockfd, file, mask) == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+    }
+    else
+    {
+        op = (file->mask == MS_EVENTLOOP_NONE) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        ev.data.fd = sockfd;
+        ev.events = mask;
+        if (ms_epoll_ctl(evlop->epfd, op, sockfd, &ev) == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
     }
 
     // 后设置 files 列表属性
@@ -309,15 +441,9 @@ void ms_eventloop_file_del(ms_event_loop_t *evlop, int sockfd, uint32_t mask)
     ms_event_file_t *file = NULL;
     struct epoll_event ev = { 0 };
 
-    // 范围检测
-    if (sockfd >= evlop->size)
-    {
-        return;
-    }
-
-    // 状态检测
-    file = &(evlop->files[sockfd]);
-    if (file->mask == MS_EVENTLOOP_NONE)
+    // 范围及状态检测
+    file = ms_eventloop_file_find(evlop, sockfd);
+    if (file == NULL || file->mask == MS_EVENTLOOP_NONE)
     {
         return;
     }
@@ -325,7 +451,11 @@ void ms_eventloop_file_del(ms_event_loop_t *evlop, int sockfd, uint32_t mask)
     // 先设置 epoll_ctl()
     ev.data.fd = sockfd;
     ev.events = file->mask & (~mask);
-    if (ev.events == MS_EVENTLOOP_NONE)
+    if (evlop->uring != NULL)
+    {
+        ms_eventloop_uring_ctl(evlop, sockfd, file, ev.events);
+    }
+    else if (ev.events == MS_EVENTLOOP_NONE)
     {
         ms_epoll_ctl(evlop->epfd, EPOLL_CTL_DEL, sockfd, &ev);
     }
@@ -376,7 +506,7 @@ ms_event_timer_t *ms_eventloop_timer_add(ms_event_loop_t *evlop, int ms,
             return NULL;
         }
     }
-    memset(timer, 0, sizeof(ms_event_rbtree_t));
+    memset(timer, 0, sizeof(ms_event_timer_t));
 
     // 设置定时器属性
     timer->node.key = ms_time_ms() + ms;
@@ -384,8 +514,8 @@ ms_event_timer_t *ms_eventloop_timer_add(ms_event_loop_t *evlop, int ms,
     timer->data = data;
     timer->next = NULL;
 
-    // 将定时器加入红黑树中
-    ms_rbtree_insert(evlop->timer->tree, &(timer->node));
+    // 将定时器加入时间轮中
+    ms_wheel_add(evlop->timer, &(timer->node));
 
     ms_errlog(MS_ERRLOG_INFO, 0, ELP_TAG
             "add timer \"%p\" on epfd \"%06d\", timeout \"%d\"",
@@ -406,8 +536,8 @@ ms_event_timer_t *ms_eventloop_timer_add(ms_event_loop_t *evlop, int ms,
  ***********************************************************/
 void ms_eventloop_timer_del(ms_event_loop_t *evlop, ms_event_timer_t *timer)
 {
-    // 将定时器从红黑树中删除
-    ms_rbtree_delete(evlop->timer->tree, &(timer->node));
+    // 将定时器从时间轮中删除
+    ms_wheel_del(evlop->timer, &(timer->node));
 
     // 将定时器加入空闲链表，准备重复利用
     timer->next = evlop->free;
@@ -433,42 +563,33 @@ void ms_eventloop_main(ms_event_loop_t *evlop, int maxtimeout)
     uint32_t mask;
     int sockfd;
     int timeout;
+    intptr_t timer_timeout;
+    uint64_t ts = 0;
     ms_event_file_t *file;
-    ms_rbtree_node_t *rbtree_node;
+    ms_stats_worker_t *st = evlop->stats;
 
     if (maxtimeout < 0)
     {
         maxtimeout = -1;
     }
 
-    while (!evlop->stop)
+    while (!__atomic_load_n(&(evlop->stop), __ATOMIC_RELAXED))
     {
         timeout = maxtimeout;
 
-        // 若红黑树中存在定时器取最小的超时时间作为 timeout 的值
-        if (evlop->timer->tree->root != evlop->timer->tree->sentinel)
+        // 若时间轮中存在定时器取下一次推进时间轮的时间作为 timeout 的值
+        timer_timeout = ms_wheel_timeout(evlop->timer, ms_time_ms());
+        if (timer_timeout >= 0)
         {
-            rbtree_node = ms_rbtree_min(evlop->timer->tree->root,
-                    evlop->timer->tree->sentinel);
-
             // timeout = -1
             if (timeout < 0)
             {
-                // 可正可负
-                timeout = rbtree_node->key - ms_time_ms();
+                timeout = timer_timeout;
             }
             // timeout >= 0
             else
             {
-                // 可正可负
-                timeout = ms_min((int64_t)(rbtree_node->key - ms_time_ms()),
-                    (int64_t)maxtimeout);
-            }
-
-            // 当前事件已经超时，epoll_wait() 立即返回
-            if (timeout < 0)
-            {
-                timeout = 0;
+                timeout = ms_min(timer_timeout, (intptr_t)maxtimeout);
             }
         }
         /*
@@ -483,14 +604,55 @@ void ms_eventloop_main(ms_event_loop_t *evlop, int maxtimeout)
 
         ms_errlog(MS_ERRLOG_INFO, 0, ELP_TAG "use timeout \"%d\"", timeout);
 
-        nfds = ms_epoll_wait(evlop->epfd, evlop->events, evlop->size, timeout);
+        // 各阶段的耗时只在开启统计时计时
+        ts = st != NULL ? ms_time_ns() : 0;
+
+        if (evlop->uring != NULL)
+        {
+            nfds = ms_uring_wait(evlop->uring, evlop->events, evlop->size,
+                    timeout);
+        }
+        else
+        {
+            nfds = ms_epoll_wait(evlop->epfd, evlop->events, evlop->size,
+                    timeout);
+        }
+        ms_stats_add(st, loops, 1);
+        ms_stats_add(st, events, nfds > 0 ? nfds : 0);
+        ms_stats_hist(st, wait, ms_time_ns() - ts);
+        ms_stats_hist(st, batch, nfds > 0 ? nfds : 0);
+
         // 处理读写事件
         for (int i = 0; i < nfds; i++)
         {
             sockfd = evlop->events[i].data.fd;
             mask = evlop->events[i].events;
 
-            file = &(evlop->files[sockfd]);
+            // io_uring: 丢弃已被取消或重新注册的 poll 请求的完成事件
+            if (evlop->uring != NULL)
+            {
+                sockfd = (int)(uint32_t)evlop->events[i].data.u64;
+                file = ms_eventloop_file_find(evlop, sockfd);
+                if (file == NULL || !file->armed
+                        || file->gen != (uint32_t)(evlop->events[i].data.u64 >> 32))
+                {
+                    continue;
+                }
+                file->armed = 0;
+
+                // poll 请求失败时只有 EPOLLERR: 交给注册的回调，由其读写时得知错误并决定是否关闭，
+                // 否则该 fd 既不回调也不再注册，没有定时器的 fd(监听套接字等)永远失效
+                if (mask == EPOLLERR)
+                {
+                    mask |= file->mask & (EPOLLIN | EPOLLOUT);
+                }
+            }
+
+            file = ms_eventloop_file_find(evlop, sockfd);
+            if (file == NULL)
+            {
+                continue;
+            }
             ms_errlog(MS_ERRLOG_INFO, 0, ELP_TAG
                     "get fd \"%06d\" mask \"%010uD\" on epfd \"%06d\"",
                     sockfd, mask, evlop->epfd);
@@ -499,36 +661,102 @@ void ms_eventloop_main(ms_event_loop_t *evlop, int maxtimeout)
             {
                 ms_errlog(MS_ERRLOG_INFO, 0, ELP_TAG "run rproc() \"%p\"",
                         file->rproc);
+                ts = st != NULL ? ms_time_ns() : 0;
                 file->rproc(evlop, sockfd, mask, file->data);
+                ms_stats_hist(st, rproc, ms_time_ns() - ts);
             }
 
             if (file->mask & mask & EPOLLOUT)
             {
                 ms_errlog(MS_ERRLOG_INFO, 0, ELP_TAG "run wproc() \"%p\"",
                         file->wproc);
+                ts = st != NULL ? ms_time_ns() : 0;
                 file->wproc(evlop, sockfd, mask, file->data);
+                ms_stats_hist(st, wproc, ms_time_ns() - ts);
+            }
+
+            // io_uring 的 poll 请求是一次性的，回调中未重新注册时需再次注册
+            if (evlop->uring != NULL && !file->armed
+                    && file->mask != MS_EVENTLOOP_NONE)
+            {
+                ms_eventloop_uring_ctl(evlop, sockfd, file, file->mask);
             }
         }
 
         // 处理超时事件
+        ts = st != NULL ? ms_time_ns() : 0;
         ms_eventloop_timer_process(evlop);
+        ms_stats_hist(st, timer, ms_time_ns() - ts);
+        ms_stats_set(st, timers, evlop->timer->count);
+
+        // 处理其他线程投递的任务
+        ms_eventloop_task_process(evlop);
     }
 
     ms_errlog(MS_ERRLOG_DEBUG, 0, ELP_TAG "stop eventloop");
 }
 // @ms_eventloop_main() ok
 
+/***********************************************************
+ * @Func   : ms_eventloop_task_post()
+ * @Author : lwp
+ * @Brief  : 向 eventloop 投递任务，任务在 eventloop 所在线程中执行。
+ * @Param  : [in] evlop
+ * @Param  : [in] task : task->proc 与 task->data 由调用者设置
+ * @Return : NONE
+ * @Note   : 线程安全，无锁；任务结点在 proc 被调用前不可释放，
+ *           同一线程投递的任务按投递顺序执行
+ ***********************************************************/
+void ms_eventloop_task_post(ms_event_loop_t *evlop, ms_event_task_t *task)
+{
+    ms_event_task_t *head = __atomic_load_n(&(evlop->tasks), __ATOMIC_RELAXED);
+
+    // 压入任务栈
+    do {
+        task->next = head;
+    } while (!__atomic_compare_exchange_n(&(evlop->tasks), &head, task, 1,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    ms_eventloop_wakeup(evlop);
+}
+// @ms_eventloop_task_post() ok
+
+/***********************************************************
+ * @Func   : ms_eventloop_wakeup()
+ * @Author : lwp
+ * @Brief  : 唤醒阻塞在 epoll_wait()/io_uring 中的 eventloop。
+ * @Param  : [in] evlop
+ * @Return : NONE
+ * @Note   : 线程安全，可在信号处理函数中调用；eventloop 处理唤醒前的多次调用只写一次 eventfd
+ ***********************************************************/
+void ms_eventloop_wakeup(ms_event_loop_t *evlop)
+{
+    uint64_t one = 1;
+    ssize_t nwrite;
+
+    if (__atomic_exchange_n(&(evlop->notified), 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+
+    do {
+        nwrite = write(evlop->notifyfd, &one, sizeof(one));
+    } while (nwrite == -1 && errno == EINTR);
+}
+// @ms_eventloop_wakeup() ok
+
 /***********************************************************
  * @Func   : ms_eventloop_stop()
  * @Author : lwp
  * @Brief  : 停止 eventloop。
  * @Param  : [in] NONE
  * @Return : NONE
- * @Note   : 
+ * @Note   : 可由其他线程或信号处理函数调用，唤醒 eventloop 后立即退出
  ***********************************************************/
 void ms_eventloop_stop(ms_event_loop_t *evlop)
 {
-    evlop->stop = 1;
+    __atomic_store_n(&(evlop->stop), 1, __ATOMIC_RELAXED);
+    ms_eventloop_wakeup(evlop);
 }
 // ms_eventloop_stop() ok
 
@@ -542,40 +770,173 @@ void ms_eventloop_stop(ms_event_loop_t *evlop)
  ***********************************************************/
 static void ms_eventloop_timer_process(ms_event_loop_t *evlop)
 {
-    ms_rbtree_node_t *rbtree_node = NULL;
+    ms_wheel_node_t *wheel_node = NULL;
     ms_event_timer_t *timer = NULL;
+    uintptr_t now = ms_time_ms();
     uint32_t i = 0;
 
-    while (evlop->timer->tree->root != evlop->timer->tree->sentinel)
+    // 剩余的定时器未超时时返回 NULL
+    while ((wheel_node = ms_wheel_expire(evlop->timer, now)) != NULL)
     {
-        rbtree_node = ms_rbtree_min(evlop->timer->tree->root,
-                evlop->timer->tree->sentinel);
-        if (rbtree_node->key <= ms_time_ms())
-        {
-            timer = (ms_event_timer_t *)rbtree_node;
+        timer = (ms_event_timer_t *)wheel_node;
 
-            // 将定时器从 evlop 中删除
-            ms_eventloop_timer_del(evlop, timer);
+        // 将定时器从 evlop 中删除
+        ms_eventloop_timer_del(evlop, timer);
 
-            ms_errlog(MS_ERRLOG_INFO, 0,
-                    ELP_TAG "run timer \"%p\" on epfd \"%06d\"",
-                    timer, evlop->epfd);
+        ms_errlog(MS_ERRLOG_INFO, 0,
+                ELP_TAG "run timer \"%p\" on epfd \"%06d\"",
+                timer, evlop->epfd);
 
-            // 处理超时事件
-            timer->proc(evlop, timer->data);
-            if ((i++) > MS_MAX_PROCE_TIMEOUT_EVENTS_PER_LOOP)
-            {
-                ms_errlog(MS_ERRLOG_ERR, 0,
-                    ELP_TAG "timeout events too much(perloop > %D), please check config",
-                    MS_MAX_PROCE_TIMEOUT_EVENTS_PER_LOOP);
-                break;
-            }
-        }
-        else
+        // 处理超时事件
+        timer->proc(evlop, timer->data);
+        if ((i++) > MS_MAX_PROCE_TIMEOUT_EVENTS_PER_LOOP)
         {
-            // 剩余的定时器未超时
+            ms_errlog(MS_ERRLOG_ERR, 0,
+                ELP_TAG "timeout events too much(perloop > %D), please check config",
+                MS_MAX_PROCE_TIMEOUT_EVENTS_PER_LOOP);
             break;
         }
     }
 }
 // @ms_eventloop_timer_process() ok
+
+/***********************************************************
+ * @Func   : ms_eventloop_uring_ctl()
+ * @Author : lwp
+ * @Brief  : 将 sockfd 在 io_uring 中的 poll 请求重置为 mask。
+ * @Param  : [in] evlop
+ * @Param  : [in] sockfd
+ * @Param  : [in] file
+ * @Param  : [in] mask : MS_EVENTLOOP_NONE 时仅取消旧的 poll 请求
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : 只写入 SQ，在下一次 ms_uring_wait() 时统一提交
+ ***********************************************************/
+static int ms_eventloop_uring_ctl(ms_event_loop_t *evlop, int sockfd,
+        ms_event_file_t *file, uint32_t mask)
+{
+    // 取消旧的 poll 请求，其完成事件因代数不同被丢弃
+    if (file->armed)
+    {
+        ms_uring_poll_del(evlop->uring,
+                ms_eventloop_uring_data(file->gen, sockfd));
+        file->armed = 0;
+    }
+    file->gen++;
+
+    if ((mask & (EPOLLIN | EPOLLOUT)) == 0)
+    {
+        return MS_OK;
+    }
+
+    // 一次性 poll 请求，不支持 EPOLLET/EPOLLONESHOT/EPOLLEXCLUSIVE
+    if (ms_uring_poll_add(evlop->uring, sockfd,
+                mask & ~(EPOLLET | EPOLLONESHOT | EPOLLEXCLUSIVE),
+                ms_eventloop_uring_data(file->gen, sockfd)) == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+    file->armed = 1;
+
+    return MS_OK;
+}
+// @ms_eventloop_uring_ctl() ok
+
+/***********************************************************
+ * @Func   : ms_eventloop_file_find()
+ * @Author : lwp
+ * @Brief  : 查找 sockfd 对应的文件属性，不分配新页。
+ * @Param  : [in] evlop
+ * @Param  : [in] sockfd
+ * @Return : NULL : sockfd 超过上限或所在页不存在
+ *           file : 成功
+ * @Note   :
+ ***********************************************************/
+static ms_event_file_t *ms_eventloop_file_find(ms_event_loop_t *evlop,
+        int sockfd)
+{
+    ms_event_file_t *page = NULL;
+
+    if (sockfd < 0 || sockfd >= evlop->maxfiles)
+    {
+        return NULL;
+    }
+
+    page = evlop->pages[sockfd >> MS_EVENTS_PAGE_BITS];
+    if (page == NULL)
+    {
+        return NULL;
+    }
+
+    return &(page[sockfd & MS_EVENTS_PAGE_MASK]);
+}
+// @ms_eventloop_file_find() ok
+
+/***********************************************************
+ * @Func   : ms_eventloop_task_process()
+ * @Author : lwp
+ * @Brief  : 取出所有已投递的任务，按投递顺序执行。
+ * @Param  : [in] evlop
+ * @Return : NONE
+ * @Note   : 先清除唤醒标志再取任务，取出之后投递的任务会再次唤醒 eventloop
+ ***********************************************************/
+static void ms_eventloop_task_process(ms_event_loop_t *evlop)
+{
+    ms_event_task_t *list = NULL;
+    ms_event_task_t *task = NULL;
+    ms_event_task_t *next = NULL;
+
+    if (__atomic_load_n(&(evlop->tasks), __ATOMIC_RELAXED) == NULL)
+    {
+        return;
+    }
+
+    __atomic_store_n(&(evlop->notified), 0, __ATOMIC_SEQ_CST);
+    task = __atomic_exchange_n(&(evlop->tasks), NULL, __ATOMIC_ACQUIRE);
+
+    // 栈为后进先出，反转后按投递顺序执行
+    while (task)
+    {
+        next = task->next;
+        task->next = list;
+        list = task;
+        task = next;
+    }
+
+    while (list)
+    {
+        task = list;
+        list = list->next;
+        task->proc(evlop, task->data);
+    }
+}
+// @ms_eventloop_task_process() ok
+
+/***********************************************************
+ * @Func   : ms_eventloop_notify_handler()
+ * @Author : lwp
+ * @Brief  : 读取 eventfd 计数，清除其可读状态。
+ * @Param  : [in] evlop
+ * @Param  : [in] sockfd : evlop->notifyfd
+ * @Param  : [in] mask
+ * @Param  : [in] data
+ * @Return : NONE
+ * @Note   : 任务在本轮循环末尾由 ms_eventloop_task_process() 执行
+ ***********************************************************/
+static void ms_eventloop_notify_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data)
+{
+    uint64_t count;
+    ssize_t nread;
+
+    do {
+        nread = read(sockfd, &count, sizeof(count));
+    } while (nread == -1 && errno == EINTR);
+
+    // 仅唤醒而没有任务时(如 ms_eventloop_stop())清除唤醒标志
+    if (__atomic_load_n(&(evlop->tasks), __ATOMIC_RELAXED) == NULL)
+    {
+        __atomic_store_n(&(evlop->notified), 0, __ATOMIC_SEQ_CST);
+    }
+}
+// @ms_eventloop_notify_handler() ok
@@ -12,23 +12,36 @@ extern "C"
 
 #include "ms_mem.h"    // 内存池
 #include "ms_epoll.h"  // epoll 异步 I/O
-#include "ms_rbtree.h" // 定时器
+#include "ms_uring.h"  // io_uring 异步 I/O
+#include "ms_wheel.h"  // 定时器
+#include "ms_buf.h"    // 链式缓冲区
+#include "ms_stats.h"  // 统计计数
 
 #define MS_EVENTS_DEFAULT_SIZE 1024
+
+// files 以两级页表存储: 每页 MS_EVENTS_PAGE_SIZE 个文件句柄，首次使用时分配，
+// 分配后地址不再变化，已分配的 files[i]->data 不会被移动
+#define MS_EVENTS_PAGE_BITS 10
+#define MS_EVENTS_PAGE_SIZE (1 << MS_EVENTS_PAGE_BITS)
+#define MS_EVENTS_PAGE_MASK (MS_EVENTS_PAGE_SIZE - 1)
 #define MS_MAX_PROCE_TIMEOUT_EVENTS_PER_LOOP 100000
 
 #define MS_EVENTLOOP_NONE 0
 #define MS_EVENTLOOP_ALL  0xffffffff
 
+#define MS_EVENTLOOP_EPOLL 0 // 使用 epoll
+#define MS_EVENTLOOP_URING 1 // 使用 io_uring，不支持时回退到 epoll
+
 #define ELP_TAG "[EVENTLOOP] "
 
 typedef struct epoll_event       ms_event_epoll_t;
 typedef struct ms_event_loop_s   ms_event_loop_t;
 typedef struct ms_event_file_s   ms_event_file_t;
 typedef struct ms_event_timer_s  ms_event_timer_t;
-typedef struct ms_event_rbtree_s ms_event_rbtree_t;
+typedef struct ms_event_task_s   ms_event_task_t;
 
 typedef void ms_event_timer_proc(ms_event_loop_t *evlop, void *data);
+typedef void ms_event_task_proc(ms_event_loop_t *evlop, void *data);
 typedef void ms_event_file_proc(ms_event_loop_t *evlop, int sockfd,
         uint32_t mask, void *data);
 
@@ -38,46 +51,60 @@ struct ms_event_file_s {
     ms_event_file_proc *rproc; // 处理可读事件的回调函数
     ms_event_file_proc *wproc; // 处理可写事件的回调函数
     void               *data;  // 回调函数的 data 参数
-};
-
-// 红黑树管理结构体
-struct ms_event_rbtree_s {
-    ms_rbtree_t      *tree;     // 根结点
-    ms_rbtree_node_t *sentinel; // 哨兵结点
+    uint32_t            gen;   // io_uring: poll 请求的代数，用于丢弃过期的完成事件
+    uint32_t            armed; // io_uring: 是否存在未完成的 poll 请求
 };
 
 // 定时器结点
 struct ms_event_timer_s {
-    ms_rbtree_node_t     node; // 红黑树结点
+    ms_wheel_node_t      node; // 时间轮结点
     ms_event_timer_proc *proc; // 处理超时事件的回调函数
-    ms_event_timer_t    *next; // 下一个定时器结点，空闲红黑树结点以链表存储
+    ms_event_timer_t    *next; // 下一个定时器结点，空闲定时器结点以链表存储
     void                *data; // 回调函数的 data 参数
 };
 
+// 任务结点，由投递者分配，在 eventloop 所在线程中执行
+struct ms_event_task_s {
+    ms_event_task_t    *next; // 下一个任务结点
+    ms_event_task_proc *proc; // 处理任务的回调函数
+    void               *data; // 回调函数的 data 参数
+};
+
 // eventloop 结构体
 struct ms_event_loop_s {
-    ms_mem_pool_t     *pool;   // 内存池指针
-    ms_event_file_t   *files;  // 存储文件属性的数组
-    ms_event_epoll_t  *events; // 存储注册事件的数组
-    ms_event_rbtree_t *timer;  // 定时器管理结构体
-    ms_event_timer_t  *free;   // 存储空闲定时器结点的链表
-    int                epfd;   // epfd 文件句柄
-    int                size;   // events 与 files 的最大容量
-    int                stop;   // eventloop 停止的标志
-    void              *data1;  // 待定
-    void              *data2;  // 待定
-    void              *data3;  // 待定
-    void              *data4;  // 待定
-    void              *data5;  // 待定
-    void              *data6;  // 待定
-    void              *data7;  // 待定
-    void              *data8;  // 待定
+    ms_mem_pool_t     *pool;     // 内存池指针
+    ms_event_file_t  **pages;    // 存储文件属性的页表，按文件句柄索引
+    ms_event_epoll_t  *events;   // 存储就绪事件的数组
+    ms_wheel_t        *timer;    // 定时器时间轮
+    ms_event_timer_t  *free;     // 存储空闲定时器结点的链表
+    ms_buf_pool_t     *bufs;     // 缓冲区池，供连接的缓冲区链使用
+    ms_uring_t        *uring;    // io_uring，为 NULL 时使用 epoll
+    ms_event_task_t   *tasks;    // 待处理任务的栈，多个线程无锁压入，eventloop 整体取出
+    int                epfd;     // epfd 文件句柄(io_uring 时为 ring 的文件句柄)
+    int                size;     // events 的容量，即单次等待返回的最大事件数
+    int                maxfiles; // 文件句柄的上限
+    int                npages;   // 页表的页数
+    int                datasize; // files[i]->data 的大小
+    int                stop;     // eventloop 停止的标志
+    int                notifyfd; // 唤醒 eventloop 的 eventfd
+    int                notified; // 是否已写入 notifyfd，用于合并多次唤醒
+    ms_stats_worker_t *stats;    // 统计计数，为 NULL 时不统计
+    void              *data1;    // 待定
+    void              *data2;    // 待定
+    void              *data3;    // 待定
+    void              *data4;    // 待定
+    void              *data5;    // 待定
+    void              *data6;    // 待定
+    void              *data7;    // 待定
+    void              *data8;    // 待定
 };
 
-ms_event_loop_t *ms_eventloop_create(int event_size, int pool_size,
-        int data_size);
+ms_event_loop_t *ms_eventloop_create(int event_size, int max_files,
+        int pool_size, int data_size, int backend);
 void ms_eventloop_destory(ms_event_loop_t *evlop);
 
+ms_event_file_t *ms_eventloop_file_get(ms_event_loop_t *evlop, int sockfd);
+
 int ms_eventloop_file_add(ms_event_loop_t *evlop, int sockfd,
         uint32_t mask, const ms_event_file_proc *proc, void *data);
 int ms_eventloop_file_mod(ms_event_loop_t *evlop, int sockfd,
@@ -88,6 +115,9 @@ ms_event_timer_t *ms_eventloop_timer_add(ms_event_loop_t *evlop, int ms,
         const ms_event_timer_proc *proc, void *data);
 void ms_eventloop_timer_del(ms_event_loop_t *evlop, ms_event_timer_t *timer);
 
+void ms_eventloop_task_post(ms_event_loop_t *evlop, ms_event_task_t *task);
+void ms_eventloop_wakeup(ms_event_loop_t *evlop);
+
 void ms_eventloop_main(ms_event_loop_t *evlop, int maxtimeout);
 void ms_eventloop_stop(ms_event_loop_t *evlop);
 
@@ -0,0 +1,149 @@
+#include "ms_hist.h"
+#include "ms_errlog.h"
+
+static uintptr_t ms_hist_index(uint64_t value);
+static uint64_t ms_hist_upper(uintptr_t index);
+
+/***********************************************************
+ * @Func   : ms_hist_add()
+ * @Author : lwp
+ * @Brief  : 记录一个值。
+ * @Param  : [in] hist
+ * @Param  : [in] value
+ * @Return : void
+ * @Note   : 只能由一个线程写入，以 relaxed 原子读写保证读者不会读到撕裂的值
+ ***********************************************************/
+void ms_hist_add(ms_hist_t *hist, uint64_t value)
+{
+    uint64_t *bucket = &hist->buckets[ms_hist_index(value)];
+
+    __atomic_store_n(bucket, __atomic_load_n(bucket, __ATOMIC_RELAXED) + 1,
+            __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->sum,
+            __atomic_load_n(&hist->sum, __ATOMIC_RELAXED) + value,
+            __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->count,
+            __atomic_load_n(&hist->count, __ATOMIC_RELAXED) + 1,
+            __ATOMIC_RELAXED);
+
+    if (value > __atomic_load_n(&hist->max, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&hist->max, value, __ATOMIC_RELAXED);
+    }
+}
+// @ms_hist_add() ok
+
+/***********************************************************
+ * @Func   : ms_hist_merge()
+ * @Author : lwp
+ * @Brief  : 将 src 的记录累加到 dst。
+ * @Param  : [in/out] dst : 调用者私有的直方图
+ * @Param  : [in] src     : 可能正在被其他线程写入
+ * @Return : void
+ ***********************************************************/
+void ms_hist_merge(ms_hist_t *dst, const ms_hist_t *src)
+{
+    uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+
+    dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+    dst->max = ms_max(dst->max, max);
+
+    for (int i = 0; i < MS_HIST_BUCKETS; i++)
+    {
+        dst->buckets[i] += __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+    }
+}
+// @ms_hist_merge() ok
+
+/***********************************************************
+ * @Func   : ms_hist_value()
+ * @Author : lwp
+ * @Brief  : 求分位数。
+ * @Param  : [in] hist
+ * @Param  : [in] quantile : [0, 1]，如 0.99
+ * @Return : 分位数所在桶的上界，不超过记录的最大值；没有记录时为 0
+ ***********************************************************/
+uint64_t ms_hist_value(const ms_hist_t *hist, double quantile)
+{
+    uint64_t rank = 0;
+    uint64_t total = 0;
+
+    if (hist->count == 0)
+    {
+        return 0;
+    }
+
+    rank = (uint64_t)(quantile * hist->count + 0.5);
+    rank = ms_max(rank, (uint64_t)1);
+
+    for (int i = 0; i < MS_HIST_BUCKETS; i++)
+    {
+        total += hist->buckets[i];
+        if (total >= rank)
+        {
+            return ms_min(ms_hist_upper(i), hist->max);
+        }
+    }
+
+    return hist->max;
+}
+// @ms_hist_value() ok
+
+/***********************************************************
+ * @Func   : ms_hist_log()
+ * @Author : lwp
+ * @Brief  : 以一行日志记录直方图的次数、均值、分位数与最大值。
+ * @Param  : [in] hist : 调用者私有的直方图，如 ms_hist_merge() 的结果
+ * @Param  : [in] name : 直方图的名称
+ * @Param  : [in] who  : 直方图所属的 worker，如 "worker 0"、"all"
+ * @Return : void
+ ***********************************************************/
+void ms_hist_log(const ms_hist_t *hist, const char *name, const char *who)
+{
+    ms_errlog(MS_ERRLOG_STATUS, 0,
+            "hist \"%s\" %s count \"%uL\" mean \"%uL\" p50 \"%uL\" "
+            "p90 \"%uL\" p99 \"%uL\" p999 \"%uL\" max \"%uL\"", name, who,
+            hist->count,
+            hist->count ? hist->sum / hist->count : (uint64_t)0,
+            ms_hist_value(hist, 0.5), ms_hist_value(hist, 0.9),
+            ms_hist_value(hist, 0.99), ms_hist_value(hist, 0.999),
+            hist->max);
+}
+// @ms_hist_log() ok
+
+// 值所在的桶: 小于 MS_HIST_SUB 的值各占一桶，之后每个 2 的幂区间按最高位之后的
+// MS_HIST_SUB_BITS 位划分子桶
+static uintptr_t ms_hist_index(uint64_t value)
+{
+    int msb = 0;
+
+    if (value < MS_HIST_SUB)
+    {
+        return value;
+    }
+
+    if (value >> MS_HIST_MAX_BITS)
+    {
+        return MS_HIST_BUCKETS - 1;
+    }
+
+    msb = 63 - __builtin_clzll(value);
+
+    return (msb - MS_HIST_SUB_BITS + 1) * MS_HIST_SUB
+        + ((value >> (msb - MS_HIST_SUB_BITS)) & (MS_HIST_SUB - 1));
+}
+
+// 桶中的最大值
+static uint64_t ms_hist_upper(uintptr_t index)
+{
+    uintptr_t group = index / MS_HIST_SUB;
+    uintptr_t sub = index % MS_HIST_SUB;
+
+    if (group == 0)
+    {
+        return sub;
+    }
+
+    return ((uint64_t)(MS_HIST_SUB + sub + 1) << (group - 1)) - 1;
+}
@@ -0,0 +1,38 @@
+// 直方图: 参考 HdrHistogram 的 log-linear 分桶，每个 2 的幂区间再均分为 MS_HIST_SUB 个子桶，
+// 相对误差不超过 1/MS_HIST_SUB；桶数固定，记录只需一次 clz 与一次加法，同布局的直方图可逐桶相加合并。
+// 只由一个线程写入，其他进程或线程可随时读取，读到的是近似一致的快照。
+#ifndef _MS_HIST_H
+#define _MS_HIST_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#define MS_HIST_SUB_BITS 4                                   // 子桶数的 shift
+#define MS_HIST_SUB      (1 << MS_HIST_SUB_BITS)             // 每个 2 的幂区间的子桶数
+#define MS_HIST_MAX_BITS 36                                  // 可区分的最大值为 2^36 - 1，更大的值计入最后一个桶
+#define MS_HIST_BUCKETS  ((MS_HIST_MAX_BITS - MS_HIST_SUB_BITS + 1) * MS_HIST_SUB)
+
+typedef struct ms_hist_s ms_hist_t;
+
+struct ms_hist_s {
+    uint64_t count;                    // 记录的次数
+    uint64_t sum;                      // 记录的值之和
+    uint64_t max;                      // 记录的最大值
+    uint64_t buckets[MS_HIST_BUCKETS]; // 各桶的次数
+};
+
+void ms_hist_add(ms_hist_t *hist, uint64_t value);
+void ms_hist_merge(ms_hist_t *dst, const ms_hist_t *src);
+uint64_t ms_hist_value(const ms_hist_t *hist, double quantile);
+void ms_hist_log(const ms_hist_t *hist, const char *name, const char *who);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
@@ -0,0 +1,776 @@
+#include "ms_http.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// 返回 [p, end) 中第一个控制字符(0x00-0x1f, 0x7f)的地址，没有时返回 end
+typedef const char *ms_http_find_proc(const char *p, const char *end);
+
+static const char *ms_http_find_c(const char *p, const char *end);
+#if defined(__x86_64__) || defined(__i386__)
+static const char *ms_http_find_sse42(const char *p, const char *end)
+    __attribute__((target("sse4.2")));
+static const char *ms_http_find_avx2(const char *p, const char *end)
+    __attribute__((target("avx2")));
+#endif
+static const char *ms_http_eol(const char *p, const char *end);
+static int ms_http_token(const ms_http_str_t *value, const char *token);
+static int ms_http_scan(ms_http_parser_t *hp, ms_buf_chain_t *chain);
+static int ms_http_lines(ms_http_parser_t *hp, const char *p,
+        ms_http_request_t *req);
+static int ms_http_framing(ms_http_parser_t *hp, ms_http_request_t *req,
+        ms_http_header_t *h, int *conn);
+
+// 按 CPU 支持的指令集选择，由 ms_http_init() 设置
+static ms_http_find_proc *ms_http_find = ms_http_find_c;
+
+// 请求头跨越缓冲区块时拷贝到这里，每个线程一个
+static __thread char ms_http_buf[MS_HTTP_MAX_HEADER];
+
+/***********************************************************
+ * @Func   : ms_http_init()
+ * @Author : lwp
+ * @Brief  : 按 CPU 支持的指令集选择查找控制字符的实现。
+ * @Param  : void
+ * @Return : void
+ * @Note   : 在创建 worker 之前调用，依次尝试 AVX2、SSE4.2，都不支持时按 8 字节成批查找
+ ***********************************************************/
+void ms_http_init(void)
+{
+    const char *name = "scalar";
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        ms_http_find = ms_http_find_avx2;
+        name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse4.2"))
+    {
+        ms_http_find = ms_http_find_sse42;
+        name = "sse4.2";
+    }
+#endif
+
+    ms_errlog(MS_ERRLOG_STATUS, 0, "http parser uses \"%s\"", name);
+}
+// @ms_http_init() ok
+
+/***********************************************************
+ * @Func   : ms_http_parse()
+ * @Author : lwp
+ * @Brief  : 增量解析 chain 起始处的请求。
+ * @Param  : [in] hp : 连接中保存的解析状态
+ * @Param  : [in] chain : 接收缓冲区链，请求从偏移 0 开始
+ * @Param  : [out] req : 请求完整时填写
+ * @Return : MS_ERROR : 请求非法，应答的状态码见 hp->status
+ *           MS_AGAIN : 请求不完整，接收更多数据后再次调用
+ *           MS_OK    : 请求完整，hp 已重置
+ * @Note   : 返回 MS_OK 后调用者须从 chain 中移除 req->mlen 字节再解析下一个请求；
+ *           req 中的切片在 chain 被修改或同一线程再次调用前有效
+ ***********************************************************/
+int ms_http_parse(ms_http_parser_t *hp, ms_buf_chain_t *chain,
+        ms_http_request_t *req)
+{
+    int rev = 0;
+    int state = hp->state;
+    const char *hdr = NULL;
+
+    if (state == MS_HTTP_HEADER)
+    {
+        rev = ms_http_scan(hp, chain);
+        if (rev != MS_OK)
+        {
+            return rev;
+        }
+    }
+    else if (state == MS_HTTP_BODY)
+    {
+        if (chain->size < hp->hlen + hp->clen)
+        {
+            return MS_AGAIN;
+        }
+    }
+    else
+    {
+        rev = ms_http_chunked(&hp->chunk, chain);
+        if (rev != MS_OK)
+        {
+            hp->status = 400;
+            return rev;
+        }
+    }
+
+    // 请求头位于同一个缓冲区块时不拷贝
+    if ((size_t)(chain->head->last - chain->head->pos) >= hp->hlen)
+    {
+        hdr = chain->head->pos;
+    }
+    else
+    {
+        ms_buf_chain_copy(chain, 0, ms_http_buf, hp->hlen);
+        hdr = ms_http_buf;
+    }
+
+    if (ms_http_lines(hp, hdr, req) == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+    req->hlen = hp->hlen;
+
+    // 请求头刚接收完成，确定请求体的边界
+    if (state == MS_HTTP_HEADER)
+    {
+        if (req->chunked)
+        {
+            hp->state = MS_HTTP_CHUNKED;
+            hp->chunk.scan = hp->hlen;
+            rev = ms_http_chunked(&hp->chunk, chain);
+            if (rev != MS_OK)
+            {
+                hp->status = 400;
+                return rev;
+            }
+        }
+        else
+        {
+            hp->state = MS_HTTP_BODY;
+            hp->clen = req->clen > 0 ? req->clen : 0;
+            if (chain->size < hp->hlen + hp->clen)
+            {
+                return MS_AGAIN;
+            }
+        }
+    }
+
+    req->mlen = (hp->state == MS_HTTP_BODY) ? hp->hlen + hp->clen
+        : hp->chunk.scan;
+    memset(hp, 0, sizeof(ms_http_parser_t));
+
+    return MS_OK;
+}
+// @ms_http_parse() ok
+
+/***********************************************************
+ * @Func   : ms_http_chunked()
+ * @Author : lwp
+ * @Brief  : 增量解析 chain 中 ck->scan 之后的 chunked 编码，块数据整段跳过。
+ * @Param  : [in] ck : 解析状态
+ * @Param  : [in] chain
+ * @Return : MS_ERROR : 格式错误
+ *           MS_AGAIN : 未结束
+ *           MS_OK    : 已结束，ck->scan 为编码之后的偏移
+ * @Note   : 调用者从 chain 头部移除数据时须同步减小 ck->scan
+ ***********************************************************/
+int ms_http_chunked(ms_http_chunked_t *ck, ms_buf_chain_t *chain)
+{
+    int c = 0;
+    size_t n = 0;
+    size_t base = 0;
+    char *p = NULL;
+    char *last = NULL;
+
+    if (ck->state == MS_HTTP_CHUNK_DONE)
+    {
+        return MS_OK;
+    }
+
+    for (ms_buf_t *buf = chain->head; buf != NULL; buf = buf->next)
+    {
+        n = buf->last - buf->pos;
+        if (ck->scan >= base + n)
+        {
+            base += n;
+            continue;
+        }
+
+        p = buf->pos + (ck->scan - base);
+        last = buf->last;
+
+        while (p < last && ck->state != MS_HTTP_CHUNK_DONE)
+        {
+            switch (ck->state)
+            {
+                case MS_HTTP_CHUNK_SIZE:
+                    c = *p++;
+                    if (isxdigit(c))
+                    {
+                        if (ck->size > ((int64_t)1 << 56))
+                        {
+                            return MS_ERROR;
+                        }
+                        ck->size = ck->size * 16
+                            + (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+                    }
+                    else if (c == ';' || c == ' ' || c == '\t')
+                    {
+                        ck->state = MS_HTTP_CHUNK_EXT;
+                    }
+                    else if (c == '\r')
+                    {
+                        ck->state = MS_HTTP_CHUNK_SIZE_LF;
+                    }
+                    else if (c == '\n')
+                    {
+                        ck->state = ck->size ? MS_HTTP_CHUNK_DATA
+                            : MS_HTTP_CHUNK_TRAILER;
+                    }
+                    else
+                    {
+                        return MS_ERROR;
+                    }
+                    break;
+
+                case MS_HTTP_CHUNK_EXT:
+                    if (*p++ == '\n')
+                    {
+                        ck->state = ck->size ? MS_HTTP_CHUNK_DATA
+                            : MS_HTTP_CHUNK_TRAILER;
+                    }
+                    break;
+
+                case MS_HTTP_CHUNK_SIZE_LF:
+                    if (*p++ != '\n')
+                    {
+                        return MS_ERROR;
+                    }
+                    ck->state = ck->size ? MS_HTTP_CHUNK_DATA
+                        : MS_HTTP_CHUNK_TRAILER;
+                    break;
+
+                case MS_HTTP_CHUNK_DATA:
+                    n = ms_min((size_t)(last - p), (size_t)ck->size);
+                    p += n;
+                    ck->size -= n;
+                    if (ck->size == 0)
+                    {
+                        ck->state = MS_HTTP_CHUNK_DATA_CR;
+                    }
+                    break;
+
+                case MS_HTTP_CHUNK_DATA_CR:
+                    if (*p++ != '\r')
+                    {
+                        return MS_ERROR;
+                    }
+                    ck->state = MS_HTTP_CHUNK_DATA_LF;
+                    break;
+
+                case MS_HTTP_CHUNK_DATA_LF:
+                    if (*p++ != '\n')
+                    {
+                        return MS_ERROR;
+                    }
+                    ck->state = MS_HTTP_CHUNK_SIZE;
+                    break;
+
+                case MS_HTTP_CHUNK_TRAILER:
+                    c = *p++;
+                    ck->state = (c == '\r') ? MS_HTTP_CHUNK_LAST_LF
+                        : (c == '\n') ? MS_HTTP_CHUNK_DONE : MS_HTTP_CHUNK_LINE;
+                    break;
+
+                case MS_HTTP_CHUNK_LINE:
+                    if (*p++ == '\n')
+                    {
+                        ck->state = MS_HTTP_CHUNK_TRAILER;
+                    }
+                    break;
+
+                case MS_HTTP_CHUNK_LAST_LF:
+                    if (*p++ != '\n')
+                    {
+                        return MS_ERROR;
+                    }
+                    ck->state = MS_HTTP_CHUNK_DONE;
+                    break;
+
+                default:
+                    return MS_ERROR;
+            }
+        }
+
+        ck->scan = base + (p - buf->pos);
+        if (ck->state == MS_HTTP_CHUNK_DONE)
+        {
+            return MS_OK;
+        }
+        base += buf->last - buf->pos;
+    }
+
+    return MS_AGAIN;
+}
+// @ms_http_chunked() ok
+
+/***********************************************************
+ * @Func   : ms_http_header()
+ * @Author : lwp
+ * @Brief  : 查找请求头字段(不区分大小写)。
+ * @Param  : [in] req
+ * @Param  : [in] name : 字段名
+ * @Return : NULL  : 不存在
+ *           value : 第一个同名字段的值
+ ***********************************************************/
+const ms_http_str_t *ms_http_header(ms_http_request_t *req, const char *name)
+{
+    size_t len = strlen(name);
+
+    for (int i = 0; i < req->nheaders; i++)
+    {
+        if (req->headers[i].name.len == len
+                && strncasecmp(req->headers[i].name.data, name, len) == 0)
+        {
+            return &(req->headers[i].value);
+        }
+    }
+
+    return NULL;
+}
+// @ms_http_header() ok
+
+/***********************************************************
+ * @Func   : ms_http_reason()
+ * @Author : lwp
+ * @Brief  : 返回状态码对应的原因短语。
+ * @Param  : [in] status
+ * @Return : 原因短语
+ ***********************************************************/
+const char *ms_http_reason(int status)
+{
+    switch (status)
+    {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 504: return "Gateway Timeout";
+        case 505: return "HTTP Version Not Supported";
+        default : return "Unknown";
+    }
+}
+// @ms_http_reason() ok
+
+/***********************************************************
+ * @Func   : ms_http_error()
+ * @Author : lwp
+ * @Brief  : 向 chain 追加没有响应体的错误响应。
+ * @Param  : [in] pool
+ * @Param  : [in] chain : 发送缓冲区链
+ * @Param  : [in] status : 状态码
+ * @Param  : [in] close : 是否附加 Connection: close
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ ***********************************************************/
+int ms_http_error(ms_buf_pool_t *pool, ms_buf_chain_t *chain, int status,
+        int close)
+{
+    return ms_buf_chain_printf(pool, chain,
+            "HTTP/1.1 %d %s\r\nContent-Length: 0\r\n%s\r\n", status,
+            ms_http_reason(status), close ? "Connection: close\r\n" : "");
+}
+// @ms_http_error() ok
+
+// 每次检查 8 字节，有字节小于 0x20 或等于 0x7f 时再逐字节查找
+static const char *ms_http_find_c(const char *p, const char *end)
+{
+    uint64_t x = 0;
+    uint64_t d = 0;
+
+    while (end - p >= 8)
+    {
+        memcpy(&x, p, 8);
+        d = x ^ 0x7f7f7f7f7f7f7f7fULL;
+        if ((((x - 0x2020202020202020ULL) & ~x)
+                    | ((d - 0x0101010101010101ULL) & ~d))
+                & 0x8080808080808080ULL)
+        {
+            break;
+        }
+        p += 8;
+    }
+
+    for (; p < end; p++)
+    {
+        if ((unsigned char)*p < 0x20 || *p == 0x7f)
+        {
+            return p;
+        }
+    }
+
+    return end;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 每次检查 16 字节: pcmpestri 按字节范围 [0x00, 0x1f] [0x7f, 0x7f] 查找
+static const char *ms_http_find_sse42(const char *p, const char *end)
+{
+    static const char ranges[16] = { 0x00, 0x1f, 0x7f, 0x7f };
+    const __m128i r = _mm_loadu_si128((const __m128i *)ranges);
+    __m128i v;
+    int i = 0;
+
+    while (end - p >= 16)
+    {
+        v = _mm_loadu_si128((const __m128i *)p);
+        i = _mm_cmpestri(r, 4, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES
+                | _SIDD_LEAST_SIGNIFICANT);
+        if (i != 16)
+        {
+            return p + i;
+        }
+        p += 16;
+    }
+
+    return ms_http_find_c(p, end);
+}
+
+// 每次检查 32 字节: 无符号 min(v, 0x1f) == v 即 v <= 0x1f
+static const char *ms_http_find_avx2(const char *p, const char *end)
+{
+    const __m256i ctl = _mm256_set1_epi8(0x1f);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    __m256i v;
+    uint32_t mask = 0;
+
+    while (end - p >= 32)
+    {
+        v = _mm256_loadu_si256((const __m256i *)p);
+        mask = _mm256_movemask_epi8(_mm256_or_si256(
+                    _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl), v),
+                    _mm256_cmpeq_epi8(v, del)));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+
+    return ms_http_find_c(p, end);
+}
+#endif
+
+// 返回以 LF 或 CRLF 结尾的行的行尾地址，行中只允许 HTAB 一种控制字符，非法时返回 NULL
+static const char *ms_http_eol(const char *p, const char *end)
+{
+    const char *q = NULL;
+
+    for (;;)
+    {
+        q = ms_http_find(p, end);
+        if (q == end)
+        {
+            return NULL;
+        }
+
+        if (*q == '\t')
+        {
+            p = q + 1;
+            continue;
+        }
+
+        if (*q == '\n' || (*q == '\r' && q + 1 < end && q[1] == '\n'))
+        {
+            return q;
+        }
+
+        return NULL;
+    }
+}
+
+// 字段值是否包含以 ',' 分隔的 token(不区分大小写)
+static int ms_http_token(const ms_http_str_t *value, const char *token)
+{
+    size_t len = strlen(token);
+    const char *p = value->data;
+    const char *end = value->data + value->len;
+    const char *e = NULL;
+    const char *t = NULL;
+
+    while (p < end)
+    {
+        for (; p < end && (*p == ' ' || *p == '\t' || *p == ','); p++);
+        for (e = p; e < end && *e != ','; e++);
+
+        // 去除 token 之后的空白
+        for (t = e; t > p && (t[-1] == ' ' || t[-1] == '\t'); t--);
+        if ((size_t)(t - p) == len && strncasecmp(p, token, len) == 0)
+        {
+            return 1;
+        }
+        p = e;
+    }
+
+    return 0;
+}
+
+// 从 hp->scan 处继续查找请求头的结束(空行)，只检查控制字符，普通字节成批跳过
+static int ms_http_scan(ms_http_parser_t *hp, ms_buf_chain_t *chain)
+{
+    size_t n = 0;
+    size_t base = 0;
+    const char *p = NULL;
+    const char *q = NULL;
+    const char *last = NULL;
+
+    for (ms_buf_t *buf = chain->head; buf != NULL; buf = buf->next)
+    {
+        n = buf->last - buf->pos;
+        if (hp->scan >= base + n)
+        {
+            base += n;
+            continue;
+        }
+
+        p = buf->pos + (hp->scan - base);
+        last = buf->last;
+
+        while (p < last)
+        {
+            q = ms_http_find(p, last);
+            if (q > p)
+            {
+                hp->eol = 0;
+            }
+
+            if (q == last)
+            {
+                break;
+            }
+
+            if (*q == '\n')
+            {
+                // 空行: 请求头结束
+                if (hp->eol)
+                {
+                    hp->hlen = base + (q - buf->pos) + 1;
+                    if (hp->hlen > MS_HTTP_MAX_HEADER)
+                    {
+                        hp->status = 431;
+                        return MS_ERROR;
+                    }
+                    return MS_OK;
+                }
+                hp->eol = 1;
+            }
+            else if (*q == '\r')
+            {
+                hp->eol = hp->eol ? 2 : 0;
+            }
+            else if (*q == '\t')
+            {
+                hp->eol = 0;
+            }
+            else
+            {
+                hp->status = 400;
+                return MS_ERROR;
+            }
+            p = q + 1;
+        }
+
+        base += n;
+        hp->scan = base;
+
+        if (hp->scan >= MS_HTTP_MAX_HEADER)
+        {
+            hp->status = 431;
+            return MS_ERROR;
+        }
+    }
+
+    return MS_AGAIN;
+}
+
+// 解析连续存储的请求头，填写 req 中的切片及请求体的边界
+static int ms_http_lines(ms_http_parser_t *hp, const char *p,
+        ms_http_request_t *req)
+{
+    int conn = 0;
+    const char *end = p + hp->hlen;
+    const char *eol = NULL;
+    const char *sp = NULL;
+    const char *v = NULL;
+    const char *e = NULL;
+    ms_http_header_t *h = NULL;
+
+    req->clen = -1;
+    req->chunked = 0;
+    req->nheaders = 0;
+
+    // 忽略请求行之前的空行
+    for (; p < end && (*p == '\r' || *p == '\n'); p++);
+
+    // 请求行: method SP request-target SP HTTP-version
+    eol = ms_http_eol(p, end);
+    if (eol == NULL)
+    {
+        goto bad;
+    }
+
+    sp = memchr(p, ' ', eol - p);
+    if (sp == NULL || sp == p)
+    {
+        goto bad;
+    }
+    req->method.data = p;
+    req->method.len = sp - p;
+
+    p = sp + 1;
+    sp = memchr(p, ' ', eol - p);
+    if (sp == NULL || sp == p)
+    {
+        goto bad;
+    }
+    req->path.data = p;
+    req->path.len = sp - p;
+
+    p = sp + 1;
+    if (eol - p != 8 || strncmp(p, "HTTP/", 5) != 0)
+    {
+        goto bad;
+    }
+
+    if (p[5] != '1' || p[6] != '.' || (p[7] != '0' && p[7] != '1'))
+    {
+        hp->status = 505;
+        return MS_ERROR;
+    }
+    req->minor = p[7] - '0';
+    p = eol + (*eol == '\r' ? 2 : 1);
+
+    // 请求头字段: name ":" OWS value OWS，以空行结束
+    for (;;)
+    {
+        eol = ms_http_eol(p, end);
+        if (eol == NULL)
+        {
+            goto bad;
+        }
+
+        if (eol == p)
+        {
+            break;
+        }
+
+        // 不支持以空白开头的折行
+        sp = memchr(p, ':', eol - p);
+        if (*p == ' ' || *p == '\t' || sp == NULL || sp == p
+                || sp[-1] == ' ' || sp[-1] == '\t')
+        {
+            goto bad;
+        }
+
+        if (req->nheaders == MS_HTTP_MAX_HEADERS)
+        {
+            hp->status = 431;
+            return MS_ERROR;
+        }
+
+        for (v = sp + 1; v < eol && (*v == ' ' || *v == '\t'); v++);
+        for (e = eol; e > v && (e[-1] == ' ' || e[-1] == '\t'); e--);
+
+        h = &(req->headers[req->nheaders++]);
+        h->name.data = p;
+        h->name.len = sp - p;
+        h->value.data = v;
+        h->value.len = e - v;
+
+        if (ms_http_framing(hp, req, h, &conn) == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+
+        p = eol + (*eol == '\r' ? 2 : 1);
+    }
+
+    // 同时存在时无法确定请求体的边界，拒绝以免请求走私
+    if (req->chunked && req->clen != -1)
+    {
+        goto bad;
+    }
+
+    // HTTP/1.1 默认保持连接，HTTP/1.0 需显式指定
+    req->keepalive = (conn == 2) ? 0 : (req->minor == 1 || conn == 1);
+
+    return MS_OK;
+bad:
+    hp->status = 400;
+    return MS_ERROR;
+}
+
+// 处理影响请求边界与连接的字段，conn: 1 keep-alive，2 close
+static int ms_http_framing(ms_http_parser_t *hp, ms_http_request_t *req,
+        ms_http_header_t *h, int *conn)
+{
+    int64_t clen = 0;
+
+    if (h->name.len == 14
+            && strncasecmp(h->name.data, "Content-Length", 14) == 0)
+    {
+        if (h->value.len == 0 || h->value.len > 18)
+        {
+            goto bad;
+        }
+
+        for (size_t i = 0; i < h->value.len; i++)
+        {
+            if (!isdigit((unsigned char)h->value.data[i]))
+            {
+                goto bad;
+            }
+            clen = clen * 10 + (h->value.data[i] - '0');
+        }
+
+        // 重复的 Content-Length 必须相同
+        if (req->clen != -1 && req->clen != clen)
+        {
+            goto bad;
+        }
+
+        if (clen > MS_HTTP_MAX_BODY)
+        {
+            hp->status = 413;
+            return MS_ERROR;
+        }
+        req->clen = clen;
+    }
+    else if (h->name.len == 17
+            && strncasecmp(h->name.data, "Transfer-Encoding", 17) == 0)
+    {
+        // chunked 必须是最后一个编码，其他编码只透传不解码
+        if (h->value.len < 7 || strncasecmp(h->value.data + h->value.len - 7,
+                    "chunked", 7) != 0 || (h->value.len > 7
+                    && h->value.data[h->value.len - 8] != ','
+                    && h->value.data[h->value.len - 8] != ' '))
+        {
+            hp->status = 501;
+            return MS_ERROR;
+        }
+        req->chunked = 1;
+    }
+    else if (h->name.len == 10
+            && strncasecmp(h->name.data, "Connection", 10) == 0)
+    {
+        if (ms_http_token(&h->value, "close"))
+        {
+            *conn = 2;
+        }
+        else if (ms_http_token(&h->value, "keep-alive") && *conn == 0)
+        {
+            *conn = 1;
+        }
+    }
+
+    return MS_OK;
+bad:
+    hp->status = 400;
+    return MS_ERROR;
+}
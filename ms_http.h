@@ -0,0 +1,104 @@
+// HTTP/1.1 请求解析: 在多次接收之间增量解析，已扫描过的数据不再重复扫描，可跨越缓冲区块的边界。
+// 请求行与请求头以 SSE4.2/AVX2 成批查找控制字符(CR/LF 等)，不逐字节分支；
+// 解析结果为指向接收缓冲区的切片，请求头跨越缓冲区块时才拷贝到线程私有的缓冲区。
+// 请求体由 Content-Length 或 chunked 编码界定，只确定其边界，不拷贝也不解码。
+#ifndef _MS_HTTP_H
+#define _MS_HTTP_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_buf.h"
+#include "ms_errlog.h"
+
+#define MS_HTTP_MAX_HEADER  8192                // 请求头的最大长度
+#define MS_HTTP_MAX_HEADERS 64                  // 请求头字段的最大数目
+#define MS_HTTP_MAX_BODY    (8 * 1024 * 1024)   // Content-Length 的最大值
+
+// 请求的解析状态
+#define MS_HTTP_HEADER  0 // 查找请求头的结束
+#define MS_HTTP_BODY    1 // 等待由 Content-Length 界定的请求体
+#define MS_HTTP_CHUNKED 2 // 解析 chunked 编码的请求体
+
+// chunked 编码的解析状态
+#define MS_HTTP_CHUNK_SIZE    0 // 块长度
+#define MS_HTTP_CHUNK_EXT     1 // 块扩展，忽略
+#define MS_HTTP_CHUNK_SIZE_LF 2 // 块长度行的 LF
+#define MS_HTTP_CHUNK_DATA    3 // 块数据
+#define MS_HTTP_CHUNK_DATA_CR 4 // 块数据后的 CR
+#define MS_HTTP_CHUNK_DATA_LF 5 // 块数据后的 LF
+#define MS_HTTP_CHUNK_TRAILER 6 // 最后一个块之后的行首
+#define MS_HTTP_CHUNK_LINE    7 // trailer 行，忽略
+#define MS_HTTP_CHUNK_LAST_LF 8 // 结束空行的 LF
+#define MS_HTTP_CHUNK_DONE    9 // 结束
+
+typedef struct ms_http_str_s     ms_http_str_t;
+typedef struct ms_http_header_s  ms_http_header_t;
+typedef struct ms_http_chunked_s ms_http_chunked_t;
+typedef struct ms_http_parser_s  ms_http_parser_t;
+typedef struct ms_http_request_s ms_http_request_t;
+
+// 指向接收缓冲区的切片，不以 '\0' 结尾
+struct ms_http_str_s {
+    const char *data;
+    size_t      len;
+};
+
+struct ms_http_header_s {
+    ms_http_str_t name;  // 字段名，保持原始大小写
+    ms_http_str_t value; // 字段值，已去除首尾空白
+};
+
+// chunked 编码的增量解析状态，全 0 时从块长度开始
+struct ms_http_chunked_s {
+    int64_t size;  // 当前块的剩余长度
+    size_t  scan;  // chain 中尚未解析的数据的偏移，结束后为编码之后的偏移
+    int     state; // 解析状态，见 MS_HTTP_CHUNK_SIZE 等
+};
+
+// 请求的增量解析状态，保存在连接中，全 0 时从请求行开始
+struct ms_http_parser_s {
+    ms_http_chunked_t chunk;  // chunked 编码的请求体的解析状态
+    size_t            scan;   // 查找请求头的结束时已扫描的长度
+    size_t            hlen;   // 请求头的长度
+    int64_t           clen;   // Content-Length 界定的请求体的长度
+    int               state;  // 解析状态，见 MS_HTTP_HEADER 等
+    int               eol;    // 已扫描部分的行尾状态: 0 行中，1 行首，2 行首的 CR
+    int               status; // 解析失败时应答的状态码
+};
+
+// 完整的请求，切片在 chain 被修改或同一线程再次解析前有效
+struct ms_http_request_s {
+    ms_http_str_t     method;    // 请求方法
+    ms_http_str_t     path;      // 请求目标，含查询参数
+    int               minor;     // HTTP/1.x 的次版本号
+    int               keepalive; // 响应后是否保持连接
+    int               chunked;   // 请求体是否为 chunked 编码
+    int64_t           clen;      // Content-Length，没有时为 -1
+    size_t            hlen;      // 请求头的长度，请求体位于 chain 中 [hlen, mlen)
+    size_t            mlen;      // 整个请求的长度
+    int               nheaders;  // 请求头字段的数目
+    ms_http_header_t  headers[MS_HTTP_MAX_HEADERS];
+};
+
+void ms_http_init(void);
+
+int ms_http_parse(ms_http_parser_t *hp, ms_buf_chain_t *chain,
+        ms_http_request_t *req);
+int ms_http_chunked(ms_http_chunked_t *ck, ms_buf_chain_t *chain);
+
+const ms_http_str_t *ms_http_header(ms_http_request_t *req, const char *name);
+const char *ms_http_reason(int status);
+int ms_http_error(ms_buf_pool_t *pool, ms_buf_chain_t *chain, int status,
+        int close);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
@@ -0,0 +1,529 @@
+#include "ms_logring.h"
+#include "ms_acclog.h"
+
+#include <poll.h>
+
+typedef struct ms_logring_ctx_s {
+    pthread_mutex_t  lock;     // 保护 rings[]，flusher 写入时持有
+    pthread_t        tid;      // flusher 线程
+    int              running;  // flusher 是否在运行
+    int              stop;     // flusher 停止的标志
+    int              reopen;   // 写完缓冲的日志后重新打开日志文件
+    int              notified; // 已写 eventfd 而 flusher 尚未读取
+    int              notifyfd; // 唤醒 flusher 的 eventfd
+    int              policy;   // 环满时的处理，MS_LOGRING_DROP/MS_LOGRING_BLOCK
+    uint64_t         size;     // 每个字节环的大小，2 的幂
+    int              nrings;   // 挂接的日志环的数目
+    ms_logring_t    *rings[MS_LOGRING_MAX_RINGS];
+} ms_logring_ctx_t;
+
+static ms_logring_ctx_t g_ms_logring;
+static __thread ms_logring_t *ms_logring_self;
+static __thread pid_t ms_logring_pid; // 挂接时缓存的进程 ID，0 代表未缓存
+static __thread pid_t ms_logring_tid; // 挂接时缓存的线程 ID
+
+static void *ms_logring_flusher(void *arg);
+static void ms_logring_flush(void);
+static uint64_t ms_logring_collect(void);
+static void ms_logring_drain(int file, int fd);
+static void ms_logring_wakeup(void);
+static void ms_logring_free(ms_logring_t *ring);
+
+/***********************************************************
+ * @Func   : ms_logring_start()
+ * @Author : lwp
+ * @Brief  : 启动当前进程的 flusher 线程。
+ * @Param  : [in] size   : 每个字节环的大小，向上取整为 2 的幂，0 代表不启用
+ * @Param  : [in] policy : 环满时的处理，MS_LOGRING_DROP/MS_LOGRING_BLOCK
+ * @Return : MS_ERROR : 失败，日志仍直接写入文件
+ *           MS_OK    : 成功
+ * @Note   : 每个进程调用一次，进程模式下须在 fork() 之后由 worker 调用；
+ *           flusher 线程阻塞所有信号
+ ***********************************************************/
+int ms_logring_start(size_t size, int policy)
+{
+    int err;
+    sigset_t sigset;
+    sigset_t oldset;
+
+    memset(&g_ms_logring, 0, sizeof(g_ms_logring));
+    g_ms_logring.notifyfd = -1;
+
+    if (size == 0)
+    {
+        return MS_OK;
+    }
+
+    // 至少容纳一行最长的日志
+    g_ms_logring.size = MS_MAX_BUF_SIZE * 2;
+    while (g_ms_logring.size < size)
+    {
+        g_ms_logring.size <<= 1;
+    }
+    g_ms_logring.policy = policy;
+
+    g_ms_logring.notifyfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_ms_logring.notifyfd == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "eventfd() failed");
+        return MS_ERROR;
+    }
+
+    if ((err = pthread_mutex_init(&(g_ms_logring.lock), NULL)) != 0)
+    {
+        ms_errlog(MS_ERRLOG_ERR, err, "pthread_mutex_init() failed");
+        close(g_ms_logring.notifyfd);
+        return MS_ERROR;
+    }
+
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+    err = pthread_create(&(g_ms_logring.tid), NULL, ms_logring_flusher, NULL);
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+    if (err != 0)
+    {
+        ms_errlog(MS_ERRLOG_ERR, err, "pthread_create() failed");
+        pthread_mutex_destroy(&(g_ms_logring.lock));
+        close(g_ms_logring.notifyfd);
+        return MS_ERROR;
+    }
+    g_ms_logring.running = 1;
+
+    return MS_OK;
+}
+// @ms_logring_start() ok
+
+/***********************************************************
+ * @Func   : ms_logring_attach()
+ * @Author : lwp
+ * @Brief  : 为调用线程创建日志环，之后该线程的日志由 flusher 写入。
+ * @Param  : [in] NONE
+ * @Return : MS_ERROR : 失败，该线程的日志仍直接写入文件
+ *           MS_OK    : 成功，或未启动 flusher
+ * @Note   : 线程退出前须调用 ms_logring_detach()；进程模式下须在 fork() 之后调用，
+ *           未启动 flusher 时也缓存进程与线程 ID，见 ms_logring_ids()
+ ***********************************************************/
+int ms_logring_attach(void)
+{
+    ms_logring_t *ring = NULL;
+
+    ms_logring_pid = getpid();
+    ms_logring_tid = (pid_t)syscall(SYS_gettid);
+
+    if (!g_ms_logring.running || ms_logring_self != NULL)
+    {
+        return MS_OK;
+    }
+
+    ring = (ms_logring_t *)calloc(1, sizeof(ms_logring_t));
+    if (ring == NULL)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "calloc() failed");
+        return MS_ERROR;
+    }
+
+    for (int i = 0; i < MS_LOGRING_FILES; i++)
+    {
+        ring->bufs[i].data = (char *)malloc(g_ms_logring.size);
+        if (ring->bufs[i].data == NULL)
+        {
+            ms_errlog(MS_ERRLOG_ERR, errno, "malloc() failed");
+            ms_logring_free(ring);
+            return MS_ERROR;
+        }
+    }
+
+    pthread_mutex_lock(&(g_ms_logring.lock));
+    if (g_ms_logring.nrings >= MS_LOGRING_MAX_RINGS)
+    {
+        pthread_mutex_unlock(&(g_ms_logring.lock));
+        ms_errlog(MS_ERRLOG_WARN, 0, "too many log rings \"%d\"",
+                MS_LOGRING_MAX_RINGS);
+        ms_logring_free(ring);
+        return MS_ERROR;
+    }
+    g_ms_logring.rings[g_ms_logring.nrings++] = ring;
+    pthread_mutex_unlock(&(g_ms_logring.lock));
+
+    ms_logring_self = ring;
+
+    return MS_OK;
+}
+// @ms_logring_attach() ok
+
+/***********************************************************
+ * @Func   : ms_logring_ids()
+ * @Author : lwp
+ * @Brief  : 返回调用线程的进程 ID 与线程 ID，用于格式化日志行。
+ * @Param  : [out] pid
+ * @Param  : [out] tid
+ * @Return : NONE
+ * @Note   : 调用过 ms_logring_attach() 的线程使用缓存的值，不进入内核；
+ *           其他线程(master、线程池中的线程等)调用 getpid()/gettid()
+ ***********************************************************/
+void ms_logring_ids(pid_t *pid, pid_t *tid)
+{
+    if (ms_logring_pid != 0)
+    {
+        *pid = ms_logring_pid;
+        *tid = ms_logring_tid;
+        return;
+    }
+
+    *pid = getpid();
+    *tid = (pid_t)syscall(SYS_gettid);
+}
+// @ms_logring_ids() ok
+
+/***********************************************************
+ * @Func   : ms_logring_write()
+ * @Author : lwp
+ * @Brief  : 将一行日志追加到调用线程的日志环。
+ * @Param  : [in] file : MS_LOGRING_ACCESS/MS_LOGRING_ERROR
+ * @Param  : [in] line : 格式化好的日志，以 '\n' 结尾
+ * @Param  : [in] len  : 日志的长度
+ * @Return : MS_BUSY : 调用线程没有日志环，或在信号处理函数中打断了追加，
+ *                     由调用者直接写入文件
+ *           MS_OK   : 已追加，或按 MS_LOGRING_DROP 丢弃
+ * @Note   : 只写内存；环过半时才写 eventfd 唤醒 flusher，
+ *           MS_LOGRING_BLOCK 时等待 flusher 腾出空间
+ ***********************************************************/
+int ms_logring_write(int file, const char *line, size_t len)
+{
+    uint64_t head;
+    uint64_t tail;
+    uint64_t off;
+    uint64_t half = g_ms_logring.size / 2;
+    ms_logring_buf_t *buf = NULL;
+    ms_logring_t *ring = ms_logring_self;
+    struct timespec ts = { 0, 100 * 1000 };
+
+    if (ring == NULL || ring->busy || len > g_ms_logring.size)
+    {
+        return MS_BUSY;
+    }
+
+    // 同一线程的信号处理函数可能打断追加，其中的日志见到 busy 后直接写入文件
+    ring->busy = 1;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    buf = &(ring->bufs[file]);
+    head = buf->head;
+    tail = __atomic_load_n(&(buf->tail), __ATOMIC_ACQUIRE);
+
+    while (g_ms_logring.size - (head - tail) < len)
+    {
+        if (g_ms_logring.policy == MS_LOGRING_DROP)
+        {
+            __atomic_store_n(&(buf->drops), buf->drops + 1, __ATOMIC_RELAXED);
+            goto end;
+        }
+
+        ms_logring_wakeup();
+        nanosleep(&ts, NULL);
+        tail = __atomic_load_n(&(buf->tail), __ATOMIC_ACQUIRE);
+    }
+
+    // 写到环的末尾时回绕到开头
+    off = head & (g_ms_logring.size - 1);
+    if (len <= g_ms_logring.size - off)
+    {
+        memcpy(buf->data + off, line, len);
+    }
+    else
+    {
+        memcpy(buf->data + off, line, g_ms_logring.size - off);
+        memcpy(buf->data, line + (g_ms_logring.size - off),
+                len - (g_ms_logring.size - off));
+    }
+    __atomic_store_n(&(buf->head), head + len, __ATOMIC_RELEASE);
+
+    // 越过一半时唤醒 flusher，否则等待其定期写入
+    if (head - tail < half && head + len - tail >= half)
+    {
+        ms_logring_wakeup();
+    }
+
+end:
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    ring->busy = 0;
+
+    return MS_OK;
+}
+// @ms_logring_write() ok
+
+/***********************************************************
+ * @Func   : ms_logring_reopen()
+ * @Author : lwp
+ * @Brief  : 通知 flusher 写完缓冲的日志后重新打开日志文件。
+ * @Param  : [in] NONE
+ * @Return : MS_ERROR : 未启动 flusher，由调用者直接重新打开
+ *           MS_OK    : 成功
+ * @Note   : 可在信号处理函数中调用；轮转前缓冲的日志写入旧文件
+ ***********************************************************/
+int ms_logring_reopen(void)
+{
+    if (!g_ms_logring.running)
+    {
+        return MS_ERROR;
+    }
+
+    __atomic_store_n(&(g_ms_logring.reopen), 1, __ATOMIC_SEQ_CST);
+    ms_logring_wakeup();
+
+    return MS_OK;
+}
+// @ms_logring_reopen() ok
+
+/***********************************************************
+ * @Func   : ms_logring_detach()
+ * @Author : lwp
+ * @Brief  : 写出调用线程的日志环中剩余的日志，释放日志环。
+ * @Param  : [in] NONE
+ * @Return : NONE
+ * @Note   : 之后该线程的日志直接写入文件
+ ***********************************************************/
+void ms_logring_detach(void)
+{
+    uint64_t drops = 0;
+    ms_logring_t *ring = ms_logring_self;
+
+    ms_logring_pid = 0;
+    ms_logring_tid = 0;
+
+    if (ring == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&(g_ms_logring.lock));
+    drops = ms_logring_collect();
+    for (int i = 0; i < g_ms_logring.nrings; i++)
+    {
+        if (g_ms_logring.rings[i] == ring)
+        {
+            g_ms_logring.rings[i] = g_ms_logring.rings[--g_ms_logring.nrings];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&(g_ms_logring.lock));
+
+    ms_logring_self = NULL;
+    ms_logring_free(ring);
+
+    if (drops > 0)
+    {
+        ms_errlog(MS_ERRLOG_WARN, 0, "log ring full, dropped \"%uL\" lines",
+                drops);
+    }
+}
+// @ms_logring_detach() ok
+
+/***********************************************************
+ * @Func   : ms_logring_stop()
+ * @Author : lwp
+ * @Brief  : 停止 flusher，写出所有日志环中剩余的日志。
+ * @Param  : [in] NONE
+ * @Return : NONE
+ * @Note   : 须在挂接日志环的线程退出后调用，未 detach 的日志环一并释放
+ ***********************************************************/
+void ms_logring_stop(void)
+{
+    if (!g_ms_logring.running)
+    {
+        return;
+    }
+
+    __atomic_store_n(&(g_ms_logring.stop), 1, __ATOMIC_SEQ_CST);
+    ms_logring_wakeup();
+    pthread_join(g_ms_logring.tid, NULL);
+
+    ms_logring_flush();
+    g_ms_logring.running = 0;
+
+    for (int i = 0; i < g_ms_logring.nrings; i++)
+    {
+        ms_logring_free(g_ms_logring.rings[i]);
+    }
+    g_ms_logring.nrings = 0;
+    ms_logring_self = NULL;
+
+    pthread_mutex_destroy(&(g_ms_logring.lock));
+    close(g_ms_logring.notifyfd);
+    g_ms_logring.notifyfd = -1;
+}
+// @ms_logring_stop() ok
+
+// flusher 线程: 等待唤醒或超时后写出各日志环中的日志
+static void *ms_logring_flusher(void *arg)
+{
+    uint64_t count;
+    ssize_t nread;
+    struct pollfd pfd;
+
+    pfd.fd = g_ms_logring.notifyfd;
+    pfd.events = POLLIN;
+
+    while (!__atomic_load_n(&(g_ms_logring.stop), __ATOMIC_SEQ_CST))
+    {
+        if (poll(&pfd, 1, MS_LOGRING_FLUSH_MS) > 0)
+        {
+            do {
+                nread = read(pfd.fd, &count, sizeof(count));
+            } while (nread == -1 && errno == EINTR);
+            __atomic_store_n(&(g_ms_logring.notified), 0, __ATOMIC_SEQ_CST);
+        }
+
+        ms_logring_flush();
+    }
+
+    return NULL;
+}
+
+// 写出各日志环中的日志，记录新丢弃的行数
+static void ms_logring_flush(void)
+{
+    uint64_t drops = 0;
+
+    pthread_mutex_lock(&(g_ms_logring.lock));
+    drops = ms_logring_collect();
+    pthread_mutex_unlock(&(g_ms_logring.lock));
+
+    if (drops > 0)
+    {
+        ms_errlog(MS_ERRLOG_WARN, 0, "log ring full, dropped \"%uL\" lines",
+                drops);
+    }
+}
+
+// 写出各日志环中的日志，处理重新打开的请求，返回新丢弃的行数；调用者持有锁
+static uint64_t ms_logring_collect(void)
+{
+    uint64_t drops = 0;
+    uint64_t total = 0;
+    ms_logring_buf_t *buf = NULL;
+
+    ms_logring_drain(MS_LOGRING_ACCESS, ms_acclog_fd());
+    ms_logring_drain(MS_LOGRING_ERROR, ms_errlog_fd());
+
+    // 轮转前缓冲的日志已写入旧文件
+    if (__atomic_exchange_n(&(g_ms_logring.reopen), 0, __ATOMIC_SEQ_CST))
+    {
+        ms_errlog_reopen();
+        ms_acclog_reopen();
+    }
+
+    for (int i = 0; i < g_ms_logring.nrings; i++)
+    {
+        for (int j = 0; j < MS_LOGRING_FILES; j++)
+        {
+            buf = &(g_ms_logring.rings[i]->bufs[j]);
+            drops = __atomic_load_n(&(buf->drops), __ATOMIC_RELAXED);
+            total += drops - buf->shown;
+            buf->shown = drops;
+        }
+    }
+
+    return total;
+}
+
+// 将各日志环中属于 file 的日志以一次 writev() 写入 fd，部分写入时继续写剩余的部分
+static void ms_logring_drain(int file, int fd)
+{
+    int n;
+    ssize_t nwrite;
+    uint64_t len;
+    uint64_t off;
+    uint64_t total;
+    uint64_t heads[MS_LOGRING_MAX_RINGS];
+    ms_logring_buf_t *buf = NULL;
+    struct iovec iov[MS_LOGRING_MAX_RINGS * 2];
+
+    // 只写出此时各环中已有的日志，写完之前不再读取 head: 部分写入后若重新读取，
+    // 前面的环中新追加的行会插入到后面的环中写了一半的行中间
+    for (int i = 0; i < g_ms_logring.nrings; i++)
+    {
+        buf = &(g_ms_logring.rings[i]->bufs[file]);
+        heads[i] = __atomic_load_n(&(buf->head), __ATOMIC_ACQUIRE);
+    }
+
+    for (;;)
+    {
+        n = 0;
+        total = 0;
+        for (int i = 0; i < g_ms_logring.nrings; i++)
+        {
+            buf = &(g_ms_logring.rings[i]->bufs[file]);
+            len = heads[i] - buf->tail;
+            if (len == 0)
+            {
+                continue;
+            }
+
+            // 跨过环的末尾时分为两段
+            off = buf->tail & (g_ms_logring.size - 1);
+            iov[n].iov_base = buf->data + off;
+            iov[n].iov_len = ms_min(len, g_ms_logring.size - off);
+            if (iov[n].iov_len < len)
+            {
+                iov[n + 1].iov_base = buf->data;
+                iov[n + 1].iov_len = len - iov[n].iov_len;
+                n++;
+            }
+            n++;
+            total += len;
+        }
+
+        if (n == 0)
+        {
+            return;
+        }
+
+        nwrite = writev(fd, iov, n);
+        if (nwrite == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        // 写入失败时丢弃，与直接写入时一致
+        if (nwrite == -1)
+        {
+            nwrite = total;
+        }
+
+        // 按 iov 的顺序推进各环的 tail，释放已写入的空间
+        for (int i = 0; i < g_ms_logring.nrings; i++)
+        {
+            buf = &(g_ms_logring.rings[i]->bufs[file]);
+            len = ms_min(heads[i] - buf->tail, (uint64_t)nwrite);
+            __atomic_store_n(&(buf->tail), buf->tail + len, __ATOMIC_RELEASE);
+            nwrite -= len;
+        }
+    }
+}
+
+// 唤醒 flusher，flusher 读取前的多次调用只写一次 eventfd
+static void ms_logring_wakeup(void)
+{
+    uint64_t one = 1;
+    ssize_t nwrite;
+
+    if (__atomic_exchange_n(&(g_ms_logring.notified), 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+
+    do {
+        nwrite = write(g_ms_logring.notifyfd, &one, sizeof(one));
+    } while (nwrite == -1 && errno == EINTR);
+}
+
+// 释放日志环
+static void ms_logring_free(ms_logring_t *ring)
+{
+    for (int i = 0; i < MS_LOGRING_FILES; i++)
+    {
+        free(ring->bufs[i].data);
+    }
+    free(ring);
+}
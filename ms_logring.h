@@ -0,0 +1,56 @@
+// 异步日志: 每个 worker 线程挂接一个日志环，ms_acclog()/ms_errlog() 将格式化好的行追加到
+// 所属线程的环中，不经过系统调用；进程中的 flusher 线程定期(或在环过半时被唤醒)取出各环中的日志，
+// 每个日志文件以一次 writev() 写入。每个环只有一个生产者(所属线程)与一个消费者(flusher)，不加锁。
+// 未挂接日志环的线程(master、线程池中的线程等)以及信号处理函数中的日志仍直接 write()。
+#ifndef _MS_LOGRING_H
+#define _MS_LOGRING_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#define MS_LOGRING_ACCESS    0  // 访问日志
+#define MS_LOGRING_ERROR     1  // 错误日志
+#define MS_LOGRING_FILES     2
+
+#define MS_LOGRING_DROP      0  // 环满时丢弃该行并计数，由 flusher 记录到错误日志
+#define MS_LOGRING_BLOCK     1  // 环满时等待 flusher 腾出空间
+
+#define MS_LOGRING_MAX_RINGS 64 // 每个进程挂接的日志环的最大数目
+#define MS_LOGRING_FLUSH_MS  10 // flusher 两次写入的最大间隔，毫秒
+
+typedef struct ms_logring_s     ms_logring_t;
+typedef struct ms_logring_buf_s ms_logring_buf_t;
+
+// 单生产者单消费者的字节环，head/tail 单调递增，对 size 取模得到偏移
+struct ms_logring_buf_s {
+    char     *data;  // 环的存储空间
+    uint64_t  head;  // 生产者写入的位置，只由所属线程修改
+    uint64_t  tail;  // 消费者读取的位置，只由 flusher 修改
+    uint64_t  drops; // 环满时丢弃的行数，只由所属线程修改
+    uint64_t  shown; // 已记录到错误日志的丢弃行数，只由 flusher 修改
+};
+
+// 每个线程的日志环，访问日志与错误日志各占一个字节环
+struct ms_logring_s {
+    ms_logring_buf_t bufs[MS_LOGRING_FILES];
+    volatile int     busy; // 正在追加，信号处理函数中的日志不再进入环
+};
+
+int ms_logring_start(size_t size, int policy);
+int ms_logring_attach(void);
+void ms_logring_ids(pid_t *pid, pid_t *tid);
+int ms_logring_write(int file, const char *line, size_t len);
+int ms_logring_reopen(void);
+void ms_logring_detach(void);
+void ms_logring_stop(void);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
@@ -0,0 +1,447 @@
+// ms_microbench: 热路径基础模块的微基准测试，结果为每个用例一行 JSON，便于比较不同版本的结果。
+// 进程绑定到一个 CPU，每个用例先预热若干轮，再测量若干轮，以时间戳计数器(rdtsc)记录每次操作的周期数，
+// 取各轮的最小值、中位数与最大值；非 x86 平台以纳秒代替周期数。
+// 用法: ms_microbench [-c cpu] [-w warmup_rounds] [-r rounds] [filter]，filter 为用例名称的子串。
+#include "ms_rbtree.h"
+#include "ms_wheel.h"
+#include "ms_mem.h"
+#include "ms_str.h"
+#include "ms_time.h"
+#include "ms_errlog.h"
+
+#include <sched.h>
+
+#define MS_MICRO_N       65536 // 每轮的操作数
+#define MS_MICRO_ROUNDS  15    // 默认的测量轮数
+#define MS_MICRO_WARMUP  3     // 默认的预热轮数
+#define MS_MICRO_TIMEOUT 60000 // 定时器的超时时间，毫秒
+#define MS_MICRO_BURST   64    // 同一毫秒内添加的定时器数
+#define MS_MICRO_RESET   256   // 内存池每分配多少次重置一次
+
+typedef struct ms_micro_case_s ms_micro_case_t;
+
+// 用例: setup 准备每轮的数据，不计时；run 为计时的部分，返回操作数
+struct ms_micro_case_s {
+    const char *name;
+    void      (*setup)(void);
+    uintptr_t (*run)(void);
+};
+
+static void ms_micro_rbtree_random(void);
+static void ms_micro_rbtree_same(void);
+static void ms_micro_rbtree_filled(void);
+static uintptr_t ms_micro_rbtree_insert(void);
+static uintptr_t ms_micro_rbtree_delete_min(void);
+static uintptr_t ms_micro_rbtree_min(void);
+static void ms_micro_wheel_empty(void);
+static void ms_micro_wheel_filled(void);
+static uintptr_t ms_micro_wheel_add_del(void);
+static uintptr_t ms_micro_wheel_expire(void);
+static void ms_micro_mem_setup(void);
+static uintptr_t ms_micro_mem_pcalloc(void);
+static uintptr_t ms_micro_str_acclog(void);
+static uintptr_t ms_micro_str_numbers(void);
+static uintptr_t ms_micro_time_stamp(void);
+static uintptr_t ms_micro_errlog_write(void);
+static uintptr_t ms_micro_errlog_filtered(void);
+static void ms_micro_none(void);
+static uint32_t ms_micro_random(void);
+static uint64_t ms_micro_cycles(void);
+static int ms_micro_cmp(const void *a, const void *b);
+static void ms_micro_measure(ms_micro_case_t *c, int cpu, int warmup,
+        int rounds);
+
+static ms_micro_case_t ms_micro_cases[] = {
+    { "rbtree_insert_random"    , ms_micro_rbtree_random, ms_micro_rbtree_insert     },
+    { "rbtree_insert_same"      , ms_micro_rbtree_same  , ms_micro_rbtree_insert     },
+    { "rbtree_delete_min"       , ms_micro_rbtree_filled, ms_micro_rbtree_delete_min },
+    { "rbtree_min"              , ms_micro_rbtree_filled, ms_micro_rbtree_min        },
+    { "wheel_add_del_same"      , ms_micro_wheel_empty  , ms_micro_wheel_add_del     },
+    { "wheel_expire"            , ms_micro_wheel_filled , ms_micro_wheel_expire      },
+    { "mem_pcalloc_mixed"       , ms_micro_mem_setup    , ms_micro_mem_pcalloc       },
+    { "str_vslprintf_acclog"    , ms_micro_none         , ms_micro_str_acclog        },
+    { "str_vslprintf_numbers"   , ms_micro_none         , ms_micro_str_numbers       },
+    { "time_stamp"              , ms_micro_none         , ms_micro_time_stamp        },
+    { "errlog_write"            , ms_micro_none         , ms_micro_errlog_write      },
+    { "errlog_filtered"         , ms_micro_none         , ms_micro_errlog_filtered   },
+    { NULL                      , NULL                  , NULL                       }
+};
+
+static ms_rbtree_t       rbtree;
+static ms_rbtree_node_t  rbtree_sentinel;
+static ms_rbtree_node_t  rbtree_nodes[MS_MICRO_N];
+static ms_wheel_t        wheel;
+static ms_wheel_node_t   wheel_nodes[MS_MICRO_N];
+static ms_mem_pool_t    *mem_pool;
+static size_t            mem_sizes[MS_MICRO_N];
+static char              str_buf[MS_MAX_BUF_SIZE];
+static uint32_t          random_state = 2463534242u;
+static volatile uintptr_t sink; // 防止编译器优化掉结果
+
+int main(int argc, char **argv)
+{
+    int opt = 0;
+    int cpu = sched_getcpu();
+    int warmup = MS_MICRO_WARMUP;
+    int rounds = MS_MICRO_ROUNDS;
+    const char *filter = NULL;
+    cpu_set_t set;
+
+    while ((opt = getopt(argc, argv, "c:w:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': cpu = atoi(optarg);    break;
+            case 'w': warmup = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            default:
+                printf("Usage: %s [-c cpu] [-w warmup_rounds] [-r rounds] "
+                        "[filter]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind < argc)
+    {
+        filter = argv[optind];
+    }
+    rounds = rounds > 0 ? rounds : 1;
+    warmup = warmup > 0 ? warmup : 0;
+
+    // 绑定 CPU，避免迁移与不同核心的频率差异
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1)
+    {
+        fprintf(stderr, "sched_setaffinity() cpu %d failed: %s\n", cpu,
+                strerror(errno));
+        return 1;
+    }
+
+    // 错误日志写入 /dev/null，只测量格式化与 write() 的开销
+    if (ms_errlog_init("/dev/null", MS_ERRLOG_ERR) == MS_ERROR)
+    {
+        return 1;
+    }
+
+    mem_pool = ms_mem_pool_create(MS_MEM_POOL_DEFAULT_SIZE);
+    if (mem_pool == NULL)
+    {
+        return 1;
+    }
+
+    for (ms_micro_case_t *c = ms_micro_cases; c->name != NULL; c++)
+    {
+        if (filter == NULL || strstr(c->name, filter) != NULL)
+        {
+            ms_micro_measure(c, cpu, warmup, rounds);
+        }
+    }
+
+    ms_mem_pool_destory(&mem_pool);
+    ms_errlog_close();
+
+    return 0;
+}
+
+// 预热后测量 rounds 轮，输出每次操作的周期数
+static void ms_micro_measure(ms_micro_case_t *c, int cpu, int warmup,
+        int rounds)
+{
+    uintptr_t ops = 0;
+    uint64_t cycles = 0;
+    uint64_t ns = 0;
+    double *cpo = (double *)calloc(rounds, sizeof(double));
+    double *npo = (double *)calloc(rounds, sizeof(double));
+
+    if (cpo == NULL || npo == NULL)
+    {
+        free(cpo);
+        free(npo);
+        return;
+    }
+
+    for (int i = 0; i < warmup; i++)
+    {
+        c->setup();
+        c->run();
+    }
+
+    for (int i = 0; i < rounds; i++)
+    {
+        c->setup();
+
+        ns = ms_time_ns();
+        cycles = ms_micro_cycles();
+        ops = c->run();
+        cycles = ms_micro_cycles() - cycles;
+        ns = ms_time_ns() - ns;
+
+        cpo[i] = (double)cycles / ops;
+        npo[i] = (double)ns / ops;
+    }
+
+    qsort(cpo, rounds, sizeof(double), ms_micro_cmp);
+    qsort(npo, rounds, sizeof(double), ms_micro_cmp);
+
+    printf("{\"bench\": \"%s\", \"cpu\": %d, \"ops\": %lu, \"rounds\": %d, "
+            "\"cycles_min\": %.2f, \"cycles_median\": %.2f, "
+            "\"cycles_max\": %.2f, \"ns_median\": %.2f}\n", c->name, cpu,
+            (unsigned long)ops, rounds, cpo[0], cpo[rounds / 2],
+            cpo[rounds - 1], npo[rounds / 2]);
+    fflush(stdout);
+
+    free(cpo);
+    free(npo);
+}
+
+// 随机的 key
+static void ms_micro_rbtree_random(void)
+{
+    ms_rbtree_init(&rbtree, &rbtree_sentinel, ms_rbtree_insert_value);
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        rbtree_nodes[i].key = ms_micro_random();
+    }
+}
+
+// 定时器的 key: 超时时间相同，同一毫秒内添加的定时器 key 相同
+static void ms_micro_rbtree_same(void)
+{
+    ms_rbtree_init(&rbtree, &rbtree_sentinel, ms_rbtree_insert_timer_value);
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        rbtree_nodes[i].key = MS_MICRO_TIMEOUT + i / MS_MICRO_BURST;
+    }
+}
+
+// 插入随机 key 的结点
+static void ms_micro_rbtree_filled(void)
+{
+    ms_micro_rbtree_random();
+    ms_micro_rbtree_insert();
+}
+
+static uintptr_t ms_micro_rbtree_insert(void)
+{
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        ms_rbtree_insert(&rbtree, &rbtree_nodes[i]);
+    }
+
+    return MS_MICRO_N;
+}
+
+// 按 eventloop 处理超时的方式: 反复取最小的结点并删除
+static uintptr_t ms_micro_rbtree_delete_min(void)
+{
+    ms_rbtree_node_t *node = NULL;
+
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        node = ms_rbtree_min(rbtree.root, rbtree.sentinel);
+        ms_rbtree_delete(&rbtree, node);
+    }
+
+    return MS_MICRO_N;
+}
+
+static uintptr_t ms_micro_rbtree_min(void)
+{
+    uintptr_t key = 0;
+
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        key += ms_rbtree_min(rbtree.root, rbtree.sentinel)->key;
+    }
+    sink = key;
+
+    return MS_MICRO_N;
+}
+
+static void ms_micro_wheel_empty(void)
+{
+    ms_wheel_init(&wheel, 0);
+}
+
+// 超时时间点分布在 1 秒内的定时器
+static void ms_micro_wheel_filled(void)
+{
+    ms_wheel_init(&wheel, 0);
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        wheel_nodes[i].key = 1 + ms_micro_random() % 1000;
+        ms_wheel_add(&wheel, &wheel_nodes[i]);
+    }
+}
+
+// 超时时间相同的定时器: 添加后按添加顺序删除，如连接在超时前收到数据
+static uintptr_t ms_micro_wheel_add_del(void)
+{
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        wheel_nodes[i].key = MS_MICRO_TIMEOUT + i / MS_MICRO_BURST;
+        ms_wheel_add(&wheel, &wheel_nodes[i]);
+    }
+
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        ms_wheel_del(&wheel, &wheel_nodes[i]);
+    }
+
+    return 2 * MS_MICRO_N;
+}
+
+// 每次推进 1 毫秒，取出全部超时的定时器
+static uintptr_t ms_micro_wheel_expire(void)
+{
+    uintptr_t n = 0;
+    ms_wheel_node_t *node = NULL;
+
+    for (uintptr_t now = 1; now <= 1000; now++)
+    {
+        while ((node = ms_wheel_expire(&wheel, now)) != NULL)
+        {
+            ms_wheel_del(&wheel, node);
+            n++;
+        }
+    }
+
+    return n;
+}
+
+// 大小混合的分配: 70% 为 8~64 字节，25% 为 64~512 字节，5% 为超过小块内存上限的大块内存
+static void ms_micro_mem_setup(void)
+{
+    uint32_t r = 0;
+
+    if (mem_sizes[0] != 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        r = ms_micro_random();
+        if (r % 100 < 70)
+        {
+            mem_sizes[i] = 8 + r / 100 % 57;
+        }
+        else if (r % 100 < 95)
+        {
+            mem_sizes[i] = 64 + r / 100 % 449;
+        }
+        else
+        {
+            mem_sizes[i] = MS_MEM_POOL_DEFAULT_SIZE + 1 + r / 100 % 8192;
+        }
+    }
+}
+
+// 每 MS_MICRO_RESET 次分配重置一次内存池，重置的开销计入
+static uintptr_t ms_micro_mem_pcalloc(void)
+{
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        sink = (uintptr_t)ms_mem_pool_pcalloc(mem_pool, mem_sizes[i]);
+        if ((i + 1) % MS_MICRO_RESET == 0)
+        {
+            ms_mem_pool_reset(mem_pool);
+        }
+    }
+    ms_mem_pool_reset(mem_pool);
+
+    return MS_MICRO_N;
+}
+
+// 访问日志的格式
+static uintptr_t ms_micro_str_acclog(void)
+{
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        sink = (uintptr_t)ms_str_slprintf(str_buf, str_buf + sizeof(str_buf),
+                "fd:%05d %s<->%05d relen:%z selen:%z", i & 0xffff,
+                "127.0.0.1", i & 0x7fff, (size_t)i, (size_t)i * 3);
+    }
+
+    return MS_MICRO_N;
+}
+
+// 各种宽度与进制的整数、浮点数
+static uintptr_t ms_micro_str_numbers(void)
+{
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        sink = (uintptr_t)ms_str_slprintf(str_buf, str_buf + sizeof(str_buf),
+                "%uL %L %8d %08xD %.3f", (uint64_t)i * 1000003,
+                (int64_t)-i, i, (uint32_t)i, i / 7.0);
+    }
+
+    return MS_MICRO_N;
+}
+
+static uintptr_t ms_micro_time_stamp(void)
+{
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        sink = (uintptr_t)ms_time_stamp(str_buf, str_buf + sizeof(str_buf));
+    }
+
+    return MS_MICRO_N;
+}
+
+// 写入错误日志: 时间戳、格式化与 write()
+static uintptr_t ms_micro_errlog_write(void)
+{
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "connect to \"%s:%d\" failed, fd \"%d\"",
+                "127.0.0.1", 8001, i);
+    }
+
+    return MS_MICRO_N;
+}
+
+// 低于日志级别的日志只有级别的判断
+static uintptr_t ms_micro_errlog_filtered(void)
+{
+    for (int i = 0; i < MS_MICRO_N; i++)
+    {
+        ms_errlog(MS_ERRLOG_INFO, 0, "read len \"%d\"", i);
+        sink = i;
+    }
+
+    return MS_MICRO_N;
+}
+
+static void ms_micro_none(void)
+{
+}
+
+// xorshift32，种子固定，每次运行的数据相同
+static uint32_t ms_micro_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+// 时间戳计数器，非 x86 平台以纳秒代替
+static uint64_t ms_micro_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return ms_time_ns();
+#endif
+}
+
+static int ms_micro_cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
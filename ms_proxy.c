@@ -0,0 +1,992 @@
+#include "ms_proxy.h"
+
+#define MS_PROXY_HEADER 0 // 等待响应头
+#define MS_PROXY_BODY   1 // 转发响应体
+#define MS_PROXY_DONE   2 // 响应已接收完成
+
+static char proxy_502[] = "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n";
+static char proxy_504[] = "HTTP/1.1 504 Gateway Timeout\r\nContent-Length: 0\r\n\r\n";
+
+static uint32_t ms_proxy_hash(const char *data, size_t len);
+static int ms_proxy_point_cmp(const void *a, const void *b);
+static void ms_proxy_peer_fail(ms_proxy_peer_t *peer);
+static void ms_proxy_peer_revive(ms_event_loop_t *evlop, void *data);
+static const char *ms_proxy_header(const char *hdr, size_t len,
+        const char *name);
+static void ms_proxy_consume(ms_proxy_req_t *req, size_t n);
+static int ms_proxy_response(ms_conn_t *conn);
+static int ms_proxy_client_send(ms_event_loop_t *evlop, ms_conn_t *conn);
+static int ms_proxy_wait(ms_event_loop_t *evlop, ms_conn_t *conn);
+static void ms_proxy_upstream_start(ms_event_loop_t *evlop, ms_conn_t *conn);
+static int ms_proxy_backup(ms_event_loop_t *evlop, ms_proxy_req_t *req);
+static int ms_proxy_retry(ms_event_loop_t *evlop, ms_conn_t *conn);
+static void ms_proxy_upstream_read(ms_event_loop_t *evlop, ms_conn_t *conn);
+static void ms_proxy_connect_handler(ms_upstream_t *up, int status,
+        void *data);
+static void ms_proxy_upstream_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data);
+static void ms_proxy_client_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data);
+static void ms_proxy_timeout_handler(ms_event_loop_t *evlop, void *data);
+static void ms_proxy_cleanup(ms_event_loop_t *evlop, ms_conn_t *conn, int ok);
+static void ms_proxy_finish(ms_event_loop_t *evlop, ms_conn_t *conn);
+static void ms_proxy_error(ms_event_loop_t *evlop, ms_conn_t *conn,
+        const char *resp);
+
+/***********************************************************
+ * @Func   : ms_proxy_parse()
+ * @Author : lwp
+ * @Brief  : 解析以 ';' 分隔的 ip:port 列表。
+ * @Param  : [in] list : 如 127.0.0.1:8001;127.0.0.1:8002
+ * @Param  : [out] addrs : 解析出的地址，网络字节序
+ * @Param  : [in] max : addrs 的容量
+ * @Return : MS_ERROR : 格式错误或超过 max
+ *           n        : 地址的数目
+ * @Note   : 格式已由配置项的 check_addrs() 检查
+ ***********************************************************/
+int ms_proxy_parse(const char *list, struct sockaddr_in *addrs, int max)
+{
+    int n = 0;
+    char *ptr = NULL;
+    char *colon = NULL;
+    char *saveptr = NULL;
+    char buff[MS_MAX_BUF_SIZE] = { 0 };
+
+    if (strlen(list) >= sizeof(buff))
+    {
+        return MS_ERROR;
+    }
+    strcpy(buff, list);
+
+    for (ptr = strtok_r(buff, ";", &saveptr); ptr != NULL;
+            ptr = strtok_r(NULL, ";", &saveptr))
+    {
+        colon = strchr(ptr, ':');
+        if (colon == NULL || n >= max)
+        {
+            ms_errlog(MS_ERRLOG_ERR, 0, "invalid upstream list \"%s\"", list);
+            return MS_ERROR;
+        }
+        *colon = '\0';
+
+        memset(&addrs[n], 0, sizeof(struct sockaddr_in));
+        addrs[n].sin_family = AF_INET;
+        addrs[n].sin_port = htons(atoi(colon + 1));
+        if (ms_socket_inetpton(AF_INET, ptr, &addrs[n].sin_addr) == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+        n++;
+    }
+
+    return n;
+}
+// @ms_proxy_parse() ok
+
+/***********************************************************
+ * @Func   : ms_proxy_create()
+ * @Author : lwp
+ * @Brief  : 创建 worker 的反向代理。
+ * @Param  : [in] evlop
+ * @Param  : [in] upstream : 该 worker 的上游连接池
+ * @Param  : [in] cycle : 后端列表及负载均衡配置
+ * @Return : NULL  : 失败
+ *           proxy : 成功
+ * @Note   : 内存分配自 evlop 的内存池，随 evlop 一同释放
+ ***********************************************************/
+ms_proxy_t *ms_proxy_create(ms_event_loop_t *evlop,
+        ms_upstream_pool_t *upstream, ms_cycle_t *cycle)
+{
+    char key[64];
+    ms_proxy_t *proxy = NULL;
+    ms_proxy_point_t *point = NULL;
+
+    if (cycle->proxy_npeers <= 0)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "proxy has no upstream");
+        return NULL;
+    }
+
+    proxy = (ms_proxy_t *)ms_mem_pool_pcalloc(evlop->pool, sizeof(ms_proxy_t));
+    if (proxy == NULL)
+    {
+        return NULL;
+    }
+
+    proxy->peers = (ms_proxy_peer_t *)ms_mem_pool_pcalloc(evlop->pool,
+            cycle->proxy_npeers * sizeof(ms_proxy_peer_t));
+    if (proxy->peers == NULL)
+    {
+        return NULL;
+    }
+
+    proxy->evlop = evlop;
+    proxy->upstream = upstream;
+    proxy->npeers = cycle->proxy_npeers;
+    proxy->balance = cycle->proxy_balance;
+    proxy->current = 0;
+    proxy->maxfails = cycle->proxy_maxfails;
+    proxy->failtime = cycle->proxy_failtime;
+
+    for (int i = 0; i < proxy->npeers; i++)
+    {
+        proxy->peers[i].addr = cycle->proxy_peers[i];
+        proxy->peers[i].proxy = proxy;
+    }
+
+    if (proxy->balance != MS_PROXY_HASH)
+    {
+        return proxy;
+    }
+
+    // 一致性哈希: 每个后端以 "ip:port-i" 生成 MS_PROXY_VNODES 个虚拟结点
+    proxy->points = (ms_proxy_point_t *)ms_mem_pool_pcalloc(evlop->pool,
+            proxy->npeers * MS_PROXY_VNODES * sizeof(ms_proxy_point_t));
+    if (proxy->points == NULL)
+    {
+        return NULL;
+    }
+
+    for (int i = 0; i < proxy->npeers; i++)
+    {
+        for (int v = 0; v < MS_PROXY_VNODES; v++)
+        {
+            point = &(proxy->points[proxy->npoints++]);
+            point->peer = i;
+            point->hash = ms_proxy_hash(key, ms_str_snprintf(key, sizeof(key),
+                        "%s:%d-%d",
+                        ms_socket_inetntop(AF_INET, &proxy->peers[i].addr.sin_addr),
+                        ntohs(proxy->peers[i].addr.sin_port), v) - key);
+        }
+    }
+    qsort(proxy->points, proxy->npoints, sizeof(ms_proxy_point_t),
+            ms_proxy_point_cmp);
+
+    return proxy;
+}
+// @ms_proxy_create() ok
+
+/***********************************************************
+ * @Func   : ms_proxy_select()
+ * @Author : lwp
+ * @Brief  : 按负载均衡算法选择一个未被摘除的后端。
+ * @Param  : [in] proxy
+ * @Param  : [in] hash : 一致性哈希时请求的哈希值
+ * @Return : NULL : 所有后端都已被摘除
+ *           peer : 选中的后端
+ * @Note   : 最少连接数相同时轮询；一致性哈希时跳过已摘除的后端
+ ***********************************************************/
+ms_proxy_peer_t *ms_proxy_select(ms_proxy_t *proxy, uint32_t hash)
+{
+    int lo = 0;
+    int hi = 0;
+    int mid = 0;
+    ms_proxy_peer_t *peer = NULL;
+    ms_proxy_peer_t *best = NULL;
+
+    switch (proxy->balance)
+    {
+        case MS_PROXY_LEASTCONN:
+            for (int i = 0; i < proxy->npeers; i++)
+            {
+                peer = &(proxy->peers[(proxy->current + i) % proxy->npeers]);
+                if (!peer->down && (best == NULL || peer->conns < best->conns))
+                {
+                    best = peer;
+                }
+            }
+            proxy->current = (proxy->current + 1) % proxy->npeers;
+            return best;
+
+        case MS_PROXY_HASH:
+            // 查找第一个哈希值不小于 hash 的结点
+            hi = proxy->npoints;
+            while (lo < hi)
+            {
+                mid = lo + (hi - lo) / 2;
+                if (proxy->points[mid].hash < hash)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+
+            for (int i = 0; i < proxy->npoints; i++)
+            {
+                peer = &(proxy->peers[
+                        proxy->points[(lo + i) % proxy->npoints].peer]);
+                if (!peer->down)
+                {
+                    return peer;
+                }
+            }
+            return NULL;
+
+        default:
+            for (int i = 0; i < proxy->npeers; i++)
+            {
+                mid = (proxy->current + i) % proxy->npeers;
+                if (!proxy->peers[mid].down)
+                {
+                    proxy->current = (mid + 1) % proxy->npeers;
+                    return &(proxy->peers[mid]);
+                }
+            }
+            return NULL;
+    }
+}
+// @ms_proxy_select() ok
+
+/***********************************************************
+ * @Func   : ms_proxy_handler()
+ * @Author : lwp
+ * @Brief  : 反向代理模式下处理请求的回调函数。
+ * @Param  : [in] conn
+ * @Param  : [in] recvlen : conn->rbuf 中数据的长度
+ * @Return : MS_ERROR : 请求非法，关闭连接
+ *           MS_AGAIN : 请求不完整
+ *           MS_OK    : 已在 conn->sbuf 中设置错误响应，或需先发送之前请求的响应
+ *           MS_DEFER : 已转发给后端，响应完成后恢复连接
+ * @Note   : 请求体由 Content-Length 或 chunked 编码界定，请求以整段缓冲区块移交给后端，不拷贝
+ ***********************************************************/
+int ms_proxy_handler(ms_conn_t *conn, ssize_t recvlen)
+{
+    int rev = 0;
+    ms_http_request_t hr;
+    ms_upstream_t *up = NULL;
+    ms_proxy_peer_t *peer = NULL;
+    ms_proxy_req_t *req = &(conn->proxy);
+    ms_event_loop_t *evlop = conn->evlop;
+    ms_proxy_t *proxy = ((ms_worker_t *)evlop->data1)->proxy;
+
+    // pipelining: 后端的响应从 sbuf 起始处解析，之前请求的响应发送完成后再转发
+    if (conn->sbuf.size > 0)
+    {
+        return MS_OK;
+    }
+
+    rev = ms_http_parse(&conn->http, &conn->rbuf, &hr);
+    if (rev == MS_AGAIN)
+    {
+        return MS_AGAIN;
+    }
+
+    // 请求非法: 应答错误并关闭连接
+    if (rev == MS_ERROR)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "proxy invalid request, status \"%d\"",
+                conn->http.status);
+        conn->close = 1;
+        return ms_http_error(evlop->bufs, &conn->sbuf, conn->http.status, 1);
+    }
+    conn->close = !hr.keepalive;
+
+    memset(req, 0, sizeof(ms_proxy_req_t));
+    ms_buf_chain_init(&req->ubuf);
+    ms_buf_chain_init(&req->rbak);
+    req->head = (hr.method.len == 4
+            && strncmp(hr.method.data, "HEAD", 4) == 0);
+
+    // 以请求 URI 作为一致性哈希的键
+    peer = ms_proxy_select(proxy, ms_proxy_hash(hr.path.data, hr.path.len));
+    if (peer == NULL)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "proxy has no live upstream");
+        ms_buf_chain_consume(evlop->bufs, &conn->rbuf, hr.mlen);
+        return ms_buf_chain_append(evlop->bufs, &conn->sbuf, proxy_502,
+                sizeof(proxy_502) - 1);
+    }
+
+    ms_acclog("fd:%05d %s<->%05d relen:%z upstream:%d",
+            conn->fd, ms_server_conn_ip(conn), ntohs(conn->addr.sin_port),
+            hr.mlen, (int)(peer - proxy->peers));
+
+    // 请求整段移交给后端
+    ms_buf_chain_move(evlop->bufs, &req->ubuf, &conn->rbuf, hr.mlen);
+    req->peer = peer;
+    peer->conns++;
+
+    up = ms_upstream_get(proxy->upstream, &peer->addr,
+            ms_proxy_connect_handler, conn);
+    if (up == NULL)
+    {
+        ms_proxy_peer_fail(peer);
+        ms_proxy_cleanup(evlop, conn, 0);
+        return ms_buf_chain_append(evlop->bufs, &conn->sbuf, proxy_502,
+                sizeof(proxy_502) - 1);
+    }
+    req->up = up;
+
+    // 复用的空闲连接直接注册写事件，在下一次事件循环中发送请求
+    if (up->state == MS_UPSTREAM_ACTIVE)
+    {
+        // 空闲连接可能已被后端关闭，保留请求的副本以便重试
+        if (up->reused && ms_proxy_backup(evlop, req) == MS_ERROR)
+        {
+            ms_proxy_cleanup(evlop, conn, 0);
+            return ms_buf_chain_append(evlop->bufs, &conn->sbuf, proxy_502,
+                    sizeof(proxy_502) - 1);
+        }
+
+        if (ms_eventloop_file_mod(evlop, up->fd, EPOLLOUT | MS_SEVENT_MODE,
+                    (const ms_event_file_proc *)ms_proxy_upstream_handler, up)
+                == MS_ERROR)
+        {
+            ms_proxy_cleanup(evlop, conn, 0);
+            return ms_buf_chain_append(evlop->bufs, &conn->sbuf, proxy_502,
+                    sizeof(proxy_502) - 1);
+        }
+    }
+
+    if (ms_proxy_wait(evlop, conn) == MS_ERROR)
+    {
+        ms_proxy_cleanup(evlop, conn, 0);
+        return MS_ERROR;
+    }
+
+    return MS_DEFER;
+}
+// @ms_proxy_handler() ok
+
+// FNV-1a，再以 murmur3 的 fmix32 打散，使相近的键均匀分布在哈希环上
+static uint32_t ms_proxy_hash(const char *data, size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (uint8_t)data[i];
+        h *= 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static int ms_proxy_point_cmp(const void *a, const void *b)
+{
+    uint32_t ha = ((const ms_proxy_point_t *)a)->hash;
+    uint32_t hb = ((const ms_proxy_point_t *)b)->hash;
+
+    return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+// 后端失败: 连续失败 maxfails 次时摘除 failtime 毫秒
+static void ms_proxy_peer_fail(ms_proxy_peer_t *peer)
+{
+    ms_proxy_t *proxy = peer->proxy;
+
+    peer->fails++;
+    if (proxy->maxfails <= 0 || peer->fails < proxy->maxfails || peer->down)
+    {
+        return;
+    }
+
+    ms_errlog(MS_ERRLOG_WARN, 0, "upstream \"%s\":\"%d\" down for \"%d\" ms",
+            ms_socket_inetntop(AF_INET, &peer->addr.sin_addr),
+            ntohs(peer->addr.sin_port), proxy->failtime);
+
+    peer->timer = ms_eventloop_timer_add(proxy->evlop, proxy->failtime,
+            (const ms_event_timer_proc *)ms_proxy_peer_revive, peer);
+    peer->down = (peer->timer != NULL);
+}
+
+// 摘除时间已到: 恢复后端，再失败一次即重新摘除，成功一次即清零
+static void ms_proxy_peer_revive(ms_event_loop_t *evlop, void *data)
+{
+    ms_proxy_peer_t *peer = (ms_proxy_peer_t *)data;
+
+    ms_errlog(MS_ERRLOG_WARN, 0, "upstream \"%s\":\"%d\" up",
+            ms_socket_inetntop(AF_INET, &peer->addr.sin_addr),
+            ntohs(peer->addr.sin_port));
+
+    peer->timer = NULL; // 已超时的定时器由 eventloop 回收
+    peer->down = 0;
+    peer->fails = peer->proxy->maxfails - 1;
+}
+
+// 在头部中查找 name 字段(不区分大小写)，返回值的起始地址
+static const char *ms_proxy_header(const char *hdr, size_t len,
+        const char *name)
+{
+    size_t nlen = strlen(name);
+    const char *p = hdr;
+    const char *end = hdr + len;
+
+    // 跳过请求行/状态行
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL)
+    {
+        p++;
+        if ((size_t)(end - p) > nlen && p[nlen] == ':'
+                && strncasecmp(p, name, nlen) == 0)
+        {
+            for (p += nlen + 1; p < end && (*p == ' ' || *p == '\t'); p++);
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+// 由 Content-Length 界定的响应体又接收了 n 字节，多余的数据使上游连接不可复用
+static void ms_proxy_consume(ms_proxy_req_t *req, size_t n)
+{
+    if ((int64_t)n > req->rlen)
+    {
+        req->reuse = 0;
+        n = req->rlen;
+    }
+    req->rlen -= n;
+}
+
+// 解析 conn->sbuf 中后端的响应，确定响应的长度
+// MS_OK:响应已接收完成；MS_AGAIN:未完成；MS_ERROR:响应非法
+static int ms_proxy_response(ms_conn_t *conn)
+{
+    char hdr[MS_PROXY_MAX_HEADER];
+    int rev = 0;
+    int status = 0;
+    intptr_t pos = 0;
+    size_t hlen = 0;
+    const char *val = NULL;
+    ms_proxy_req_t *req = &(conn->proxy);
+
+    while (req->state == MS_PROXY_HEADER)
+    {
+        pos = ms_buf_chain_search(&conn->sbuf, 0, "\r\n\r\n", 4);
+        if (pos == -1)
+        {
+            return conn->sbuf.size >= MS_PROXY_MAX_HEADER ? MS_ERROR : MS_AGAIN;
+        }
+
+        hlen = pos + 4;
+        if (hlen > sizeof(hdr))
+        {
+            return MS_ERROR;
+        }
+        ms_buf_chain_copy(&conn->sbuf, 0, hdr, hlen);
+
+        if (hlen < 12 || strncmp(hdr, "HTTP/1.", 7) != 0)
+        {
+            return MS_ERROR;
+        }
+        status = atoi(hdr + 9);
+
+        // 1xx 中间响应(如 100 Continue)之后还有最终响应: 请求已完整转发，
+        // 丢弃中间响应，继续解析下一个响应头
+        if (status >= 100 && status < 200 && status != 101)
+        {
+            ms_buf_chain_consume(conn->evlop->bufs, &conn->sbuf, hlen);
+            continue;
+        }
+
+        // HTTP/1.1 默认保持连接
+        val = ms_proxy_header(hdr, hlen, "Connection");
+        req->reuse = (hdr[7] == '1')
+            && (val == NULL || strncasecmp(val, "close", 5) != 0);
+        req->state = MS_PROXY_BODY;
+
+        if (status == 101)
+        {
+            // 不支持协议升级，响应头之后的数据不再是 HTTP，两端连接都不复用
+            req->rlen = 0;
+            req->reuse = 0;
+            req->close = 1;
+        }
+        else if (req->head || status == 204 || status == 304)
+        {
+            req->rlen = 0;
+        }
+        else if ((val = ms_proxy_header(hdr, hlen, "Transfer-Encoding"))
+                != NULL && strncasecmp(val, "chunked", 7) == 0)
+        {
+            req->rlen = -1;
+            req->chunk.scan = hlen;
+        }
+        else if ((val = ms_proxy_header(hdr, hlen, "Content-Length")) != NULL)
+        {
+            req->rlen = strtoll(val, NULL, 10);
+        }
+        else
+        {
+            // 由后端关闭连接界定，客户端连接也需在发送完成后关闭
+            req->rlen = -1;
+            req->reuse = 0;
+            req->close = 1;
+            req->chunk.state = MS_HTTP_CHUNK_DONE;
+        }
+
+        // 已接收的部分响应体
+        if (req->rlen >= 0)
+        {
+            ms_proxy_consume(req, conn->sbuf.size - hlen);
+        }
+    }
+
+    if (req->rlen >= 0)
+    {
+        return req->rlen == 0 ? MS_OK : MS_AGAIN;
+    }
+
+    if (req->close)
+    {
+        return MS_AGAIN;
+    }
+
+    rev = ms_http_chunked(&req->chunk, &conn->sbuf);
+
+    // 响应结束后还有多余的数据，上游连接不可复用
+    if (rev == MS_OK && req->chunk.scan < conn->sbuf.size)
+    {
+        req->reuse = 0;
+    }
+
+    return rev;
+}
+
+// 将 conn->sbuf 发送给客户端，发送缓冲区满时注册客户端连接的写事件
+static int ms_proxy_client_send(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    ssize_t rev = 0;
+    ms_proxy_req_t *req = &(conn->proxy);
+
+    rev = ms_buf_chain_writev(evlop->bufs, &conn->sbuf, conn->fd);
+    if (rev == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+
+    if (rev > 0)
+    {
+        ms_stats_add(evlop->stats, bytes_out, rev);
+        req->sent = 1;
+        req->chunk.scan -= ms_min(req->chunk.scan, (size_t)rev);
+    }
+
+    if (conn->sbuf.size > 0 && !req->wevent)
+    {
+        if (ms_eventloop_file_mod(evlop, conn->fd, EPOLLOUT | MS_SEVENT_MODE,
+                    (const ms_event_file_proc *)ms_proxy_client_handler, conn)
+                == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+        req->wevent = 1;
+    }
+    else if (conn->sbuf.size == 0 && req->wevent)
+    {
+        ms_eventloop_file_del(evlop, conn->fd, MS_EVENTLOOP_ALL);
+        req->wevent = 0;
+    }
+
+    return MS_OK;
+}
+
+// 重置超时定时器，后端或客户端在 max_read_timeout 内没有进展时超时
+static int ms_proxy_wait(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    if (conn->timer != NULL)
+    {
+        ms_eventloop_timer_del(evlop, conn->timer);
+        conn->timer = NULL;
+    }
+
+    if (conn->cycle->max_read_timeout > 0)
+    {
+        conn->timer = ms_eventloop_timer_add(evlop,
+                conn->cycle->max_read_timeout,
+                (const ms_event_timer_proc *)ms_proxy_timeout_handler, conn);
+        if (conn->timer == NULL)
+        {
+            return MS_ERROR;
+        }
+    }
+
+    return MS_OK;
+}
+
+// 连接后端完成
+static void ms_proxy_connect_handler(ms_upstream_t *up, int status,
+        void *data)
+{
+    ms_conn_t *conn = (ms_conn_t *)data;
+
+    if (status != MS_OK)
+    {
+        conn->proxy.up = NULL; // 已由 ms_upstream 关闭
+        ms_proxy_peer_fail(conn->proxy.peer);
+        ms_proxy_error(conn->evlop, conn, proxy_502);
+        return;
+    }
+
+    ms_proxy_upstream_start(conn->evlop, conn);
+}
+
+// 注册上游连接的写事件，开始发送请求
+static void ms_proxy_upstream_start(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    ms_upstream_t *up = conn->proxy.up;
+
+    if (ms_eventloop_file_mod(evlop, up->fd, EPOLLOUT | MS_SEVENT_MODE,
+                (const ms_event_file_proc *)ms_proxy_upstream_handler, up)
+            == MS_ERROR)
+    {
+        ms_proxy_error(evlop, conn, proxy_502);
+    }
+}
+
+// 复制待发送给后端的请求到 rbak
+static int ms_proxy_backup(ms_event_loop_t *evlop, ms_proxy_req_t *req)
+{
+    ms_buf_t *b = NULL;
+
+    for (b = req->ubuf.head; b != NULL; b = b->next)
+    {
+        if (ms_buf_chain_append(evlop->bufs, &req->rbak, b->pos,
+                    b->last - b->pos) == MS_ERROR)
+        {
+            ms_buf_chain_free(evlop->bufs, &req->rbak);
+            return MS_ERROR;
+        }
+    }
+    req->retry = 1;
+
+    return MS_OK;
+}
+
+// 复用的空闲连接在收到响应前失败: 后端可能已关闭该连接，在新连接上重试一次，不计入失败
+static int ms_proxy_retry(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    ms_upstream_t *up = NULL;
+    ms_proxy_req_t *req = &(conn->proxy);
+    ms_proxy_t *proxy = ((ms_worker_t *)evlop->data1)->proxy;
+
+    if (!req->retry || req->state != MS_PROXY_HEADER || req->sent
+            || conn->sbuf.size > 0)
+    {
+        return MS_ERROR;
+    }
+    req->retry = 0;
+
+    ms_errlog(MS_ERRLOG_INFO, 0, "clientfd \"%d\" proxy retry on new upstream",
+            conn->fd);
+
+    ms_upstream_close(req->up);
+    req->up = NULL;
+    ms_buf_chain_free(evlop->bufs, &req->ubuf);
+    ms_buf_chain_move(evlop->bufs, &req->ubuf, &req->rbak, req->rbak.size);
+
+    up = ms_upstream_connect(proxy->upstream, &req->peer->addr,
+            ms_proxy_connect_handler, conn);
+    if (up == NULL)
+    {
+        return MS_ERROR;
+    }
+    req->up = up;
+
+    if (ms_proxy_wait(evlop, conn) == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+
+    if (up->state == MS_UPSTREAM_ACTIVE)
+    {
+        ms_proxy_upstream_start(evlop, conn);
+    }
+
+    return MS_OK;
+}
+
+// 上游连接的读写事件: 先发送请求，再接收响应
+static void ms_proxy_upstream_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data)
+{
+    ssize_t rev = 0;
+    ms_upstream_t *up = (ms_upstream_t *)data;
+    ms_conn_t *conn = (ms_conn_t *)up->data;
+    ms_proxy_req_t *req = &(conn->proxy);
+
+    if (req->ubuf.size > 0)
+    {
+        rev = ms_buf_chain_writev(evlop->bufs, &req->ubuf, sockfd);
+        if (rev == MS_ERROR)
+        {
+            if (ms_proxy_retry(evlop, conn) == MS_OK)
+            {
+                return;
+            }
+            ms_proxy_peer_fail(req->peer);
+            ms_proxy_error(evlop, conn, proxy_502);
+            return;
+        }
+
+        // 发送缓冲区已满，等待下一次写事件
+        if (req->ubuf.size > 0)
+        {
+            return;
+        }
+
+        // 请求发送完成，重置为读事件
+        if (ms_eventloop_file_mod(evlop, sockfd, EPOLLIN | MS_SEVENT_MODE,
+                    (const ms_event_file_proc *)ms_proxy_upstream_handler, up)
+                == MS_ERROR)
+        {
+            ms_proxy_error(evlop, conn, proxy_502);
+            return;
+        }
+    }
+
+    ms_proxy_upstream_read(evlop, conn);
+}
+
+// 接收后端的响应并转发给客户端，待发送的数据过多时暂停
+static void ms_proxy_upstream_read(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    int full = 0;
+    ssize_t rev = 0;
+    ms_proxy_req_t *req = &(conn->proxy);
+
+    do
+    {
+        while (conn->sbuf.size < MS_PROXY_MAX_BUFFER)
+        {
+            rev = ms_buf_chain_read(evlop->bufs, &conn->sbuf, req->up->fd,
+                    MS_PROXY_MAX_BUFFER, NULL);
+            if (rev == MS_AGAIN)
+            {
+                break;
+            }
+
+            // 后端关闭连接: 只有由关闭界定的响应是完整的
+            if (rev == MS_ERROR || rev == 0)
+            {
+                if (req->state == MS_PROXY_BODY && req->close)
+                {
+                    ms_proxy_finish(evlop, conn);
+                    return;
+                }
+
+                if (req->state == MS_PROXY_HEADER)
+                {
+                    if (ms_proxy_retry(evlop, conn) == MS_OK)
+                    {
+                        return;
+                    }
+                    ms_proxy_peer_fail(req->peer);
+                }
+                ms_proxy_error(evlop, conn, proxy_502);
+                return;
+            }
+
+            // 收到了响应，不再重试
+            if (req->retry)
+            {
+                req->retry = 0;
+                ms_buf_chain_free(evlop->bufs, &req->rbak);
+            }
+
+            if (req->state == MS_PROXY_BODY && req->rlen >= 0)
+            {
+                ms_proxy_consume(req, rev);
+            }
+
+            rev = ms_proxy_response(conn);
+            if (rev == MS_ERROR)
+            {
+                ms_errlog(MS_ERRLOG_ERR, 0, "proxy invalid response from upstream");
+                ms_proxy_peer_fail(req->peer);
+                ms_proxy_error(evlop, conn, proxy_502);
+                return;
+            }
+
+            if (rev == MS_OK)
+            {
+                ms_proxy_finish(evlop, conn);
+                return;
+            }
+        }
+        full = (conn->sbuf.size >= MS_PROXY_MAX_BUFFER);
+
+        // 响应头接收完成后边接收边发送
+        if (req->state == MS_PROXY_BODY
+                && ms_proxy_client_send(evlop, conn) == MS_ERROR)
+        {
+            ms_proxy_cleanup(evlop, conn, 0);
+            ms_server_conn_close(evlop, conn);
+            return;
+        }
+
+        if (full && conn->sbuf.size >= MS_PROXY_MAX_BUFFER)
+        {
+            // 待发送的数据过多，暂停读取后端，由客户端连接可写时恢复
+            ms_eventloop_file_del(evlop, req->up->fd, MS_EVENTLOOP_ALL);
+            req->paused = 1;
+            break;
+        }
+    } while (full);
+
+    if (ms_proxy_wait(evlop, conn) == MS_ERROR)
+    {
+        ms_proxy_error(evlop, conn, proxy_502);
+    }
+}
+
+// 客户端连接可写: 发送响应，发送完成后恢复读取后端或结束
+static void ms_proxy_client_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data)
+{
+    ms_conn_t *conn = (ms_conn_t *)data;
+    ms_proxy_req_t *req = &(conn->proxy);
+
+    if (ms_proxy_client_send(evlop, conn) == MS_ERROR)
+    {
+        ms_proxy_cleanup(evlop, conn, 0);
+        ms_server_conn_close(evlop, conn);
+        return;
+    }
+
+    // 响应已接收完成，只剩由关闭界定的响应待发送
+    if (req->state == MS_PROXY_DONE)
+    {
+        if (conn->sbuf.size == 0)
+        {
+            ms_server_conn_close(evlop, conn);
+        }
+        return;
+    }
+
+    if (req->paused && conn->sbuf.size < MS_PROXY_MAX_BUFFER)
+    {
+        req->paused = 0;
+        if (ms_eventloop_file_mod(evlop, req->up->fd, EPOLLIN | MS_SEVENT_MODE,
+                    (const ms_event_file_proc *)ms_proxy_upstream_handler,
+                    req->up) == MS_ERROR)
+        {
+            ms_proxy_error(evlop, conn, proxy_502);
+            return;
+        }
+        ms_proxy_upstream_read(evlop, conn);
+        return;
+    }
+
+    if (ms_proxy_wait(evlop, conn) == MS_ERROR)
+    {
+        ms_proxy_cleanup(evlop, conn, 0);
+        ms_server_conn_close(evlop, conn);
+    }
+}
+
+// 后端或客户端超时
+static void ms_proxy_timeout_handler(ms_event_loop_t *evlop, void *data)
+{
+    ms_conn_t *conn = (ms_conn_t *)data;
+
+    ms_errlog(MS_ERRLOG_ERR, 0, "clientfd \"%d\" proxy timeout", conn->fd);
+
+    conn->timer = NULL; // 已超时的定时器由 eventloop 回收
+    if (conn->proxy.state == MS_PROXY_HEADER)
+    {
+        ms_proxy_peer_fail(conn->proxy.peer);
+    }
+    ms_proxy_error(evlop, conn, proxy_504);
+}
+
+// 释放请求占用的上游连接与后端，ok 为 1 时响应完整，上游连接可复用
+static void ms_proxy_cleanup(ms_event_loop_t *evlop, ms_conn_t *conn, int ok)
+{
+    ms_proxy_req_t *req = &(conn->proxy);
+
+    if (conn->timer != NULL)
+    {
+        ms_eventloop_timer_del(evlop, conn->timer);
+        conn->timer = NULL;
+    }
+
+    if (req->up != NULL)
+    {
+        if (ok && req->reuse)
+        {
+            ms_upstream_release(req->up);
+        }
+        else
+        {
+            ms_upstream_close(req->up);
+        }
+        req->up = NULL;
+    }
+
+    if (req->peer != NULL)
+    {
+        req->peer->conns--;
+        if (ok)
+        {
+            req->peer->fails = 0;
+        }
+        req->peer = NULL;
+    }
+
+    ms_buf_chain_free(evlop->bufs, &req->ubuf);
+    ms_buf_chain_free(evlop->bufs, &req->rbak);
+    req->retry = 0;
+}
+
+// 响应接收完成: 归还上游连接，发送剩余的响应后恢复客户端连接
+static void ms_proxy_finish(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    ms_proxy_req_t *req = &(conn->proxy);
+
+    req->state = MS_PROXY_DONE;
+    ms_proxy_cleanup(evlop, conn, 1);
+
+    if (!req->close)
+    {
+        ms_server_conn_resume(evlop, conn);
+        return;
+    }
+
+    // 由关闭界定的响应，发送完成后关闭客户端连接
+    if (ms_proxy_client_send(evlop, conn) == MS_ERROR || conn->sbuf.size == 0)
+    {
+        ms_server_conn_close(evlop, conn);
+        return;
+    }
+
+    if (ms_proxy_wait(evlop, conn) == MS_ERROR)
+    {
+        ms_server_conn_close(evlop, conn);
+    }
+}
+
+// 请求失败: 尚未向客户端发送响应时回复 resp，否则关闭客户端连接
+static void ms_proxy_error(ms_event_loop_t *evlop, ms_conn_t *conn,
+        const char *resp)
+{
+    ms_proxy_req_t *req = &(conn->proxy);
+
+    ms_proxy_cleanup(evlop, conn, 0);
+
+    if (req->sent || req->state == MS_PROXY_DONE)
+    {
+        ms_server_conn_close(evlop, conn);
+        return;
+    }
+
+    ms_buf_chain_free(evlop->bufs, &conn->sbuf);
+    if (ms_buf_chain_append(evlop->bufs, &conn->sbuf, resp, strlen(resp))
+            == MS_ERROR)
+    {
+        ms_server_conn_close(evlop, conn);
+        return;
+    }
+
+    req->state = MS_PROXY_DONE;
+    ms_server_conn_resume(evlop, conn);
+}
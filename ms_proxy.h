@@ -0,0 +1,68 @@
+// 反向代理: 接收客户端的 HTTP 请求，按负载均衡算法选择后端并转发，
+// 后端的响应边接收边发送给客户端。后端连续失败时被暂时摘除(被动健康检查)。
+#ifndef _MS_PROXY_H
+#define _MS_PROXY_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_acclog.h"
+#include "ms_server.h"
+
+#define MS_PROXY_RR        0 // 轮询
+#define MS_PROXY_LEASTCONN 1 // 最少连接数
+#define MS_PROXY_HASH      2 // 按请求 URI 一致性哈希(ketama)
+
+#define MS_PROXY_VNODES     160          // 一致性哈希中每个后端的虚拟结点数
+#define MS_PROXY_MAX_HEADER 8192         // 请求头与响应头的最大长度
+#define MS_PROXY_MAX_BUFFER (256 * 1024) // 未发送给客户端的响应数据的上限，超过时暂停读取后端
+
+typedef struct ms_proxy_point_s ms_proxy_point_t;
+
+// 后端，每个 worker 单独统计
+struct ms_proxy_peer_s {
+    struct sockaddr_in  addr;  // 后端地址，网络字节序
+    ms_proxy_t         *proxy; // 所属的反向代理
+    ms_event_timer_t   *timer; // 摘除后恢复的定时器
+    int                 conns; // 正在处理的请求数
+    int                 fails; // 连续失败的次数
+    int                 down;  // 是否已被摘除
+};
+
+// 一致性哈希环上的结点
+struct ms_proxy_point_s {
+    uint32_t hash; // 虚拟结点的哈希值
+    int      peer; // 对应的后端的下标
+};
+
+// 反向代理，每个 worker 一个
+struct ms_proxy_s {
+    ms_event_loop_t    *evlop;    // 所属的 eventloop
+    ms_upstream_pool_t *upstream; // 上游连接池
+    ms_proxy_peer_t    *peers;    // 后端数组
+    ms_proxy_point_t   *points;   // 一致性哈希环，按哈希值升序
+    int                 npeers;   // 后端的数目
+    int                 npoints;  // 哈希环上的结点数
+    int                 balance;  // 负载均衡算法
+    int                 current;  // 轮询的起始位置
+    int                 maxfails; // 连续失败多少次后摘除，0 代表不摘除
+    int                 failtime; // 摘除的时间，毫秒
+};
+
+int ms_proxy_parse(const char *list, struct sockaddr_in *addrs, int max);
+ms_proxy_t *ms_proxy_create(ms_event_loop_t *evlop,
+        ms_upstream_pool_t *upstream, ms_cycle_t *cycle);
+ms_proxy_peer_t *ms_proxy_select(ms_proxy_t *proxy, uint32_t hash);
+
+int ms_proxy_handler(ms_conn_t *conn, ssize_t recvlen);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
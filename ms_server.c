@@ -1,59 +1,437 @@
 #include "ms_server.h"
+#include "ms_proxy.h"
+#include "ms_static.h"
 
-static void ms_server_conn_close(ms_event_loop_t *evlop, ms_conn_t *conn);
+static void ms_server_worker_run(ms_worker_t *worker);
 static void ms_server_acceable_handler(ms_event_loop_t *evlop, int sockfd,
         uint32_t mask, void *data);
 static void ms_server_readable_handler(ms_event_loop_t *evlop, int sockfd,
         uint32_t mask, void *data);
 static void ms_server_writeable_handler(ms_event_loop_t *evlop, int sockfd,
         uint32_t mask, void *data);
+static int ms_server_conn_send(ms_conn_t *conn);
+static int ms_server_conn_wait_read(ms_event_loop_t *evlop, ms_conn_t *conn);
+static int ms_server_conn_wait_send(ms_event_loop_t *evlop, ms_conn_t *conn);
+static void ms_server_offload_run(void *data);
+static void ms_server_offload_complete(ms_event_loop_t *evlop, void *data);
+static void ms_server_retry_handler(ms_event_loop_t *evlop, ms_conn_t *conn);
+static void ms_server_yield_handler(ms_event_loop_t *evlop, void *data);
+static void ms_server_co_main(void *data);
+static void ms_server_co_resume(ms_event_loop_t *evlop, ms_conn_t *conn);
+static void ms_server_co_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data);
+static void ms_server_co_timeout(ms_event_loop_t *evlop, ms_conn_t *conn);
+static int ms_server_co_wait(ms_conn_t *conn, uint32_t mask, uintptr_t timeout);
 
+// 进程模式: fork() 出的子进程运行第 cycle->worker 个 worker
 void *ms_server_worker_cycle(ms_cycle_t *cycle)
 {
+    ms_worker_t *worker = &(cycle->workerlist[cycle->worker]);
+
     ms_errlog(MS_ERRLOG_STATUS, 0, "worker process \"%P\" run", getpid());
 
-    // 创建 evlop
-    cycle->evlop = ms_eventloop_create(cycle->max_evnlop_size,
-            cycle->max_mempol_size, sizeof(ms_conn_t));
-    if (NULL == cycle->evlop)
+    // reuseport: 关闭其他 worker 的监听套接字
+    if (cycle->reuseport)
+    {
+        for (int i = 0; i < cycle->workers; i++)
+        {
+            if (i != cycle->worker)
+            {
+                ms_socket_close(cycle->listenfds[i]);
+                cycle->listenfds[i] = -1;
+            }
+        }
+    }
+
+    // 启动本进程的 flusher，失败时日志直接写入文件
+    ms_logring_start(cycle->log_ring_size, cycle->log_ring_policy);
+
+    ms_server_worker_run(worker);
+
+    // 写出日志环中剩余的日志
+    ms_logring_stop();
+
+    ms_errlog(MS_ERRLOG_STATUS, 0, "worker process \"%P\" exit", getpid());
+    return NULL;
+}
+
+// 线程模式: 每个 worker 一个线程，绑定到第 id % ncpu 个 CPU
+void *ms_server_worker_thread(void *arg)
+{
+    long ncpu;
+    cpu_set_t cpuset;
+    ms_worker_t *worker = (ms_worker_t *)arg;
+
+    ms_errlog(MS_ERRLOG_STATUS, 0, "worker thread \"%d\" run", worker->id);
+
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu > 0)
+    {
+        CPU_ZERO(&cpuset);
+        CPU_SET(worker->id % ncpu, &cpuset);
+        errno = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (errno != 0)
+        {
+            ms_errlog(MS_ERRLOG_WARN, errno, "pthread_setaffinity_np() failed");
+        }
+    }
+
+    ms_server_worker_run(worker);
+
+    ms_errlog(MS_ERRLOG_STATUS, 0, "worker thread \"%d\" exit", worker->id);
+    return NULL;
+}
+
+// 停止所有 worker 的 eventloop，可在信号处理函数中调用
+void ms_server_workers_stop(ms_cycle_t *cycle)
+{
+    ms_event_loop_t *evlop = NULL;
+
+    __atomic_store_n(&(cycle->stop), 1, __ATOMIC_SEQ_CST);
+
+    for (int i = 0; i < cycle->workers; i++)
+    {
+        evlop = __atomic_load_n(&(cycle->workerlist[i].evlop), __ATOMIC_SEQ_CST);
+        if (evlop != NULL)
+        {
+            ms_eventloop_stop(evlop);
+        }
+    }
+}
+
+// 创建 worker 的 eventloop，注册监听套接字并运行
+static void ms_server_worker_run(ms_worker_t *worker)
+{
+    uint32_t mask = EPOLLIN | EPOLLET;
+    sigset_t sigset;
+    sigset_t oldset;
+    ms_cycle_t *cycle = worker->cycle;
+    ms_event_loop_t *evlop = NULL;
+
+    // 共享监听套接字: 每个连接只唤醒一个 worker
+    if (!cycle->reuseport && cycle->exclusive)
+    {
+        mask |= EPOLLEXCLUSIVE;
+    }
+
+    // 该线程的日志追加到日志环中，由 flusher 写入文件，失败时直接写入；
+    // 同时缓存进程与线程 ID，格式化日志行时不再进入内核
+    ms_logring_attach();
+
+    // 创建 evlop，每个 fd 的 data 存储客户端连接或上游连接
+    evlop = ms_eventloop_create(cycle->max_evnlop_size,
+            cycle->max_openfd_size, cycle->max_mempol_size,
+            ms_max(sizeof(ms_conn_t), sizeof(ms_upstream_t)),
+            cycle->iouring ? MS_EVENTLOOP_URING : MS_EVENTLOOP_EPOLL);
+    if (NULL == evlop)
+    {
+        goto end;
+    }
+    evlop->data1 = worker;
+
+    // 该 worker 在统计区中的槽
+    if (cycle->stats != NULL)
+    {
+        evlop->stats = &(cycle->stats->workers[worker->id]);
+        ms_stats_set(evlop->stats, pid,
+                cycle->threads ? (int64_t)syscall(SYS_gettid) : getpid());
+    }
+
+    // 创建线程池，线程池中的线程阻塞所有信号
+    if (cycle->offload_threads > 0)
+    {
+        worker->offload = (ms_thpool_t *)ms_mem_pool_pcalloc(evlop->pool,
+                sizeof(ms_thpool_t));
+        if (worker->offload == NULL)
+        {
+            goto end;
+        }
+
+        sigfillset(&sigset);
+        pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+        if (ms_thpool_create(worker->offload, cycle->offload_threads,
+                    cycle->offload_queue) == MS_ERROR)
+        {
+            worker->offload = NULL;
+        }
+        pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+        if (worker->offload == NULL)
+        {
+            goto end;
+        }
+    }
+
+    // 创建协程池
+    if (cycle->coroutine)
+    {
+        worker->copool = (ms_co_pool_t *)ms_mem_pool_pcalloc(evlop->pool,
+                sizeof(ms_co_pool_t));
+        if (worker->copool == NULL)
+        {
+            goto end;
+        }
+        ms_co_pool_init(worker->copool, cycle->co_stack_size, MS_CO_MAX_FREE);
+    }
+
+    // 创建上游连接池
+    worker->upstream = (ms_upstream_pool_t *)ms_mem_pool_pcalloc(evlop->pool,
+            sizeof(ms_upstream_pool_t));
+    if (worker->upstream == NULL)
+    {
+        goto end;
+    }
+    ms_upstream_pool_init(worker->upstream, evlop, cycle->upstream_idle,
+            cycle->upstream_itime, cycle->upstream_ctime);
+
+    // 创建反向代理
+    if (cycle->proxy)
+    {
+        worker->proxy = ms_proxy_create(evlop, worker->upstream, cycle);
+        if (worker->proxy == NULL)
+        {
+            ms_errlog(MS_ERRLOG_ERR, 0, "create proxy failed");
+            goto end;
+        }
+    }
+
+    // 创建打开文件的缓存
+    if (cycle->staticfile)
+    {
+        worker->statics = ms_static_cache_create(evlop, cycle->static_root,
+                cycle->static_cache, cycle->static_ttl);
+        if (worker->statics == NULL)
+        {
+            goto end;
+        }
+    }
+
+    // 创建 UDP 监听套接字，各 worker 以 SO_REUSEPORT 绑定同一端口
+    if (cycle->udp_port > 0)
+    {
+        worker->udp = ms_udp_create(evlop, cycle->server_ip, cycle->udp_port,
+                cycle->udp_batch, cycle->udp_handler, cycle);
+        if (worker->udp == NULL)
+        {
+            goto end;
+        }
+    }
+    __atomic_store_n(&(worker->evlop), evlop, __ATOMIC_SEQ_CST);
+
+    // 在 evlop 创建前已收到退出信号
+    if (__atomic_load_n(&(cycle->stop), __ATOMIC_SEQ_CST))
     {
         goto end;
     }
 
     // 注册监听套接字建议使用 EPOLLET
-    if (ms_eventloop_file_add(cycle->evlop, cycle->listenfd, EPOLLIN | EPOLLET,
+    if (ms_eventloop_file_add(evlop, worker->listenfd, mask,
                 (const ms_event_file_proc *)ms_server_acceable_handler, cycle)
             == MS_ERROR)
     {
         goto end;
     }
 
-    ms_eventloop_main(cycle->evlop, cycle->max_epwt_timeout);
+    ms_eventloop_main(evlop, cycle->max_epwt_timeout);
 
 end:
-    // 销毁 evlop
-    ms_eventloop_destory(cycle->evlop);
+    // 先销毁线程池，确保没有任务再投递到 evlop
+    if (worker->offload != NULL)
+    {
+        ms_thpool_destory(worker->offload);
+        worker->offload = NULL;
+    }
 
-    ms_errlog(MS_ERRLOG_STATUS, 0, "worker process \"%P\" exit", getpid());
-    return NULL;
+    // 关闭缓存中打开的文件
+    if (worker->statics != NULL)
+    {
+        ms_static_cache_destory(worker->statics);
+        worker->statics = NULL;
+    }
+
+    // 关闭 UDP 监听套接字
+    if (worker->udp != NULL)
+    {
+        ms_udp_destory(worker->udp);
+        worker->udp = NULL;
+    }
+
+    // 关闭空闲的上游连接
+    if (worker->upstream != NULL)
+    {
+        ms_upstream_pool_destory(worker->upstream);
+        worker->upstream = NULL;
+    }
+
+    // 释放协程池中空闲的协程
+    if (worker->copool != NULL)
+    {
+        ms_errlog(MS_ERRLOG_INFO, 0, "co pool alloc \"%uL\" free \"%uL\"",
+                (uint64_t)worker->copool->nalloc,
+                (uint64_t)worker->copool->nfree);
+        ms_co_pool_destory(worker->copool);
+        worker->copool = NULL;
+    }
+
+    // 销毁 evlop，监听套接字由 master 关闭
+    __atomic_store_n(&(worker->evlop), NULL, __ATOMIC_SEQ_CST);
+    if (evlop != NULL)
+    {
+        ms_stats_set(evlop->stats, pid, 0);
+        ms_eventloop_file_del(evlop, worker->listenfd, MS_EVENTLOOP_ALL);
+    }
+    ms_eventloop_destory(evlop);
+
+    // 写出该线程的日志环中剩余的日志
+    ms_logring_detach();
 }
 
-static void ms_server_conn_close(ms_event_loop_t *evlop, ms_conn_t *conn)
+// 在监听套接字上设置 accept() 返回的连接继承的选项，避免每个连接都调用 setsockopt()
+int ms_server_listenfd_init(ms_cycle_t *cycle, int listenfd)
+{
+    // 设置 tcpnodelay
+    if (cycle->tcpnodelay)
+    {
+        if (ms_socket_tcpnodelay(listenfd, cycle->tcpnodelay) == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+    }
+
+    // 设置 keepalive
+    if (cycle->keepalive)
+    {
+        if (ms_socket_keepalive(listenfd, cycle->keepidle, cycle->keepintl,
+                    cycle->keepcout) == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+    }
+
+    return MS_OK;
+}
+
+// 将耗时的请求提交到线程池，成功时 proce_handler 应返回 MS_DEFER
+// MS_OK:已提交；MS_BUSY:队列已满；MS_ERROR:未启用线程池
+int ms_server_conn_offload(ms_conn_t *conn, offload_work *work,
+        offload_done *done, void *data)
+{
+    ms_worker_t *worker = (ms_worker_t *)conn->evlop->data1;
+
+    if (worker == NULL || worker->offload == NULL)
+    {
+        return MS_ERROR;
+    }
+
+    conn->offload.job.proc = ms_server_offload_run;
+    conn->offload.job.data = conn;
+    conn->offload.task.proc = ms_server_offload_complete;
+    conn->offload.task.data = conn;
+    conn->offload.work = work;
+    conn->offload.done = done;
+    conn->offload.data = data;
+
+    return ms_thpool_submit(worker->offload, &(conn->offload.job));
+}
+
+// 返回连接对端的 ip，仅在需要时格式化
+const char *ms_server_conn_ip(ms_conn_t *conn)
+{
+    return ms_socket_inetntop(AF_INET, &conn->addr.sin_addr);
+}
+
+// 恢复被 MS_DEFER 暂停的连接: 发送 conn->sbuf 中的响应，恢复读写事件
+void ms_server_conn_resume(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    int rev = 0;
+
+    // 直接发送响应，发送缓冲区满时注册写事件
+    rev = ms_server_conn_send(conn);
+    if (rev == MS_ERROR)
+    {
+        goto end;
+    }
+
+    if (rev == MS_AGAIN)
+    {
+        if (ms_eventloop_file_mod(evlop, conn->fd, EPOLLOUT | MS_SEVENT_MODE,
+                    (const ms_event_file_proc *)ms_server_writeable_handler,
+                    conn) == MS_ERROR)
+        {
+            goto end;
+        }
+
+        if (ms_server_conn_wait_send(evlop, conn) == MS_ERROR)
+        {
+            goto end;
+        }
+        return;
+    }
+
+    // 恢复读事件，暂停期间到达的数据会立即触发读事件
+    if (ms_eventloop_file_mod(evlop, conn->fd, EPOLLIN | MS_SEVENT_MODE,
+                (const ms_event_file_proc *)ms_server_readable_handler, conn)
+            == MS_ERROR)
+    {
+        goto end;
+    }
+
+    // 已缓存了下一个请求，或暂停读取时套接字中还有数据，或对端已关闭写端时立即处理
+    if (conn->rbuf.size > 0 || conn->rfull || conn->eof)
+    {
+        ms_server_readable_handler(evlop, conn->fd, EPOLLIN, conn);
+        return;
+    }
+
+    if (ms_server_conn_wait_read(evlop, conn) == MS_ERROR)
+    {
+        goto end;
+    }
+
+    return;
+end:
+    ms_server_conn_close(evlop, conn);
+}
+
+// 暂停连接，ms 毫秒后恢复并再次处理 conn->rbuf 中的请求，成功时 proce_handler 应返回 MS_DEFER
+// 用于等待其他 worker 完成计算，如响应缓存中相同请求的未命中
+int ms_server_conn_retry(ms_conn_t *conn, int ms)
+{
+    conn->timer = ms_eventloop_timer_add(conn->evlop, ms > 0 ? ms : 1,
+            (const ms_event_timer_proc *)ms_server_retry_handler, conn);
+    if (conn->timer == NULL)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "ms_eventloop_timer_add() failed");
+        return MS_ERROR;
+    }
+
+    return MS_OK;
+}
+
+void ms_server_conn_close(ms_event_loop_t *evlop, ms_conn_t *conn)
 {
     ms_errlog(MS_ERRLOG_INFO, 0, "close fd \"%d\"", conn->fd);
+    ms_stats_add(evlop->stats, active, -1);
 
-    // 删除 rtimeout_timer
-    if (conn->rtimeout_timer != NULL)
+    // 删除超时定时器
+    if (conn->timer != NULL)
     {
-        ms_eventloop_timer_del(evlop, conn->rtimeout_timer);
-        conn->rtimeout_timer = NULL;
+        ms_eventloop_timer_del(evlop, conn->timer);
+        conn->timer = NULL;
     }
 
-    // 删除 stimeout_timer
-    if (conn->stimeout_timer != NULL)
+    // 归还接收 & 发送缓冲区链
+    ms_buf_chain_free(evlop->bufs, &conn->rbuf);
+    ms_buf_chain_free(evlop->bufs, &conn->sbuf);
+
+    // 归还正在发送的文件
+    ms_static_release(conn);
+
+    // 归还协程，不可在该连接的协程中调用
+    if (conn->co != NULL)
     {
-        ms_eventloop_timer_del(evlop, conn->stimeout_timer);
-        conn->stimeout_timer = NULL;
+        ms_co_free(((ms_worker_t *)evlop->data1)->copool, conn->co);
+        conn->co = NULL;
     }
 
     // 删除该连接注册的所有事件
@@ -68,77 +446,62 @@ static void ms_server_acceable_handler(ms_event_loop_t *evlop, int sockfd,
 {
     int clientfd;
     ms_conn_t *conn;
+    ms_event_file_t *file;
     ms_cycle_t *cycle = (ms_cycle_t *)data;
     struct sockaddr_in addr;
-    socklen_t addrlen = sizeof(addr);
+    socklen_t addrlen;
 
-    while (memset(&addr, 0, sizeof(addr)) &&
-            (clientfd = ms_socket_accept(sockfd, (struct sockaddr *)&addr, &addrlen)) > 0)
+    // 非阻塞、tcpnodelay、keepalive 均继承自监听套接字，见 ms_server_listenfd_init()
+    while ((addrlen = sizeof(addr)) &&
+            (clientfd = ms_socket_accept4(sockfd, (struct sockaddr *)&addr,
+                    &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC)) > 0)
     {
         ms_errlog(MS_ERRLOG_INFO, 0, "new client \"%d\" from \"%s\":\"%d\"",
-                clientfd, inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+                clientfd, ms_socket_inetntop(AF_INET, &addr.sin_addr),
+                ntohs(addr.sin_port));
+        ms_stats_add(evlop->stats, accepts, 1);
 
-        // 判断客户端数量
-        if (clientfd >= evlop->size)
+        // 获取该 fd 对应的 conn 结构体，fd 超过上限时关闭
+        file = ms_eventloop_file_get(evlop, clientfd);
+        if (file == NULL)
         {
-            ms_errlog(MS_ERRLOG_ERR, 0, "eventlop event queue full");
             ms_socket_close(clientfd);
             continue;
         }
 
-        // 设置非阻塞
-        if (ms_socket_blocking(clientfd, 0) == MS_ERROR)
-        {
-            ms_socket_close(clientfd);
-            continue;
-        }
-
-        // 设置 tcpnodelay
-        if (cycle->tcpnodelay)
-        {
-            if (ms_socket_tcpnodelay(clientfd, cycle->tcpnodelay) == MS_ERROR)
-            {
-                ms_socket_close(clientfd);
-                continue;
-            }
-        }
+        // 初始化 conn 结构体
+        conn = (ms_conn_t *)file->data;
+        memset(conn, 0, sizeof(ms_conn_t));
+        conn->timer = NULL;
+        ms_buf_chain_init(&conn->rbuf);
+        ms_buf_chain_init(&conn->sbuf);
+        conn->evlop = evlop;
+        conn->cycle = cycle;
+        conn->addr = addr;
+        conn->fd = clientfd;
 
-        // 设置 keepalive
-        if (cycle->keepalive)
+        // 协程模式: 创建协程并立即运行，读写事件与超时由协程自行等待
+        if (cycle->coroutine)
         {
-            if (ms_socket_keepalive(clientfd, cycle->keepidle, cycle->keepintl,
-                        cycle->keepcout) == MS_ERROR)
+            conn->co = ms_co_create(((ms_worker_t *)evlop->data1)->copool,
+                    ms_server_co_main, conn);
+            if (conn->co == NULL)
             {
                 ms_socket_close(clientfd);
                 continue;
             }
+            ms_stats_add(evlop->stats, active, 1);
+            ms_server_co_resume(evlop, conn);
+            continue;
         }
 
-        // 获取该 fd 对应的 conn 结构体，并初始化
-        conn = (ms_conn_t *)evlop->files[clientfd].data;
-        memset(conn, 0, sizeof(ms_conn_t));
-        conn->rtimeout_timer = NULL;
-        conn->stimeout_timer = NULL;
-        conn->buffsize = ms_min(sizeof(conn->rebuff), sizeof(conn->sebuff));
-        conn->sendsize = 0;
-        conn->cycle = cycle;
-        conn->addr.port = ntohs(addr.sin_port);
-        strcpy(conn->addr.ip, inet_ntoa(addr.sin_addr));
-        conn->fd = clientfd;
-
         // 设置接收超时
-        if (cycle->rtimeout_handler && cycle->max_read_timeout > 0)
+        if (ms_server_conn_wait_read(evlop, conn) == MS_ERROR)
         {
-            conn->rtimeout_timer = ms_eventloop_timer_add(evlop,
-                    cycle->max_read_timeout,
-                    (const ms_event_timer_proc *)cycle->rtimeout_handler, conn);
-            if (conn->rtimeout_timer == NULL)
-            {
-                ms_errlog(MS_ERRLOG_ERR, 0, "ms_eventloop_timer_add() failed");
-                ms_socket_close(clientfd);
-                continue;
-            }
+            ms_socket_close(clientfd);
+            continue;
         }
+        ms_stats_add(evlop->stats, active, 1);
 
         // 注册读事件
         if (ms_eventloop_file_add(evlop, clientfd, EPOLLIN | MS_SEVENT_MODE,
@@ -155,69 +518,154 @@ static void ms_server_readable_handler(ms_event_loop_t *evlop, int sockfd,
         uint32_t mask, void *data)
 {
     ssize_t rev = 0;
+    size_t size = 0;
+    int rounds = 0;
     ms_conn_t *conn = (ms_conn_t *)data;
 
-    // 初始化接收 & 发送缓冲区
-    memset(conn->rebuff, 0, conn->buffsize);
-    memset(conn->sebuff, 0, conn->buffsize);
-
-    // 初始化要发送的数据的长度
-    conn->sendsize = 0;
-
-    // 删除 rtimeout_timer
-    if (conn->rtimeout_timer)
+    // 删除接收/发送超时定时器
+    if (conn->timer)
     {
-        ms_eventloop_timer_del(evlop, conn->rtimeout_timer);
-        conn->rtimeout_timer = NULL;
+        ms_eventloop_timer_del(evlop, conn->timer);
+        conn->timer = NULL;
     }
 
-    // 边缘模式下要一直读，直到返回 EAGAIN
-    rev = ms_socket_read(sockfd, conn->rebuff, conn->buffsize - 1);
-    if (rev == MS_ERROR || rev == 0)
+    // 写优先时发送完响应后继续处理已缓存的请求，以循环代替递归，栈深度不随请求数增长
+    for (;;)
     {
-        goto end;
-    }
+        // 边缘模式下要一直读，直到返回 EAGAIN；接收缓冲区已满时暂停读取，先处理其中的请求
+        // 没有新数据时仍处理已缓存的请求，见 ms_server_conn_resume()
+        if (!conn->eof && conn->rbuf.size < MS_MAX_REQUEST_SIZE)
+        {
+            // 对端关闭了写端(如 pipelining 后半关闭)时置 eof，已缓存的请求仍要应答；
+            // FIN 可能与请求同批到达，此后不会再有读事件
+            rev = ms_buf_chain_read(evlop->bufs, &conn->rbuf, sockfd,
+                    MS_MAX_REQUEST_SIZE, &conn->eof);
+            if (rev == MS_ERROR)
+            {
+                goto end;
+            }
+            ms_stats_add(evlop->stats, bytes_in, rev > 0 ? rev : 0);
+        }
+        conn->rfull = conn->rbuf.size >= MS_MAX_REQUEST_SIZE;
 
-    // 请求的数据过多
-    if (rev >= (conn->buffsize - 1))
-    {
-        ms_errlog(MS_ERRLOG_ERR, 0, "recv buff full, connect would be close");
-        goto end;
+        if (conn->rbuf.size == 0)
+        {
+            goto wait;
+        }
+
+        // 记录请求首字节到达的时间，响应全部发送完成时计入 request 直方图
+        if (evlop->stats != NULL && conn->start == 0)
+        {
+            conn->start = ms_time_ns();
+        }
+
+        // 依次处理接收缓冲区中所有完整的请求(pipelining)，响应按顺序追加到 conn->sbuf，
+        // 之后一并发送。需以 sendfile() 发送文件或需关闭连接时先发送已有的响应
+        do
+        {
+            size = conn->rbuf.size;
+            rev = conn->cycle->proce_handler(conn, size);
+            if (conn->rbuf.size < size)
+            {
+                ms_stats_add(evlop->stats, requests, 1);
+            }
+        } while (rev == MS_OK && conn->rbuf.size > 0
+                && conn->rbuf.size < size && conn->file == NULL
+                && !conn->close && conn->sbuf.size < MS_MAX_PIPELINE_SIZE);
+
+        if (rev == MS_ERROR)
+        {
+            goto end;
+        }
+
+        // 接收缓冲区已满而其中没有完整的请求: 应答 431/413 后关闭连接
+        if (rev == MS_AGAIN && conn->rbuf.size >= MS_MAX_REQUEST_SIZE)
+        {
+            ms_errlog(MS_ERRLOG_ERR, 0,
+                    "request too large, connect would be close");
+            if (ms_http_error(evlop->bufs, &conn->sbuf,
+                        conn->http.state == MS_HTTP_HEADER ? 431 : 413, 1)
+                    == MS_ERROR)
+            {
+                goto end;
+            }
+            conn->close = 1;
+        }
+
+        // 请求已提交到线程池或转发给后端，暂停读写直到完成，之前的响应随后一并发送
+        if (rev == MS_DEFER)
+        {
+            ms_eventloop_file_del(evlop, sockfd, MS_EVENTLOOP_ALL);
+            return;
+        }
+
+        // 没有需要发送的响应，继续等待读事件
+        if (conn->sbuf.size == 0 && conn->file == NULL)
+        {
+            goto wait;
+        }
+
+        // 写优先: 直接发送响应，全部发送完成时保持读事件不变
+        if (!conn->cycle->writefirst)
+        {
+            break;
+        }
+
+        rev = ms_server_conn_send(conn);
+        if (rev == MS_ERROR)
+        {
+            goto end;
+        }
+
+        if (rev == MS_AGAIN)
+        {
+            break;
+        }
+
+        // 已缓存了下一个请求，或暂停读取时套接字中还有数据，继续处理
+        if (conn->rbuf.size == 0 && !conn->rfull)
+        {
+            goto wait;
+        }
+
+        // 连续处理多批后让出 eventloop，下一轮循环再继续，避免一个连接独占 worker；
+        // 期间不注册事件与定时器，连接不会被关闭
+        if (++rounds >= MS_MAX_PIPELINE_ROUNDS)
+        {
+            ms_eventloop_file_del(evlop, sockfd, MS_EVENTLOOP_ALL);
+            conn->yield.proc = ms_server_yield_handler;
+            conn->yield.data = conn;
+            ms_eventloop_task_post(evlop, &(conn->yield));
+            return;
+        }
     }
 
-    // 处理请求
-    if (conn->cycle->proce_handler(conn, rev) == MS_ERROR)
+    // 重置为写事件
+    if (ms_eventloop_file_mod(evlop, sockfd, EPOLLOUT | MS_SEVENT_MODE,
+                (const ms_event_file_proc *)ms_server_writeable_handler, conn)
+            == MS_ERROR)
     {
         goto end;
     }
 
-    // 待发送的数据过多
-    if (conn->sendsize >= (conn->buffsize - 1))
+    // 设置发送超时
+    if (ms_server_conn_wait_send(evlop, conn) == MS_ERROR)
     {
-        ms_errlog(MS_ERRLOG_ERR, 0, "send buff full, connect would be close");
         goto end;
     }
 
-    // 重置为写事件
-    if (ms_eventloop_file_mod(evlop, sockfd, EPOLLOUT | MS_SEVENT_MODE,
-                (const ms_event_file_proc *)ms_server_writeable_handler, conn)
-            == MS_ERROR)
+    return;
+wait:
+    // 对端已关闭写端，剩余的数据不会再构成完整的请求
+    if (conn->eof)
     {
         goto end;
     }
 
-    // 设置发送超时
-    if (conn->cycle->stimeout_handler && conn->cycle->max_send_timeout > 0)
+    // 设置接收超时
+    if (ms_server_conn_wait_read(evlop, conn) == MS_ERROR)
     {
-        conn->stimeout_timer = ms_eventloop_timer_add(evlop,
-                conn->cycle->max_send_timeout,
-                (const ms_event_timer_proc *)conn->cycle->stimeout_handler,
-                conn);
-        if (conn->stimeout_timer == NULL)
-        {
-            ms_errlog(MS_ERRLOG_ERR, 0, "ms_eventloop_timer_add() failed");
-            goto end;
-        }
+        goto end;
     }
 
     return;
@@ -228,25 +676,32 @@ end:
 static void ms_server_writeable_handler(ms_event_loop_t *evlop, int sockfd,
         uint32_t mask, void *data)
 {
+    int rev = 0;
     ms_conn_t *conn = (ms_conn_t *)data;
 
-    // 删除 stimeout_timer
-    if (conn->stimeout_timer)
+    // 删除接收/发送超时定时器
+    if (conn->timer)
     {
-        ms_eventloop_timer_del(evlop, conn->stimeout_timer);
-        conn->stimeout_timer = NULL;
+        ms_eventloop_timer_del(evlop, conn->timer);
+        conn->timer = NULL;
     }
 
     // 发送数据
-    if (ms_socket_write(sockfd, conn->sebuff, conn->sendsize) != conn->sendsize)
+    rev = ms_server_conn_send(conn);
+    if (rev == MS_ERROR)
     {
         goto end;
     }
 
-#ifdef DEBUG_SWITCH
-    ms_errlog(MS_ERRLOG_STATUS, 0, "send : data [\"%s\"], len [\"%d\"]",
-            conn->sebuff, conn->sendsize);
-#endif
+    // 发送缓冲区已满，等待下一次写事件
+    if (rev == MS_AGAIN)
+    {
+        if (ms_server_conn_wait_send(evlop, conn) == MS_ERROR)
+        {
+            goto end;
+        }
+        return;
+    }
 
     // 重置为读事件
     if (ms_eventloop_file_mod(evlop, sockfd, EPOLLIN | MS_SEVENT_MODE,
@@ -256,21 +711,351 @@ static void ms_server_writeable_handler(ms_event_loop_t *evlop, int sockfd,
         goto end;
     }
 
+    // 已缓存了下一个请求，或暂停读取时套接字中还有数据，或对端已关闭写端时立即处理
+    if (conn->rbuf.size > 0 || conn->rfull || conn->eof)
+    {
+        ms_server_readable_handler(evlop, sockfd, EPOLLIN, conn);
+        return;
+    }
+
     // 设置接收超时
+    if (ms_server_conn_wait_read(evlop, conn) == MS_ERROR)
+    {
+        goto end;
+    }
+
+    return;
+end:
+    ms_server_conn_close(evlop, conn);
+}
+
+// MS_OK:全部发送完成；MS_AGAIN:发送缓冲区已满；MS_ERROR:失败或响应完成后需关闭连接
+static int ms_server_conn_send(ms_conn_t *conn)
+{
+    ssize_t rev = 0;
+
+    rev = ms_buf_chain_writev(conn->evlop->bufs, &conn->sbuf, conn->fd);
+    if (rev == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+    ms_stats_add(conn->evlop->stats, bytes_out, rev > 0 ? rev : 0);
+
+    if (conn->sbuf.size > 0)
+    {
+        return MS_AGAIN;
+    }
+
+    // 响应头发送完成后发送文件
+    if (conn->file != NULL)
+    {
+        rev = ms_static_send(conn);
+        if (rev != MS_OK)
+        {
+            return rev;
+        }
+    }
+
+    // 同一批 pipelining 请求的响应一并发送，按批计入
+    if (conn->start != 0)
+    {
+        ms_stats_hist(conn->evlop->stats, request, ms_time_ns() - conn->start);
+        conn->start = 0;
+    }
+
+    // 响应发送完成后关闭连接
+    return conn->close ? MS_ERROR : MS_OK;
+}
+
+// 设置接收超时
+static int ms_server_conn_wait_read(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
     if (conn->cycle->rtimeout_handler && conn->cycle->max_read_timeout > 0)
     {
-        conn->rtimeout_timer = ms_eventloop_timer_add(evlop,
+        conn->timer = ms_eventloop_timer_add(evlop,
                 conn->cycle->max_read_timeout,
                 (const ms_event_timer_proc *)conn->cycle->rtimeout_handler,
                 conn);
-        if (conn->rtimeout_timer == NULL)
+        if (conn->timer == NULL)
         {
             ms_errlog(MS_ERRLOG_ERR, 0, "ms_eventloop_timer_add() failed");
-            goto end;
+            return MS_ERROR;
         }
     }
 
-    return;
-end:
-    ms_server_conn_close(evlop, conn);
+    return MS_OK;
+}
+
+// 设置发送超时
+static int ms_server_conn_wait_send(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    if (conn->cycle->stimeout_handler && conn->cycle->max_send_timeout > 0)
+    {
+        conn->timer = ms_eventloop_timer_add(evlop,
+                conn->cycle->max_send_timeout,
+                (const ms_event_timer_proc *)conn->cycle->stimeout_handler,
+                conn);
+        if (conn->timer == NULL)
+        {
+            ms_errlog(MS_ERRLOG_ERR, 0, "ms_eventloop_timer_add() failed");
+            return MS_ERROR;
+        }
+    }
+
+    return MS_OK;
+}
+
+// 线程池中执行: 完成后将连接投递回所属的 eventloop
+static void ms_server_offload_run(void *data)
+{
+    ms_conn_t *conn = (ms_conn_t *)data;
+
+    if (conn->offload.work)
+    {
+        conn->offload.work(conn->offload.data);
+    }
+
+    ms_eventloop_task_post(conn->evlop, &(conn->offload.task));
+}
+
+// eventloop 中执行: 生成响应并发送，恢复读写事件
+static void ms_server_offload_complete(ms_event_loop_t *evlop, void *data)
+{
+    ms_conn_t *conn = (ms_conn_t *)data;
+
+    if (conn->offload.done(conn, conn->offload.data) == MS_ERROR)
+    {
+        ms_server_conn_close(evlop, conn);
+        return;
+    }
+    ms_stats_add(evlop->stats, requests, 1);
+
+    ms_server_conn_resume(evlop, conn);
+}
+
+// 重试的时间到: 恢复连接，conn->rbuf 中的请求随即被再次处理
+static void ms_server_retry_handler(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    conn->timer = NULL; // 已超时的定时器由 eventloop 回收
+    ms_server_conn_resume(evlop, conn);
+}
+
+// 让出的下一轮循环: 恢复读事件，继续处理 conn->rbuf 中的请求
+static void ms_server_yield_handler(ms_event_loop_t *evlop, void *data)
+{
+    ms_server_conn_resume(evlop, (ms_conn_t *)data);
+}
+
+/*******************************************************************************
+ * 协程模式: 每个连接由一个协程运行 cycle->corou_handler(conn)，其中调用
+ * ms_co_read()/ms_co_write()/ms_co_sleep() 时挂起协程，返回 eventloop，
+ * 事件就绪或超时后再恢复。corou_handler 返回时关闭连接。
+ ******************************************************************************/
+
+/***********************************************************
+ * @Func   : ms_co_read()
+ * @Author : lwp
+ * @Brief  : 在协程中接收数据，无数据时挂起直到可读或接收超时。
+ * @Param  : [in] conn
+ * @Param  : [in/out] buf
+ * @Param  : [in] len
+ * @Return : MS_ERROR : 失败或超时
+ *           0        : 对端关闭连接
+ *           >0       : 接收的字节数
+ * @Note   : 只能在 conn 的协程中调用
+ ***********************************************************/
+ssize_t ms_co_read(ms_conn_t *conn, void *buf, size_t len)
+{
+    ssize_t rev = -1;
+
+    while (1)
+    {
+        rev = read(conn->fd, buf, len);
+        if (rev >= 0)
+        {
+            ms_stats_add(conn->evlop->stats, bytes_in, rev);
+            return rev;
+        }
+
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            ms_errlog(MS_ERRLOG_ERR, errno, "read() failed");
+            return MS_ERROR;
+        }
+
+        if (ms_server_co_wait(conn, EPOLLIN, conn->cycle->max_read_timeout)
+                == MS_ERROR)
+        {
+            ms_stats_add(conn->evlop->stats, timeouts, 1);
+            ms_errlog(MS_ERRLOG_ERR, 0, "clientfd \"%d\" read timeout",
+                    conn->fd);
+            return MS_ERROR;
+        }
+    }
+}
+// @ms_co_read() ok
+
+/***********************************************************
+ * @Func   : ms_co_write()
+ * @Author : lwp
+ * @Brief  : 在协程中发送全部数据，发送缓冲区满时挂起直到可写或发送超时。
+ * @Param  : [in] conn
+ * @Param  : [in] buf
+ * @Param  : [in] len
+ * @Return : MS_ERROR : 失败或超时
+ *           len      : 成功
+ * @Note   : 只能在 conn 的协程中调用
+ ***********************************************************/
+ssize_t ms_co_write(ms_conn_t *conn, const void *buf, size_t len)
+{
+    ssize_t rev = -1;
+    size_t total = 0;
+
+    while (total < len)
+    {
+        rev = write(conn->fd, (const char *)buf + total, len - total);
+        if (rev >= 0)
+        {
+            ms_stats_add(conn->evlop->stats, bytes_out, rev);
+            total += rev;
+            continue;
+        }
+
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            ms_errlog(MS_ERRLOG_ERR, errno, "write() failed");
+            return MS_ERROR;
+        }
+
+        if (ms_server_co_wait(conn, EPOLLOUT, conn->cycle->max_send_timeout)
+                == MS_ERROR)
+        {
+            ms_stats_add(conn->evlop->stats, timeouts, 1);
+            ms_errlog(MS_ERRLOG_ERR, 0, "clientfd \"%d\" send timeout",
+                    conn->fd);
+            return MS_ERROR;
+        }
+    }
+
+    return total;
+}
+// @ms_co_write() ok
+
+/***********************************************************
+ * @Func   : ms_co_sleep()
+ * @Author : lwp
+ * @Brief  : 挂起协程 ms 毫秒。
+ * @Param  : [in] conn
+ * @Param  : [in] ms
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : 只能在 conn 的协程中调用，期间 eventloop 继续处理其他连接
+ ***********************************************************/
+int ms_co_sleep(ms_conn_t *conn, int ms)
+{
+    ms_server_co_wait(conn, 0, ms > 0 ? ms : 1);
+
+    return conn->cotimeout ? MS_OK : MS_ERROR;
+}
+// @ms_co_sleep() ok
+
+// 协程的入口: 处理连接，返回后由 ms_server_co_resume() 关闭连接
+static void ms_server_co_main(void *data)
+{
+    ms_conn_t *conn = (ms_conn_t *)data;
+
+    conn->cycle->corou_handler(conn);
+}
+
+// 恢复连接的协程，协程结束时关闭连接
+static void ms_server_co_resume(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    if (ms_co_resume(conn->co) != MS_AGAIN)
+    {
+        ms_server_conn_close(evlop, conn);
+    }
+}
+
+// 读写事件: 协程等待该事件时恢复，否则注销事件，避免 io_uring 下重复触发
+static void ms_server_co_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data)
+{
+    ms_conn_t *conn = (ms_conn_t *)data;
+
+    if ((conn->cowait & mask)
+            || (conn->cowait && (mask & (EPOLLERR | EPOLLHUP))))
+    {
+        ms_server_co_resume(evlop, conn);
+        return;
+    }
+
+    if (conn->cowait == 0 && conn->comask != MS_EVENTLOOP_NONE)
+    {
+        ms_eventloop_file_del(evlop, sockfd, MS_EVENTLOOP_ALL);
+        conn->comask = MS_EVENTLOOP_NONE;
+    }
+}
+
+// 等待超时: 恢复协程，由 ms_server_co_wait() 返回超时
+static void ms_server_co_timeout(ms_event_loop_t *evlop, ms_conn_t *conn)
+{
+    conn->timer = NULL; // 已超时的定时器由 eventloop 回收
+    conn->cotimeout = 1;
+    ms_server_co_resume(evlop, conn);
+}
+
+// 挂起协程，直到 mask 事件就绪或 timeout 毫秒后超时；mask 为 0 时只等待超时
+// 事件掩码与上次相同时不再调用 epoll_ctl()
+static int ms_server_co_wait(ms_conn_t *conn, uint32_t mask, uintptr_t timeout)
+{
+    ms_event_loop_t *evlop = conn->evlop;
+
+    conn->cotimeout = 0;
+    if (conn->co == NULL || ms_co_self() != conn->co)
+    {
+        return MS_ERROR;
+    }
+
+    if (mask != 0 && conn->comask != mask)
+    {
+        if (ms_eventloop_file_mod(evlop, conn->fd, mask | MS_SEVENT_MODE,
+                    (const ms_event_file_proc *)ms_server_co_handler, conn)
+                == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+        conn->comask = mask;
+    }
+
+    if (timeout > 0)
+    {
+        conn->timer = ms_eventloop_timer_add(evlop, timeout,
+                (const ms_event_timer_proc *)ms_server_co_timeout, conn);
+        if (conn->timer == NULL)
+        {
+            return MS_ERROR;
+        }
+    }
+
+    conn->cowait = mask;
+    ms_co_yield();
+    conn->cowait = 0;
+
+    if (conn->timer != NULL)
+    {
+        ms_eventloop_timer_del(evlop, conn->timer);
+        conn->timer = NULL;
+    }
+
+    return conn->cotimeout ? MS_ERROR : MS_OK;
 }
@@ -10,9 +10,19 @@ extern "C"
 #include "ms_conf.h"
 
 #include "ms_socket.h"
+#include "ms_co.h"
+#include "ms_thpool.h"
+#include "ms_upstream.h"
+#include "ms_udp.h"
+#include "ms_http.h"
+#include "ms_cache.h"
 #include "ms_eventloop.h"
 
 #define MS_MAX_WORKERS 48
+#define MS_MAX_PEERS   64 // 反向代理的最大后端数
+#define MS_MAX_REQUEST_SIZE (8 * 1024 * 1024) // 接收缓冲区链的最大长度
+#define MS_MAX_PIPELINE_SIZE (256 * 1024)     // 连续处理 pipelining 请求时待发送响应的上限，超过时先发送
+#define MS_MAX_PIPELINE_ROUNDS 16             // 一次读事件中连续处理并发送的批数，超过时让出 eventloop
 
 /*******************************************************************************
  * clientfd 的 epoll 运行模式 (listenfd 的 epoll 运行模式为 EPOLLET)
@@ -22,32 +32,91 @@ extern "C"
 #define MS_SEVENT_MODE EPOLLET      // 边缘触发
 //#define MS_SEVENT_MODE EPOLLONESHOT
 
-typedef struct ms_addr_s  ms_addr_t;
-typedef struct ms_conn_s  ms_conn_t;
-typedef struct ms_cycle_s ms_cycle_t;
+typedef struct ms_conn_s         ms_conn_t;
+typedef struct ms_cycle_s        ms_cycle_t;
+typedef struct ms_worker_s       ms_worker_t;
+typedef struct ms_offload_s      ms_offload_t;
+typedef struct ms_proxy_s        ms_proxy_t;
+typedef struct ms_proxy_peer_s   ms_proxy_peer_t;
+typedef struct ms_proxy_req_s    ms_proxy_req_t;
+typedef struct ms_static_file_s  ms_static_file_t;
+typedef struct ms_static_cache_s ms_static_cache_t;
 
 typedef int proc_handler(ms_conn_t *conn, ssize_t recvlen);
 typedef void error_handler(ms_event_loop_t *evnlop, ms_conn_t *conn);
+typedef void offload_work(void *data);
+typedef int offload_done(ms_conn_t *conn, void *data);
+typedef void co_handler(ms_conn_t *conn);
+
+// 提交到线程池的请求: work 在线程池中执行，done 在连接所属的 eventloop 中执行
+struct ms_offload_s {
+    ms_thpool_job_t  job;  // 线程池任务结点
+    ms_event_task_t  task; // 完成后投递回 eventloop 的任务结点
+    offload_work    *work; // 在线程池中执行，不可访问 conn 的缓冲区
+    offload_done    *done; // 在 eventloop 中执行，向 conn->sbuf 写入响应
+    void            *data; // work 与 done 的 data 参数
+};
 
-struct ms_addr_s {
-    char ip[32];
-    int  port;
+// 反向代理中正在处理的请求，见 ms_proxy.c
+struct ms_proxy_req_s {
+    ms_upstream_t     *up;     // 使用的上游连接
+    ms_proxy_peer_t   *peer;   // 选择的后端
+    ms_buf_chain_t     ubuf;   // 待发送给后端的请求
+    ms_buf_chain_t     rbak;   // 复用空闲连接时请求的副本，收到响应前失败时在新连接上重试
+    int64_t            rlen;   // 响应体的剩余长度，-1 代表由 chunked 编码或后端关闭连接界定
+    ms_http_chunked_t  chunk;  // chunked 编码的响应体的解析状态，偏移相对于 sbuf
+    int                state;  // 响应的解析状态
+    int                head;   // 是否为 HEAD 请求，响应没有响应体
+    int                sent;   // 是否已向客户端发送了响应数据
+    int                reuse;  // 响应结束后上游连接是否可复用
+    int                close;  // 响应结束后是否关闭客户端连接
+    int                wevent; // 是否已注册客户端连接的写事件
+    int                paused; // 待发送给客户端的数据过多，暂停读取后端
+    int                retry;  // 是否可在新连接上重试，rbak 中保存有请求
 };
 
 struct ms_conn_s {
-    ms_event_timer_t *rtimeout_timer;          // 接收超时的定时器
-    ms_event_timer_t *stimeout_timer;          // 发送超时的定时器
-
-    char              sebuff[MS_MAX_BUF_SIZE]; // 发送缓冲区
-    char              rebuff[MS_MAX_BUF_SIZE]; // 接收缓冲区
-
-    ssize_t           buffsize;                // 发送/接收缓冲区的容量
-    ssize_t           sendsize;                // 待发送数据的长度
-
-    ms_cycle_t       *cycle;                   // 配置信息
-    ms_addr_t         addr;                    // 当前连接的地址信息
+    ms_event_timer_t   *timer;                   // 接收/发送超时的定时器，二者不会同时存在
+
+    ms_buf_chain_t      rbuf;                    // 接收缓冲区链，空闲时不占用缓冲区块
+    ms_buf_chain_t      sbuf;                    // 发送缓冲区链，空闲时不占用缓冲区块
+
+    ms_event_loop_t    *evlop;                   // 所属的 eventloop
+    ms_cycle_t         *cycle;                   // 配置信息
+    struct sockaddr_in  addr;                    // 当前连接的地址信息，网络字节序
+    ms_offload_t        offload;                 // 提交到线程池的请求，同一时间最多一个
+    ms_proxy_req_t      proxy;                   // 反向代理中正在处理的请求
+    ms_http_parser_t    http;                    // 接收中的请求的解析状态
+
+    ms_static_file_t   *file;                    // 响应头之后以 sendfile() 发送的文件
+    off_t               foff;                    // 文件中待发送数据的偏移
+    off_t               flen;                    // 文件中待发送数据的长度
+
+    ms_co_t            *co;                      // 协程模式下处理该连接的协程
+    uint32_t            cowait;                  // 协程挂起时等待的事件，0 代表未等待
+    uint32_t            comask;                  // 协程模式下已注册的事件掩码
+    int                 cotimeout;               // 协程等待的事件是否已超时
+
+    ms_event_task_t     yield;                   // 让出 eventloop 后继续处理已缓存的请求
+    uint64_t            start;                   // 请求首字节到达的时间，纳秒，仅在开启统计时记录
+    int                 close;                   // 响应发送完成后关闭连接
+    int                 eof;                     // 对端已关闭写端，处理完已缓存的请求后关闭连接
+    int                 rfull;                   // 接收缓冲区已满时暂停读取，套接字中可能还有数据
+    int                 fd;                      // 该连接对应的文件句柄
+};
 
-    int               fd;                      // 该连接对应的文件句柄
+struct ms_worker_s {
+    int                 id;       // worker 的序号
+    int                 listenfd; // 该 worker 使用的监听套接字
+    pthread_t           tid;      // 线程模式下的线程 ID
+    ms_event_loop_t    *evlop;    // 该 worker 的 eventloop，仅由该 worker 访问
+    ms_thpool_t        *offload;  // 该 worker 的线程池，为 NULL 时未启用
+    ms_co_pool_t       *copool;   // 该 worker 的协程池，为 NULL 时未启用
+    ms_upstream_pool_t *upstream; // 该 worker 到各后端的上游连接池
+    ms_proxy_t         *proxy;    // 该 worker 的反向代理，为 NULL 时未启用
+    ms_udp_t           *udp;      // 该 worker 的 UDP 监听，为 NULL 时未启用
+    ms_static_cache_t  *statics;  // 该 worker 打开的静态文件的缓存，为 NULL 时未启用
+    ms_cycle_t         *cycle;    // 配置信息，各 worker 只读共享
 };
 
 struct ms_cycle_s {
@@ -55,17 +124,27 @@ struct ms_cycle_s {
     int              server_port;
 
     int              workers;
-    int              listenfd;
+    int              worker;          // 当前 worker 的序号，master 中为 -1
+    int              listenfd;        // 当前 worker 使用的监听套接字
+    int              listenfds[MS_MAX_WORKERS]; // 监听套接字，未开启 reuseport 时只使用第 0 个
     int              backlog;
 
     char            *pidlog;
     char            *accesslog;
     char            *errorlog;
+    char            *statsfile;       // 统计文件，各 worker 的计数映射于其中
     log_level_t      loglevel;
 
     int              daemon;          // 是否后台运行
     int              tcpnodelay;      // 是否开启 tcpnodelay
     int              keepalive;       // 是否开启 keepalive
+    int              iouring;         // 是否使用 io_uring
+    int              writefirst;      // 是否在读事件中直接发送响应
+    int              reuseport;       // 是否为每个 worker 创建单独的 SO_REUSEPORT 监听套接字
+    int              exclusive;       // 共享监听套接字时是否使用 EPOLLEXCLUSIVE
+    int              threads;         // 是否使用线程模式，各 worker 为同一进程中的线程
+    int              coroutine;       // 是否使用协程模式，每个连接由一个协程处理
+    int              stop;            // 停止所有 worker 的标志
 
     int              keepidle;        // 首次 KeepAlive 探测前 TCP 的空闭时间，秒
     int              keepintl;        // 两次 KeepAlive 探测间的时间间隔，秒
@@ -73,7 +152,38 @@ struct ms_cycle_s {
 
     int              max_mempol_size; // 小块内存池的容量
     int              max_openfd_size; // 进程最大打开文件数
-    int              max_evnlop_size; // eventloop 的容量
+    int              max_evnlop_size; // 单次等待返回的最大事件数
+
+    int              offload_threads; // 每个 worker 的线程池的线程数，0 代表不启用
+    int              offload_queue;   // 每个 worker 的线程池的队列容量
+    int              co_stack_size;   // 协程栈的大小，字节
+
+    int              upstream_idle;   // 每个 worker 到每个后端保留的空闲连接数
+    int              upstream_itime;  // 空闲的后端连接的超时时间，毫秒
+    int              upstream_ctime;  // 连接后端的超时时间，毫秒
+
+    int              proxy;           // 是否使用反向代理模式
+    int              proxy_balance;   // 负载均衡算法，见 MS_PROXY_RR 等
+    int              proxy_maxfails;  // 后端连续失败多少次后摘除
+    int              proxy_failtime;  // 后端被摘除的时间，毫秒
+    int              proxy_npeers;    // 后端的数目
+    struct sockaddr_in proxy_peers[MS_MAX_PEERS]; // 后端地址，网络字节序
+
+    int              udp_port;        // UDP 监听端口，0 代表不启用
+    int              udp_batch;       // 每批接收的数据报的最大数目
+
+    int              staticfile;      // 是否使用静态文件模式
+    char            *static_root;     // 静态文件的根目录，以 '/' 结尾
+    int              static_cache;    // 每个 worker 缓存的打开文件的最大数目
+    int              static_ttl;      // 打开文件缓存的有效时间，毫秒
+
+    int              cache_size;      // 响应缓存的共享内存大小，字节 0 代表不启用
+    int              cache_ttl;       // 响应缓存的有效时间，毫秒 0 代表不过期
+    ms_cache_t      *cache;           // 响应缓存，位于共享内存中，各 worker 共用
+    ms_stats_t      *stats;           // 统计区，每个 worker 占用其中一个槽
+
+    int              log_ring_size;   // 每个 worker 的日志环的大小，字节 0 代表直接写入文件
+    int              log_ring_policy; // 日志环满时的处理，见 MS_LOGRING_DROP 等
 
     int              max_epwt_timeout; // epoll_wait() 最大超时事件，毫秒
     uintptr_t        max_read_timeout; // 接收超时时间，毫秒
@@ -82,11 +192,26 @@ struct ms_cycle_s {
     error_handler   *rtimeout_handler; // 接收超时的回调函数
     error_handler   *stimeout_handler; // 发送超时的回调函数
     proc_handler    *proce_handler;    // 处理请求的回调函数
+    co_handler      *corou_handler;    // 协程模式下处理连接的函数
+    ms_udp_proc     *udp_handler;      // 处理一批 UDP 数据报的回调函数
 
-    ms_event_loop_t *evlop;
+    ms_worker_t      workerlist[MS_MAX_WORKERS]; // 各 worker 的运行信息
 };
 
 void *ms_server_worker_cycle(ms_cycle_t *cycle);
+void *ms_server_worker_thread(void *arg);
+void ms_server_workers_stop(ms_cycle_t *cycle);
+int ms_server_listenfd_init(ms_cycle_t *cycle, int listenfd);
+const char *ms_server_conn_ip(ms_conn_t *conn);
+int ms_server_conn_offload(ms_conn_t *conn, offload_work *work,
+        offload_done *done, void *data);
+void ms_server_conn_resume(ms_event_loop_t *evlop, ms_conn_t *conn);
+int ms_server_conn_retry(ms_conn_t *conn, int ms);
+void ms_server_conn_close(ms_event_loop_t *evlop, ms_conn_t *conn);
+
+ssize_t ms_co_read(ms_conn_t *conn, void *buf, size_t len);
+ssize_t ms_co_write(ms_conn_t *conn, const void *buf, size_t len);
+int ms_co_sleep(ms_conn_t *conn, int ms);
 
 #ifdef __cpluscplus
 }
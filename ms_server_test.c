@@ -1,4 +1,6 @@
 #include "ms_server.h"
+#include "ms_proxy.h"
+#include "ms_static.h"
 
 #include "ms_acclog.h"
 #include "ms_config.h"
@@ -9,20 +11,29 @@
 static ms_cycle_t  g_cycle;
 static ms_cycle_t *cycle = &g_cycle;
 static pid_t workers_pid[MS_MAX_WORKERS] = { 0 };
-static char http_head[] = "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s";
+static char http_head[] = "HTTP/1.1 200 OK\r\nContent-Length: %z\r\n\r\n";
 
 static void master_exit_signal_handler(int signal);
 static void master_reopen_signal_handler(int signal);
+static void master_hist_signal_handler(int signal);
 static void worker_exit_signal_handler(int signal);
 static void worker_reopen_signal_handler(int signal);
 static void ms_server_rtimeout_handler(ms_event_loop_t *evlop, ms_conn_t *conn);
 static void ms_server_stimeout_handler(ms_event_loop_t *evlop, ms_conn_t *conn);
 static int ms_server_proce_handler(ms_conn_t *conn, ssize_t recvlen);
+static int ms_server_response(ms_conn_t *conn, void *data);
+static void ms_server_offload_work(void *data);
+static int ms_server_cached(ms_conn_t *conn, ms_http_request_t *req);
+static int ms_server_cache_fill(ms_conn_t *conn, void *data);
+static void ms_server_corou_handler(ms_conn_t *conn);
+static void ms_server_udp_handler(ms_udp_t *udp, ms_udp_msg_t *msgs, int n,
+        void *data);
 
 // 信号及其对应的 handler，最后一个信号设置为 -1
 static ms_signal_t signals_st[] = {
     { SIGINT , master_reopen_signal_handler },
     { SIGQUIT, master_exit_signal_handler   },
+    { SIGHUP , master_hist_signal_handler   },
     { SIGUSR1, worker_reopen_signal_handler },
     { SIGUSR2, worker_exit_signal_handler   },
     { -1     , NULL                         }
@@ -30,35 +41,66 @@ static ms_signal_t signals_st[] = {
 
 // 调用进程注册其关心的信号，阻塞未在 worker_signals[] 中的信号。
 // 注意 : SIGKILL 和 SIGSTOP 信号不能被捕获，阻塞，忽视。最后一个信号设置为 -1。
-static int master_signals[] = { SIGINT,  SIGQUIT, -1 };
+static int master_signals[] = { SIGINT,  SIGQUIT, SIGHUP, -1 };
 static int worker_signals[] = { SIGUSR1, SIGUSR2, -1 };
 
 static ms_conf_item_t ms_sys_conf[] = {
-    { "server_ip"        , { 0 }, check_ipv4  },
-    { "server_port"      , { 0 }, check_port  },
-    { "workers"          , { 0 }, check_num   },
-    { "listen_backlog"   , { 0 }, check_num   },
-    { "pid_log"          , { 0 }, check_file  },
-    { "access_log"       , { 0 }, check_file  },
-    { "error_log"        , { 0 }, check_file  },
-    { "log_level"        , { 0 }, check_level },
-    { "is_daemon"        , { 0 }, check_num   },
-    { "is_tcpnodelay"    , { 0 }, check_num   },
-    { "is_keepalive"     , { 0 }, check_num   },
-    { "keepidle"         , { 0 }, check_num   },
-    { "keepintl"         , { 0 }, check_num   },
-    { "keepcout"         , { 0 }, check_num   },
-    { "max_mempool_size" , { 0 }, check_num   },
-    { "max_open_files"   , { 0 }, check_num   },
-    { "max_events_size"  , { 0 }, check_num   },
-    { "max_epoll_timeout", { 0 }, check_num   },
-    { "max_read_timeout" , { 0 }, check_num   },
-    { "max_send_timeout" , { 0 }, check_num   }
+    { "server_ip"               , { 0 }, check_ipv4    },
+    { "server_port"             , { 0 }, check_port    },
+    { "workers"                 , { 0 }, check_num     },
+    { "listen_backlog"          , { 0 }, check_num     },
+    { "pid_log"                 , { 0 }, check_file    },
+    { "access_log"              , { 0 }, check_file    },
+    { "error_log"               , { 0 }, check_file    },
+    { "stats_file"              , { 0 }, check_file_off},
+    { "log_level"               , { 0 }, check_level   },
+    { "log_ring_size"           , { 0 }, check_num     },
+    { "log_ring_policy"         , { 0 }, check_policy  },
+    { "is_daemon"               , { 0 }, check_num     },
+    { "is_tcpnodelay"           , { 0 }, check_num     },
+    { "is_keepalive"            , { 0 }, check_num     },
+    { "is_io_uring"             , { 0 }, check_num     },
+    { "is_writefirst"           , { 0 }, check_num     },
+    { "is_reuseport"            , { 0 }, check_num     },
+    { "is_exclusive"            , { 0 }, check_num     },
+    { "is_threads"              , { 0 }, check_num     },
+    { "is_coroutine"            , { 0 }, check_num     },
+    { "offload_threads"         , { 0 }, check_num     },
+    { "offload_queue"           , { 0 }, check_num     },
+    { "co_stack_size"           , { 0 }, check_num     },
+    { "upstream_max_idle"       , { 0 }, check_num     },
+    { "upstream_idle_timeout"   , { 0 }, check_num     },
+    { "upstream_connect_timeout", { 0 }, check_num     },
+    { "is_proxy"                , { 0 }, check_num     },
+    { "proxy_upstreams"         , { 0 }, check_addrs   },
+    { "proxy_balance"           , { 0 }, check_balance },
+    { "proxy_max_fails"         , { 0 }, check_num     },
+    { "proxy_fail_timeout"      , { 0 }, check_num     },
+    { "udp_port"                , { 0 }, check_num     },
+    { "udp_batch"               , { 0 }, check_num     },
+    { "is_static"               , { 0 }, check_num     },
+    { "static_root"             , { 0 }, check_dir     },
+    { "static_cache_size"       , { 0 }, check_num     },
+    { "static_cache_ttl"        , { 0 }, check_num     },
+    { "cache_size"              , { 0 }, check_num     },
+    { "cache_ttl"               , { 0 }, check_num     },
+    { "keepidle"                , { 0 }, check_num     },
+    { "keepintl"                , { 0 }, check_num     },
+    { "keepcout"                , { 0 }, check_num     },
+    { "max_mempool_size"        , { 0 }, check_num     },
+    { "max_open_files"          , { 0 }, check_num     },
+    { "max_events_size"         , { 0 }, check_num     },
+    { "max_epoll_timeout"       , { 0 }, check_num     },
+    { "max_read_timeout"        , { 0 }, check_num     },
+    { "max_send_timeout"        , { 0 }, check_num     }
 };
 
 int main(int argc, char **argv)
 {
     pid_t pid = 0;
+    int nthreads = 0;
+    sigset_t sigset;
+    sigset_t oldset;
 
     if (argc != 2)
     {
@@ -80,7 +122,12 @@ int main(int argc, char **argv)
     }
 
     cycle->listenfd         = -1;
-    cycle->evlop            = NULL; // evlop 结构体指针
+    cycle->worker           = -1;
+    for (int i = 0; i < MS_MAX_WORKERS; i++)
+    {
+        cycle->listenfds[i] = -1;
+    }
+    cycle->stop             = 0;    // 停止所有 worker 的标志
     cycle->server_ip        =      ms_config_get_value("server_ip");
     cycle->server_port      = atoi(ms_config_get_value("server_port"));
     cycle->workers          = atoi(ms_config_get_value("workers"));
@@ -88,16 +135,43 @@ int main(int argc, char **argv)
     cycle->pidlog           =      ms_config_get_value("pid_log");
     cycle->accesslog        =      ms_config_get_value("access_log");
     cycle->errorlog         =      ms_config_get_value("error_log");
+    cycle->statsfile        =      ms_config_get_value("stats_file");         // 统计文件，由 ms_top 读取
     cycle->loglevel         = (log_level_t)atoi(ms_config_get_value("log_level"));
+    cycle->log_ring_size    = atoi(ms_config_get_value("log_ring_size"));     // 每个 worker 的日志环的大小，字节 0 代表不启用
+    cycle->log_ring_policy  = atoi(ms_config_get_value("log_ring_policy"));   // 日志环满时丢弃或等待
     cycle->daemon           = atoi(ms_config_get_value("is_daemon"));
     cycle->tcpnodelay       = atoi(ms_config_get_value("is_tcpnodelay"));
     cycle->keepalive        = atoi(ms_config_get_value("is_keepalive"));
+    cycle->iouring          = atoi(ms_config_get_value("is_io_uring"));       // 是否使用 io_uring，不支持时回退到 epoll
+    cycle->writefirst       = atoi(ms_config_get_value("is_writefirst"));     // 是否在读事件中直接发送响应
+    cycle->reuseport        = atoi(ms_config_get_value("is_reuseport"));      // 是否为每个 worker 创建单独的监听套接字
+    cycle->exclusive        = atoi(ms_config_get_value("is_exclusive"));      // 共享监听套接字时是否使用 EPOLLEXCLUSIVE
+    cycle->threads          = atoi(ms_config_get_value("is_threads"));        // 是否使用线程模式
+    cycle->coroutine        = atoi(ms_config_get_value("is_coroutine"));      // 是否使用协程模式
+    cycle->offload_threads  = atoi(ms_config_get_value("offload_threads"));   // 每个 worker 线程池的线程数，0 代表不启用
+    cycle->offload_queue    = atoi(ms_config_get_value("offload_queue"));     // 线程池队列的容量
+    cycle->co_stack_size    = atoi(ms_config_get_value("co_stack_size"));     // 协程栈的大小，字节
+    cycle->upstream_idle    = atoi(ms_config_get_value("upstream_max_idle"));        // 每个后端保留的空闲连接数，0 代表不复用
+    cycle->upstream_itime   = atoi(ms_config_get_value("upstream_idle_timeout"));    // 空闲的后端连接的超时时间，毫秒 0 代表不启用
+    cycle->upstream_ctime   = atoi(ms_config_get_value("upstream_connect_timeout")); // 连接后端的超时时间，毫秒 0 代表不启用
+    cycle->proxy            = atoi(ms_config_get_value("is_proxy"));          // 是否使用反向代理模式
+    cycle->proxy_balance    = atoi(ms_config_get_value("proxy_balance"));     // 负载均衡算法
+    cycle->proxy_maxfails   = atoi(ms_config_get_value("proxy_max_fails"));   // 后端连续失败多少次后摘除，0 代表不摘除
+    cycle->proxy_failtime   = atoi(ms_config_get_value("proxy_fail_timeout")); // 后端摘除的时间，毫秒
+    cycle->udp_port         = atoi(ms_config_get_value("udp_port"));          // UDP 监听端口，0 代表不启用
+    cycle->udp_batch        = atoi(ms_config_get_value("udp_batch"));         // 每批接收的数据报的最大数目
+    cycle->staticfile       = atoi(ms_config_get_value("is_static"));         // 是否使用静态文件模式
+    cycle->static_root      =      ms_config_get_value("static_root");        // 静态文件的根目录
+    cycle->static_cache     = atoi(ms_config_get_value("static_cache_size")); // 每个 worker 缓存的打开文件数
+    cycle->static_ttl       = atoi(ms_config_get_value("static_cache_ttl"));  // 打开文件缓存的有效时间，毫秒 0 代表不过期
+    cycle->cache_size       = atoi(ms_config_get_value("cache_size"));        // 响应缓存的共享内存大小，字节 0 代表不启用
+    cycle->cache_ttl        = atoi(ms_config_get_value("cache_ttl"));         // 响应缓存的有效时间，毫秒 0 代表不过期
     cycle->keepidle         = atoi(ms_config_get_value("keepidle"));          // 首次 KeepAlive 探测前 TCP 的空闭时间，秒
     cycle->keepintl         = atoi(ms_config_get_value("keepintl"));          // 两次 KeepAlive 探测间的时间间隔，秒
     cycle->keepcout         = atoi(ms_config_get_value("keepcout"));          // 断开前 KeepAlive 探测的次数
     cycle->max_mempol_size  = atoi(ms_config_get_value("max_mempool_size"));  // 内存池可分配的最大小块内存
     cycle->max_openfd_size  = atoi(ms_config_get_value("max_open_files"));    // 进程最大打开文件数
-    cycle->max_evnlop_size  = atoi(ms_config_get_value("max_events_size"));   // evlop 的最大容量
+    cycle->max_evnlop_size  = atoi(ms_config_get_value("max_events_size"));   // 单次等待返回的最大事件数
     cycle->max_epwt_timeout = atoi(ms_config_get_value("max_epoll_timeout")); // epollwait 的最大超时时间，毫秒
     cycle->max_read_timeout = atoi(ms_config_get_value("max_read_timeout"));  // 接收超时时间，毫秒 0 代表不启用
     cycle->max_send_timeout = atoi(ms_config_get_value("max_send_timeout"));  // 发送超时时间，毫秒 0 代表不启用
@@ -105,6 +179,8 @@ int main(int argc, char **argv)
     cycle->rtimeout_handler = ms_server_rtimeout_handler; // 接收超时的回调函数
     cycle->stimeout_handler = ms_server_stimeout_handler; // 发送超时的回调函数
     cycle->proce_handler    = ms_server_proce_handler;    // 处理请求的回调函数
+    cycle->corou_handler    = ms_server_corou_handler;    // 协程模式下处理连接的函数
+    cycle->udp_handler      = ms_server_udp_handler;      // 处理一批 UDP 数据报的回调函数
 
     // 初始化 errlog
     if (ms_errlog_init(cycle->errorlog, cycle->loglevel) == MS_ERROR)
@@ -119,6 +195,38 @@ int main(int argc, char **argv)
         goto end;
     }
 
+    // 按 CPU 支持的指令集选择 HTTP 解析器的实现
+    ms_http_init();
+
+    // 反向代理模式下由 ms_proxy_handler() 转发请求
+    if (cycle->proxy)
+    {
+        cycle->proxy_npeers = ms_proxy_parse(
+                ms_config_get_value("proxy_upstreams"), cycle->proxy_peers,
+                MS_MAX_PEERS);
+        if (cycle->proxy_npeers <= 0)
+        {
+            goto end;
+        }
+        cycle->proce_handler = ms_proxy_handler;
+    }
+
+    // 静态文件模式下由 ms_static_handler() 发送 static_root 下的文件
+    if (cycle->staticfile && !cycle->proxy)
+    {
+        cycle->proce_handler = ms_static_handler;
+    }
+
+    // 响应缓存位于共享内存中，须在创建 worker 之前创建
+    if (cycle->cache_size > 0)
+    {
+        cycle->cache = ms_cache_create(cycle->cache_size, cycle->cache_ttl);
+        if (cycle->cache == NULL)
+        {
+            goto end;
+        }
+    }
+
     // 判断是否已有实例在运行
     pid = ms_daemon_get_pid(cycle->pidlog);
     if (pid != MS_ERROR)
@@ -139,13 +247,40 @@ int main(int argc, char **argv)
         goto end;
     }
 
-    // 创建监听套接字
-    cycle->listenfd = ms_socket_create_listenfd(cycle->server_ip,
-            cycle->server_port, cycle->backlog);
-    if (cycle->listenfd == MS_ERROR)
+    // 修正 worker 进程数
+    if (cycle->workers <= 0)
+        cycle->workers = 1;
+    if (cycle->workers > MS_MAX_WORKERS)
+        cycle->workers = MS_MAX_WORKERS;
+
+    // 统计区映射于统计文件中，须在创建 worker 之前创建，off 时不统计
+    if (strcmp(cycle->statsfile, "off") != 0)
+    {
+        cycle->stats = ms_stats_create(cycle->statsfile, cycle->workers);
+        if (cycle->stats == NULL)
+        {
+            goto end;
+        }
+    }
+
+    // 创建监听套接字，reuseport 时为每个 worker 创建一个，由内核分发连接
+    for (int i = 0; i < (cycle->reuseport ? cycle->workers : 1); i++)
     {
-        goto end;
+        cycle->listenfds[i] = ms_socket_create_listenfd(cycle->server_ip,
+                cycle->server_port, cycle->backlog);
+        if (cycle->listenfds[i] == MS_ERROR)
+        {
+            cycle->listenfds[i] = -1;
+            goto end;
+        }
+
+        // 设置由连接继承的选项
+        if (ms_server_listenfd_init(cycle, cycle->listenfds[i]) == MS_ERROR)
+        {
+            goto end;
+        }
     }
+    cycle->listenfd = cycle->listenfds[0];
 
     // 守护进程
     if (cycle->daemon)
@@ -162,11 +297,67 @@ int main(int argc, char **argv)
         goto end;
     }
 
-    // 创建多个 worker 进程
-    if (cycle->workers <= 0)
-        cycle->workers = 1;
-    if (cycle->workers > MS_MAX_WORKERS)
-        cycle->workers = MS_MAX_WORKERS;
+    // 初始化各 worker
+    for (int i = 0; i < cycle->workers; i++)
+    {
+        cycle->workerlist[i].id = i;
+        cycle->workerlist[i].listenfd = cycle->reuseport ?
+            cycle->listenfds[i] : cycle->listenfds[0];
+        cycle->workerlist[i].evlop = NULL;
+        cycle->workerlist[i].offload = NULL;
+        cycle->workerlist[i].copool = NULL;
+        cycle->workerlist[i].proxy = NULL;
+        cycle->workerlist[i].udp = NULL;
+        cycle->workerlist[i].statics = NULL;
+        cycle->workerlist[i].cycle = cycle;
+    }
+
+    // 线程模式: 创建多个 worker 线程
+    if (cycle->threads)
+    {
+        // 各 worker 线程共用本进程的 flusher，失败时日志直接写入文件
+        ms_logring_start(cycle->log_ring_size, cycle->log_ring_policy);
+
+        // 新线程继承信号掩码，worker 线程阻塞所有信号，由主线程处理
+        sigfillset(&sigset);
+        pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+        for (nthreads = 0; nthreads < cycle->workers; nthreads++)
+        {
+            errno = pthread_create(&(cycle->workerlist[nthreads].tid), NULL,
+                    ms_server_worker_thread, &(cycle->workerlist[nthreads]));
+            if (errno != 0)
+            {
+                ms_errlog(MS_ERRLOG_ERR, errno, "pthread_create() failed");
+                ms_server_workers_stop(cycle);
+                break;
+            }
+        }
+        pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+        // 主线程注册 master 关注的信号
+        if (ms_signal_register(master_signals) == MS_ERROR)
+        {
+            // 无法接收退出信号，停止 worker 线程后退出
+            ms_errlog(MS_ERRLOG_ERR, 0, "master register signals failed, "
+                    "stop worker threads");
+            ms_server_workers_stop(cycle);
+        }
+
+        // 等待 worker 线程退出
+        for (int i = 0; i < nthreads; i++)
+        {
+            pthread_join(cycle->workerlist[i].tid, NULL);
+        }
+
+        // 写出日志环中剩余的日志
+        ms_logring_stop();
+
+        // 清空 pid 文件
+        ms_daemon_clean_pid(cycle->pidlog);
+        goto end;
+    }
+
+    // 进程模式: 创建多个 worker 进程
     for (int i = 0; i < cycle->workers; i++)
     {
         pid = fork();
@@ -183,6 +374,7 @@ int main(int argc, char **argv)
                 {
                     exit(1);
                 }
+                cycle->worker = i;
                 ms_server_worker_cycle(cycle);
                 exit(1);
             // 父进程
@@ -215,7 +407,23 @@ int main(int argc, char **argv)
 
 end:
     // 关闭监听套接字
-    ms_socket_close(cycle->listenfd);
+    for (int i = 0; i < MS_MAX_WORKERS; i++)
+    {
+        if (cycle->listenfds[i] != -1)
+        {
+            ms_socket_close(cycle->listenfds[i]);
+        }
+    }
+
+    // 解除共享内存的映射
+    if (cycle->cache != NULL)
+    {
+        ms_cache_stat(cycle->cache);
+    }
+    ms_shm_destory();
+
+    // 解除统计区的映射
+    ms_stats_destory(cycle->stats);
 
     // 关闭 acclog
     ms_acclog_close();
@@ -237,6 +445,13 @@ static void master_exit_signal_handler(int signal)
             "master recv \"%s\" exit signal, notify worker ...",
             ms_signal_toname(signal));
 
+    // 线程模式: 直接停止各 worker 线程的 eventloop
+    if (cycle->threads)
+    {
+        ms_server_workers_stop(cycle);
+        return;
+    }
+
     for (int i = 0; i < cycle->workers; i++)
     {
         if (kill(workers_pid[i], SIGUSR2) == -1)
@@ -252,7 +467,7 @@ static void master_reopen_signal_handler(int signal)
             "master recv \"%s\" reopen signal, notify worker ...",
             ms_signal_toname(signal));
 
-    for (int i = 0; i < cycle->workers; i++)
+    for (int i = 0; i < cycle->workers && !cycle->threads; i++)
     {
         if (kill(workers_pid[i], SIGUSR1) == -1)
         {
@@ -260,8 +475,21 @@ static void master_reopen_signal_handler(int signal)
         }
     }
 
-    ms_errlog_reopen();
-    ms_acclog_reopen();
+    // 线程模式下由 flusher 写完日志环中的日志后重新打开
+    if (ms_logring_reopen() == MS_ERROR)
+    {
+        ms_errlog_reopen();
+        ms_acclog_reopen();
+    }
+}
+
+static void master_hist_signal_handler(int signal)
+{
+    ms_errlog(MS_ERRLOG_STATUS, 0,
+            "master recv \"%s\" hist signal, log latency histograms",
+            ms_signal_toname(signal));
+
+    ms_stats_log(cycle->stats);
 }
 
 static void worker_exit_signal_handler(int signal)
@@ -269,7 +497,7 @@ static void worker_exit_signal_handler(int signal)
     ms_errlog(MS_ERRLOG_STATUS, 0, "worker recv \"%s\", stop eventloop",
             ms_signal_toname(signal));
 
-    ms_eventloop_stop(cycle->evlop);
+    ms_server_workers_stop(cycle);
 }
 
 static void worker_reopen_signal_handler(int signal)
@@ -278,41 +506,248 @@ static void worker_reopen_signal_handler(int signal)
             "worker recv \"%s\", reopen errorlog, accesslog",
             ms_signal_toname(signal));
 
-    ms_errlog_reopen();
-    ms_acclog_reopen();
+    // 由 flusher 写完日志环中的日志后重新打开
+    if (ms_logring_reopen() == MS_ERROR)
+    {
+        ms_errlog_reopen();
+        ms_acclog_reopen();
+    }
 }
 
 static void ms_server_rtimeout_handler(ms_event_loop_t *evlop, ms_conn_t *conn)
 {
     ms_errlog(MS_ERRLOG_ERR, 0, "clientfd \"%d\" read timeout", conn->fd);
-    ms_eventloop_file_del(evlop, conn->fd, MS_EVENTLOOP_ALL);
-    ms_socket_close(conn->fd);
+    ms_stats_add(evlop->stats, timeouts, 1);
+    conn->timer = NULL; // 已超时的定时器由 eventloop 回收
+    ms_server_conn_close(evlop, conn);
 }
 
 static void ms_server_stimeout_handler(ms_event_loop_t *evlop, ms_conn_t *conn)
 {
     ms_errlog(MS_ERRLOG_ERR, 0, "clientfd \"%d\" send timeout", conn->fd);
-    ms_eventloop_file_del(evlop, conn->fd, MS_EVENTLOOP_ALL);
-    ms_socket_close(conn->fd);
+    ms_stats_add(evlop->stats, timeouts, 1);
+    conn->timer = NULL; // 已超时的定时器由 eventloop 回收
+    ms_server_conn_close(evlop, conn);
 }
 
-// MS_OK:成功； MS_ERROR:失败，底层会直接关闭该连接
+// MS_OK:成功； MS_AGAIN:请求不完整，等待更多数据； MS_ERROR:失败，底层会直接关闭该连接
+// MS_DEFER:请求已通过 ms_server_conn_offload() 提交到线程池，完成后再发送响应
+// 请求数据位于 conn->rbuf，已处理的部分需从中移除；响应数据追加到 conn->sbuf
 static int ms_server_proce_handler(ms_conn_t *conn, ssize_t recvlen)
 {
-    char *p = NULL;
+    int rev = 0;
+    ms_http_request_t req;
+    void *mlen = NULL;
+
+    rev = ms_http_parse(&conn->http, &conn->rbuf, &req);
+    if (rev == MS_AGAIN)
+    {
+        return MS_AGAIN;
+    }
+
+    // 请求非法: 应答错误并关闭连接
+    if (rev == MS_ERROR)
+    {
+        conn->close = 1;
+        return ms_http_error(conn->evlop->bufs, &conn->sbuf,
+                conn->http.status, 1);
+    }
+    conn->close = !req.keepalive;
+    mlen = (void *)(uintptr_t)req.mlen;
+
+    // 示例: "/offload" 请求交由线程池处理，队列满时直接处理
+    if (req.path.len >= 8 && strncmp(req.path.data, "/offload", 8) == 0)
+    {
+        if (ms_server_conn_offload(conn, ms_server_offload_work,
+                    ms_server_response, mlen) == MS_OK)
+        {
+            return MS_DEFER;
+        }
+    }
+
+    // 示例: "/cache" 开头的 GET 请求的响应缓存在各 worker 共用的共享内存中
+    if (cycle->cache != NULL && req.path.len >= 6
+            && strncmp(req.path.data, "/cache", 6) == 0
+            && req.method.len == 3 && strncmp(req.method.data, "GET", 3) == 0)
+    {
+        return ms_server_cached(conn, &req);
+    }
+
+    // 合法请求
+    return ms_server_response(conn, mlen);
+}
+
+// 设置响应: 回显请求，data 为请求的长度
+static int ms_server_response(ms_conn_t *conn, void *data)
+{
+    ms_buf_pool_t *bufs = conn->evlop->bufs;
+    size_t recvlen = (size_t)(uintptr_t)data;
 
     // 处理请求，设置响应
     // TODO
-    p = ms_str_snprintf(conn->sebuff, conn->buffsize - 1, http_head, recvlen,
-            conn->rebuff);
-    conn->sendsize = p - conn->sebuff;
-    ms_acclog("fd:%05d %s<->%05d relen:%d selen:%d",
-            conn->fd, conn->addr.ip, conn->addr.port,
-            recvlen, conn->sendsize);
+    if (ms_buf_chain_printf(bufs, &conn->sbuf, http_head, recvlen) == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+    ms_buf_chain_move(bufs, &conn->sbuf, &conn->rbuf, recvlen);
+
+    ms_acclog("fd:%05d %s<->%05d relen:%z selen:%z",
+            conn->fd, ms_server_conn_ip(conn), ntohs(conn->addr.sin_port),
+            recvlen, conn->sbuf.size);
+
+    return MS_OK;
+}
+
+// 在线程池中执行，模拟阻塞操作
+static void ms_server_offload_work(void *data)
+{
+    usleep(1000);
+}
+
+// 以请求路径为键查找响应缓存: 命中时直接发送缓存的响应；其他 worker 正在生成时稍后重试；
+// 未命中时由线程池生成响应(模拟耗时的计算)，之后存入缓存
+static int ms_server_cached(ms_conn_t *conn, ms_http_request_t *req)
+{
+    int rev = 0;
+    size_t size = conn->sbuf.size;
+    ms_buf_pool_t *bufs = conn->evlop->bufs;
+
+    rev = ms_cache_get(cycle->cache, req->path.data, req->path.len, bufs,
+            &conn->sbuf);
+    if (rev == MS_OK)
+    {
+        ms_buf_chain_consume(bufs, &conn->rbuf, req->mlen);
+        ms_acclog("fd:%05d %s<->%05d relen:%z selen:%z cache:hit",
+                conn->fd, ms_server_conn_ip(conn), ntohs(conn->addr.sin_port),
+                req->mlen, conn->sbuf.size - size);
+        return MS_OK;
+    }
+
+    if (rev == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+
+    // 请求留在 conn->rbuf 中，恢复后重新处理；响应尚未生成，恢复时不可关闭连接
+    if (rev == MS_BUSY)
+    {
+        conn->close = 0;
+        return ms_server_conn_retry(conn, MS_CACHE_WAIT) == MS_OK ?
+            MS_DEFER : MS_ERROR;
+    }
+
+    if (ms_server_conn_offload(conn, ms_server_offload_work,
+                ms_server_cache_fill, NULL) == MS_OK)
+    {
+        return MS_DEFER;
+    }
+
+    return ms_server_cache_fill(conn, NULL);
+}
+
+// 生成 "/cache" 请求的响应并存入缓存，响应体为请求的路径
+static int ms_server_cache_fill(ms_conn_t *conn, void *data)
+{
+    size_t size = conn->sbuf.size;
+    ms_buf_pool_t *bufs = conn->evlop->bufs;
+    ms_http_request_t req;
+
+    // 请求仍位于 conn->rbuf 的起始处，重新解析以取得路径；
+    // 失败时键未知无法取消，计算中的结点在 LRU 链表中，截止时间后随过期或淘汰释放
+    if (ms_http_parse(&conn->http, &conn->rbuf, &req) != MS_OK)
+    {
+        return MS_ERROR;
+    }
+
+    if (ms_buf_chain_printf(bufs, &conn->sbuf, http_head, req.path.len)
+            == MS_ERROR
+            || ms_buf_chain_append(bufs, &conn->sbuf, req.path.data,
+                req.path.len) == MS_ERROR)
+    {
+        ms_cache_cancel(cycle->cache, req.path.data, req.path.len);
+        return MS_ERROR;
+    }
+
+    // 缓存失败时只是不缓存，响应照常发送
+    ms_cache_set(cycle->cache, req.path.data, req.path.len, &conn->sbuf, size,
+            conn->sbuf.size - size);
+    ms_buf_chain_consume(bufs, &conn->rbuf, req.mlen);
+
+    ms_acclog("fd:%05d %s<->%05d relen:%z selen:%z cache:miss",
+            conn->fd, ms_server_conn_ip(conn), ntohs(conn->addr.sin_port),
+            req.mlen, conn->sbuf.size - size);
 
-    // 合法请求
     return MS_OK;
+}
+
+// 协程模式下处理连接: 以同步的写法接收请求并回显，返回时关闭连接
+static void ms_server_corou_handler(ms_conn_t *conn)
+{
+    ssize_t rev = 0;
+    size_t recvlen = 0;
+    char buf[MS_MAX_BUF_SIZE];
+    ms_buf_pool_t *bufs = conn->evlop->bufs;
+
+    while (1)
+    {
+        // 接收完整的请求头
+        while (ms_buf_chain_search(&conn->rbuf, 0, "\r\n\r\n", 4) == -1)
+        {
+            if (conn->rbuf.size >= MS_MAX_REQUEST_SIZE)
+            {
+                return;
+            }
+
+            rev = ms_co_read(conn, buf, sizeof(buf));
+            if (rev <= 0)
+            {
+                return;
+            }
+
+            if (ms_buf_chain_append(bufs, &conn->rbuf, buf, rev) == MS_ERROR)
+            {
+                return;
+            }
+        }
+
+        // 示例: "GET /sleep" 请求延迟 10 毫秒响应，期间不阻塞其他连接
+        // 请求头可能短于 10 字节(如 "\r\n\r\n")，只比较实际拷贝的数据
+        if (ms_buf_chain_copy(&conn->rbuf, 0, buf, 10) == 10
+                && memcmp(buf, "GET /sleep", 10) == 0)
+        {
+            ms_co_sleep(conn, 10);
+        }
+
+        // 发送响应头，再回显请求
+        recvlen = conn->rbuf.size;
+        rev = ms_str_snprintf(buf, sizeof(buf), http_head, recvlen) - buf;
+        if (ms_co_write(conn, buf, rev) == MS_ERROR)
+        {
+            return;
+        }
 
-    // 非法请求
-    return MS_ERROR;
+        while (conn->rbuf.size > 0)
+        {
+            rev = ms_buf_chain_copy(&conn->rbuf, 0, buf, sizeof(buf));
+            if (ms_co_write(conn, buf, rev) == MS_ERROR)
+            {
+                return;
+            }
+            ms_buf_chain_consume(bufs, &conn->rbuf, rev);
+        }
+
+        ms_acclog("fd:%05d %s<->%05d relen:%z selen:%z",
+                conn->fd, ms_server_conn_ip(conn), ntohs(conn->addr.sin_port),
+                recvlen, recvlen);
+    }
+}
+
+// 处理一批 UDP 数据报: 回显，回复在本批处理完后以 sendmmsg() 发送
+static void ms_server_udp_handler(ms_udp_t *udp, ms_udp_msg_t *msgs, int n,
+        void *data)
+{
+    for (int i = 0; i < n; i++)
+    {
+        ms_udp_reply(udp, &msgs[i].addr, msgs[i].data, msgs[i].len);
+    }
 }
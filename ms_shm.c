@@ -0,0 +1,205 @@
+#include "ms_shm.h"
+#include "ms_slab.h"
+
+#include <linux/futex.h>
+
+static ms_shm_zone_t ms_shm_zones[MS_SHM_MAX_ZONES];
+static int ms_shm_nzones = 0;
+
+static void ms_shm_futex_wait(volatile uint32_t *addr, uint32_t val);
+static void ms_shm_futex_wake(volatile uint32_t *addr);
+
+/***********************************************************
+ * @Func   : ms_shm_zone_add()
+ * @Author : lwp
+ * @Brief  : 创建命名的共享内存 zone，并在其中初始化 slab 池。
+ * @Param  : [in] name : zone 的名称，不可重复
+ * @Param  : [in] size : 共享内存的大小，向上取整到页大小
+ * @Return : NULL : 失败
+ *           zone : 成功
+ * @Note   : 必须在 master 中 fork() 之前调用，之后 worker 通过 ms_shm_zone_find() 查找
+ ***********************************************************/
+ms_shm_zone_t *ms_shm_zone_add(const char *name, size_t size)
+{
+    char *addr = NULL;
+    ms_shm_zone_t *zone = NULL;
+
+    if (strlen(name) >= MS_SHM_MAX_NAME || ms_shm_zone_find(name) != NULL
+            || ms_shm_nzones >= MS_SHM_MAX_ZONES)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "invalid or duplicate shm zone \"%s\"",
+                name);
+        return NULL;
+    }
+
+    // 至少容纳 slab 池、页描述符与若干页
+    size = (size + MS_SLAB_PAGE_SIZE - 1) & ~((size_t)MS_SLAB_PAGE_SIZE - 1);
+    size = ms_max(size, (size_t)8 * MS_SLAB_PAGE_SIZE);
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+            -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno,
+                "mmap() shm zone \"%s\" size \"%z\" failed", name, size);
+        return NULL;
+    }
+
+    zone = &ms_shm_zones[ms_shm_nzones];
+    zone->pool = ms_slab_init(addr, size);
+    if (zone->pool == NULL)
+    {
+        munmap(addr, size);
+        return NULL;
+    }
+
+    strcpy(zone->name, name);
+    zone->size = size;
+    zone->addr = addr;
+    ms_shm_nzones++;
+
+    ms_errlog(MS_ERRLOG_INFO, 0, "shm zone \"%s\" size \"%z\" pages \"%uL\"",
+            name, size, (uint64_t)zone->pool->npages);
+
+    return zone;
+}
+// @ms_shm_zone_add() ok
+
+/***********************************************************
+ * @Func   : ms_shm_zone_find()
+ * @Author : lwp
+ * @Brief  : 按名称查找共享内存 zone。
+ * @Param  : [in] name
+ * @Return : NULL : 不存在
+ *           zone : 成功
+ ***********************************************************/
+ms_shm_zone_t *ms_shm_zone_find(const char *name)
+{
+    for (int i = 0; i < ms_shm_nzones; i++)
+    {
+        if (strcmp(ms_shm_zones[i].name, name) == 0)
+        {
+            return &ms_shm_zones[i];
+        }
+    }
+
+    return NULL;
+}
+// @ms_shm_zone_find() ok
+
+/***********************************************************
+ * @Func   : ms_shm_destory()
+ * @Author : lwp
+ * @Brief  : 解除所有 zone 的映射。
+ * @Param  : void
+ * @Return : void
+ * @Note   : 共享内存在最后一个映射它的进程解除映射后释放
+ ***********************************************************/
+void ms_shm_destory(void)
+{
+    for (int i = 0; i < ms_shm_nzones; i++)
+    {
+        ms_slab_stat(ms_shm_zones[i].pool, ms_shm_zones[i].name);
+        munmap(ms_shm_zones[i].addr, ms_shm_zones[i].size);
+    }
+
+    memset(ms_shm_zones, 0, sizeof(ms_shm_zones));
+    ms_shm_nzones = 0;
+}
+// @ms_shm_destory() ok
+
+/***********************************************************
+ * @Func   : ms_shm_mutex_init()
+ * @Author : lwp
+ * @Brief  : 初始化位于共享内存中的互斥锁。
+ * @Param  : [in] mtx
+ * @Return : void
+ ***********************************************************/
+void ms_shm_mutex_init(ms_shm_mutex_t *mtx)
+{
+    mtx->lock = 0;
+}
+// @ms_shm_mutex_init() ok
+
+/***********************************************************
+ * @Func   : ms_shm_mutex_lock()
+ * @Author : lwp
+ * @Brief  : 加锁: 先自旋 MS_SHM_SPIN 次，仍未获得时以 futex 睡眠等待。
+ * @Param  : [in] mtx
+ * @Return : void
+ * @Note   : 不可重入；持有锁的进程崩溃时锁不会被释放，临界区内不可有阻塞操作
+ ***********************************************************/
+void ms_shm_mutex_lock(ms_shm_mutex_t *mtx)
+{
+    uint32_t c = 0;
+
+    for (int i = 0; i < MS_SHM_SPIN; i++)
+    {
+        c = __sync_val_compare_and_swap(&mtx->lock, 0, 1);
+        if (c == 0)
+        {
+            return;
+        }
+
+        // 已有进程在等待，不再自旋
+        if (c == 2)
+        {
+            break;
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    // 标记有等待者后睡眠，被唤醒后重新竞争
+    c = __sync_lock_test_and_set(&mtx->lock, 2);
+    while (c != 0)
+    {
+        ms_shm_futex_wait(&mtx->lock, 2);
+        c = __sync_lock_test_and_set(&mtx->lock, 2);
+    }
+}
+// @ms_shm_mutex_lock() ok
+
+/***********************************************************
+ * @Func   : ms_shm_mutex_trylock()
+ * @Author : lwp
+ * @Brief  : 尝试加锁，不等待。
+ * @Param  : [in] mtx
+ * @Return : MS_BUSY : 已被其他进程持有
+ *           MS_OK   : 成功
+ ***********************************************************/
+int ms_shm_mutex_trylock(ms_shm_mutex_t *mtx)
+{
+    return __sync_bool_compare_and_swap(&mtx->lock, 0, 1) ? MS_OK : MS_BUSY;
+}
+// @ms_shm_mutex_trylock() ok
+
+/***********************************************************
+ * @Func   : ms_shm_mutex_unlock()
+ * @Author : lwp
+ * @Brief  : 解锁，有等待者时唤醒其中一个。
+ * @Param  : [in] mtx
+ * @Return : void
+ ***********************************************************/
+void ms_shm_mutex_unlock(ms_shm_mutex_t *mtx)
+{
+    if (__sync_fetch_and_sub(&mtx->lock, 1) != 1)
+    {
+        __sync_lock_release(&mtx->lock);
+        ms_shm_futex_wake(&mtx->lock);
+    }
+}
+// @ms_shm_mutex_unlock() ok
+
+// 共享内存中的 futex 不可使用 FUTEX_PRIVATE_FLAG
+static void ms_shm_futex_wait(volatile uint32_t *addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static void ms_shm_futex_wake(volatile uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
@@ -0,0 +1,51 @@
+// 共享内存: master 在 fork() 之前以 mmap(MAP_SHARED | MAP_ANONYMOUS) 为每个命名的 zone
+// 创建一段共享内存，其中以 ms_slab 管理分配，各 worker 按名称查找 zone 后直接读写，无需经过 master。
+// 各进程中映射的地址相同，zone 中可以直接保存指针。每个 zone 有一把基于 futex 的互斥锁。
+#ifndef _MS_SHM_H
+#define _MS_SHM_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_errlog.h"
+
+#define MS_SHM_MAX_ZONES 16 // zone 的最大数目
+#define MS_SHM_MAX_NAME  32 // zone 名称的最大长度，含 '\0'
+#define MS_SHM_SPIN      64 // 加锁时进入 futex 等待前自旋的次数
+
+typedef struct ms_shm_mutex_s ms_shm_mutex_t;
+typedef struct ms_shm_zone_s  ms_shm_zone_t;
+typedef struct ms_slab_pool_s ms_slab_pool_t;
+
+// 位于共享内存中的互斥锁: 0 未加锁，1 已加锁，2 已加锁且有等待者
+struct ms_shm_mutex_s {
+    volatile uint32_t lock;
+};
+
+// 命名的共享内存区域，描述结构位于各进程的私有内存中，fork() 时被复制
+struct ms_shm_zone_s {
+    char            name[MS_SHM_MAX_NAME]; // zone 的名称
+    size_t          size;                  // 共享内存的大小
+    char           *addr;                  // 共享内存的起始地址
+    ms_slab_pool_t *pool;                  // 管理共享内存的 slab 池，位于 addr 处
+};
+
+ms_shm_zone_t *ms_shm_zone_add(const char *name, size_t size);
+ms_shm_zone_t *ms_shm_zone_find(const char *name);
+void ms_shm_destory(void);
+
+void ms_shm_mutex_init(ms_shm_mutex_t *mtx);
+void ms_shm_mutex_lock(ms_shm_mutex_t *mtx);
+int ms_shm_mutex_trylock(ms_shm_mutex_t *mtx);
+void ms_shm_mutex_unlock(ms_shm_mutex_t *mtx);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
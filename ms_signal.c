@@ -42,7 +42,9 @@ const char *ms_signal_toname(int signal)
         case SIGWINCH  : return "SIGWINCH";
         case SIGSTKFLT : return "SIGSTKFLT";
         case SIGPWR    : return "SIGPWR";
+#ifdef SIGUNUSED
         case SIGUNUSED : return "SIGUNUSED";
+#endif
 //      case SIGSYS    : return "SIGSYS";
 //      case Synonym   : return "Synonym";
 //      case SIGIOT    : return "SIGIOT";
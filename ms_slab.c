@@ -0,0 +1,445 @@
+#include "ms_slab.h"
+
+static void ms_slab_link(ms_slab_page_t *head, ms_slab_page_t *page);
+static void ms_slab_unlink(ms_slab_page_t *page);
+static ms_slab_page_t *ms_slab_alloc_pages(ms_slab_pool_t *pool,
+        uintptr_t npages);
+static void ms_slab_free_pages(ms_slab_pool_t *pool, ms_slab_page_t *page,
+        uintptr_t npages);
+
+// 页描述符与页的相互转换
+#define ms_slab_page_addr(pool, page)                                          \
+    ((pool)->start + ((uintptr_t)((page) - (pool)->pages) << MS_SLAB_PAGE_SHIFT))
+#define ms_slab_addr_page(pool, p)                                             \
+    (&(pool)->pages[((char *)(p) - (pool)->start) >> MS_SLAB_PAGE_SHIFT])
+
+/***********************************************************
+ * @Func   : ms_slab_init()
+ * @Author : lwp
+ * @Brief  : 在一段内存上初始化 slab 池。
+ * @Param  : [in] addr : 内存的起始地址，按页对齐
+ * @Param  : [in] size : 内存的大小
+ * @Return : NULL : 内存过小
+ *           pool : 成功，位于 addr 处
+ * @Note   : 池结构与页描述符占用内存的头部，页从之后第一个页对齐的地址开始
+ ***********************************************************/
+ms_slab_pool_t *ms_slab_init(void *addr, size_t size)
+{
+    uintptr_t n = 0;
+    char *end = (char *)addr + size;
+    ms_slab_pool_t *pool = (ms_slab_pool_t *)addr;
+
+    if (size < sizeof(ms_slab_pool_t) + MS_SLAB_PAGE_SIZE)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "slab size \"%z\" too small", size);
+        return NULL;
+    }
+
+    memset(pool, 0, sizeof(ms_slab_pool_t));
+    ms_shm_mutex_init(&pool->mutex);
+
+    pool->pages = (ms_slab_page_t *)(pool + 1);
+    n = (size - sizeof(ms_slab_pool_t))
+        / (MS_SLAB_PAGE_SIZE + sizeof(ms_slab_page_t));
+
+    // 页按页大小对齐，对齐可能占用若干页
+    pool->start = (char *)(((uintptr_t)(pool->pages + n) + MS_SLAB_PAGE_SIZE - 1)
+            & ~((uintptr_t)MS_SLAB_PAGE_SIZE - 1));
+    if (pool->start + (n << MS_SLAB_PAGE_SHIFT) > end)
+    {
+        n = (end - pool->start) >> MS_SLAB_PAGE_SHIFT;
+    }
+
+    if (n == 0)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "slab size \"%z\" too small", size);
+        return NULL;
+    }
+
+    pool->npages = n;
+    pool->pfree = n;
+    pool->end = pool->start + (n << MS_SLAB_PAGE_SHIFT);
+    memset(pool->pages, 0, n * sizeof(ms_slab_page_t));
+
+    pool->free.next = &pool->free;
+    pool->free.prev = &pool->free;
+    for (int i = 0; i < MS_SLAB_SLOTS; i++)
+    {
+        pool->slots[i].next = &pool->slots[i];
+        pool->slots[i].prev = &pool->slots[i];
+    }
+
+    // 初始时所有页为一段连续的空闲页
+    for (uintptr_t i = 1; i < n; i++)
+    {
+        pool->pages[i].type = MS_SLAB_BUSY;
+    }
+    pool->pages[0].type = MS_SLAB_FREE;
+    pool->pages[0].npages = n;
+    pool->pages[n - 1].head = &pool->pages[0];
+    ms_slab_link(&pool->free, &pool->pages[0]);
+
+    return pool;
+}
+// @ms_slab_init() ok
+
+/***********************************************************
+ * @Func   : ms_slab_alloc()
+ * @Author : lwp
+ * @Brief  : 加锁后分配内存。
+ * @Param  : [in] pool
+ * @Param  : [in] size
+ * @Return : NULL : 内存不足
+ *           p    : 成功，按 8 字节对齐，整页分配时按页对齐
+ ***********************************************************/
+void *ms_slab_alloc(ms_slab_pool_t *pool, size_t size)
+{
+    void *p = NULL;
+
+    ms_shm_mutex_lock(&pool->mutex);
+    p = ms_slab_alloc_locked(pool, size);
+    ms_shm_mutex_unlock(&pool->mutex);
+
+    return p;
+}
+// @ms_slab_alloc() ok
+
+/***********************************************************
+ * @Func   : ms_slab_alloc_locked()
+ * @Author : lwp
+ * @Brief  : 分配内存，调用者已持有 pool->mutex。
+ * @Param  : [in] pool
+ * @Param  : [in] size
+ * @Return : NULL : 内存不足
+ *           p    : 成功
+ * @Note   : 不超过半页时按 2 的幂取整分配块，否则分配连续的整页
+ ***********************************************************/
+void *ms_slab_alloc_locked(ms_slab_pool_t *pool, size_t size)
+{
+    int slot = 0;
+    int shift = MS_SLAB_MIN_SHIFT;
+    char *addr = NULL;
+    void *p = NULL;
+    ms_slab_page_t *page = NULL;
+
+    // 整页分配
+    if (size > (1 << MS_SLAB_MAX_SHIFT))
+    {
+        page = ms_slab_alloc_pages(pool,
+                (size + MS_SLAB_PAGE_SIZE - 1) >> MS_SLAB_PAGE_SHIFT);
+        if (page == NULL)
+        {
+            pool->pfails++;
+            return NULL;
+        }
+        return ms_slab_page_addr(pool, page);
+    }
+
+    while ((size_t)1 << shift < size)
+    {
+        shift++;
+    }
+    slot = shift - MS_SLAB_MIN_SHIFT;
+    pool->stats[slot].reqs++;
+
+    // 该大小类中没有尚有空闲块的页时，分配一页并划分为块
+    page = pool->slots[slot].next;
+    if (page == &pool->slots[slot])
+    {
+        page = ms_slab_alloc_pages(pool, 1);
+        if (page == NULL)
+        {
+            pool->stats[slot].fails++;
+            return NULL;
+        }
+
+        page->type = MS_SLAB_SMALL;
+        page->shift = shift;
+        page->used = 0;
+        page->free = NULL;
+
+        addr = ms_slab_page_addr(pool, page);
+        for (int i = (MS_SLAB_PAGE_SIZE >> shift) - 1; i >= 0; i--)
+        {
+            *(void **)(addr + (i << shift)) = page->free;
+            page->free = addr + (i << shift);
+        }
+        pool->stats[slot].total += MS_SLAB_PAGE_SIZE >> shift;
+
+        ms_slab_link(&pool->slots[slot], page);
+    }
+
+    p = page->free;
+    page->free = *(void **)p;
+    page->used++;
+    pool->stats[slot].used++;
+
+    // 页已满，从大小类的链表中移除
+    if (page->free == NULL)
+    {
+        ms_slab_unlink(page);
+    }
+
+    return p;
+}
+// @ms_slab_alloc_locked() ok
+
+/***********************************************************
+ * @Func   : ms_slab_calloc()
+ * @Author : lwp
+ * @Brief  : 加锁后分配内存并清零。
+ * @Param  : [in] pool
+ * @Param  : [in] size
+ * @Return : NULL : 内存不足
+ *           p    : 成功
+ ***********************************************************/
+void *ms_slab_calloc(ms_slab_pool_t *pool, size_t size)
+{
+    void *p = NULL;
+
+    ms_shm_mutex_lock(&pool->mutex);
+    p = ms_slab_calloc_locked(pool, size);
+    ms_shm_mutex_unlock(&pool->mutex);
+
+    return p;
+}
+// @ms_slab_calloc() ok
+
+/***********************************************************
+ * @Func   : ms_slab_calloc_locked()
+ * @Author : lwp
+ * @Brief  : 分配内存并清零，调用者已持有 pool->mutex。
+ * @Param  : [in] pool
+ * @Param  : [in] size
+ * @Return : NULL : 内存不足
+ *           p    : 成功
+ ***********************************************************/
+void *ms_slab_calloc_locked(ms_slab_pool_t *pool, size_t size)
+{
+    void *p = ms_slab_alloc_locked(pool, size);
+
+    if (p != NULL)
+    {
+        memset(p, 0, size);
+    }
+
+    return p;
+}
+// @ms_slab_calloc_locked() ok
+
+/***********************************************************
+ * @Func   : ms_slab_free()
+ * @Author : lwp
+ * @Brief  : 加锁后释放内存。
+ * @Param  : [in] pool
+ * @Param  : [in] p : ms_slab_alloc() 返回的地址
+ * @Return : void
+ ***********************************************************/
+void ms_slab_free(ms_slab_pool_t *pool, void *p)
+{
+    ms_shm_mutex_lock(&pool->mutex);
+    ms_slab_free_locked(pool, p);
+    ms_shm_mutex_unlock(&pool->mutex);
+}
+// @ms_slab_free() ok
+
+/***********************************************************
+ * @Func   : ms_slab_free_locked()
+ * @Author : lwp
+ * @Brief  : 释放内存，调用者已持有 pool->mutex。
+ * @Param  : [in] pool
+ * @Param  : [in] p : ms_slab_alloc() 返回的地址
+ * @Return : void
+ * @Note   : 块所在的页全部空闲时归还为空闲页，空闲页与相邻的空闲页合并
+ ***********************************************************/
+void ms_slab_free_locked(ms_slab_pool_t *pool, void *p)
+{
+    int slot = 0;
+    int full = 0;
+    uintptr_t off = 0;
+    ms_slab_page_t *page = NULL;
+
+    if ((char *)p < pool->start || (char *)p >= pool->end)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "ms_slab_free(): outside of pool");
+        return;
+    }
+
+    page = ms_slab_addr_page(pool, p);
+    off = ((char *)p - pool->start) & (MS_SLAB_PAGE_SIZE - 1);
+
+    switch (page->type)
+    {
+        case MS_SLAB_SMALL:
+            if (off & (((uintptr_t)1 << page->shift) - 1))
+            {
+                goto wrong;
+            }
+
+            slot = page->shift - MS_SLAB_MIN_SHIFT;
+            full = (page->free == NULL);
+
+            *(void **)p = page->free;
+            page->free = p;
+            page->used--;
+            pool->stats[slot].used--;
+
+            // 页已全部空闲，归还为空闲页
+            if (page->used == 0)
+            {
+                if (!full)
+                {
+                    ms_slab_unlink(page);
+                }
+                pool->stats[slot].total -= MS_SLAB_PAGE_SIZE >> page->shift;
+                ms_slab_free_pages(pool, page, 1);
+            }
+            else if (full)
+            {
+                ms_slab_link(&pool->slots[slot], page);
+            }
+            return;
+
+        case MS_SLAB_PAGES:
+            if (off != 0)
+            {
+                goto wrong;
+            }
+            ms_slab_free_pages(pool, page, page->npages);
+            return;
+
+        default:
+            goto wrong;
+    }
+
+wrong:
+    ms_errlog(MS_ERRLOG_ERR, 0, "ms_slab_free(): pointer to wrong chunk");
+}
+// @ms_slab_free_locked() ok
+
+/***********************************************************
+ * @Func   : ms_slab_stat()
+ * @Author : lwp
+ * @Brief  : 将各大小类的使用情况记录到错误日志。
+ * @Param  : [in] pool
+ * @Param  : [in] name : 日志中显示的名称
+ * @Return : void
+ ***********************************************************/
+void ms_slab_stat(ms_slab_pool_t *pool, const char *name)
+{
+    ms_shm_mutex_lock(&pool->mutex);
+
+    ms_errlog(MS_ERRLOG_INFO, 0,
+            "slab \"%s\" pages \"%uL\" free \"%uL\" fails \"%uL\"", name,
+            (uint64_t)pool->npages, (uint64_t)pool->pfree,
+            (uint64_t)pool->pfails);
+
+    for (int i = 0; i < MS_SLAB_SLOTS; i++)
+    {
+        if (pool->stats[i].reqs == 0)
+        {
+            continue;
+        }
+
+        ms_errlog(MS_ERRLOG_INFO, 0,
+                "slab \"%s\" size \"%d\" total \"%uL\" used \"%uL\" "
+                "reqs \"%uL\" fails \"%uL\"", name, 1 << (i + MS_SLAB_MIN_SHIFT),
+                (uint64_t)pool->stats[i].total, (uint64_t)pool->stats[i].used,
+                (uint64_t)pool->stats[i].reqs, (uint64_t)pool->stats[i].fails);
+    }
+
+    ms_shm_mutex_unlock(&pool->mutex);
+}
+// @ms_slab_stat() ok
+
+// 插入到链表头部
+static void ms_slab_link(ms_slab_page_t *head, ms_slab_page_t *page)
+{
+    page->next = head->next;
+    page->prev = head;
+    head->next->prev = page;
+    head->next = page;
+}
+
+static void ms_slab_unlink(ms_slab_page_t *page)
+{
+    page->prev->next = page->next;
+    page->next->prev = page->prev;
+    page->next = NULL;
+    page->prev = NULL;
+}
+
+// 首次适配: 从第一段足够长的连续空闲页的头部分配，剩余部分仍为空闲页
+static ms_slab_page_t *ms_slab_alloc_pages(ms_slab_pool_t *pool,
+        uintptr_t npages)
+{
+    ms_slab_page_t *rest = NULL;
+
+    for (ms_slab_page_t *page = pool->free.next; page != &pool->free;
+            page = page->next)
+    {
+        if (page->npages < npages)
+        {
+            continue;
+        }
+
+        ms_slab_unlink(page);
+
+        if (page->npages > npages)
+        {
+            rest = page + npages;
+            rest->type = MS_SLAB_FREE;
+            rest->npages = page->npages - npages;
+            rest[rest->npages - 1].head = rest;
+            ms_slab_link(&pool->free, rest);
+        }
+
+        // 整页分配的最后一页同样指向第一页，释放时据此合并
+        page->type = MS_SLAB_PAGES;
+        page->npages = npages;
+        page[npages - 1].head = page;
+        pool->pfree -= npages;
+
+        return page;
+    }
+
+    return NULL;
+}
+
+// 归还连续的 npages 页，与前后相邻的空闲页合并
+static void ms_slab_free_pages(ms_slab_pool_t *pool, ms_slab_page_t *page,
+        uintptr_t npages)
+{
+    ms_slab_page_t *next = page + npages;
+    ms_slab_page_t *prev = NULL;
+
+    page->type = MS_SLAB_FREE;
+    page->npages = npages;
+    page->free = NULL;
+    pool->pfree += npages;
+
+    if (next < pool->pages + pool->npages && next->type == MS_SLAB_FREE)
+    {
+        ms_slab_unlink(next);
+        page->npages += next->npages;
+        next->type = MS_SLAB_BUSY;
+        next->npages = 0;
+    }
+
+    if (page > pool->pages)
+    {
+        prev = page[-1].head;
+        if (prev != NULL && prev->type == MS_SLAB_FREE
+                && prev + prev->npages == page)
+        {
+            ms_slab_unlink(prev);
+            prev->npages += page->npages;
+            page->type = MS_SLAB_BUSY;
+            page->npages = 0;
+            page = prev;
+        }
+    }
+
+    page[page->npages - 1].head = page;
+    ms_slab_link(&pool->free, page);
+}
@@ -0,0 +1,83 @@
+// slab 分配器: 参考 nginx 的 ngx_slab，管理一段连续内存(通常为共享内存 zone)。
+// 内存按页划分，不超过半页的请求按 2 的幂向上取整到大小类，同一页只存放同一大小类的块；
+// 更大的请求分配连续的整页，释放时与相邻的空闲页合并。所有操作由池中的互斥锁保护。
+#ifndef _MS_SLAB_H
+#define _MS_SLAB_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_shm.h"
+#include "ms_errlog.h"
+
+#define MS_SLAB_PAGE_SHIFT 12                            // 页大小的 shift
+#define MS_SLAB_PAGE_SIZE  (1 << MS_SLAB_PAGE_SHIFT)     // 页大小
+#define MS_SLAB_MIN_SHIFT  3                             // 最小的块为 8 字节
+#define MS_SLAB_MAX_SHIFT  (MS_SLAB_PAGE_SHIFT - 1)      // 最大的块为半页
+#define MS_SLAB_SLOTS      (MS_SLAB_MAX_SHIFT - MS_SLAB_MIN_SHIFT + 1) // 大小类的数目
+
+// 页的类型
+#define MS_SLAB_FREE  0 // 空闲页，连续空闲页中的第一页记录页数
+#define MS_SLAB_SMALL 1 // 按大小类划分为块的页
+#define MS_SLAB_PAGES 2 // 整页分配的第一页，记录页数
+#define MS_SLAB_BUSY  3 // 整页分配或连续空闲页中的其他页
+
+typedef struct ms_slab_page_s ms_slab_page_t;
+typedef struct ms_slab_stat_s ms_slab_stat_t;
+
+// 页描述符，与页一一对应，按链表挂在大小类或空闲页链表上
+struct ms_slab_page_s {
+    ms_slab_page_t *next;   // 链表中的下一个
+    ms_slab_page_t *prev;   // 链表中的上一个
+    ms_slab_page_t *head;   // 连续空闲页的最后一页指向第一页，用于与之后释放的页合并
+    void           *free;   // SMALL: 空闲块链表
+    uint32_t        npages; // FREE/PAGES: 连续的页数
+    uint16_t        shift;  // SMALL: 块大小的 shift
+    uint16_t        used;   // SMALL: 已分配的块数
+    int             type;   // 页的类型，见 MS_SLAB_FREE 等
+};
+
+// 每个大小类的统计
+struct ms_slab_stat_s {
+    uintptr_t total; // 已划分的块数
+    uintptr_t used;  // 已分配的块数
+    uintptr_t reqs;  // 分配请求的次数
+    uintptr_t fails; // 分配失败的次数
+};
+
+// slab 池，位于被管理内存的起始处，之后依次为页描述符数组与页
+struct ms_slab_pool_s {
+    ms_shm_mutex_t  mutex;                 // 保护整个池的互斥锁
+    ms_slab_page_t  free;                  // 连续空闲页链表的哨兵
+    ms_slab_page_t  slots[MS_SLAB_SLOTS];  // 各大小类中尚有空闲块的页的链表的哨兵
+    ms_slab_stat_t  stats[MS_SLAB_SLOTS];  // 各大小类的统计
+    ms_slab_page_t *pages;                 // 页描述符数组
+    char           *start;                 // 第一页的地址，按页对齐
+    char           *end;                   // 最后一页之后的地址
+    uintptr_t       npages;                // 页的总数
+    uintptr_t       pfree;                 // 空闲页的数目
+    uintptr_t       pfails;                // 整页分配失败的次数
+    void           *data;                  // 使用者的数据，如 zone 中的哈希表
+};
+
+ms_slab_pool_t *ms_slab_init(void *addr, size_t size);
+
+void *ms_slab_alloc(ms_slab_pool_t *pool, size_t size);
+void *ms_slab_alloc_locked(ms_slab_pool_t *pool, size_t size);
+void *ms_slab_calloc(ms_slab_pool_t *pool, size_t size);
+void *ms_slab_calloc_locked(ms_slab_pool_t *pool, size_t size);
+void ms_slab_free(ms_slab_pool_t *pool, void *p);
+void ms_slab_free_locked(ms_slab_pool_t *pool, void *p);
+
+void ms_slab_stat(ms_slab_pool_t *pool, const char *name);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
@@ -68,11 +68,11 @@ int ms_socket_inetpton(int af, const char *src, void *dst)
  * @Param  : [in] src
  * @Return : NULL : 失败
  *           !NULL : "ddd.ddd.ddd.ddd" 或 "x:x:x:x:x:x:x:x" 格式的地址
- * @Note   : 
+ * @Note   : 返回每个线程单独的静态缓冲区，下一次调用时被覆盖
  ***********************************************************/
 const char *ms_socket_inetntop(int af, const void *src)
 {
-    static char dst[256] = { 0 };
+    static __thread char dst[256] = { 0 };
     const char *p = inet_ntop(af, src, dst, sizeof(dst));
     if (p == NULL)
     {
@@ -400,6 +400,64 @@ int ms_socket_connect(int sockfd, const char *ip, int port)
 }
 // @ms_socket_connect() ok
 
+/***********************************************************
+ * @Func   : ms_socket_connect_nonblock()
+ * @Author : lwp
+ * @Brief  : 使用非阻塞的 sockfd 发起连接，不等待连接完成。
+ * @Param  : [in] sockfd : 非阻塞套接字
+ * @Param  : [in] addr : 对端地址，网络字节序
+ * @Return : MS_ERROR : 失败
+ *           MS_AGAIN : 连接进行中，可写时调用 ms_socket_error() 获取结果
+ *           MS_OK    : 已连接
+ * @Note   :
+ ***********************************************************/
+int ms_socket_connect_nonblock(int sockfd, const struct sockaddr_in *addr)
+{
+    while (connect(sockfd, (const struct sockaddr *)addr, sizeof(*addr)) == -1)
+    {
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        if (errno == EINPROGRESS)
+        {
+            return MS_AGAIN;
+        }
+
+        ms_errlog(MS_ERRLOG_ERR, errno, "connect() failed");
+        return MS_ERROR;
+    }
+
+    return MS_OK;
+}
+// @ms_socket_connect_nonblock() ok
+
+/***********************************************************
+ * @Func   : ms_socket_error()
+ * @Author : lwp
+ * @Brief  : 获取并清除 sockfd 上未决的错误(SO_ERROR)。
+ * @Param  : [in] sockfd
+ * @Return : MS_ERROR : getsockopt() 失败
+ *           0        : 无错误
+ *           errno    : 未决的错误
+ * @Note   : 非阻塞 connect() 完成后用于判断连接是否成功
+ ***********************************************************/
+int ms_socket_error(int sockfd)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "getsockopt(SO_ERROR) failed");
+        return MS_ERROR;
+    }
+
+    return err;
+}
+// @ms_socket_error() ok
+
 /***********************************************************
  * @Func   : ms_socket_accept()
  * @Author : lwp
@@ -442,6 +500,50 @@ int ms_socket_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
 }
 // @ms_socket_accept() ok
 
+/***********************************************************
+ * @Func   : ms_socket_accept4()
+ * @Author : lwp
+ * @Brief  : 接受客户端连接，同时设置 flags。
+ * @Param  : [in] sockfd : listenfd
+ * @Param  : [in/out] addr
+ * @Param  : [in/out] addrlen
+ * @Param  : [in] flags : SOCK_NONBLOCK/SOCK_CLOEXEC
+ * @Return : MS_ERROR : 失败或暂无连接
+ *           clientfd : 成功
+ * @Note   : 省去 accept() 后设置非阻塞的两次 fcntl()，对端已关闭的连接直接跳过
+ ***********************************************************/
+int ms_socket_accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+        int flags)
+{
+    int clientfd = -1;
+
+    while (1)
+    {
+        clientfd = accept4(sockfd, addr, addrlen, flags);
+        if (clientfd == -1)
+        {
+            // 信号中断或对端已关闭
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            else
+            {
+                ms_errlog(MS_ERRLOG_ERR, errno, "accept4() failed");
+                return MS_ERROR;
+            }
+        }
+        break;
+    }
+
+    return clientfd;
+}
+// @ms_socket_accept4() ok
+
 /***********************************************************
  * @Func   : ms_socket_write()
  * @Author : lwp
@@ -676,3 +778,77 @@ ssize_t ms_socket_sendto(int sockfd, const void *buf, size_t buflen, int flags,
     return sendlen;
 }
 // @ms_socket_sendto() ok
+
+/***********************************************************
+ * @Func   : ms_socket_recvmmsg()
+ * @Author : lwp
+ * @Brief  : 以一次系统调用接收多个数据报。
+ * @Param  : [in] sockfd
+ * @Param  : [in/out] msgs : 各数据报的缓冲区，返回时设置 msg_len
+ * @Param  : [in] vlen : msgs 的数目
+ * @Param  : [in] flags
+ * @Return : MS_ERROR : 失败
+ *           MS_AGAIN : 没有可接收的数据报
+ *           n        : 接收到的数据报的数目
+ * @Note   : 被信号中断时重试
+ ***********************************************************/
+int ms_socket_recvmmsg(int sockfd, struct mmsghdr *msgs, unsigned int vlen,
+        int flags)
+{
+    int rev = 0;
+
+    do
+    {
+        rev = recvmmsg(sockfd, msgs, vlen, flags, NULL);
+    } while (rev == -1 && errno == EINTR);
+
+    if (rev == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return MS_AGAIN;
+        }
+        ms_errlog(MS_ERRLOG_ERR, errno, "recvmmsg() failed");
+        return MS_ERROR;
+    }
+
+    return rev;
+}
+// @ms_socket_recvmmsg() ok
+
+/***********************************************************
+ * @Func   : ms_socket_sendmmsg()
+ * @Author : lwp
+ * @Brief  : 以一次系统调用发送多个数据报。
+ * @Param  : [in] sockfd
+ * @Param  : [in/out] msgs : 各数据报，返回时设置 msg_len
+ * @Param  : [in] vlen : msgs 的数目
+ * @Param  : [in] flags
+ * @Return : MS_ERROR : 第一个数据报发送失败
+ *           MS_AGAIN : 发送缓冲区已满
+ *           n        : 已发送的数据报的数目，可能小于 vlen
+ * @Note   : 被信号中断时重试
+ ***********************************************************/
+int ms_socket_sendmmsg(int sockfd, struct mmsghdr *msgs, unsigned int vlen,
+        int flags)
+{
+    int rev = 0;
+
+    do
+    {
+        rev = sendmmsg(sockfd, msgs, vlen, flags);
+    } while (rev == -1 && errno == EINTR);
+
+    if (rev == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return MS_AGAIN;
+        }
+        ms_errlog(MS_ERRLOG_ERR, errno, "sendmmsg() failed");
+        return MS_ERROR;
+    }
+
+    return rev;
+}
+// @ms_socket_sendmmsg() ok
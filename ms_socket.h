@@ -29,7 +29,11 @@ int ms_socket_settimeout(int sockfd, int timeout);
 int ms_socket_bind(int sockfd, const char *ip, int port);
 int ms_socket_listen(int sockfd, int backlog);
 int ms_socket_connect(int sockfd, const char *ip, int port);
+int ms_socket_connect_nonblock(int sockfd, const struct sockaddr_in *addr);
+int ms_socket_error(int sockfd);
 int ms_socket_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+int ms_socket_accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+        int flags);
 ssize_t ms_socket_write(int sockfd, const void *buf, size_t len);
 ssize_t ms_socket_read(int sockfd, void *buf, size_t len);
 void ms_socket_close(int sockfd);
@@ -40,6 +44,10 @@ ssize_t ms_socket_recvfrom(int sockfd, void *buf, size_t buflen, int flags,
         struct sockaddr *addr, socklen_t *addrlen);
 ssize_t ms_socket_sendto(int sockfd, const void *buf, size_t buflen, int flags,
         const struct sockaddr *addr, socklen_t addrlen);
+int ms_socket_recvmmsg(int sockfd, struct mmsghdr *msgs, unsigned int vlen,
+        int flags);
+int ms_socket_sendmmsg(int sockfd, struct mmsghdr *msgs, unsigned int vlen,
+        int flags);
 
 #ifdef __cpluscplus
 }
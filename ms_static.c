@@ -0,0 +1,603 @@
+#include "ms_static.h"
+
+// 按扩展名确定 Content-Type
+static struct {
+    const char *ext;
+    const char *type;
+} ms_static_types[] = {
+    { "html", "text/html"                },
+    { "htm" , "text/html"                },
+    { "css" , "text/css"                 },
+    { "js"  , "application/javascript"   },
+    { "json", "application/json"         },
+    { "txt" , "text/plain"               },
+    { "xml" , "text/xml"                 },
+    { "png" , "image/png"                },
+    { "jpg" , "image/jpeg"               },
+    { "jpeg", "image/jpeg"               },
+    { "gif" , "image/gif"                },
+    { "svg" , "image/svg+xml"            },
+    { "ico" , "image/x-icon"             },
+    { "wasm", "application/wasm"         },
+    { "pdf" , "application/pdf"          },
+    { NULL  , "application/octet-stream" }
+};
+
+static uint32_t ms_static_hash(const char *data, size_t len);
+static int ms_static_path(const char *uri, size_t n, char *path);
+static const char *ms_static_type(const char *path, size_t len);
+static int ms_static_error(ms_conn_t *conn, int status);
+static ms_static_file_t *ms_static_open(ms_static_cache_t *cache,
+        const char *path, size_t len, int *status);
+static void ms_static_unlink(ms_static_file_t *file);
+static void ms_static_close(ms_static_file_t *file);
+static void ms_static_put(ms_static_file_t *file);
+static void ms_static_expire(ms_event_loop_t *evlop, void *data);
+
+/***********************************************************
+ * @Func   : ms_static_cache_create()
+ * @Author : lwp
+ * @Brief  : 创建打开文件的缓存。
+ * @Param  : [in] evlop
+ * @Param  : [in] root : 静态文件的根目录
+ * @Param  : [in] maxfiles : 缓存的文件的最大数目，0 代表不缓存
+ * @Param  : [in] ttl : 缓存的有效时间，毫秒 0 代表不过期
+ * @Return : NULL  : 失败
+ *           cache : 成功
+ * @Note   : 文件以 openat() 相对于根目录打开
+ ***********************************************************/
+ms_static_cache_t *ms_static_cache_create(ms_event_loop_t *evlop,
+        const char *root, int maxfiles, int ttl)
+{
+    ms_static_cache_t *cache = NULL;
+
+    cache = (ms_static_cache_t *)ms_mem_pool_pcalloc(evlop->pool,
+            sizeof(ms_static_cache_t));
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+
+    cache->rootfd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cache->rootfd == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "open() static root \"%s\" failed", root);
+        return NULL;
+    }
+
+    cache->evlop = evlop;
+    cache->maxfiles = maxfiles;
+    cache->ttl = ttl;
+
+    return cache;
+}
+// @ms_static_cache_create() ok
+
+/***********************************************************
+ * @Func   : ms_static_cache_destory()
+ * @Author : lwp
+ * @Brief  : 关闭缓存中所有未被引用的文件。
+ * @Param  : [in] cache
+ * @Return : NONE
+ * @Note   : 仍被连接引用的文件由 ms_static_release() 关闭
+ ***********************************************************/
+void ms_static_cache_destory(ms_static_cache_t *cache)
+{
+    ms_static_file_t *file = NULL;
+
+    ms_errlog(MS_ERRLOG_INFO, 0, "static cache hit \"%uL\" miss \"%uL\"",
+            (uint64_t)cache->nhit, (uint64_t)cache->nmiss);
+
+    while (cache->oldest)
+    {
+        file = cache->oldest;
+        ms_static_unlink(file);
+        if (file->refs == 0)
+        {
+            ms_static_close(file);
+        }
+    }
+
+    close(cache->rootfd);
+    cache->rootfd = -1;
+}
+// @ms_static_cache_destory() ok
+
+/***********************************************************
+ * @Func   : ms_static_handler()
+ * @Author : lwp
+ * @Brief  : 静态文件模式下处理请求的回调函数。
+ * @Param  : [in] conn
+ * @Param  : [in] recvlen : conn->rbuf 中数据的长度
+ * @Return : MS_ERROR : 失败，关闭连接
+ *           MS_AGAIN : 请求不完整
+ *           MS_OK    : 已在 conn->sbuf 中设置响应头，文件内容由 ms_static_send() 发送
+ * @Note   : 只支持 GET 与 HEAD，路径中不可包含 ".."；请求非法时应答错误后关闭连接
+ ***********************************************************/
+int ms_static_handler(ms_conn_t *conn, ssize_t recvlen)
+{
+    int rev = 0;
+    int status = 0;
+    int len = 0;
+    int get = 0;
+    int head = 0;
+    char tbuf[64];
+    char path[MS_STATIC_MAX_PATH];
+    struct tm tm;
+    ms_http_request_t req;
+    ms_static_file_t *file = NULL;
+    ms_static_cache_t *cache = ((ms_worker_t *)conn->evlop->data1)->statics;
+    ms_buf_pool_t *bufs = conn->evlop->bufs;
+
+    rev = ms_http_parse(&conn->http, &conn->rbuf, &req);
+    if (rev == MS_AGAIN)
+    {
+        return MS_AGAIN;
+    }
+
+    // 请求非法: 应答错误并关闭连接
+    if (rev == MS_ERROR)
+    {
+        conn->close = 1;
+        return ms_static_error(conn, conn->http.status);
+    }
+    conn->close = !req.keepalive;
+
+    get = (req.method.len == 3 && strncmp(req.method.data, "GET", 3) == 0);
+    head = (req.method.len == 4 && strncmp(req.method.data, "HEAD", 4) == 0);
+    len = ms_static_path(req.path.data, req.path.len, path);
+
+    // 忽略请求体，之后 req 中的切片不再有效
+    ms_buf_chain_consume(bufs, &conn->rbuf, req.mlen);
+
+    if (!get && !head)
+    {
+        return ms_static_error(conn, 405);
+    }
+
+    if (len == MS_ERROR)
+    {
+        return ms_static_error(conn, 400);
+    }
+
+    file = ms_static_open(cache, path, len, &status);
+    if (file == NULL)
+    {
+        return ms_static_error(conn, status);
+    }
+
+    gmtime_r(&file->st.st_mtime, &tm);
+    strftime(tbuf, sizeof(tbuf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    rev = ms_buf_chain_printf(bufs, &conn->sbuf,
+            "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %L\r\n"
+            "Last-Modified: %s\r\n\r\n",
+            ms_static_type(path, len), (int64_t)file->st.st_size, tbuf);
+    if (rev == MS_ERROR)
+    {
+        ms_static_put(file);
+        return MS_ERROR;
+    }
+
+    ms_acclog("fd:%05d %s<->%05d relen:%z selen:%L %s",
+            conn->fd, ms_server_conn_ip(conn), ntohs(conn->addr.sin_port),
+            req.mlen, (int64_t)file->st.st_size, path);
+
+    // HEAD 请求及空文件没有响应体
+    if (head || file->st.st_size == 0)
+    {
+        ms_static_put(file);
+        return MS_OK;
+    }
+
+    conn->file = file;
+    conn->foff = 0;
+    conn->flen = file->st.st_size;
+
+    return MS_OK;
+}
+// @ms_static_handler() ok
+
+/***********************************************************
+ * @Func   : ms_static_send()
+ * @Author : lwp
+ * @Brief  : 以 sendfile() 发送 conn->file 中剩余的数据。
+ * @Param  : [in] conn
+ * @Return : MS_ERROR : 失败
+ *           MS_AGAIN : 发送缓冲区已满
+ *           MS_OK    : 全部发送完成，已归还文件
+ * @Note   : 在 conn->sbuf 发送完成后调用
+ ***********************************************************/
+int ms_static_send(ms_conn_t *conn)
+{
+    ssize_t rev = 0;
+
+    while (conn->flen > 0)
+    {
+        rev = sendfile(conn->fd, conn->file->fd, &conn->foff, conn->flen);
+        if (rev == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return MS_AGAIN;
+            }
+
+            ms_errlog(MS_ERRLOG_ERR, errno, "sendfile() \"%s\" failed",
+                    conn->file->path);
+            return MS_ERROR;
+        }
+
+        // 文件在发送期间被截断，已发送的 Content-Length 无法满足
+        if (rev == 0)
+        {
+            ms_errlog(MS_ERRLOG_ERR, 0, "file \"%s\" was truncated",
+                    conn->file->path);
+            return MS_ERROR;
+        }
+
+        conn->flen -= rev;
+        ms_stats_add(conn->evlop->stats, bytes_out, rev);
+    }
+
+    ms_static_release(conn);
+
+    return MS_OK;
+}
+// @ms_static_send() ok
+
+/***********************************************************
+ * @Func   : ms_static_release()
+ * @Author : lwp
+ * @Brief  : 归还连接引用的文件。
+ * @Param  : [in] conn
+ * @Return : NONE
+ * @Note   : 连接关闭时调用
+ ***********************************************************/
+void ms_static_release(ms_conn_t *conn)
+{
+    if (conn->file != NULL)
+    {
+        ms_static_put(conn->file);
+        conn->file = NULL;
+        conn->foff = 0;
+        conn->flen = 0;
+    }
+}
+// @ms_static_release() ok
+
+static uint32_t ms_static_hash(const char *data, size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (uint8_t)data[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+// 解码请求 URI 中的路径，去掉查询串，拒绝 ".." 与 '\0'；以 '/' 结尾时补上首页
+static int ms_static_path(const char *uri, size_t n, char *path)
+{
+    int c = 0;
+    size_t len = 0;
+    char hex[3] = { 0 };
+
+    if (n == 0 || uri[0] != '/')
+    {
+        return MS_ERROR;
+    }
+
+    for (size_t i = 0; i < n && uri[i] != '?' && uri[i] != '#'; i++)
+    {
+        c = uri[i];
+        if (c == '%')
+        {
+            if (i + 2 >= n || !isxdigit(uri[i + 1]) || !isxdigit(uri[i + 2]))
+            {
+                return MS_ERROR;
+            }
+            hex[0] = uri[i + 1];
+            hex[1] = uri[i + 2];
+            c = strtol(hex, NULL, 16);
+            i += 2;
+        }
+
+        if (c == '\0' || len >= MS_STATIC_MAX_PATH - sizeof(MS_STATIC_INDEX) - 1)
+        {
+            return MS_ERROR;
+        }
+
+        // 合并连续的 '/'
+        if (c == '/' && len > 0 && path[len - 1] == '/')
+        {
+            continue;
+        }
+        path[len++] = c;
+    }
+    path[len] = '\0';
+
+    if (strstr(path, "/../") != NULL
+            || (len >= 3 && strcmp(path + len - 3, "/..") == 0))
+    {
+        return MS_ERROR;
+    }
+
+    if (path[len - 1] == '/')
+    {
+        strcpy(path + len, MS_STATIC_INDEX);
+        len += sizeof(MS_STATIC_INDEX) - 1;
+    }
+
+    return len;
+}
+
+static const char *ms_static_type(const char *path, size_t len)
+{
+    int i = 0;
+    const char *ext = NULL;
+
+    ext = strrchr(path, '.');
+    if (ext == NULL || strchr(ext, '/') != NULL)
+    {
+        return "application/octet-stream";
+    }
+
+    for (i = 0; ms_static_types[i].ext != NULL; i++)
+    {
+        if (strcasecmp(ext + 1, ms_static_types[i].ext) == 0)
+        {
+            break;
+        }
+    }
+
+    return ms_static_types[i].type;
+}
+
+// 设置错误响应
+static int ms_static_error(ms_conn_t *conn, int status)
+{
+    ms_acclog("fd:%05d %s<->%05d status:%d",
+            conn->fd, ms_server_conn_ip(conn), ntohs(conn->addr.sin_port),
+            status);
+
+    return ms_http_error(conn->evlop->bufs, &conn->sbuf, status, conn->close);
+}
+
+// 查找缓存，未命中时打开文件并加入缓存；status 为失败时的响应状态码
+static ms_static_file_t *ms_static_open(ms_static_cache_t *cache,
+        const char *path, size_t len, int *status)
+{
+    int fd = -1;
+    int dirfd = -1;
+    uint32_t hash = 0;
+    struct stat st;
+    ms_static_file_t *file = NULL;
+    ms_static_file_t **bucket = NULL;
+
+    hash = ms_static_hash(path, len);
+    bucket = &(cache->buckets[hash & (MS_STATIC_BUCKETS - 1)]);
+
+    for (file = *bucket; file != NULL; file = file->next)
+    {
+        if (file->hash == hash && file->len == len
+                && memcmp(file->path, path, len) == 0)
+        {
+            break;
+        }
+    }
+
+    // 命中: 移到 LRU 链表头
+    if (file != NULL)
+    {
+        cache->nhit++;
+        if (file != cache->newest)
+        {
+            file->newer->older = file->older;
+            if (file->older)
+            {
+                file->older->newer = file->newer;
+            }
+            else
+            {
+                cache->oldest = file->newer;
+            }
+            file->newer = NULL;
+            file->older = cache->newest;
+            cache->newest->newer = file;
+            cache->newest = file;
+        }
+        file->refs++;
+        return file;
+    }
+    cache->nmiss++;
+
+    // 路径以 '/' 开头，相对于根目录打开；"/" 对应根目录本身
+    fd = openat(cache->rootfd, len > 1 ? path + 1 : ".",
+            O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        goto error;
+    }
+
+    // 目录: 返回其中的首页
+    if (S_ISDIR(st.st_mode))
+    {
+        dirfd = fd;
+        fd = openat(dirfd, MS_STATIC_INDEX, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        close(dirfd);
+        if (fd == -1 || fstat(fd, &st) == -1)
+        {
+            goto error;
+        }
+    }
+
+    // 只发送普通文件，管道等没有长度，且可能阻塞 eventloop
+    if (!S_ISREG(st.st_mode))
+    {
+        close(fd);
+        *status = 403;
+        return NULL;
+    }
+
+    file = (ms_static_file_t *)malloc(sizeof(ms_static_file_t) + len + 1);
+    if (file == NULL)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "malloc() static file failed");
+        close(fd);
+        *status = 500;
+        return NULL;
+    }
+
+    memset(file, 0, sizeof(ms_static_file_t));
+    memcpy(file->path, path, len + 1);
+    file->len = len;
+    file->hash = hash;
+    file->fd = fd;
+    file->st = st;
+    file->refs = 1;
+    file->cache = cache;
+
+    // 缓存已满时淘汰最久未使用且未被引用的文件
+    for (ms_static_file_t *old = cache->oldest;
+            old != NULL && cache->nfiles >= cache->maxfiles; )
+    {
+        ms_static_file_t *newer = old->newer;
+        if (old->refs == 0)
+        {
+            ms_static_unlink(old);
+            ms_static_close(old);
+        }
+        old = newer;
+    }
+
+    // 仍无空间时不缓存，归还时直接关闭
+    if (cache->nfiles >= cache->maxfiles)
+    {
+        file->stale = 1;
+        return file;
+    }
+
+    if (cache->ttl > 0)
+    {
+        file->timer = ms_eventloop_timer_add(cache->evlop, cache->ttl,
+                (const ms_event_timer_proc *)ms_static_expire, file);
+        if (file->timer == NULL)
+        {
+            file->stale = 1;
+            return file;
+        }
+    }
+
+    file->next = *bucket;
+    *bucket = file;
+    file->older = cache->newest;
+    if (cache->newest)
+    {
+        cache->newest->newer = file;
+    }
+    else
+    {
+        cache->oldest = file;
+    }
+    cache->newest = file;
+    cache->nfiles++;
+
+    return file;
+
+error:
+    *status = (errno == ENOENT || errno == ENOTDIR || errno == ENAMETOOLONG) ? 404
+        : ((errno == EACCES || errno == ELOOP) ? 403 : 500);
+    if (*status == 500)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "open() \"%s\" failed", path);
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    return NULL;
+}
+
+// 从哈希表与 LRU 链表中移除，之后不再被查找到
+static void ms_static_unlink(ms_static_file_t *file)
+{
+    ms_static_cache_t *cache = file->cache;
+    ms_static_file_t **pp = NULL;
+
+    if (file->stale)
+    {
+        return;
+    }
+
+    pp = &(cache->buckets[file->hash & (MS_STATIC_BUCKETS - 1)]);
+    while (*pp != file)
+    {
+        pp = &((*pp)->next);
+    }
+    *pp = file->next;
+
+    if (file->newer)
+    {
+        file->newer->older = file->older;
+    }
+    else
+    {
+        cache->newest = file->older;
+    }
+
+    if (file->older)
+    {
+        file->older->newer = file->newer;
+    }
+    else
+    {
+        cache->oldest = file->newer;
+    }
+
+    if (file->timer != NULL)
+    {
+        ms_eventloop_timer_del(cache->evlop, file->timer);
+        file->timer = NULL;
+    }
+
+    file->next = file->newer = file->older = NULL;
+    file->stale = 1;
+    cache->nfiles--;
+}
+
+static void ms_static_close(ms_static_file_t *file)
+{
+    close(file->fd);
+    free(file);
+}
+
+// 归还引用，已失效的文件在引用归零时关闭
+static void ms_static_put(ms_static_file_t *file)
+{
+    file->refs--;
+    if (file->refs == 0 && file->stale)
+    {
+        ms_static_close(file);
+    }
+}
+
+// 缓存超时: 之后的请求重新打开文件，以感知文件的修改
+static void ms_static_expire(ms_event_loop_t *evlop, void *data)
+{
+    ms_static_file_t *file = (ms_static_file_t *)data;
+
+    file->timer = NULL; // 已超时的定时器由 eventloop 回收
+    ms_static_unlink(file);
+    if (file->refs == 0)
+    {
+        ms_static_close(file);
+    }
+}
@@ -0,0 +1,66 @@
+// 静态文件: 在 static_root 下查找请求的文件，响应头追加到 conn->sbuf，
+// 文件内容在响应头发送完成后以 sendfile() 直接由内核发送，不经过用户态缓冲区。
+// 打开的文件及其 stat 结果缓存在每个 eventloop 单独的 LRU 中，超过 TTL 后重新打开。
+#ifndef _MS_STATIC_H
+#define _MS_STATIC_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_acclog.h"
+#include "ms_server.h"
+
+#include <sys/sendfile.h>
+
+#define MS_STATIC_BUCKETS    1024         // 缓存哈希表的桶数，必须为 2 的幂
+#define MS_STATIC_MAX_PATH   1024         // 请求路径解码后的最大长度
+#define MS_STATIC_INDEX      "index.html" // 请求目录时返回的文件
+
+// 缓存的文件，被连接引用期间不会关闭
+struct ms_static_file_s {
+    ms_static_file_t  *next;  // 同一个桶中的下一个文件
+    ms_static_file_t  *newer; // LRU 链表中较新的文件
+    ms_static_file_t  *older; // LRU 链表中较旧的文件
+    ms_static_cache_t *cache; // 所属的缓存
+    ms_event_timer_t  *timer; // TTL 定时器
+    struct stat        st;    // 打开时的 stat 结果
+    uint32_t           hash;  // 路径的哈希值
+    int                fd;    // 打开的文件句柄
+    int                refs;  // 正在发送该文件的连接数
+    int                stale; // 已超时或被淘汰，不再被查找到，引用归零时关闭
+    size_t             len;   // 路径的长度
+    char               path[]; // 解码后的请求路径，以 '\0' 结尾
+};
+
+// 打开文件的缓存，每个 eventloop 一个，只在 eventloop 所在线程中使用
+struct ms_static_cache_s {
+    ms_event_loop_t   *evlop;    // 所属的 eventloop
+    ms_static_file_t  *buckets[MS_STATIC_BUCKETS]; // 以路径为键的哈希表
+    ms_static_file_t  *newest;   // LRU 链表头，最近使用的文件
+    ms_static_file_t  *oldest;   // LRU 链表尾，最先淘汰的文件
+    int                rootfd;   // static_root 目录的文件句柄
+    int                nfiles;   // 缓存中文件的数目
+    int                maxfiles; // 缓存中文件的最大数目
+    int                ttl;      // 缓存的有效时间，毫秒
+    uintptr_t          nhit;     // 命中的次数
+    uintptr_t          nmiss;    // 未命中的次数
+};
+
+ms_static_cache_t *ms_static_cache_create(ms_event_loop_t *evlop,
+        const char *root, int maxfiles, int ttl);
+void ms_static_cache_destory(ms_static_cache_t *cache);
+
+int ms_static_handler(ms_conn_t *conn, ssize_t recvlen);
+int ms_static_send(ms_conn_t *conn);
+void ms_static_release(ms_conn_t *conn);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
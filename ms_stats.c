@@ -0,0 +1,131 @@
+#include "ms_stats.h"
+#include "ms_time.h"
+#include "ms_errlog.h"
+#include "ms_str.h"
+
+// 直方图的名称及其在 ms_stats_worker_t 中的偏移
+static struct {
+    const char *name;
+    size_t      offset;
+} ms_stats_hists[] = {
+    { "wait"   , offsetof(ms_stats_worker_t, wait)    },
+    { "rproc"  , offsetof(ms_stats_worker_t, rproc)   },
+    { "wproc"  , offsetof(ms_stats_worker_t, wproc)   },
+    { "timer"  , offsetof(ms_stats_worker_t, timer)   },
+    { "batch"  , offsetof(ms_stats_worker_t, batch)   },
+    { "request", offsetof(ms_stats_worker_t, request) }
+};
+
+/***********************************************************
+ * @Func   : ms_stats_create()
+ * @Author : lwp
+ * @Brief  : 创建统计文件并映射为共享的统计区，计数清零。
+ * @Param  : [in] path     : 统计文件的路径，已存在时被截断
+ * @Param  : [in] nworkers : worker 的数目
+ * @Return : NULL  : 失败
+ *           stats : 成功
+ * @Note   : 必须在 master 中 fork() 之前调用；文件可放在 /dev/shm 下，不占用磁盘
+ ***********************************************************/
+ms_stats_t *ms_stats_create(const char *path, int nworkers)
+{
+    int fd = -1;
+    size_t size = sizeof(ms_stats_t) + nworkers * sizeof(ms_stats_worker_t);
+    ms_stats_t *stats = NULL;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "open() stats file \"%s\" failed",
+                path);
+        return NULL;
+    }
+
+    if (ftruncate(fd, size) == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "ftruncate() stats file \"%s\" failed",
+                path);
+        close(fd);
+        return NULL;
+    }
+
+    stats = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "mmap() stats file \"%s\" failed",
+                path);
+        return NULL;
+    }
+
+    // ftruncate() 扩展的部分已为 0，最后写入 magic，读者据此判断统计区已就绪
+    stats->version = MS_STATS_VERSION;
+    stats->nworkers = nworkers;
+    stats->size = size;
+    stats->start = ms_time_ms();
+    stats->pid = getpid();
+    __atomic_store_n(&stats->magic, MS_STATS_MAGIC, __ATOMIC_RELEASE);
+
+    return stats;
+}
+// @ms_stats_create() ok
+
+/***********************************************************
+ * @Func   : ms_stats_destory()
+ * @Author : lwp
+ * @Brief  : 解除统计区的映射，统计文件保留最后的计数。
+ * @Param  : [in] stats
+ * @Return : void
+ ***********************************************************/
+void ms_stats_destory(ms_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    __atomic_store_n(&stats->pid, 0, __ATOMIC_RELAXED);
+    munmap(stats, stats->size);
+}
+// @ms_stats_destory() ok
+
+/***********************************************************
+ * @Func   : ms_stats_log()
+ * @Author : lwp
+ * @Brief  : 将各 worker 的直方图及其合并结果记录到错误日志。
+ * @Param  : [in] stats
+ * @Return : void
+ * @Note   : 在 master 的信号处理函数中调用，不需要 worker 配合，不分配内存；
+ *           直方图自启动以来累计，不清零
+ ***********************************************************/
+void ms_stats_log(ms_stats_t *stats)
+{
+    char who[32];
+    static ms_hist_t hist;
+    static ms_hist_t all;
+
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(ms_stats_hists) / sizeof(ms_stats_hists[0]);
+            i++)
+    {
+        memset(&all, 0, sizeof(ms_hist_t));
+
+        for (uint32_t w = 0; w < stats->nworkers; w++)
+        {
+            memset(&hist, 0, sizeof(ms_hist_t));
+            ms_hist_merge(&hist, (ms_hist_t *)((char *)&stats->workers[w]
+                        + ms_stats_hists[i].offset));
+            ms_hist_merge(&all, &hist);
+
+            *ms_str_snprintf(who, sizeof(who) - 1, "worker \"%uD\"", w)
+                = '\0';
+            ms_hist_log(&hist, ms_stats_hists[i].name, who);
+        }
+
+        ms_hist_log(&all, ms_stats_hists[i].name, "all");
+    }
+}
+// @ms_stats_log() ok
@@ -0,0 +1,93 @@
+// 统计计数: master 在 fork() 之前将 stats_file 以 mmap(MAP_SHARED) 映射为共享的统计区，
+// 每个 worker 占用一个按 cache line 对齐的槽，只由该 worker 以 relaxed 原子操作更新，不加锁也不经过系统调用；
+// ms_top 等外部进程只读映射同一文件，随时读取各 worker 的计数。
+// 各阶段的耗时记录在每个 worker 的直方图中，master 收到 SIGHUP 时合并各 worker 的直方图并记录到错误日志。
+#ifndef _MS_STATS_H
+#define _MS_STATS_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_hist.h"
+
+#define MS_STATS_MAGIC   0x7473736d // "msst"，统计文件的标识
+#define MS_STATS_VERSION 2          // 统计区布局的版本，布局改变时递增
+
+typedef struct ms_stats_s        ms_stats_t;
+typedef struct ms_stats_worker_s ms_stats_worker_t;
+
+// 每个 worker 的计数，独占 cache line 以免 worker 之间伪共享
+struct ms_stats_worker_s {
+    uint64_t accepts;   // 接受的连接数
+    uint64_t active;    // 当前的连接数
+    uint64_t bytes_in;  // 从客户端接收的字节数
+    uint64_t bytes_out; // 向客户端发送的字节数
+    uint64_t requests;  // 处理完成的请求数
+    uint64_t timeouts;  // 接收/发送超时的次数
+    uint64_t loops;     // eventloop 等待事件的次数
+    uint64_t events;    // eventloop 处理的就绪事件数
+    uint64_t timers;    // 当前的定时器数
+    int64_t  pid;       // worker 的进程 ID，线程模式下为线程 ID，退出后为 0
+
+    ms_hist_t wait;     // 阻塞等待事件的时间，纳秒
+    ms_hist_t rproc;    // 读事件回调的耗时，纳秒
+    ms_hist_t wproc;    // 写事件回调的耗时，纳秒
+    ms_hist_t timer;    // 处理超时定时器的耗时，纳秒
+    ms_hist_t batch;    // 每次唤醒返回的就绪事件数
+    ms_hist_t request;  // 请求的首字节到达至响应全部发送完成的时间，纳秒
+} __attribute__((aligned(64)));
+
+// 统计区，位于 stats_file 的映射中
+struct ms_stats_s {
+    uint32_t          magic;     // MS_STATS_MAGIC
+    uint32_t          version;   // MS_STATS_VERSION
+    uint32_t          nworkers;  // worker 的数目
+    uint32_t          size;      // 统计区的大小
+    uint64_t          start;     // master 启动的时间，毫秒
+    int64_t           pid;       // master 的进程 ID
+    ms_stats_worker_t workers[];
+};
+
+// 只由所属 worker 写入，读改写无需带 lock 前缀，relaxed 原子读写保证读者不会读到撕裂的值
+#define ms_stats_add(st, field, n)                                             \
+    do {                                                                       \
+        if ((st) != NULL)                                                      \
+        {                                                                      \
+            __atomic_store_n(&(st)->field,                                     \
+                    __atomic_load_n(&(st)->field, __ATOMIC_RELAXED) + (n),     \
+                    __ATOMIC_RELAXED);                                         \
+        }                                                                      \
+    } while (0)
+
+#define ms_stats_set(st, field, v)                                             \
+    do {                                                                       \
+        if ((st) != NULL)                                                      \
+        {                                                                      \
+            __atomic_store_n(&(st)->field, (v), __ATOMIC_RELAXED);             \
+        }                                                                      \
+    } while (0)
+
+#define ms_stats_hist(st, field, v)                                            \
+    do {                                                                       \
+        if ((st) != NULL)                                                      \
+        {                                                                      \
+            ms_hist_add(&(st)->field, (v));                                    \
+        }                                                                      \
+    } while (0)
+
+#define ms_stats_get(st, field) __atomic_load_n(&(st)->field, __ATOMIC_RELAXED)
+
+ms_stats_t *ms_stats_create(const char *path, int nworkers);
+void ms_stats_destory(ms_stats_t *stats);
+void ms_stats_log(ms_stats_t *stats);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
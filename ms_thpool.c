@@ -0,0 +1,162 @@
+#include "ms_thpool.h"
+
+static void *ms_thpool_worker(void *arg);
+
+/***********************************************************
+ * @Func   : ms_thpool_create()
+ * @Author : lwp
+ * @Brief  : 创建线程池。
+ * @Param  : [in] pool
+ * @Param  : [in] nthreads : 线程数，不超过 MS_THPOOL_MAX_THREADS
+ * @Param  : [in] maxsize : 队列的容量
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : 线程继承调用线程的信号掩码
+ ***********************************************************/
+int ms_thpool_create(ms_thpool_t *pool, int nthreads, int maxsize)
+{
+    int err;
+
+    memset(pool, 0, sizeof(ms_thpool_t));
+    pool->maxsize = maxsize > 0 ? maxsize : 1;
+    nthreads = ms_min(ms_max(nthreads, 1), MS_THPOOL_MAX_THREADS);
+
+    if ((err = pthread_mutex_init(&(pool->lock), NULL)) != 0)
+    {
+        ms_errlog(MS_ERRLOG_ERR, err, "pthread_mutex_init() failed");
+        return MS_ERROR;
+    }
+
+    if ((err = pthread_cond_init(&(pool->cond), NULL)) != 0)
+    {
+        ms_errlog(MS_ERRLOG_ERR, err, "pthread_cond_init() failed");
+        pthread_mutex_destroy(&(pool->lock));
+        return MS_ERROR;
+    }
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        err = pthread_create(&(pool->tids[i]), NULL, ms_thpool_worker, pool);
+        if (err != 0)
+        {
+            ms_errlog(MS_ERRLOG_ERR, err, "pthread_create() failed");
+            ms_thpool_destory(pool);
+            return MS_ERROR;
+        }
+        pool->nthreads++;
+    }
+
+    return MS_OK;
+}
+// @ms_thpool_create() ok
+
+/***********************************************************
+ * @Func   : ms_thpool_submit()
+ * @Author : lwp
+ * @Brief  : 向线程池提交任务。
+ * @Param  : [in] pool
+ * @Param  : [in] job : job->proc 与 job->data 由调用者设置
+ * @Return : MS_BUSY : 队列已满或线程池已停止
+ *           MS_OK   : 成功
+ * @Note   : 线程安全；任务结点在 proc 执行完成前不可释放
+ ***********************************************************/
+int ms_thpool_submit(ms_thpool_t *pool, ms_thpool_job_t *job)
+{
+    pthread_mutex_lock(&(pool->lock));
+
+    if (pool->stop || pool->size >= pool->maxsize)
+    {
+        pthread_mutex_unlock(&(pool->lock));
+        return MS_BUSY;
+    }
+
+    job->next = NULL;
+    if (pool->tail)
+    {
+        pool->tail->next = job;
+    }
+    else
+    {
+        pool->head = job;
+    }
+    pool->tail = job;
+    pool->size++;
+
+    pthread_cond_signal(&(pool->cond));
+    pthread_mutex_unlock(&(pool->lock));
+
+    return MS_OK;
+}
+// @ms_thpool_submit() ok
+
+/***********************************************************
+ * @Func   : ms_thpool_destory()
+ * @Author : lwp
+ * @Brief  : 停止并销毁线程池。
+ * @Param  : [in] pool
+ * @Return : NONE
+ * @Note   : 等待正在执行的任务完成，丢弃队列中尚未执行的任务
+ ***********************************************************/
+void ms_thpool_destory(ms_thpool_t *pool)
+{
+    pthread_mutex_lock(&(pool->lock));
+    pool->stop = 1;
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->size = 0;
+    pthread_cond_broadcast(&(pool->cond));
+    pthread_mutex_unlock(&(pool->lock));
+
+    for (int i = 0; i < pool->nthreads; i++)
+    {
+        pthread_join(pool->tids[i], NULL);
+    }
+    pool->nthreads = 0;
+
+    pthread_cond_destroy(&(pool->cond));
+    pthread_mutex_destroy(&(pool->lock));
+}
+// @ms_thpool_destory() ok
+
+/***********************************************************
+ * @Func   : ms_thpool_worker()
+ * @Author : lwp
+ * @Brief  : 线程池中线程的主循环。
+ * @Param  : [in] arg : 线程池
+ * @Return : NULL
+ * @Note   :
+ ***********************************************************/
+static void *ms_thpool_worker(void *arg)
+{
+    ms_thpool_t *pool = (ms_thpool_t *)arg;
+    ms_thpool_job_t *job = NULL;
+
+    while (1)
+    {
+        pthread_mutex_lock(&(pool->lock));
+        while (!pool->stop && pool->head == NULL)
+        {
+            pthread_cond_wait(&(pool->cond), &(pool->lock));
+        }
+
+        if (pool->stop)
+        {
+            pthread_mutex_unlock(&(pool->lock));
+            break;
+        }
+
+        job = pool->head;
+        pool->head = job->next;
+        if (pool->head == NULL)
+        {
+            pool->tail = NULL;
+        }
+        pool->size--;
+        pthread_mutex_unlock(&(pool->lock));
+
+        job->proc(job->data);
+    }
+
+    return NULL;
+}
+// @ms_thpool_worker() ok
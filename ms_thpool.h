@@ -0,0 +1,51 @@
+// 线程池: 固定数目的线程从有界队列中取出任务执行，用于将阻塞操作(磁盘 I/O、
+// 压缩、加解密等)移出 eventloop。队列满时提交失败，由调用者决定如何处理。
+#ifndef _MS_THPOOL_H
+#define _MS_THPOOL_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_errlog.h"
+
+#define MS_THPOOL_MAX_THREADS 64
+
+typedef struct ms_thpool_s     ms_thpool_t;
+typedef struct ms_thpool_job_s ms_thpool_job_t;
+
+typedef void ms_thpool_proc(void *data);
+
+// 任务结点，由提交者分配
+struct ms_thpool_job_s {
+    ms_thpool_job_t *next; // 下一个任务结点
+    ms_thpool_proc  *proc; // 在线程池中执行的回调函数
+    void            *data; // 回调函数的 data 参数
+};
+
+// 线程池结构体
+struct ms_thpool_s {
+    pthread_mutex_t  lock;     // 保护队列的互斥锁
+    pthread_cond_t   cond;     // 队列非空的条件变量
+    ms_thpool_job_t *head;     // 队列头
+    ms_thpool_job_t *tail;     // 队列尾
+    int              size;     // 队列中的任务数
+    int              maxsize;  // 队列的容量
+    int              nthreads; // 线程数
+    int              stop;     // 线程池停止的标志
+    pthread_t        tids[MS_THPOOL_MAX_THREADS]; // 线程 ID
+};
+
+int ms_thpool_create(ms_thpool_t *pool, int nthreads, int maxsize);
+int ms_thpool_submit(ms_thpool_t *pool, ms_thpool_job_t *job);
+void ms_thpool_destory(ms_thpool_t *pool);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
@@ -36,6 +36,23 @@ uintptr_t ms_time_ms(void)
 }
 // @ms_time_ms() ok
 
+/***********************************************************
+ * @Func   : ms_time_ns()
+ * @Author : lwp
+ * @Brief  : 获取单调时钟的纳秒数，用于计算耗时。
+ * @Param  : [in] NONE
+ * @Return : NONE
+ * @Note   : 经 vDSO 调用，不进入内核；不同进程的值可以比较
+ ***********************************************************/
+uint64_t ms_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+// @ms_time_ns() ok
+
 /***********************************************************
  * @Func   : ms_time_stamp()
  * @Author : lwp
@@ -22,6 +22,7 @@ extern "C"
 
 uintptr_t ms_time_sec(void);
 uintptr_t ms_time_ms(void);
+uint64_t ms_time_ns(void);
 char *ms_time_stamp(char *buff, const char *last);
 
 #ifdef __cpluscplus
@@ -0,0 +1,208 @@
+// ms_top: 只读映射 server 的统计文件(stats_file)，定时显示各 worker 的计数及其变化率。
+// 用法: ms_top stats_file [interval_ms [count]]，count 为 0 时一直运行，直到 server 退出。
+#include "ms_stats.h"
+
+#define MS_TOP_INTERVAL 1000 // 默认的刷新间隔，毫秒
+
+static ms_stats_t *ms_top_open(const char *path);
+static void ms_top_show(ms_stats_t *stats, ms_stats_worker_t *prev,
+        uint64_t ms, int tty);
+static uint64_t ms_top_now(void);
+
+int main(int argc, char **argv)
+{
+    int tty = isatty(STDOUT_FILENO);
+    int interval = MS_TOP_INTERVAL;
+    int count = 0;
+    uint64_t last = 0;
+    uint64_t now = 0;
+    ms_stats_t *stats = NULL;
+    ms_stats_worker_t *prev = NULL;
+
+    if (argc < 2 || argc > 4)
+    {
+        printf("Usage: %s stats_file [interval_ms [count]]\n", argv[0]);
+        return 1;
+    }
+
+    if (argc > 2)
+    {
+        interval = atoi(argv[2]) > 0 ? atoi(argv[2]) : MS_TOP_INTERVAL;
+    }
+
+    if (argc > 3)
+    {
+        count = atoi(argv[3]);
+    }
+
+    stats = ms_top_open(argv[1]);
+    if (stats == NULL)
+    {
+        return 1;
+    }
+
+    // 保存上一次的计数，用于计算变化率
+    prev = (ms_stats_worker_t *)calloc(stats->nworkers,
+            sizeof(ms_stats_worker_t));
+    if (prev == NULL)
+    {
+        return 1;
+    }
+    memcpy(prev, stats->workers, stats->nworkers * sizeof(ms_stats_worker_t));
+    last = ms_top_now();
+
+    for (int i = 0; count <= 0 || i < count; i++)
+    {
+        usleep(interval * 1000);
+
+        now = ms_top_now();
+        ms_top_show(stats, prev, now - last, tty);
+        last = now;
+
+        if (__atomic_load_n(&stats->pid, __ATOMIC_RELAXED) == 0)
+        {
+            printf("server exited\n");
+            break;
+        }
+    }
+
+    free(prev);
+    munmap(stats, stats->size);
+
+    return 0;
+}
+
+// 只读映射统计文件，检查其标识与版本
+static ms_stats_t *ms_top_open(const char *path)
+{
+    int fd = -1;
+    struct stat st;
+    ms_stats_t *stats = NULL;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        fprintf(stderr, "open \"%s\" failed: %s\n", path, strerror(errno));
+        goto end;
+    }
+
+    if ((size_t)st.st_size < sizeof(ms_stats_t))
+    {
+        fprintf(stderr, "\"%s\" is not a stats file\n", path);
+        goto end;
+    }
+
+    stats = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (stats == MAP_FAILED)
+    {
+        fprintf(stderr, "mmap \"%s\" failed: %s\n", path, strerror(errno));
+        stats = NULL;
+        goto end;
+    }
+
+    if (__atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE) != MS_STATS_MAGIC
+            || stats->version != MS_STATS_VERSION
+            || stats->size != (size_t)st.st_size)
+    {
+        fprintf(stderr, "\"%s\" is not a stats file of version %d\n", path,
+                MS_STATS_VERSION);
+        munmap(stats, st.st_size);
+        stats = NULL;
+    }
+
+end:
+    if (fd != -1)
+    {
+        close(fd);
+    }
+
+    return stats;
+}
+
+// 显示各 worker 在 ms 毫秒内的变化率与当前值，最后一行为合计
+static void ms_top_show(ms_stats_t *stats, ms_stats_worker_t *prev,
+        uint64_t ms, int tty)
+{
+    ms_stats_worker_t curr;
+    ms_stats_worker_t total;
+    double sec = ms > 0 ? ms / 1000.0 : 1.0;
+
+    memset(&total, 0, sizeof(total));
+
+    // 终端中原地刷新
+    if (tty)
+    {
+        printf("\033[H\033[J");
+    }
+
+    printf("master %ld  uptime %lus  workers %u\n",
+            (long)__atomic_load_n(&stats->pid, __ATOMIC_RELAXED),
+            (unsigned long)((ms_top_now() - stats->start) / 1000),
+            stats->nworkers);
+    printf("%6s %8s %10s %8s %10s %10s %10s %8s %10s %10s %8s\n",
+            "worker", "pid", "accepts/s", "active", "in KB/s", "out KB/s",
+            "req/s", "timeouts", "loops/s", "events/s", "timers");
+
+    for (uint32_t i = 0; i <= stats->nworkers; i++)
+    {
+        if (i < stats->nworkers)
+        {
+            ms_stats_worker_t *w = &stats->workers[i];
+
+            curr.accepts   = ms_stats_get(w, accepts);
+            curr.active    = ms_stats_get(w, active);
+            curr.bytes_in  = ms_stats_get(w, bytes_in);
+            curr.bytes_out = ms_stats_get(w, bytes_out);
+            curr.requests  = ms_stats_get(w, requests);
+            curr.timeouts  = ms_stats_get(w, timeouts);
+            curr.loops     = ms_stats_get(w, loops);
+            curr.events    = ms_stats_get(w, events);
+            curr.timers    = ms_stats_get(w, timers);
+            curr.pid       = ms_stats_get(w, pid);
+
+            // 合计的变化率由各 worker 的差值累加
+            total.accepts   += curr.accepts - prev[i].accepts;
+            total.active    += curr.active;
+            total.bytes_in  += curr.bytes_in - prev[i].bytes_in;
+            total.bytes_out += curr.bytes_out - prev[i].bytes_out;
+            total.requests  += curr.requests - prev[i].requests;
+            total.timeouts  += curr.timeouts;
+            total.loops     += curr.loops - prev[i].loops;
+            total.events    += curr.events - prev[i].events;
+            total.timers    += curr.timers;
+
+            printf("%6u %8ld %10.0f %8lu %10.1f %10.1f %10.0f %8lu %10.0f "
+                    "%10.0f %8lu\n", i, (long)curr.pid,
+                    (curr.accepts - prev[i].accepts) / sec,
+                    (unsigned long)curr.active,
+                    (curr.bytes_in - prev[i].bytes_in) / 1024.0 / sec,
+                    (curr.bytes_out - prev[i].bytes_out) / 1024.0 / sec,
+                    (curr.requests - prev[i].requests) / sec,
+                    (unsigned long)curr.timeouts,
+                    (curr.loops - prev[i].loops) / sec,
+                    (curr.events - prev[i].events) / sec,
+                    (unsigned long)curr.timers);
+
+            prev[i] = curr;
+            continue;
+        }
+
+        printf("%6s %8s %10.0f %8lu %10.1f %10.1f %10.0f %8lu %10.0f "
+                "%10.0f %8lu\n", "total", "-", total.accepts / sec,
+                (unsigned long)total.active, total.bytes_in / 1024.0 / sec,
+                total.bytes_out / 1024.0 / sec, total.requests / sec,
+                (unsigned long)total.timeouts, total.loops / sec,
+                total.events / sec, (unsigned long)total.timers);
+    }
+
+    fflush(stdout);
+}
+
+static uint64_t ms_top_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
@@ -0,0 +1,367 @@
+#include "ms_udp.h"
+
+static int ms_udp_socket(ms_udp_t *udp, const char *ip, int port);
+static int ms_udp_split(ms_udp_t *udp, int n);
+static void ms_udp_readable_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data);
+
+/***********************************************************
+ * @Func   : ms_udp_create()
+ * @Author : lwp
+ * @Brief  : 创建 UDP 监听套接字并注册到 evlop。
+ * @Param  : [in] evlop
+ * @Param  : [in] ip : 监听地址
+ * @Param  : [in] port : 监听端口
+ * @Param  : [in] batch : 每批接收的数据报的最大数目 [1, MS_UDP_MAX_BATCH]
+ * @Param  : [in] proc : 一批数据报的回调函数
+ * @Param  : [in] data : 回调函数的 data 参数
+ * @Return : NULL : 失败
+ *           udp  : 成功
+ * @Note   : 以 SO_REUSEPORT 绑定，各 worker 分别创建，由内核按四元组分发
+ ***********************************************************/
+ms_udp_t *ms_udp_create(ms_event_loop_t *evlop, const char *ip, int port,
+        int batch, ms_udp_proc *proc, void *data)
+{
+    ms_udp_t *udp = NULL;
+    ms_mem_pool_t *pool = evlop->pool;
+
+    udp = (ms_udp_t *)ms_mem_pool_pcalloc(pool, sizeof(ms_udp_t));
+    if (udp == NULL)
+    {
+        return NULL;
+    }
+
+    udp->evlop = evlop;
+    udp->proc = proc;
+    udp->data = data;
+    udp->batch = batch > 0 ? ms_min(batch, MS_UDP_MAX_BATCH) : MS_UDP_DEFAULT_BATCH;
+
+    udp->fd = ms_udp_socket(udp, ip, port);
+    if (udp->fd == MS_ERROR)
+    {
+        return NULL;
+    }
+
+    // 启用 GRO 时一个缓冲区可能包含多个数据报，拆分后交给回调函数
+    udp->bufsize = udp->gro ? MS_UDP_GRO_SIZE : MS_UDP_BUF_SIZE;
+    udp->nmsgs = udp->gro ? udp->batch * MS_UDP_MAX_SEGS : udp->batch;
+    udp->ssize = ms_max((size_t)udp->batch * MS_UDP_BUF_SIZE,
+            (size_t)MS_UDP_MAX_PAYLOAD);
+
+    udp->rmsgs = ms_mem_pool_pcalloc(pool, udp->batch * sizeof(struct mmsghdr));
+    udp->riovs = ms_mem_pool_pcalloc(pool, udp->batch * sizeof(struct iovec));
+    udp->raddrs = ms_mem_pool_pcalloc(pool, udp->batch * sizeof(struct sockaddr_in));
+    udp->rcmsgs = ms_mem_pool_pcalloc(pool, udp->batch * sizeof(ms_udp_cmsg_t));
+    udp->msgs = ms_mem_pool_pcalloc(pool, udp->nmsgs * sizeof(ms_udp_msg_t));
+    udp->smsgs = ms_mem_pool_pcalloc(pool, udp->batch * sizeof(struct mmsghdr));
+    udp->siovs = ms_mem_pool_pcalloc(pool, udp->batch * sizeof(struct iovec));
+    udp->saddrs = ms_mem_pool_pcalloc(pool, udp->batch * sizeof(struct sockaddr_in));
+    udp->scmsgs = ms_mem_pool_pcalloc(pool, udp->batch * sizeof(ms_udp_cmsg_t));
+    udp->ssegs = ms_mem_pool_pcalloc(pool, udp->batch * sizeof(uint16_t));
+    udp->sbuf = ms_mem_pool_pcalloc(pool, udp->ssize);
+    if (udp->rmsgs == NULL || udp->riovs == NULL || udp->raddrs == NULL
+            || udp->rcmsgs == NULL || udp->msgs == NULL || udp->smsgs == NULL
+            || udp->siovs == NULL || udp->saddrs == NULL || udp->scmsgs == NULL
+            || udp->ssegs == NULL || udp->sbuf == NULL)
+    {
+        goto end;
+    }
+
+    for (int i = 0; i < udp->batch; i++)
+    {
+        udp->riovs[i].iov_base = ms_mem_pool_pcalloc(pool, udp->bufsize);
+        if (udp->riovs[i].iov_base == NULL)
+        {
+            goto end;
+        }
+        udp->riovs[i].iov_len = udp->bufsize;
+
+        udp->rmsgs[i].msg_hdr.msg_name = &(udp->raddrs[i]);
+        udp->rmsgs[i].msg_hdr.msg_iov = &(udp->riovs[i]);
+        udp->rmsgs[i].msg_hdr.msg_iovlen = 1;
+        udp->rmsgs[i].msg_hdr.msg_control = udp->gro ? udp->rcmsgs[i].buf : NULL;
+    }
+
+    // 水平触发，每次可读事件最多接收 MS_UDP_MAX_ROUNDS 批
+    if (ms_eventloop_file_add(evlop, udp->fd, EPOLLIN,
+                (const ms_event_file_proc *)ms_udp_readable_handler, udp)
+            == MS_ERROR)
+    {
+        goto end;
+    }
+
+    ms_errlog(MS_ERRLOG_INFO, 0, "udp \"%s\":\"%d\" batch \"%d\" gro \"%d\" gso \"%d\"",
+            ip, port, udp->batch, udp->gro, udp->gso);
+
+    return udp;
+
+end:
+    ms_socket_close(udp->fd);
+    return NULL;
+}
+// @ms_udp_create() ok
+
+/***********************************************************
+ * @Func   : ms_udp_destory()
+ * @Author : lwp
+ * @Brief  : 关闭 UDP 监听套接字。
+ * @Param  : [in] udp
+ * @Return : NONE
+ * @Note   : 内存随 evlop 的内存池一同释放
+ ***********************************************************/
+void ms_udp_destory(ms_udp_t *udp)
+{
+    ms_errlog(MS_ERRLOG_INFO, 0, "udp recv \"%uL\" sent \"%uL\" drop \"%uL\"",
+            (uint64_t)udp->nrecv, (uint64_t)udp->nsent, (uint64_t)udp->ndrop);
+
+    ms_eventloop_file_del(udp->evlop, udp->fd, MS_EVENTLOOP_ALL);
+    ms_socket_close(udp->fd);
+    udp->fd = -1;
+}
+// @ms_udp_destory() ok
+
+/***********************************************************
+ * @Func   : ms_udp_reply()
+ * @Author : lwp
+ * @Brief  : 在回调函数中回复一个数据报。
+ * @Param  : [in] udp
+ * @Param  : [in] addr : 对端地址，一般为 msgs[i].addr
+ * @Param  : [in] data
+ * @Param  : [in] len : 不大于 MS_UDP_MAX_PAYLOAD
+ * @Return : MS_ERROR : 数据报过长
+ *           MS_OK    : 成功
+ * @Note   : 数据被拷贝，回调函数返回后统一发送；
+ *           可使用 GSO 时，发往同一地址的连续等长回复合并为一个数据报发送
+ ***********************************************************/
+int ms_udp_reply(ms_udp_t *udp, const struct sockaddr_in *addr,
+        const void *data, size_t len)
+{
+    int i = 0;
+    size_t seg = 0;
+
+    if (len > MS_UDP_MAX_PAYLOAD)
+    {
+        ms_errlog(MS_ERRLOG_ERR, 0, "udp reply \"%z\" too large", len);
+        return MS_ERROR;
+    }
+
+    if (udp->nsend >= udp->batch || udp->soff + len > udp->ssize)
+    {
+        ms_udp_flush(udp);
+    }
+
+    // 与上一个回复合并: 同一地址，上一个回复的各分段均为完整的 seg，本回复不长于 seg
+    i = udp->nsend - 1;
+    if (udp->gso && i >= 0 && len > 0)
+    {
+        seg = udp->ssegs[i];
+        if (len <= seg && udp->siovs[i].iov_len % seg == 0
+                && udp->siovs[i].iov_len / seg < MS_UDP_MAX_SEGS
+                && udp->siovs[i].iov_len + len <= MS_UDP_MAX_PAYLOAD
+                && udp->saddrs[i].sin_addr.s_addr == addr->sin_addr.s_addr
+                && udp->saddrs[i].sin_port == addr->sin_port)
+        {
+            memcpy(udp->sbuf + udp->soff, data, len);
+            udp->soff += len;
+            udp->siovs[i].iov_len += len;
+            return MS_OK;
+        }
+    }
+
+    i = udp->nsend++;
+    memcpy(udp->sbuf + udp->soff, data, len);
+    udp->siovs[i].iov_base = udp->sbuf + udp->soff;
+    udp->siovs[i].iov_len = len;
+    udp->saddrs[i] = *addr;
+    udp->ssegs[i] = (uint16_t)len;
+    udp->soff += len;
+
+    return MS_OK;
+}
+// @ms_udp_reply() ok
+
+/***********************************************************
+ * @Func   : ms_udp_flush()
+ * @Author : lwp
+ * @Brief  : 以 sendmmsg() 发送所有待发送的回复。
+ * @Param  : [in] udp
+ * @Return : NONE
+ * @Note   : 发送缓冲区满时丢弃剩余的回复，发送失败的数据报被跳过
+ ***********************************************************/
+void ms_udp_flush(ms_udp_t *udp)
+{
+    int rev = 0;
+    int off = 0;
+    struct msghdr *hdr = NULL;
+    struct cmsghdr *cmsg = NULL;
+
+    for (int i = 0; i < udp->nsend; i++)
+    {
+        hdr = &(udp->smsgs[i].msg_hdr);
+        memset(hdr, 0, sizeof(struct msghdr));
+        hdr->msg_name = &(udp->saddrs[i]);
+        hdr->msg_namelen = sizeof(struct sockaddr_in);
+        hdr->msg_iov = &(udp->siovs[i]);
+        hdr->msg_iovlen = 1;
+
+        // 由内核(或网卡)按 ssegs[i] 将合并的回复切分为多个数据报
+        if (udp->siovs[i].iov_len > udp->ssegs[i])
+        {
+            hdr->msg_control = udp->scmsgs[i].buf;
+            hdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            cmsg = CMSG_FIRSTHDR(hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            memcpy(CMSG_DATA(cmsg), &(udp->ssegs[i]), sizeof(uint16_t));
+        }
+    }
+
+    while (off < udp->nsend)
+    {
+        rev = ms_socket_sendmmsg(udp->fd, udp->smsgs + off, udp->nsend - off,
+                MSG_DONTWAIT);
+        if (rev == MS_AGAIN)
+        {
+            udp->ndrop += udp->nsend - off;
+            break;
+        }
+
+        if (rev == MS_ERROR)
+        {
+            udp->ndrop++;
+            off++;
+            continue;
+        }
+
+        udp->nsent += rev;
+        off += rev;
+    }
+
+    udp->nsend = 0;
+    udp->soff = 0;
+}
+// @ms_udp_flush() ok
+
+// 创建非阻塞的 UDP 套接字，尽量启用 UDP_GRO 并探测 UDP_SEGMENT
+static int ms_udp_socket(ms_udp_t *udp, const char *ip, int port)
+{
+    int fd = -1;
+    int on = 1;
+    int off = 0;
+
+    fd = ms_socket_create(AF_INET, SOCK_DGRAM, 0);
+    if (fd == MS_ERROR)
+    {
+        return MS_ERROR;
+    }
+
+    if (ms_socket_reuseaddr(fd) == MS_ERROR
+            || ms_socket_reuseport(fd) == MS_ERROR
+            || ms_socket_bind(fd, ip, port) == MS_ERROR
+            || ms_socket_blocking(fd, 0) == MS_ERROR)
+    {
+        ms_socket_close(fd);
+        return MS_ERROR;
+    }
+
+    // 内核 5.0 起支持 UDP_GRO，4.18 起支持 UDP_SEGMENT，不支持时逐个收发
+    udp->gro = (setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0);
+    udp->gso = (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &off, sizeof(off)) == 0);
+
+    return fd;
+}
+
+// 将接收到的 n 个缓冲区拆分为数据报，返回数据报的数目
+static int ms_udp_split(ms_udp_t *udp, int n)
+{
+    int gso = 0;
+    int count = 0;
+    size_t off = 0;
+    size_t len = 0;
+    size_t seg = 0;
+    struct msghdr *hdr = NULL;
+    struct cmsghdr *cmsg = NULL;
+    ms_udp_msg_t *msg = NULL;
+
+    for (int i = 0; i < n; i++)
+    {
+        hdr = &(udp->rmsgs[i].msg_hdr);
+        len = udp->rmsgs[i].msg_len;
+
+        // 数据报长于缓冲区
+        if (hdr->msg_flags & MSG_TRUNC)
+        {
+            udp->ndrop++;
+            continue;
+        }
+
+        seg = len;
+        for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+            {
+                memcpy(&gso, CMSG_DATA(cmsg), sizeof(int));
+                seg = gso > 0 ? (size_t)gso : len;
+            }
+        }
+
+        off = 0;
+        do
+        {
+            if (count >= udp->nmsgs)
+            {
+                udp->ndrop++;
+                break;
+            }
+
+            msg = &(udp->msgs[count++]);
+            msg->addr = udp->raddrs[i];
+            msg->data = (char *)udp->riovs[i].iov_base + off;
+            msg->len = ms_min(seg, len - off);
+            off += msg->len;
+        } while (off < len);
+    }
+
+    return count;
+}
+
+// UDP 套接字可读: 分批接收，每批处理完后发送回复
+static void ms_udp_readable_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data)
+{
+    int n = 0;
+    int count = 0;
+    ms_udp_t *udp = (ms_udp_t *)data;
+
+    for (int round = 0; round < MS_UDP_MAX_ROUNDS; round++)
+    {
+        // 内核会修改以下字段，每批接收前重置
+        for (int i = 0; i < udp->batch; i++)
+        {
+            udp->rmsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            udp->rmsgs[i].msg_hdr.msg_controllen = udp->gro ? sizeof(ms_udp_cmsg_t) : 0;
+            udp->rmsgs[i].msg_hdr.msg_flags = 0;
+        }
+
+        n = ms_socket_recvmmsg(sockfd, udp->rmsgs, udp->batch, MSG_DONTWAIT);
+        if (n <= 0)
+        {
+            break;
+        }
+
+        count = ms_udp_split(udp, n);
+        udp->nrecv += count;
+        if (count > 0)
+        {
+            udp->proc(udp, udp->msgs, count, udp->data);
+        }
+        ms_udp_flush(udp);
+
+        // 已接收完
+        if (n < udp->batch)
+        {
+            break;
+        }
+    }
+}
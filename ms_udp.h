@@ -0,0 +1,97 @@
+// UDP 监听: 可读时以 recvmmsg() 一次接收一批数据报交给回调函数处理，
+// 回调函数中产生的回复在处理完这一批后以 sendmmsg() 一次发送。
+// 内核支持时接收启用 UDP_GRO，发送时将发往同一地址的等长回复以 UDP_SEGMENT 合并。
+#ifndef _MS_UDP_H
+#define _MS_UDP_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_socket.h"
+#include "ms_eventloop.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO     104
+#endif
+
+#define MS_UDP_DEFAULT_BATCH 64    // 每批接收的数据报的默认数目
+#define MS_UDP_MAX_BATCH     1024  // 每批接收的数据报的最大数目，即 UIO_MAXIOV
+#define MS_UDP_BUF_SIZE      2048  // 未启用 GRO 时每个数据报的缓冲区大小，超过时被丢弃
+#define MS_UDP_GRO_SIZE      65536 // 启用 GRO 时每个缓冲区的大小，可容纳合并后的数据报
+#define MS_UDP_MAX_PAYLOAD   65507 // 单个数据报(含 GSO 合并后)的最大长度
+#define MS_UDP_MAX_SEGS      64    // 单个 GRO/GSO 数据报最多包含的分段数
+#define MS_UDP_MAX_ROUNDS    8     // 每次可读事件最多接收的批数，避免饿死其他连接
+
+typedef struct ms_udp_s     ms_udp_t;
+typedef struct ms_udp_msg_s ms_udp_msg_t;
+
+// 接收到的数据报，data 指向 ms_udp 的接收缓冲区，只在回调函数中有效
+struct ms_udp_msg_s {
+    struct sockaddr_in  addr; // 对端地址，网络字节序
+    char               *data; // 数据报的内容
+    size_t              len;  // 数据报的长度
+};
+
+// 一批数据报的回调函数，在其中调用 ms_udp_reply() 回复
+typedef void ms_udp_proc(ms_udp_t *udp, ms_udp_msg_t *msgs, int n, void *data);
+
+// 控制消息缓冲区，UDP_GRO 与 UDP_SEGMENT 各占一个 int/uint16_t
+typedef union {
+    char            buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr  align;
+} ms_udp_cmsg_t;
+
+// UDP 监听，每个 eventloop 一个，内存分配自 eventloop 的内存池
+struct ms_udp_s {
+    ms_event_loop_t    *evlop;   // 所属的 eventloop
+    ms_udp_proc        *proc;    // 一批数据报的回调函数
+    void               *data;    // 回调函数的 data 参数
+    int                 fd;      // UDP 套接字
+    int                 batch;   // 每批接收/发送的数据报的最大数目
+    int                 gro;     // 是否已启用 UDP_GRO
+    int                 gso;     // 是否可使用 UDP_SEGMENT
+    size_t              bufsize; // 每个接收缓冲区的大小
+
+    struct mmsghdr     *rmsgs;   // recvmmsg() 的参数
+    struct iovec       *riovs;   // 各接收缓冲区
+    struct sockaddr_in *raddrs;  // 各数据报的对端地址
+    ms_udp_cmsg_t      *rcmsgs;  // 各数据报的 UDP_GRO 控制消息
+    ms_udp_msg_t       *msgs;    // 交给回调函数的数据报，GRO 合并的数据报被拆分
+    int                 nmsgs;   // msgs 的容量
+
+    struct mmsghdr     *smsgs;   // sendmmsg() 的参数
+    struct iovec       *siovs;   // 各回复在 sbuf 中的位置
+    struct sockaddr_in *saddrs;  // 各回复的对端地址
+    ms_udp_cmsg_t      *scmsgs;  // 各回复的 UDP_SEGMENT 控制消息
+    uint16_t           *ssegs;   // 各回复的分段长度
+    char               *sbuf;    // 回复的数据，依次追加
+    size_t              soff;    // sbuf 已使用的长度
+    size_t              ssize;   // sbuf 的容量
+    int                 nsend;   // 待发送的回复的数目
+
+    uintptr_t           nrecv;   // 接收的数据报的数目
+    uintptr_t           nsent;   // 发送的数据报的数目，GSO 合并的按一个计
+    uintptr_t           ndrop;   // 因截断或发送缓冲区满而丢弃的数据报的数目
+};
+
+ms_udp_t *ms_udp_create(ms_event_loop_t *evlop, const char *ip, int port,
+        int batch, ms_udp_proc *proc, void *data);
+void ms_udp_destory(ms_udp_t *udp);
+
+int ms_udp_reply(ms_udp_t *udp, const struct sockaddr_in *addr,
+        const void *data, size_t len);
+void ms_udp_flush(ms_udp_t *udp);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
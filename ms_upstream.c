@@ -0,0 +1,421 @@
+#include "ms_upstream.h"
+
+static ms_upstream_peer_t *ms_upstream_peer_get(ms_upstream_pool_t *pool,
+        const struct sockaddr_in *addr);
+static void ms_upstream_unlink(ms_upstream_t *up);
+static void ms_upstream_connect_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data);
+static void ms_upstream_connect_timeout(ms_event_loop_t *evlop, void *data);
+static void ms_upstream_idle_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data);
+static void ms_upstream_idle_timeout(ms_event_loop_t *evlop, void *data);
+
+/***********************************************************
+ * @Func   : ms_upstream_pool_init()
+ * @Author : lwp
+ * @Brief  : 初始化上游连接池。
+ * @Param  : [in] pool
+ * @Param  : [in] evlop : 所属的 eventloop，其 data 的大小不小于 ms_upstream_t
+ * @Param  : [in] maxidle : 每个后端保留的空闲连接的最大数目，0 代表不复用
+ * @Param  : [in] idletime : 空闲连接的超时时间，毫秒 0 代表不启用
+ * @Param  : [in] ctimeout : 连接超时时间，毫秒 0 代表不启用
+ * @Return : NONE
+ * @Note   :
+ ***********************************************************/
+void ms_upstream_pool_init(ms_upstream_pool_t *pool, ms_event_loop_t *evlop,
+        int maxidle, int idletime, int ctimeout)
+{
+    memset(pool, 0, sizeof(ms_upstream_pool_t));
+    pool->evlop = evlop;
+    pool->maxidle = maxidle;
+    pool->idletime = idletime;
+    pool->ctimeout = ctimeout;
+}
+// @ms_upstream_pool_init() ok
+
+/***********************************************************
+ * @Func   : ms_upstream_pool_destory()
+ * @Author : lwp
+ * @Brief  : 关闭连接池中所有的空闲连接。
+ * @Param  : [in] pool
+ * @Return : NONE
+ * @Note   : 后端结点分配自 eventloop 的内存池，随 eventloop 一同释放
+ ***********************************************************/
+void ms_upstream_pool_destory(ms_upstream_pool_t *pool)
+{
+    ms_upstream_peer_t *peer = NULL;
+
+    ms_errlog(MS_ERRLOG_INFO, 0, "upstream connect \"%uL\" reuse \"%uL\"",
+            (uint64_t)pool->nconnect, (uint64_t)pool->nreuse);
+
+    for (int i = 0; i < MS_UPSTREAM_BUCKETS; i++)
+    {
+        for (peer = pool->buckets[i]; peer != NULL; peer = peer->next)
+        {
+            while (peer->idle)
+            {
+                ms_upstream_close(peer->idle);
+            }
+        }
+    }
+}
+// @ms_upstream_pool_destory() ok
+
+/***********************************************************
+ * @Func   : ms_upstream_get()
+ * @Author : lwp
+ * @Brief  : 获取到 addr 的上游连接，优先复用空闲连接，否则发起非阻塞连接。
+ * @Param  : [in] pool
+ * @Param  : [in] addr : 后端地址，网络字节序
+ * @Param  : [in] proc : 连接完成的回调函数
+ * @Param  : [in] data : 回调函数的 data 参数
+ * @Return : NULL : 失败
+ *           up   : up->state 为 MS_UPSTREAM_ACTIVE 时可直接使用，不再回调；
+ *                  为 MS_UPSTREAM_CONNECTING 时连接完成或超时后回调 proc
+ * @Note   : 使用完后调用 ms_upstream_release() 归还，出错时调用 ms_upstream_close()
+ ***********************************************************/
+ms_upstream_t *ms_upstream_get(ms_upstream_pool_t *pool,
+        const struct sockaddr_in *addr, ms_upstream_proc *proc, void *data)
+{
+    ms_upstream_t *up = NULL;
+    ms_upstream_peer_t *peer = NULL;
+    ms_event_loop_t *evlop = pool->evlop;
+
+    peer = ms_upstream_peer_get(pool, addr);
+    if (peer == NULL)
+    {
+        return NULL;
+    }
+
+    // 复用最近归还的空闲连接
+    if (peer->idle != NULL)
+    {
+        up = peer->idle;
+        ms_upstream_unlink(up);
+        if (up->timer != NULL)
+        {
+            ms_eventloop_timer_del(evlop, up->timer);
+            up->timer = NULL;
+        }
+        ms_eventloop_file_del(evlop, up->fd, MS_EVENTLOOP_ALL);
+
+        up->proc = proc;
+        up->data = data;
+        up->state = MS_UPSTREAM_ACTIVE;
+        up->reused = 1;
+        pool->nreuse++;
+        return up;
+    }
+
+    return ms_upstream_connect(pool, addr, proc, data);
+}
+// @ms_upstream_get() ok
+
+/***********************************************************
+ * @Func   : ms_upstream_connect()
+ * @Author : lwp
+ * @Brief  : 不复用空闲连接，发起到 addr 的非阻塞连接。
+ * @Param  : [in] pool
+ * @Param  : [in] addr : 后端地址，网络字节序
+ * @Param  : [in] proc : 连接完成的回调函数
+ * @Param  : [in] data : 回调函数的 data 参数
+ * @Return : NULL : 失败
+ *           up   : 同 ms_upstream_get()
+ * @Note   : 用于复用的空闲连接失败后重试
+ ***********************************************************/
+ms_upstream_t *ms_upstream_connect(ms_upstream_pool_t *pool,
+        const struct sockaddr_in *addr, ms_upstream_proc *proc, void *data)
+{
+    int fd = -1;
+    int rev = 0;
+    ms_upstream_t *up = NULL;
+    ms_upstream_peer_t *peer = NULL;
+    ms_event_file_t *file = NULL;
+    ms_event_loop_t *evlop = pool->evlop;
+
+    peer = ms_upstream_peer_get(pool, addr);
+    if (peer == NULL)
+    {
+        return NULL;
+    }
+
+    // 新建连接
+    fd = ms_socket_create(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == MS_ERROR)
+    {
+        return NULL;
+    }
+
+    file = ms_eventloop_file_get(evlop, fd);
+    if (file == NULL || evlop->datasize < (int)sizeof(ms_upstream_t))
+    {
+        ms_socket_close(fd);
+        return NULL;
+    }
+
+    up = (ms_upstream_t *)file->data;
+    memset(up, 0, sizeof(ms_upstream_t));
+    up->peer = peer;
+    up->pool = pool;
+    up->proc = proc;
+    up->data = data;
+    up->fd = fd;
+    up->state = MS_UPSTREAM_CONNECTING;
+    pool->nconnect++;
+
+    ms_socket_tcpnodelay(fd, 1);
+
+    rev = ms_socket_connect_nonblock(fd, addr);
+    if (rev == MS_ERROR)
+    {
+        goto end;
+    }
+
+    if (rev == MS_OK)
+    {
+        up->state = MS_UPSTREAM_ACTIVE;
+        return up;
+    }
+
+    // 连接进行中: 可写时完成
+    if (ms_eventloop_file_add(evlop, fd, EPOLLOUT,
+                (const ms_event_file_proc *)ms_upstream_connect_handler, up)
+            == MS_ERROR)
+    {
+        goto end;
+    }
+
+    if (pool->ctimeout > 0)
+    {
+        up->timer = ms_eventloop_timer_add(evlop, pool->ctimeout,
+                (const ms_event_timer_proc *)ms_upstream_connect_timeout, up);
+        if (up->timer == NULL)
+        {
+            goto end;
+        }
+    }
+
+    return up;
+
+end:
+    ms_upstream_close(up);
+    return NULL;
+}
+// @ms_upstream_connect() ok
+
+/***********************************************************
+ * @Func   : ms_upstream_release()
+ * @Author : lwp
+ * @Brief  : 归还上游连接，放入空闲连接池以便复用。
+ * @Param  : [in] up : 状态为 MS_UPSTREAM_ACTIVE 且没有未读数据的连接
+ * @Return : NONE
+ * @Note   : 空闲连接数已达上限时直接关闭；空闲期间对端关闭或发送数据时关闭
+ ***********************************************************/
+void ms_upstream_release(ms_upstream_t *up)
+{
+    ms_upstream_pool_t *pool = up->pool;
+    ms_upstream_peer_t *peer = up->peer;
+    ms_event_loop_t *evlop = pool->evlop;
+
+    if (up->state != MS_UPSTREAM_ACTIVE || peer->nidle >= pool->maxidle)
+    {
+        ms_upstream_close(up);
+        return;
+    }
+
+    if (up->timer != NULL)
+    {
+        ms_eventloop_timer_del(evlop, up->timer);
+        up->timer = NULL;
+    }
+
+    // 水平触发，空闲期间任何可读事件都意味着连接不可再复用
+    if (ms_eventloop_file_mod(evlop, up->fd, EPOLLIN,
+                (const ms_event_file_proc *)ms_upstream_idle_handler, up)
+            == MS_ERROR)
+    {
+        ms_upstream_close(up);
+        return;
+    }
+
+    if (pool->idletime > 0)
+    {
+        up->timer = ms_eventloop_timer_add(evlop, pool->idletime,
+                (const ms_event_timer_proc *)ms_upstream_idle_timeout, up);
+        if (up->timer == NULL)
+        {
+            ms_upstream_close(up);
+            return;
+        }
+    }
+
+    up->proc = NULL;
+    up->data = NULL;
+    up->state = MS_UPSTREAM_IDLE;
+    up->prev = NULL;
+    up->next = peer->idle;
+    if (peer->idle != NULL)
+    {
+        peer->idle->prev = up;
+    }
+    peer->idle = up;
+    peer->nidle++;
+}
+// @ms_upstream_release() ok
+
+/***********************************************************
+ * @Func   : ms_upstream_close()
+ * @Author : lwp
+ * @Brief  : 关闭上游连接。
+ * @Param  : [in] up
+ * @Return : NONE
+ * @Note   : 关闭后 up 所在的 data 可被该 fd 的下一个使用者覆盖
+ ***********************************************************/
+void ms_upstream_close(ms_upstream_t *up)
+{
+    ms_event_loop_t *evlop = up->pool->evlop;
+
+    if (up->state == MS_UPSTREAM_CLOSED)
+    {
+        return;
+    }
+
+    if (up->state == MS_UPSTREAM_IDLE)
+    {
+        ms_upstream_unlink(up);
+    }
+
+    if (up->timer != NULL)
+    {
+        ms_eventloop_timer_del(evlop, up->timer);
+        up->timer = NULL;
+    }
+
+    ms_errlog(MS_ERRLOG_INFO, 0, "close upstream fd \"%d\"", up->fd);
+
+    ms_eventloop_file_del(evlop, up->fd, MS_EVENTLOOP_ALL);
+    ms_socket_close(up->fd);
+    up->fd = -1;
+    up->state = MS_UPSTREAM_CLOSED;
+}
+// @ms_upstream_close() ok
+
+// 查找后端，不存在时创建
+static ms_upstream_peer_t *ms_upstream_peer_get(ms_upstream_pool_t *pool,
+        const struct sockaddr_in *addr)
+{
+    uint32_t hash;
+    ms_upstream_peer_t *peer = NULL;
+
+    hash = (addr->sin_addr.s_addr ^ ((uint32_t)addr->sin_port << 16))
+        * 2654435761u;
+    hash = (hash >> 16) & (MS_UPSTREAM_BUCKETS - 1);
+
+    for (peer = pool->buckets[hash]; peer != NULL; peer = peer->next)
+    {
+        if (peer->addr.sin_addr.s_addr == addr->sin_addr.s_addr
+                && peer->addr.sin_port == addr->sin_port)
+        {
+            return peer;
+        }
+    }
+
+    peer = (ms_upstream_peer_t *)ms_mem_pool_pcalloc(pool->evlop->pool,
+            sizeof(ms_upstream_peer_t));
+    if (peer == NULL)
+    {
+        return NULL;
+    }
+
+    peer->addr = *addr;
+    peer->next = pool->buckets[hash];
+    pool->buckets[hash] = peer;
+
+    return peer;
+}
+
+// 从后端的空闲链表中移除
+static void ms_upstream_unlink(ms_upstream_t *up)
+{
+    ms_upstream_peer_t *peer = up->peer;
+
+    if (up->prev != NULL)
+    {
+        up->prev->next = up->next;
+    }
+    else
+    {
+        peer->idle = up->next;
+    }
+
+    if (up->next != NULL)
+    {
+        up->next->prev = up->prev;
+    }
+
+    up->next = NULL;
+    up->prev = NULL;
+    peer->nidle--;
+}
+
+// 连接完成: 根据 SO_ERROR 判断是否成功，失败时关闭后回调
+static void ms_upstream_connect_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data)
+{
+    int err = 0;
+    ms_upstream_t *up = (ms_upstream_t *)data;
+
+    if (up->timer != NULL)
+    {
+        ms_eventloop_timer_del(evlop, up->timer);
+        up->timer = NULL;
+    }
+    ms_eventloop_file_del(evlop, sockfd, MS_EVENTLOOP_ALL);
+
+    err = ms_socket_error(sockfd);
+    if (err != 0)
+    {
+        if (err != MS_ERROR)
+        {
+            ms_errlog(MS_ERRLOG_ERR, err, "upstream connect to \"%s\":\"%d\" failed",
+                    ms_socket_inetntop(AF_INET, &up->peer->addr.sin_addr),
+                    ntohs(up->peer->addr.sin_port));
+        }
+        ms_upstream_close(up);
+        up->proc(up, MS_ERROR, up->data);
+        return;
+    }
+
+    up->state = MS_UPSTREAM_ACTIVE;
+    up->proc(up, MS_OK, up->data);
+}
+
+// 连接超时: 关闭后回调
+static void ms_upstream_connect_timeout(ms_event_loop_t *evlop, void *data)
+{
+    ms_upstream_t *up = (ms_upstream_t *)data;
+
+    ms_errlog(MS_ERRLOG_ERR, 0, "upstream connect to \"%s\":\"%d\" timeout",
+            ms_socket_inetntop(AF_INET, &up->peer->addr.sin_addr),
+            ntohs(up->peer->addr.sin_port));
+
+    up->timer = NULL; // 已超时的定时器由 eventloop 回收
+    ms_upstream_close(up);
+    up->proc(up, MS_ERROR, up->data);
+}
+
+// 空闲连接可读: 对端已关闭或发送了多余的数据，不可再复用
+static void ms_upstream_idle_handler(ms_event_loop_t *evlop, int sockfd,
+        uint32_t mask, void *data)
+{
+    ms_upstream_close((ms_upstream_t *)data);
+}
+
+// 空闲连接超时
+static void ms_upstream_idle_timeout(ms_event_loop_t *evlop, void *data)
+{
+    ms_upstream_t *up = (ms_upstream_t *)data;
+
+    up->timer = NULL; // 已超时的定时器由 eventloop 回收
+    ms_upstream_close(up);
+}
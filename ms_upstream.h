@@ -0,0 +1,80 @@
+// 上游连接: 在 eventloop 中以非阻塞方式连接后端，连接完成或超时后回调；
+// 用完的连接按后端地址保存在每个 eventloop 单独的空闲连接池中，供后续请求复用。
+#ifndef _MS_UPSTREAM_H
+#define _MS_UPSTREAM_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_socket.h"
+#include "ms_eventloop.h"
+
+#define MS_UPSTREAM_BUCKETS 64 // 后端哈希表的桶数，必须为 2 的幂
+
+#define MS_UPSTREAM_CLOSED     0 // 已关闭
+#define MS_UPSTREAM_CONNECTING 1 // 正在连接
+#define MS_UPSTREAM_ACTIVE     2 // 已连接，由调用者使用
+#define MS_UPSTREAM_IDLE       3 // 已连接，位于空闲连接池中
+
+typedef struct ms_upstream_s      ms_upstream_t;
+typedef struct ms_upstream_peer_s ms_upstream_peer_t;
+typedef struct ms_upstream_pool_s ms_upstream_pool_t;
+
+// 连接完成的回调: status 为 MS_OK 时连接可用；为 MS_ERROR 时连接失败或超时，
+// 此时 up 已被关闭，只可用于识别是哪个连接
+typedef void ms_upstream_proc(ms_upstream_t *up, int status, void *data);
+
+// 上游连接，存储在 eventloop 中该 fd 对应的 data 中，与 fd 同生命周期
+struct ms_upstream_s {
+    ms_upstream_t      *next;   // 空闲链表中的下一个连接
+    ms_upstream_t      *prev;   // 空闲链表中的上一个连接
+    ms_upstream_peer_t *peer;   // 所属的后端
+    ms_upstream_pool_t *pool;   // 所属的连接池
+    ms_event_timer_t   *timer;  // 连接超时或空闲超时的定时器
+    ms_upstream_proc   *proc;   // 连接完成的回调函数
+    void               *data;   // 回调函数的 data 参数
+    int                 fd;     // 连接的文件句柄
+    int                 state;  // 连接的状态
+    int                 reused; // 是否取自空闲连接池，对端可能在复用前已关闭
+};
+
+// 后端，以地址为键，保存到该后端的空闲连接
+struct ms_upstream_peer_s {
+    ms_upstream_peer_t *next;  // 同一个桶中的下一个后端
+    ms_upstream_t      *idle;  // 空闲连接链表，最近归还的在前
+    int                 nidle; // 空闲连接的数目
+    struct sockaddr_in  addr;  // 后端地址，网络字节序
+};
+
+// 连接池，每个 eventloop 一个，只在 eventloop 所在线程中使用
+struct ms_upstream_pool_s {
+    ms_event_loop_t    *evlop;    // 所属的 eventloop
+    ms_upstream_peer_t *buckets[MS_UPSTREAM_BUCKETS]; // 后端哈希表
+    int                 maxidle;  // 每个后端保留的空闲连接的最大数目
+    int                 idletime; // 空闲连接的超时时间，毫秒 0 代表不启用
+    int                 ctimeout; // 连接超时时间，毫秒 0 代表不启用
+    uintptr_t           nconnect; // 新建连接的次数
+    uintptr_t           nreuse;   // 复用空闲连接的次数
+};
+
+void ms_upstream_pool_init(ms_upstream_pool_t *pool, ms_event_loop_t *evlop,
+        int maxidle, int idletime, int ctimeout);
+void ms_upstream_pool_destory(ms_upstream_pool_t *pool);
+
+ms_upstream_t *ms_upstream_get(ms_upstream_pool_t *pool,
+        const struct sockaddr_in *addr, ms_upstream_proc *proc, void *data);
+ms_upstream_t *ms_upstream_connect(ms_upstream_pool_t *pool,
+        const struct sockaddr_in *addr, ms_upstream_proc *proc, void *data);
+void ms_upstream_release(ms_upstream_t *up);
+void ms_upstream_close(ms_upstream_t *up);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
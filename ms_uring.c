@@ -0,0 +1,408 @@
+#include "ms_uring.h"
+
+static int ms_uring_enter(ms_uring_t *ring, unsigned min_complete,
+        unsigned flags, void *arg, size_t argsz);
+static struct io_uring_sqe *ms_uring_get_sqe(ms_uring_t *ring);
+static void ms_uring_commit_sqe(ms_uring_t *ring);
+
+/***********************************************************
+ * @Func   : ms_uring_create()
+ * @Author : lwp
+ * @Brief  : 创建 io_uring 并映射 SQ/CQ/SQE。
+ * @Param  : [in] ring
+ * @Param  : [in] entries : SQ 的容量
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : 内核不支持 io_uring 时返回 MS_ERROR，调用者应回退到 epoll
+ ***********************************************************/
+int ms_uring_create(ms_uring_t *ring, unsigned entries)
+{
+    struct io_uring_params p;
+
+    memset(ring, 0, sizeof(ms_uring_t));
+    memset(&p, 0, sizeof(p));
+    ring->fd = -1;
+
+    if (entries < 1)
+    {
+        entries = 1;
+    }
+    if (entries > MS_URING_MAX_ENTRIES)
+    {
+        entries = MS_URING_MAX_ENTRIES;
+    }
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd == -1)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "io_uring_setup() failed");
+        return MS_ERROR;
+    }
+    ring->features = p.features;
+    ring->sq_entries = p.sq_entries;
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    // 新内核中 SQ 与 CQ 可共用一次映射
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sq_len = ms_max(ring->sq_len, ring->cq_len);
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED)
+    {
+        ring->sq_ptr = NULL;
+        ms_errlog(MS_ERRLOG_ERR, errno, "mmap(IORING_OFF_SQ_RING) failed");
+        goto end;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_ptr = ring->sq_ptr;
+    }
+    else
+    {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED)
+        {
+            ring->cq_ptr = NULL;
+            ms_errlog(MS_ERRLOG_ERR, errno, "mmap(IORING_OFF_CQ_RING) failed");
+            goto end;
+        }
+    }
+
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_len,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+            IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        ms_errlog(MS_ERRLOG_ERR, errno, "mmap(IORING_OFF_SQES) failed");
+        goto end;
+    }
+
+    ring->sq_head  = (unsigned *)((char *)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail  = (unsigned *)((char *)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask  = (unsigned *)((char *)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ptr + p.sq_off.array);
+
+    ring->cq_head  = (unsigned *)((char *)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail  = (unsigned *)((char *)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask  = (unsigned *)((char *)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + p.cq_off.cqes);
+
+    ring->pending = 0;
+
+    return MS_OK;
+
+end:
+    ms_uring_close(ring);
+    return MS_ERROR;
+}
+// @ms_uring_create() ok
+
+/***********************************************************
+ * @Func   : ms_uring_poll_add()
+ * @Author : lwp
+ * @Brief  : 提交一次性的 poll 请求，事件发生后由 ms_uring_wait() 返回。
+ * @Param  : [in] ring
+ * @Param  : [in] fd
+ * @Param  : [in] mask : EPOLLIN/EPOLLOUT ...
+ * @Param  : [in] user_data : 事件发生时原样返回
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : 仅写入 SQ，不产生系统调用
+ ***********************************************************/
+int ms_uring_poll_add(ms_uring_t *ring, int fd, uint32_t mask,
+        uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = NULL;
+
+    sqe = ms_uring_get_sqe(ring);
+    if (NULL == sqe)
+    {
+        return MS_ERROR;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = mask;
+    sqe->user_data = user_data;
+    ms_uring_commit_sqe(ring);
+
+    return MS_OK;
+}
+// @ms_uring_poll_add() ok
+
+/***********************************************************
+ * @Func   : ms_uring_poll_del()
+ * @Author : lwp
+ * @Brief  : 取消 user_data 对应的 poll 请求。
+ * @Param  : [in] ring
+ * @Param  : [in] user_data : ms_uring_poll_add() 时使用的 user_data
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功
+ * @Note   : 仅写入 SQ，不产生系统调用
+ ***********************************************************/
+int ms_uring_poll_del(ms_uring_t *ring, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = NULL;
+
+    sqe = ms_uring_get_sqe(ring);
+    if (NULL == sqe)
+    {
+        return MS_ERROR;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = MS_URING_INNER_DATA;
+    ms_uring_commit_sqe(ring);
+
+    return MS_OK;
+}
+// @ms_uring_poll_del() ok
+
+/***********************************************************
+ * @Func   : ms_uring_wait()
+ * @Author : lwp
+ * @Brief  : 提交所有未提交的 SQE 并等待完成事件，以 epoll_event 的形式返回。
+ * @Param  : [in] ring
+ * @Param  : [in] events : events[i].data.u64 为 user_data
+ * @Param  : [in] maxevents
+ * @Param  : [in] timeout : 毫秒，-1 永久阻塞，0 立即返回
+ * @Return : MS_ERROR : 失败
+ *           nfds     : 成功
+ * @Note   : 提交与等待只需一次 io_uring_enter()
+ ***********************************************************/
+int ms_uring_wait(ms_uring_t *ring, struct epoll_event *events, int maxevents,
+        int timeout)
+{
+    int nfds = 0;
+    unsigned head;
+    unsigned tail;
+    unsigned flags = 0;
+    unsigned min_complete = 0;
+    void *arg = NULL;
+    size_t argsz = 0;
+    struct io_uring_sqe *sqe = NULL;
+    struct io_uring_cqe *cqe = NULL;
+    struct io_uring_getevents_arg earg;
+
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    // CQ 中已存在完成事件时不阻塞
+    if (head == tail && timeout != 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+        min_complete = 1;
+
+        if (timeout > 0)
+        {
+            ring->ts.tv_sec = timeout / 1000;
+            ring->ts.tv_nsec = (timeout % 1000) * 1000000;
+
+            if (ring->features & IORING_FEAT_EXT_ARG)
+            {
+                memset(&earg, 0, sizeof(earg));
+                earg.ts = (uint64_t)(uintptr_t)&ring->ts;
+                flags |= IORING_ENTER_EXT_ARG;
+                arg = &earg;
+                argsz = sizeof(earg);
+            }
+            // 老内核: 超时或任一请求完成时返回
+            else
+            {
+                sqe = ms_uring_get_sqe(ring);
+                if (sqe != NULL)
+                {
+                    sqe->opcode = IORING_OP_TIMEOUT;
+                    sqe->fd = -1;
+                    sqe->addr = (uint64_t)(uintptr_t)&ring->ts;
+                    sqe->len = 1;
+                    sqe->off = 1;
+                    sqe->user_data = MS_URING_INNER_DATA;
+                    ms_uring_commit_sqe(ring);
+                }
+            }
+        }
+    }
+
+    if (ring->pending > 0 || flags != 0)
+    {
+        if (ms_uring_enter(ring, min_complete, flags, arg, argsz) == MS_ERROR)
+        {
+            return MS_ERROR;
+        }
+    }
+
+    // 收割完成事件
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && nfds < maxevents)
+    {
+        cqe = &(ring->cqes[head & *ring->cq_mask]);
+        head++;
+
+        if (cqe->user_data == MS_URING_INNER_DATA || cqe->res == -ECANCELED)
+        {
+            continue;
+        }
+
+        if (cqe->res < 0)
+        {
+            ms_errlog(MS_ERRLOG_WARN, -cqe->res, "io_uring poll fd \"%d\" failed",
+                    (int)(uint32_t)cqe->user_data);
+        }
+
+        events[nfds].data.u64 = cqe->user_data;
+        events[nfds].events = (cqe->res < 0) ? EPOLLERR : (uint32_t)cqe->res;
+        nfds++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    ms_errlog(MS_ERRLOG_INFO, 0, "io_uring_enter() on fd \"%d\" return \"%d\"",
+            ring->fd, nfds);
+
+    return nfds;
+}
+// @ms_uring_wait() ok
+
+/***********************************************************
+ * @Func   : ms_uring_close()
+ * @Author : lwp
+ * @Brief  : 解除映射并关闭 io_uring 文件句柄。
+ * @Param  : [in] ring
+ * @Return : NONE
+ * @Note   :
+ ***********************************************************/
+void ms_uring_close(ms_uring_t *ring)
+{
+    if (ring->sqes != NULL)
+    {
+        munmap(ring->sqes, ring->sqes_len);
+        ring->sqes = NULL;
+    }
+
+    if (ring->cq_ptr != NULL && ring->cq_ptr != ring->sq_ptr)
+    {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    ring->cq_ptr = NULL;
+
+    if (ring->sq_ptr != NULL)
+    {
+        munmap(ring->sq_ptr, ring->sq_len);
+        ring->sq_ptr = NULL;
+    }
+
+    if (ring->fd > 0)
+    {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+}
+// @ms_uring_close() ok
+
+/***********************************************************
+ * @Func   : ms_uring_enter()
+ * @Author : lwp
+ * @Brief  : 提交未提交的 SQE，按需等待完成事件。
+ * @Param  : [in] ring
+ * @Param  : [in] min_complete
+ * @Param  : [in] flags
+ * @Param  : [in] arg
+ * @Param  : [in] argsz
+ * @Return : MS_ERROR : 失败
+ *           MS_OK    : 成功(包括等待超时与信号中断)
+ * @Note   :
+ ***********************************************************/
+static int ms_uring_enter(ms_uring_t *ring, unsigned min_complete,
+        unsigned flags, void *arg, size_t argsz)
+{
+    int rev;
+
+    rev = syscall(__NR_io_uring_enter, ring->fd, ring->pending, min_complete,
+            flags, arg, argsz);
+
+    // 内核已消费的 SQE 不再计入 pending
+    ring->pending = *ring->sq_tail
+        - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    if (rev == -1 && errno != EINTR && errno != ETIME && errno != EAGAIN
+            && errno != EBUSY)
+    {
+        ms_errlog(MS_ERRLOG_ERR, errno, "io_uring_enter() on fd \"%d\" failed",
+                ring->fd);
+        return MS_ERROR;
+    }
+
+    return MS_OK;
+}
+// @ms_uring_enter() ok
+
+/***********************************************************
+ * @Func   : ms_uring_get_sqe()
+ * @Author : lwp
+ * @Brief  : 从 SQ 中获取一个空闲 SQE，SQ 已满时先提交。
+ * @Param  : [in] ring
+ * @Return : NULL : 失败
+ *           sqe  : 成功
+ * @Note   :
+ ***********************************************************/
+static struct io_uring_sqe *ms_uring_get_sqe(ms_uring_t *ring)
+{
+    unsigned head;
+    unsigned tail;
+    unsigned index;
+    struct io_uring_sqe *sqe = NULL;
+
+    tail = *ring->sq_tail;
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= ring->sq_entries)
+    {
+        if (ms_uring_enter(ring, 0, 0, NULL, 0) == MS_ERROR)
+        {
+            return NULL;
+        }
+
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= ring->sq_entries)
+        {
+            ms_errlog(MS_ERRLOG_ERR, 0, "io_uring sq on fd \"%d\" full",
+                    ring->fd);
+            return NULL;
+        }
+    }
+
+    index = tail & *ring->sq_mask;
+    sqe = &(ring->sqes[index]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+
+    return sqe;
+}
+// @ms_uring_get_sqe() ok
+
+/***********************************************************
+ * @Func   : ms_uring_commit_sqe()
+ * @Author : lwp
+ * @Brief  : 将 ms_uring_get_sqe() 取得的 SQE 放入 SQ。
+ * @Param  : [in] ring
+ * @Return : NONE
+ * @Note   :
+ ***********************************************************/
+static void ms_uring_commit_sqe(ms_uring_t *ring)
+{
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+}
+// @ms_uring_commit_sqe() ok
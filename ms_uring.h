@@ -0,0 +1,61 @@
+// io_uring 异步 I/O: 以 IORING_OP_POLL_ADD 代替 epoll_ctl()，注册/修改/删除事件
+// 只是向 SQ 中追加 SQE，在下一次 ms_uring_wait() 时与等待合并为一次系统调用。
+#ifndef _MS_URING_H
+#define _MS_URING_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#include "ms_errlog.h"
+
+#include <linux/io_uring.h>
+
+#define MS_URING_MAX_ENTRIES 32768
+#define MS_URING_INNER_DATA  ((uint64_t)-1) // 内部请求(删除/超时)的 user_data
+
+typedef struct ms_uring_s ms_uring_t;
+
+struct ms_uring_s {
+    int                    fd;         // io_uring 文件句柄
+    unsigned               features;   // 内核支持的特性
+
+    unsigned              *sq_head;    // SQ 头指针(内核更新)
+    unsigned              *sq_tail;    // SQ 尾指针(用户更新)
+    unsigned              *sq_mask;    // SQ 掩码
+    unsigned              *sq_array;   // SQ 索引数组
+    unsigned               sq_entries; // SQ 容量
+    unsigned               pending;    // 未提交的 SQE 数目
+    struct io_uring_sqe   *sqes;       // SQE 数组
+
+    unsigned              *cq_head;    // CQ 头指针(用户更新)
+    unsigned              *cq_tail;    // CQ 尾指针(内核更新)
+    unsigned              *cq_mask;    // CQ 掩码
+    struct io_uring_cqe   *cqes;       // CQE 数组
+
+    void                  *sq_ptr;     // SQ 映射地址
+    size_t                 sq_len;     // SQ 映射长度
+    void                  *cq_ptr;     // CQ 映射地址
+    size_t                 cq_len;     // CQ 映射长度
+    size_t                 sqes_len;   // SQE 数组映射长度
+
+    struct __kernel_timespec ts;       // 等待超时时间
+};
+
+int ms_uring_create(ms_uring_t *ring, unsigned entries);
+int ms_uring_poll_add(ms_uring_t *ring, int fd, uint32_t mask,
+        uint64_t user_data);
+int ms_uring_poll_del(ms_uring_t *ring, uint64_t user_data);
+int ms_uring_wait(ms_uring_t *ring, struct epoll_event *events, int maxevents,
+        int timeout);
+void ms_uring_close(ms_uring_t *ring);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
@@ -0,0 +1,318 @@
+#include "ms_wheel.h"
+
+static void ms_wheel_link(ms_wheel_t *wheel, ms_wheel_node_t *node);
+static void ms_wheel_cascade(ms_wheel_t *wheel);
+static intptr_t ms_wheel_next_root(ms_wheel_t *wheel, uintptr_t index);
+
+/***********************************************************
+ * @Func   : ms_wheel_init()
+ * @Author : lwp
+ * @Brief  : 初始化时间轮。
+ * @Param  : [in] wheel
+ * @Param  : [in] now : 当前时间(毫秒)
+ * @Return : NONE
+ * @Note   :
+ ***********************************************************/
+void ms_wheel_init(ms_wheel_t *wheel, uintptr_t now)
+{
+    for (int i = 0; i < MS_WHEEL_SLOTS; i++)
+    {
+        wheel->slots[i].prev = &(wheel->slots[i]);
+        wheel->slots[i].next = &(wheel->slots[i]);
+        wheel->slots[i].key = 0;
+        wheel->slots[i].slot = i;
+    }
+
+    memset(wheel->bitmap, 0, sizeof(wheel->bitmap));
+    wheel->curr = now;
+    wheel->count = 0;
+}
+// @ms_wheel_init() ok
+
+/***********************************************************
+ * @Func   : ms_wheel_add()
+ * @Author : lwp
+ * @Brief  : 向时间轮中添加结点 node。
+ * @Param  : [in] wheel
+ * @Param  : [in] node : node->key 为超时时间点(毫秒)
+ * @Return : NONE
+ * @Note   : O(1)
+ ***********************************************************/
+void ms_wheel_add(ms_wheel_t *wheel, ms_wheel_node_t *node)
+{
+    ms_wheel_link(wheel, node);
+    wheel->count++;
+}
+// @ms_wheel_add() ok
+
+/***********************************************************
+ * @Func   : ms_wheel_del()
+ * @Author : lwp
+ * @Brief  : 从时间轮中删除结点 node。
+ * @Param  : [in] wheel
+ * @Param  : [in] node
+ * @Return : NONE
+ * @Note   : O(1)
+ ***********************************************************/
+void ms_wheel_del(ms_wheel_t *wheel, ms_wheel_node_t *node)
+{
+    uintptr_t slot = node->slot;
+
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = NULL;
+    node->next = NULL;
+
+    // 第 0 层的槽为空时清除位图
+    if (slot < MS_WHEEL_ROOT_SIZE
+            && wheel->slots[slot].next == &(wheel->slots[slot]))
+    {
+        wheel->bitmap[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    }
+
+    wheel->count--;
+}
+// @ms_wheel_del() ok
+
+/***********************************************************
+ * @Func   : ms_wheel_expire()
+ * @Author : lwp
+ * @Brief  : 将时间轮推进到 now，返回一个已超时的结点。
+ * @Param  : [in] wheel
+ * @Param  : [in] now : 当前时间(毫秒)
+ * @Return : NULL : 没有超时的结点
+ *           node : 已超时的结点，调用者需调用 ms_wheel_del() 将其删除
+ * @Note   : 跳过第 0 层中的空槽，每跨越一圈下移一次上层的槽
+ ***********************************************************/
+ms_wheel_node_t *ms_wheel_expire(ms_wheel_t *wheel, uintptr_t now)
+{
+    intptr_t index;
+    uintptr_t next;
+    ms_wheel_node_t *head = NULL;
+
+    // 时间轮为空时直接推进到 now
+    if (wheel->count == 0)
+    {
+        if (now > wheel->curr)
+        {
+            wheel->curr = now;
+        }
+        return NULL;
+    }
+
+    while (1)
+    {
+        head = &(wheel->slots[wheel->curr & MS_WHEEL_ROOT_MASK]);
+        if (head->next != head)
+        {
+            return head->next;
+        }
+
+        if (wheel->curr >= now)
+        {
+            return NULL;
+        }
+
+        // 下一个非空槽，或者本圈结束处
+        index = ms_wheel_next_root(wheel, wheel->curr & MS_WHEEL_ROOT_MASK);
+        if (index >= 0)
+        {
+            next = (wheel->curr & ~(uintptr_t)MS_WHEEL_ROOT_MASK) + index;
+        }
+        else
+        {
+            next = (wheel->curr | MS_WHEEL_ROOT_MASK) + 1;
+        }
+
+        // 尚未到达，且中间没有跨圈，无需下移
+        if (next > now)
+        {
+            wheel->curr = now;
+            return NULL;
+        }
+
+        wheel->curr = next;
+        if ((wheel->curr & MS_WHEEL_ROOT_MASK) == 0)
+        {
+            ms_wheel_cascade(wheel);
+        }
+    }
+}
+// @ms_wheel_expire() ok
+
+/***********************************************************
+ * @Func   : ms_wheel_timeout()
+ * @Author : lwp
+ * @Brief  : 计算距离下一次需要推进时间轮的毫秒数。
+ * @Param  : [in] wheel
+ * @Param  : [in] now : 当前时间(毫秒)
+ * @Return : -1 : 时间轮为空
+ *           >= 0 : 毫秒数
+ * @Note   : 第 0 层无结点时返回本圈结束的时间，届时下移上层的槽
+ ***********************************************************/
+intptr_t ms_wheel_timeout(ms_wheel_t *wheel, uintptr_t now)
+{
+    intptr_t index;
+    uintptr_t next;
+    uintptr_t curr = wheel->curr;
+
+    if (wheel->count == 0)
+    {
+        return -1;
+    }
+
+    index = ms_wheel_next_root(wheel, curr & MS_WHEEL_ROOT_MASK);
+    if (index >= 0)
+    {
+        next = (curr & ~(uintptr_t)MS_WHEEL_ROOT_MASK) + index;
+    }
+    else
+    {
+        next = (curr | MS_WHEEL_ROOT_MASK) + 1;
+    }
+
+    return (next > now) ? (intptr_t)(next - now) : 0;
+}
+// @ms_wheel_timeout() ok
+
+/***********************************************************
+ * @Func   : ms_wheel_link()
+ * @Author : lwp
+ * @Brief  : 根据 node->key 与当前刻度的距离，将 node 挂到对应层的槽中。
+ * @Param  : [in] wheel
+ * @Param  : [in] node
+ * @Return : NONE
+ * @Note   : 已超时的结点挂到当前刻度的槽中
+ ***********************************************************/
+static void ms_wheel_link(ms_wheel_t *wheel, ms_wheel_node_t *node)
+{
+    uintptr_t key = node->key;
+    uintptr_t delta;
+    uintptr_t slot;
+    uintptr_t shift;
+    ms_wheel_node_t *head = NULL;
+
+    if (key < wheel->curr)
+    {
+        key = wheel->curr;
+    }
+
+    delta = key - wheel->curr;
+    if (delta > MS_WHEEL_MAX_DELTA)
+    {
+        delta = MS_WHEEL_MAX_DELTA;
+        key = wheel->curr + delta;
+    }
+
+    if (delta < MS_WHEEL_ROOT_SIZE)
+    {
+        slot = key & MS_WHEEL_ROOT_MASK;
+        wheel->bitmap[slot / 64] |= ((uint64_t)1 << (slot % 64));
+    }
+    else
+    {
+        slot = MS_WHEEL_ROOT_SIZE;
+        shift = MS_WHEEL_ROOT_BITS;
+        for (int i = 0; i < MS_WHEEL_LEVELS - 1; i++)
+        {
+            if (delta < ((uintptr_t)1 << (shift + MS_WHEEL_LEVEL_BITS)))
+            {
+                break;
+            }
+            slot += MS_WHEEL_LEVEL_SIZE;
+            shift += MS_WHEEL_LEVEL_BITS;
+        }
+        slot += (key >> shift) & MS_WHEEL_LEVEL_MASK;
+    }
+
+    // 插入槽链表的尾部
+    head = &(wheel->slots[slot]);
+    node->slot = slot;
+    node->next = head;
+    node->prev = head->prev;
+    head->prev->next = node;
+    head->prev = node;
+}
+// @ms_wheel_link() ok
+
+/***********************************************************
+ * @Func   : ms_wheel_cascade()
+ * @Author : lwp
+ * @Brief  : 第 0 层转满一圈时，将上层当前槽中的结点重新挂到下层。
+ * @Param  : [in] wheel
+ * @Return : NONE
+ * @Note   : 上层的槽下标为 0 时继续下移更上一层
+ ***********************************************************/
+static void ms_wheel_cascade(ms_wheel_t *wheel)
+{
+    uintptr_t index;
+    uintptr_t shift = MS_WHEEL_ROOT_BITS;
+    ms_wheel_node_t list;
+    ms_wheel_node_t *head = NULL;
+    ms_wheel_node_t *node = NULL;
+
+    for (int i = 0; i < MS_WHEEL_LEVELS; i++)
+    {
+        index = (wheel->curr >> shift) & MS_WHEEL_LEVEL_MASK;
+        head = &(wheel->slots[MS_WHEEL_ROOT_SIZE + i * MS_WHEEL_LEVEL_SIZE
+                + index]);
+
+        // 先摘下整个槽，再逐个重新挂载
+        if (head->next != head)
+        {
+            list.next = head->next;
+            list.prev = head->prev;
+            list.next->prev = &list;
+            list.prev->next = &list;
+            head->next = head;
+            head->prev = head;
+
+            while (list.next != &list)
+            {
+                node = list.next;
+                list.next = node->next;
+                node->next->prev = &list;
+                ms_wheel_link(wheel, node);
+            }
+        }
+
+        if (index != 0)
+        {
+            break;
+        }
+        shift += MS_WHEEL_LEVEL_BITS;
+    }
+}
+// @ms_wheel_cascade() ok
+
+/***********************************************************
+ * @Func   : ms_wheel_next_root()
+ * @Author : lwp
+ * @Brief  : 在第 0 层中查找下标不小于 index 的第一个非空槽。
+ * @Param  : [in] wheel
+ * @Param  : [in] index
+ * @Return : -1 : 不存在
+ *           >= 0 : 槽的下标
+ * @Note   :
+ ***********************************************************/
+static intptr_t ms_wheel_next_root(ms_wheel_t *wheel, uintptr_t index)
+{
+    uint64_t bits;
+    uintptr_t word = index / 64;
+
+    bits = wheel->bitmap[word] & (~(uint64_t)0 << (index % 64));
+    while (1)
+    {
+        if (bits)
+        {
+            return word * 64 + __builtin_ctzll(bits);
+        }
+
+        if (++word >= MS_WHEEL_ROOT_SIZE / 64)
+        {
+            return -1;
+        }
+        bits = wheel->bitmap[word];
+    }
+}
+// @ms_wheel_next_root() ok
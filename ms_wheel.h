@@ -0,0 +1,60 @@
+// 分层时间轮: 第 0 层 256 个槽，精度 1 毫秒；第 1~4 层各 64 个槽，精度逐层扩大 64 倍。
+// 添加、删除定时器为 O(1)，到期时按层级逐级下移(cascade)。
+#ifndef _MS_WHEEL_H
+#define _MS_WHEEL_H
+
+#ifdef __cpluscplus
+extern "C"
+{
+#endif
+
+#include "ms_head.h"
+#include "ms_conf.h"
+
+#define MS_WHEEL_ROOT_BITS  8
+#define MS_WHEEL_LEVEL_BITS 6
+#define MS_WHEEL_LEVELS     4 // 除第 0 层外的层数
+#define MS_WHEEL_ROOT_SIZE  (1 << MS_WHEEL_ROOT_BITS)
+#define MS_WHEEL_LEVEL_SIZE (1 << MS_WHEEL_LEVEL_BITS)
+#define MS_WHEEL_ROOT_MASK  (MS_WHEEL_ROOT_SIZE - 1)
+#define MS_WHEEL_LEVEL_MASK (MS_WHEEL_LEVEL_SIZE - 1)
+#define MS_WHEEL_SLOTS      (MS_WHEEL_ROOT_SIZE \
+                            + MS_WHEEL_LEVELS * MS_WHEEL_LEVEL_SIZE)
+
+// 超过时间轮范围的定时器(约 49 天)按最大范围处理
+#define MS_WHEEL_MAX_DELTA  \
+    (((uintptr_t)1 << (MS_WHEEL_ROOT_BITS \
+        + MS_WHEEL_LEVELS * MS_WHEEL_LEVEL_BITS)) - 1)
+
+typedef struct ms_wheel_s ms_wheel_t;
+typedef struct ms_wheel_node_s ms_wheel_node_t;
+
+// 时间轮结点
+struct ms_wheel_node_s {
+    ms_wheel_node_t *prev; // 前一个结点
+    ms_wheel_node_t *next; // 后一个结点
+    uintptr_t        key;  // 超时时间点(毫秒)
+    uintptr_t        slot; // 所在的槽
+};
+
+// 时间轮结构体
+struct ms_wheel_s {
+    ms_wheel_node_t slots[MS_WHEEL_SLOTS];              // 每个槽的链表头
+    uint64_t        bitmap[MS_WHEEL_ROOT_SIZE / 64];    // 第 0 层非空槽的位图
+    uintptr_t       curr;                               // 当前刻度(毫秒)
+    uintptr_t       count;                              // 定时器数目
+};
+
+void ms_wheel_init(ms_wheel_t *wheel, uintptr_t now);
+
+void ms_wheel_add(ms_wheel_t *wheel, ms_wheel_node_t *node);
+void ms_wheel_del(ms_wheel_t *wheel, ms_wheel_node_t *node);
+
+ms_wheel_node_t *ms_wheel_expire(ms_wheel_t *wheel, uintptr_t now);
+intptr_t ms_wheel_timeout(ms_wheel_t *wheel, uintptr_t now);
+
+#ifdef __cpluscplus
+}
+#endif
+
+#endif
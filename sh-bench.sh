@@ -0,0 +1,38 @@
+################################################################################
+# @File      : sh-bench.sh
+# @Copyright : 2018 lwp Corporation, All Rights Reserved.
+#
+# @Author    : lwp
+#
+# @Brief     : 以 ms_bench 压测，每组结果为一行 JSON，可重定向到文件后比较
+#
+#--------------------------- Revision History ----------------------------------
+#  No      Version     Date        Revised By      Item        Description
+# @1
+#
+################################################################################
+
+#!bin/bash
+
+target="127.0.0.1:9999"
+threads=$(nproc)
+bench="./ms_bench -t ${threads} -d 10 -w 2"
+
+# 闭环: 不同的连接数
+for conns in 100 200 500 1000
+do
+    ${bench} -c ${conns} ${target}
+done
+
+# pipelining: 每个连接 16 个请求在途
+${bench} -c  100 -p 16 ${target}
+${bench} -c 1000 -p 16 ${target}
+
+# 每个请求使用新的连接
+${bench} -c 100 -k ${target}
+
+# 开环: 固定速率，延迟从计划发送的时间算起
+for rate in 50000 100000 200000
+do
+    ${bench} -c 1000 -r ${rate} ${target}
+done
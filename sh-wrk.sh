@@ -24,3 +24,7 @@ wrk -t 12 -c  700 -d 10s --latenc "http://127.0.0.1:9999"
 wrk -t 12 -c  800 -d 10s --latenc "http://127.0.0.1:9999"
 wrk -t 12 -c  900 -d 10s --latenc "http://127.0.0.1:9999"
 wrk -t 12 -c 1000 -d 10s --latenc "http://127.0.0.1:9999"
+
+# pipelining: 每个连接一次发送 16 个请求
+wrk -t 12 -c  100 -d 10s --latenc -s wrk-pipeline.lua "http://127.0.0.1:9999" -- 16
+wrk -t 12 -c 1000 -d 10s --latenc -s wrk-pipeline.lua "http://127.0.0.1:9999" -- 16
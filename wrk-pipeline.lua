@@ -0,0 +1,16 @@
+-- wrk 的 pipelining 脚本: 每个连接一次发送 depth 个请求，默认 16 个
+-- 用法: wrk -t 12 -c 100 -d 10s -s wrk-pipeline.lua "http://127.0.0.1:9999" -- 16
+
+init = function(args)
+    local depth = tonumber(args[1]) or 16
+    local reqs = {}
+
+    for i = 1, depth do
+        reqs[i] = wrk.format(nil, "/")
+    end
+    req = table.concat(reqs)
+end
+
+request = function()
+    return req
+end